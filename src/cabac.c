@@ -79,7 +79,7 @@ void kvz_cabac_start(cabac_data_t * const data)
 {
   data->low = 0;
   data->range = 510;
-  data->bits_left = 23;
+  data->bits_left = CABAC_BITS_LEFT;
   data->num_buffered_bytes = 0;
   data->buffered_byte = 0xff;
   data->only_count = 0; // By default, write bits out
@@ -120,20 +120,13 @@ void kvz_cabac_encode_bin(cabac_data_t * const data, const uint32_t bin_value)
 }
 
 /**
- * \brief
+ * \brief Output one byte, keeping 0xff bytes buffered until the carry into
+ *        them is known.
+ *
+ * \param lead_byte  byte to output with the carry in bit 8
  */
-void kvz_cabac_write(cabac_data_t * const data)
+static INLINE void cabac_put_byte(cabac_data_t * const data, const uint32_t lead_byte)
 {
-  uint32_t lead_byte = data->low >> (24 - data->bits_left);
-  data->bits_left += 8;
-  data->low &= 0xffffffffu >> data->bits_left;
-
-  // Binary counter mode
-  if(data->only_count) {
-    data->num_buffered_bytes++;
-    return;
-  }
-
   if (lead_byte == 0xff) {
     data->num_buffered_bytes++;
   } else {
@@ -155,20 +148,66 @@ void kvz_cabac_write(cabac_data_t * const data)
   }
 }
 
+/**
+ * \brief Output the four leading bytes of the low register.
+ *
+ * The bits above the four bytes are the carry into the bytes output
+ * before.
+ */
+void kvz_cabac_write(cabac_data_t * const data)
+{
+  const uint64_t lead = data->low >> (32 - data->bits_left);
+  data->bits_left += 32;
+  data->low &= UINT64_MAX >> data->bits_left;
+
+  // Binary counter mode
+  if(data->only_count) {
+    data->num_buffered_bytes += 4;
+    return;
+  }
+
+  const uint32_t carry = (uint32_t)(lead >> 32);
+  const uint32_t bytes = (uint32_t)lead;
+
+  if (carry == 0 && bytes == 0xffffffff && data->num_buffered_bytes > 0) {
+    data->num_buffered_bytes += 4;
+    return;
+  }
+
+  cabac_put_byte(data, (carry << 8) | (bytes >> 24));
+  cabac_put_byte(data, (bytes >> 16) & 0xff);
+  cabac_put_byte(data, (bytes >> 8) & 0xff);
+  cabac_put_byte(data, bytes & 0xff);
+}
+
+/**
+ * \brief Return the number of bits encoded so far.
+ *
+ * Unlike kvz_bitstream_tell, this includes the bytes buffered for carry
+ * propagation and the bits pending in the low register, so the result
+ * does not depend on how often the bytes are flushed to the bitstream.
+ */
+uint64_t kvz_cabac_tell(const cabac_data_t * const data)
+{
+  return kvz_bitstream_tell(data->stream) +
+         8 * (uint64_t)data->num_buffered_bytes +
+         (CABAC_BITS_LEFT - data->bits_left);
+}
+
 /**
  * \brief
  */
 void kvz_cabac_finish(cabac_data_t * const data)
 {
-  assert(data->bits_left <= 32);
+  assert(data->bits_left <= 64);
 
-  if (data->low >> (32 - data->bits_left)) {
+  if (data->low >> (64 - data->bits_left)) {
     kvz_bitstream_put_byte(data->stream, data->buffered_byte + 1);
     while (data->num_buffered_bytes > 1) {
       kvz_bitstream_put_byte(data->stream, 0);
       data->num_buffered_bytes--;
     }
-    data->low -= 1 << (32 - data->bits_left);
+    data->low -= (uint64_t)1 << (64 - data->bits_left);
   } else {
     if (data->num_buffered_bytes > 0) {
       kvz_bitstream_put_byte(data->stream, data->buffered_byte);
@@ -180,8 +219,13 @@ void kvz_cabac_finish(cabac_data_t * const data)
   }
 
   {
-    uint8_t bits = (uint8_t)(24 - data->bits_left);
-    kvz_bitstream_put(data->stream, data->low >> 8, bits);
+    uint8_t bits = (uint8_t)(56 - data->bits_left);
+    const uint64_t value = data->low >> 8;
+    if (bits > 32) {
+      kvz_bitstream_put(data->stream, (uint32_t)(value >> 32), bits - 32);
+      bits = 32;
+    }
+    kvz_bitstream_put(data->stream, (uint32_t)value, bits);
   }
 }
 
@@ -227,32 +271,28 @@ void kvz_cabac_encode_bin_ep(cabac_data_t * const data, const uint32_t bin_value
 }
 
 /**
- * \brief
+ * \brief Encode bypass bins.
+ *
+ * As many bins as fit in the low register are added with a single shift.
+ *
+ * \param bin_values  bins with the first one in the most significant bit
+ * \param num_bins    number of bins, at most 32
  */
 void kvz_cabac_encode_bins_ep(cabac_data_t * const data, uint32_t bin_values, int num_bins)
 {
-  uint32_t pattern;
+  while (num_bins > 0) {
+    const int bins = MIN(num_bins, data->bits_left - 1);
+    num_bins -= bins;
 
-  while (num_bins > 8) {
-    num_bins -= 8;
-    pattern = bin_values >> num_bins;
-    data->low <<= 8;
-    data->low += data->range * pattern;
+    const uint32_t pattern = bin_values >> num_bins;
+    data->low = (data->low << bins) + (uint64_t)data->range * pattern;
     bin_values -= pattern << num_bins;
-    data->bits_left -= 8;
+    data->bits_left -= bins;
 
-    if(data->bits_left < 12) {
+    if (data->bits_left < 12) {
       kvz_cabac_write(data);
     }
   }
-
-  data->low <<= num_bins;
-  data->low += data->range * bin_values;
-  data->bits_left -= num_bins;
-
-  if (data->bits_left < 12) {
-    kvz_cabac_write(data);
-  }
 }
 
 /**
@@ -32,6 +32,15 @@
 
 struct encoder_state_t;
 
+/**
+ * \brief Value of bits_left when the low register holds no pending bits.
+ *
+ * The low register holds the 9 bits of range on top of the pending bits,
+ * and four bytes are written out once there are more than
+ * CABAC_BITS_LEFT - 12 pending bits.
+ */
+#define CABAC_BITS_LEFT 55
+
 // Types
 typedef struct
 {
@@ -41,7 +50,7 @@ typedef struct
 typedef struct
 {
   cabac_ctx_t *cur_ctx;
-  uint32_t   low;
+  uint64_t   low;
   uint32_t   range;
   uint32_t   buffered_byte;
   int32_t    num_buffered_bytes;
@@ -103,6 +112,7 @@ void kvz_cabac_encode_bins_ep(cabac_data_t *data, uint32_t bin_values, int num_b
 void kvz_cabac_encode_bin_trm(cabac_data_t *data, uint8_t bin_value);
 void kvz_cabac_write(cabac_data_t *data);
 void kvz_cabac_finish(cabac_data_t *data);
+uint64_t kvz_cabac_tell(const cabac_data_t *data);
 void kvz_cabac_write_coeff_remain(cabac_data_t *cabac, uint32_t symbol,
                               uint32_t r_param);
 void kvz_cabac_write_coeff_remain_encry(struct encoder_state_t * const state, cabac_data_t * const cabac, const uint32_t symbol,
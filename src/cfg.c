@@ -141,6 +141,17 @@ int kvz_config_init(kvz_config *cfg)
   cfg->max_merge = 5;
   cfg->early_skip = true;
 
+  cfg->thread_affinity = KVZ_THREAD_AFFINITY_NONE;
+  cfg->trace_file = NULL;
+  cfg->lookahead = 0;
+  cfg->scenecut = 0;
+  cfg->cutree = false;
+  cfg->aq_mode = KVZ_AQ_NONE;
+  cfg->subpel_planes = false;
+  cfg->me_cache = false;
+  cfg->coeff_bit_table = false;
+  cfg->frame_filter = false;
+
   return 1;
 }
 
@@ -153,6 +164,7 @@ int kvz_config_destroy(kvz_config *cfg)
     FREE_POINTER(cfg->slice_addresses_in_ts);
     FREE_POINTER(cfg->roi.dqps);
     FREE_POINTER(cfg->optional_key);
+    FREE_POINTER(cfg->trace_file);
   }
   free(cfg);
 
@@ -360,7 +372,7 @@ static int parse_slice_specification(const char* const arg, int32_t * const nsli
 
 int kvz_config_parse(kvz_config *cfg, const char *name, const char *value)
 {
-  static const char * const me_names[]          = { "hexbs", "tz", "full", "full8", "full16", "full32", "full64", "dia", NULL };
+  static const char * const me_names[]          = { "hexbs", "tz", "full", "full8", "full16", "full32", "full64", "dia", "pyramid", NULL };
   static const char * const source_scan_type_names[] = { "progressive", "tff", "bff", NULL };
 
   static const char * const overscan_names[]    = { "undef", "show", "crop", NULL };
@@ -374,7 +386,7 @@ int kvz_config_parse(kvz_config *cfg, const char *name, const char *value)
   static const char * const colormatrix_names[] = { "GBR", "bt709", "undef", "", "fcc", "bt470bg", "smpte170m",
                                                     "smpte240m", "YCgCo", "bt2020nc", "bt2020c", NULL };
   static const char * const mv_constraint_names[] = { "none", "frame", "tile", "frametile", "frametilemargin", NULL };
-  static const char * const hash_names[] = { "none", "checksum", "md5", NULL };
+  static const char * const hash_names[] = { "none", "checksum", "md5", "crc", NULL };
 
   static const char * const cu_split_termination_names[] = { "zero", "off", NULL };
   static const char * const crypto_toggle_names[] = { "off", "on", NULL };
@@ -386,6 +398,9 @@ int kvz_config_parse(kvz_config *cfg, const char *name, const char *value)
 
   static const char * const scaling_list_names[] = { "off", "custom", "default", NULL };
 
+  static const char * const thread_affinity_names[] = { "none", "cores", "numa", NULL };
+  static const char * const aq_mode_names[] = { "none", "variance", NULL };
+
   static const char * const preset_values[11][25*2] = {
       {
         "ultrafast",
@@ -981,6 +996,23 @@ int kvz_config_parse(kvz_config *cfg, const char *name, const char *value)
     cfg->bipred = atobool(value);
   else if OPT("bitrate")
     cfg->target_bitrate = atoi(value);
+  else if OPT("lookahead")
+    cfg->lookahead = atoi(value);
+  else if OPT("scenecut")
+    cfg->scenecut = atoi(value);
+  else if OPT("cutree")
+    cfg->cutree = (bool)atobool(value);
+  else if OPT("aq-mode") {
+    return parse_enum(value, aq_mode_names, &cfg->aq_mode);
+  }
+  else if OPT("subpel-planes")
+    cfg->subpel_planes = (bool)atobool(value);
+  else if OPT("me-cache")
+    cfg->me_cache = (bool)atobool(value);
+  else if OPT("coeff-bit-table")
+    cfg->coeff_bit_table = (bool)atobool(value);
+  else if OPT("frame-filter")
+    cfg->frame_filter = (bool)atobool(value);
   else if OPT("preset") {
     int preset_line = 0;
 
@@ -1260,6 +1292,18 @@ int kvz_config_parse(kvz_config *cfg, const char *name, const char *value)
   else if OPT("early-skip") {
   cfg->early_skip = (bool)atobool(value);
   }
+  else if OPT("thread-affinity") {
+    return parse_enum(value, thread_affinity_names, &cfg->thread_affinity);
+  }
+  else if OPT("trace-file") {
+    char *trace_file = strdup(value);
+    if (!trace_file) {
+      fprintf(stderr, "Failed to allocate memory for trace file name.\n");
+      return 0;
+    }
+    FREE_POINTER(cfg->trace_file);
+    cfg->trace_file = trace_file;
+  }
   else {
     return 0;
   }
@@ -1552,6 +1596,27 @@ int kvz_config_validate(const kvz_config *const cfg)
     }
   }
 
+  if (cfg->lookahead < 0 || cfg->lookahead > KVZ_MAX_LOOKAHEAD) {
+    fprintf(stderr, "Input error: --lookahead must be in range 0..%d\n",
+            KVZ_MAX_LOOKAHEAD);
+    error = 1;
+  }
+
+  if (cfg->cutree && cfg->lookahead == 0) {
+    fprintf(stderr, "Input error: --cutree requires --lookahead\n");
+    error = 1;
+  }
+
+  if (cfg->scenecut < 0 || cfg->scenecut > 100) {
+    fprintf(stderr, "Input error: --scenecut must be in range 0..100\n");
+    error = 1;
+  }
+
+  if (cfg->scenecut > 0 && cfg->source_scan_type != KVZ_INTERLACING_NONE) {
+    fprintf(stderr, "Input error: --scenecut does not work with interlaced input\n");
+    error = 1;
+  }
+
   if (cfg->implicit_rdpcm && !cfg->lossless) {
     fprintf(stderr, "Input error: --implicit-rdpcm is not suppoted without --lossless\n");
     error = 1;
@@ -96,6 +96,17 @@ static const struct option long_options[] = {
   { "bipred",                   no_argument, NULL, 0 },
   { "no-bipred",                no_argument, NULL, 0 },
   { "bitrate",            required_argument, NULL, 0 },
+  { "lookahead",          required_argument, NULL, 0 },
+  { "scenecut",           required_argument, NULL, 0 },
+  { "cutree",                   no_argument, NULL, 0 },
+  { "no-cutree",                no_argument, NULL, 0 },
+  { "aq-mode",            required_argument, NULL, 0 },
+  { "subpel-planes",            no_argument, NULL, 0 },
+  { "no-subpel-planes",         no_argument, NULL, 0 },
+  { "me-cache",                 no_argument, NULL, 0 },
+  { "no-me-cache",              no_argument, NULL, 0 },
+  { "coeff-bit-table",          no_argument, NULL, 0 },
+  { "no-coeff-bit-table",       no_argument, NULL, 0 },
   { "preset",             required_argument, NULL, 0 },
   { "mv-rdo",                   no_argument, NULL, 0 },
   { "no-mv-rdo",                no_argument, NULL, 0 },
@@ -104,6 +115,7 @@ static const struct option long_options[] = {
   { "version",                  no_argument, NULL, 0 },
   { "help",                     no_argument, NULL, 0 },
   { "loop-input",               no_argument, NULL, 0 },
+  { "stats",                    no_argument, NULL, 0 },
   { "mv-constraint",      required_argument, NULL, 0 },
   { "hash",               required_argument, NULL, 0 },
   {"cu-split-termination",required_argument, NULL, 0 },
@@ -137,6 +149,10 @@ static const struct option long_options[] = {
   { "max-merge",          required_argument, NULL, 0 },
   { "early-skip",               no_argument, NULL, 0 },
   { "no-early-skip",            no_argument, NULL, 0 },
+  { "thread-affinity",    required_argument, NULL, 0 },
+  { "trace-file",         required_argument, NULL, 0 },
+  { "frame-filter",             no_argument, NULL, 0 },
+  { "no-frame-filter",          no_argument, NULL, 0 },
   {0, 0, 0, 0}
 };
 
@@ -249,6 +265,8 @@ cmdline_opts_t* cmdline_opts_parse(const kvz_api *const api, int argc, char *arg
       goto done;
     } else if (!strcmp(name, "loop-input")) {
       opts->loop_input = true;
+    } else if (!strcmp(name, "stats")) {
+      opts->stats = true;
     } else if (!api->config_parse(opts->config, name, optarg)) {
       fprintf(stderr, "invalid argument: %s=%s\n", name, optarg);
       ok = 0;
@@ -370,7 +388,12 @@ void print_help(void)
     "                                   - none: 0 bytes\n"
     "                                   - checksum: 18 bytes\n"
     "                                   - md5: 56 bytes\n"
+    "                                   - crc: 12 bytes\n"
     "      --(no-)psnr            : Calculate PSNR for frames. [enabled]\n"
+    "      --stats                : Print time spent in each encoding stage and\n"
+    "                               bits spent on each part of each frame.\n"
+    "                               The bitstream stage only writes headers and\n"
+    "                               joins the LCUs coded in the cabac stage.\n"
     "      --(no-)info            : Add encoder info SEI. [enabled]\n"
     "      --crypto <string>      : Selective encryption. Crypto support must be\n"
     "                               enabled at compile-time. Can be 'on' or 'off' or\n"
@@ -392,6 +415,10 @@ void print_help(void)
     "                                   - 0: Only first picture is intra.\n"
     "                                   - 1: All pictures are intra.\n"
     "                                   - N: Every Nth picture is intra.\n"
+    "      --scenecut <integer>   : Start a new intra period at scene cuts [0]\n"
+    "                                   - 0: Disabled.\n"
+    "                                   - N: Cut when inter prediction saves at\n"
+    "                                        most N percent of the intra cost.\n"
     "      --vps-period <integer> : How often the video parameter set is re-sent [0]\n"
     "                                   - 0: Only send VPS with the first frame.\n"
     "                                   - N: Send VPS with every Nth intra frame.\n"
@@ -410,6 +437,11 @@ void print_help(void)
     "      --bitrate <integer>    : Target bitrate [0]\n"
     "                                   - 0: Disable rate control.\n"
     "                                   - N: Target N bits per second.\n"
+    "      --lookahead <integer>  : Number of frames to analyse ahead of encoding\n"
+    "                               for rate control and --cutree. Delays the\n"
+    "                               output by as many frames. [0]\n"
+    "      --(no-)cutree          : Lower the QP of LCUs that are referenced by\n"
+    "                               the frames in the lookahead. [disabled]\n"
     "      --(no-)lossless        : Use lossless coding. [disabled]\n"
     "      --mv-constraint <string> : Constrain movement vectors. [none]\n"
     "                                   - none: No constraint\n"
@@ -425,6 +457,10 @@ void print_help(void)
     "                               in PPS and slice_qp_delta in slize header zero.\n"
     "      --(no-)erp-aqp         : Use adaptive QP for 360 degree video with\n"
     "                               equirectangular projection. [disabled]\n"
+    "      --aq-mode <string>     : Adaptive quantization mode. [none]\n"
+    "                                   - none: Disabled.\n"
+    "                                   - variance: Lower the QP of flat LCUs and\n"
+    "                                     raise the QP of textured LCUs.\n"
     "      --level <number>       : Use the given HEVC level in the output and give\n"
     "                               an error if level limits are exceeded. [6.2]\n"
     "                                   - 1, 2, 2.1, 3, 3.1, 4, 4.1, 5, 5.1, 5.2, 6,\n"
@@ -466,14 +502,25 @@ void print_help(void)
     "                                   - full:  Full Search\n"
     "                                   - full8, full16, full32, full64\n"
     "                                   - dia:   Diamond Search\n"
+    "                                   - pyramid: Coarse-to-fine search on\n"
+    "                                              downscaled frames\n"
     "      --me-steps <integer>   : Motion estimation search step limit. Only\n"
-    "                               affects 'hexbs' and 'dia'. [-1]\n"
+    "                               affects 'hexbs', 'dia' and 'pyramid'. [-1]\n"
+    "      --(no-)me-cache        : Start the motion search of small blocks from\n"
+    "                               the vectors found for the larger blocks\n"
+    "                               containing them. Skip the integer search\n"
+    "                               when those vectors agree. [disabled]\n"
     "      --subme <integer>      : Fractional pixel motion estimation level [4]\n"
     "                                   - 0: Integer motion estimation only\n"
     "                                   - 1: + 1/2-pixel horizontal and vertical\n"
     "                                   - 2: + 1/2-pixel diagonal\n"
     "                                   - 3: + 1/4-pixel horizontal and vertical\n"
     "                                   - 4: + 1/4-pixel diagonal\n"
+    "      --(no-)subpel-planes   : Interpolate the fractional pixels of each\n"
+    "                               reference picture once instead of for\n"
+    "                               every prediction unit. Uses 15 times the\n"
+    "                               luma size of memory per reference.\n"
+    "                               [disabled]\n"
     "      --pu-depth-inter <int>-<int> : Inter prediction units sizes [0-3]\n"
     "                                   - 0, 1, 2, 3: from 64x64 to 8x8\n"
     "      --pu-depth-intra <int>-<int> : Intra prediction units sizes [1-4]\n"
@@ -489,6 +536,10 @@ void print_help(void)
     "                                   - sensitive: Terminate even earlier.\n"
     "      --fast-residual-cost <int> : Skip CABAC cost for residual coefficients\n"
     "                                   when QP is below the limit. [0]\n"
+    "      --(no-)coeff-bit-table : Estimate the CABAC cost of residual\n"
+    "                               coefficients with per-context bit tables\n"
+    "                               instead of running the CABAC coder.\n"
+    "                               [disabled]\n"
     "      --(no-)intra-rdo-et    : Check intra modes in rdo stage only until\n"
     "                               a zero coefficient CU is found. [disabled]\n"
     "      --(no-)early-skip      : Try to find skip cu from merge candidates.\n"
@@ -531,6 +582,21 @@ void print_help(void)
     "                                   - tiles: Put tiles in independent slices.\n"
     "                                   - wpp: Put rows in dependent slices.\n"
     "                                   - tiles+wpp: Do both.\n"
+    "      --(no-)frame-filter    : Without WPP and tiles, deblock and apply SAO\n"
+    "                               to LCU rows in parallel after the search of\n"
+    "                               the frame. The bitstream is then coded after\n"
+    "                               the filtering, so the search estimates bits\n"
+    "                               without the SAO parameters. [disabled]\n"
+    "      --thread-affinity <string> : Placement of worker threads on CPUs.\n"
+    "                                   [none]\n"
+    "                                   - none: Let the operating system decide.\n"
+    "                                   - cores: Pin each thread to one core.\n"
+    "                                   - numa: Pin threads to NUMA nodes and\n"
+    "                                           encode each frame on one node.\n"
+    "      --trace-file <filename> : Write the jobs run by each thread to a file\n"
+    "                                in Chrome trace format when the encoder is\n"
+    "                                closed. View with chrome://tracing or\n"
+    "                                Perfetto.\n"
     "\n"
     /* Word wrap to this width to stay under 80 characters (including ") *************/
     "Video Usability Information:\n"
@@ -591,3 +657,22 @@ void print_frame_info(const kvz_frame_info *const info,
 
   fprintf(stderr, "\n");
 }
+
+void print_frame_stats(const kvz_frame_stats *const stats)
+{
+  fprintf(stderr, "    %.1f ms: search %.1f ms, recon %.1f ms, deblock %.1f ms,"
+          " sao %.1f ms, cabac %.1f ms, bitstream %.1f ms, queue %.1f ms,"
+          " wait %.1f ms; bits: sao %llu, coding tree %llu, headers %llu\n",
+          stats->wall_time * 1000,
+          stats->search_time * 1000,
+          stats->recon_time * 1000,
+          stats->deblock_time * 1000,
+          stats->sao_time * 1000,
+          stats->cabac_time * 1000,
+          stats->bitstream_time * 1000,
+          stats->queue_time * 1000,
+          stats->wait_time * 1000,
+          (long long unsigned int)stats->sao_bits,
+          (long long unsigned int)stats->coding_tree_bits,
+          (long long unsigned int)stats->header_bits);
+}
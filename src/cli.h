@@ -47,6 +47,8 @@ typedef struct cmdline_opts_t {
   bool version;
   /** \brief Whether to loop input */
   bool loop_input;
+  /** \brief Whether to print timing statistics of frames */
+  bool stats;
 } cmdline_opts_t;
 
 cmdline_opts_t* cmdline_opts_parse(const kvz_api *api, int argc, char *argv[]);
@@ -59,5 +61,6 @@ void print_frame_info(const kvz_frame_info *const info,
                       const double frame_psnr[3],
                       const uint32_t bytes,
                       const bool print_psnr);
+void print_frame_stats(const kvz_frame_stats *const stats);
 
 #endif
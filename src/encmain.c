@@ -433,6 +433,10 @@ int main(int argc, char *argv[])
     uint32_t frames_done = 0;
     double psnr_sum[3] = { 0.0, 0.0, 0.0 };
 
+    // Sums of the statistics of all frames. Only used with --stats.
+    kvz_frame_stats stats_sum;
+    memset(&stats_sum, 0, sizeof(stats_sum));
+
     // how many bits have been written this second? used for checking if framerate exceeds level's limits
     uint64_t bits_this_second = 0;
     // the amount of frames have been encoded in this second of video. can be non-integer value if framerate is non-integer value
@@ -603,6 +607,22 @@ int main(int argc, char *argv[])
         psnr_sum[2] += frame_psnr[2];
 
         print_frame_info(&info_out, frame_psnr, len_out, encoder->cfg.calc_psnr);
+
+        if (opts->stats) {
+          kvz_frame_stats stats;
+          stats.version = KVZ_FRAME_STATS_VERSION;
+          if (api->encoder_frame_stats(enc, &stats)) {
+            print_frame_stats(&stats);
+            stats_sum.search_time    += stats.search_time;
+            stats_sum.recon_time     += stats.recon_time;
+            stats_sum.deblock_time   += stats.deblock_time;
+            stats_sum.sao_time       += stats.sao_time;
+            stats_sum.cabac_time     += stats.cabac_time;
+            stats_sum.bitstream_time += stats.bitstream_time;
+            stats_sum.queue_time     += stats.queue_time;
+            stats_sum.wait_time      += stats.wait_time;
+          }
+        }
       }
 
       api->picture_free(cur_in_img);
@@ -639,6 +659,19 @@ int main(int argc, char *argv[])
       fprintf(stderr, " Encoding CPU usage: %.2f%%\n", encoding_time/wall_time*100.f);
       fprintf(stderr, " FPS: %.2f\n", ((double)frames_done)/wall_time);
     }
+    if (opts->stats) {
+      fprintf(stderr, " Stage times: search %.3f s, recon %.3f s, deblock %.3f s,"
+              " sao %.3f s, cabac %.3f s, bitstream %.3f s\n",
+              stats_sum.search_time,
+              stats_sum.recon_time,
+              stats_sum.deblock_time,
+              stats_sum.sao_time,
+              stats_sum.cabac_time,
+              stats_sum.bitstream_time);
+      fprintf(stderr, " Queue time: %.3f s, wait time: %.3f s\n",
+              stats_sum.queue_time,
+              stats_sum.wait_time);
+    }
     pthread_join(input_thread, NULL);
   }
 
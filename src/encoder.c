@@ -230,6 +230,7 @@ encoder_control_t* kvz_encoder_control_init(const kvz_config *const cfg)
   encoder->cfg.tiles_width_split = NULL;
   encoder->cfg.tiles_height_split = NULL;
   encoder->cfg.slice_addresses_in_ts = NULL;
+  encoder->cfg.trace_file = NULL;
 
   if (encoder->cfg.gop_len > 0) {
     if (encoder->cfg.gop_lowdelay) {
@@ -286,7 +287,16 @@ encoder_control_t* kvz_encoder_control_init(const kvz_config *const cfg)
     }
   }
 
-  encoder->threadqueue = kvz_threadqueue_init(encoder->cfg.threads);
+  if (cfg->trace_file) {
+    encoder->trace = kvz_trace_alloc(cfg->trace_file, encoder->cfg.threads);
+    if (!encoder->trace) {
+      goto init_failed;
+    }
+  }
+
+  encoder->threadqueue = kvz_threadqueue_init(encoder->cfg.threads,
+                                              encoder->cfg.thread_affinity,
+                                              encoder->trace);
   if (!encoder->threadqueue) {
     fprintf(stderr, "Could not initialize threadqueue.\n");
     goto init_failed;
@@ -324,6 +334,20 @@ encoder_control_t* kvz_encoder_control_init(const kvz_config *const cfg)
 
   kvz_encoder_control_input_init(encoder, encoder->cfg.width, encoder->cfg.height);
 
+  // Scene cut detection uses the analysis of the lookahead even if the
+  // frames are not held in it.
+  if (encoder->cfg.lookahead > 0 || encoder->cfg.scenecut > 0) {
+    encoder->lookahead = kvz_lookahead_alloc(encoder->threadqueue,
+                                             encoder->in.width,
+                                             encoder->in.height,
+                                             encoder->cfg.lookahead,
+                                             encoder->cfg.gop_len,
+                                             encoder->cfg.scenecut);
+    if (!encoder->lookahead) {
+      goto init_failed;
+    }
+  }
+
   if (encoder->cfg.framerate_num != 0) {
     double framerate = encoder->cfg.framerate_num / (double)encoder->cfg.framerate_denom;
     encoder->target_avg_bppic = encoder->cfg.target_bitrate / framerate;
@@ -356,7 +380,9 @@ encoder_control_t* kvz_encoder_control_init(const kvz_config *const cfg)
   // for SMP and AMP partition units.
   encoder->tr_depth_inter = 0;
 
-  if (encoder->cfg.target_bitrate > 0 || encoder->cfg.roi.dqps || encoder->cfg.set_qp_in_cu) {
+  if (encoder->cfg.target_bitrate > 0 || encoder->cfg.roi.dqps ||
+      encoder->cfg.set_qp_in_cu || encoder->cfg.cutree ||
+      encoder->cfg.aq_mode != KVZ_AQ_NONE) {
     encoder->max_qp_delta_depth = 0;
   } else {
     encoder->max_qp_delta_depth = -1;
@@ -559,6 +585,15 @@ encoder_control_t* kvz_encoder_control_init(const kvz_config *const cfg)
       }
     }
 
+    // Filtering after the search is only done when a single leaf state
+    // encodes the whole frame.
+    encoder->frame_filter = encoder->cfg.frame_filter &&
+                            !encoder->cfg.wpp &&
+                            !encoder->tiles_enable &&
+                            encoder->slice_count == 1 &&
+                            !encoder->cfg.crypto_features &&
+                            (encoder->cfg.deblock_enable || encoder->cfg.sao_type);
+
 #ifdef _DEBUG_PRINT_THREADING_INFO
     printf("Tiles columns width:");
     for (int i = 0; i < encoder->cfg.tiles_width_count; ++i) {
@@ -664,9 +699,18 @@ void kvz_encoder_control_free(encoder_control_t *const encoder)
 
   kvz_scalinglist_destroy(&encoder->scaling_list);
 
+  // The lookahead frees its jobs, so it must be freed before the
+  // threadqueue.
+  kvz_lookahead_free(encoder->lookahead);
+  encoder->lookahead = NULL;
+
   kvz_threadqueue_free(encoder->threadqueue);
   encoder->threadqueue = NULL;
 
+  // The trace is written after all threads have stopped.
+  kvz_trace_free(encoder->trace);
+  encoder->trace = NULL;
+
   free(encoder);
 }
 
@@ -29,7 +29,9 @@
 #include "global.h" // IWYU pragma: keep
 #include "kvazaar.h"
 #include "scalinglist.h"
+#include "lookahead.h"
 #include "threadqueue.h"
+#include "trace.h"
 
 
 /* Encoder control options, the main struct */
@@ -44,6 +46,7 @@ typedef struct encoder_control_t
    *    - tiles_width_split
    *    - tiles_height_split
    *    - slice_addresses_in_ts
+   *    - trace_file
    * Use appropriate fields in encoder_control_t instead.
    */
   kvz_config cfg;
@@ -107,8 +110,23 @@ typedef struct encoder_control_t
   int slice_count;
   const int* slice_addresses_in_ts;
 
+  /**
+   * \brief Whether the frames are filtered in LCU row jobs after the
+   * search, see kvz_config.frame_filter.
+   */
+  int8_t frame_filter;
+
   threadqueue_queue_t *threadqueue;
 
+  /**
+   * \brief Trace of the jobs run by the threads, or NULL if tracing is
+   * disabled.
+   */
+  kvz_trace_t *trace;
+
+  /** \brief Analysis of the frames ahead, or NULL if disabled. */
+  lookahead_t *lookahead;
+
   //! Target average bits per picture.
   double target_avg_bppic;
 
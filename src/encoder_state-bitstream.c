@@ -38,6 +38,7 @@
 #include "scalinglist.h"
 #include "tables.h"
 #include "threadqueue.h"
+#include "threads.h"
 #include "videoframe.h"
 
 
@@ -906,11 +907,13 @@ static void add_checksum(encoder_state_t * const state)
 
   int num_colors = (state->encoder_control->chroma_format == KVZ_CSP_400 ? 1 : 3);
 
+  // Hash the rows not hashed by the LCU jobs.
+  kvz_picture_hash_final(&state->frame->hash, state->encoder_control->cfg.hash,
+                         frame->rec, checksum, state->encoder_control->bitdepth);
+
   switch (state->encoder_control->cfg.hash)
   {
   case KVZ_HASH_CHECKSUM:
-    kvz_image_checksum(frame->rec, checksum, state->encoder_control->bitdepth);
-
     WRITE_U(stream, 1 + num_colors * 4, 8, "size");
     WRITE_U(stream, 2, 8, "hash_type");  // 2 = checksum
 
@@ -925,8 +928,6 @@ static void add_checksum(encoder_state_t * const state)
     break;
 
   case KVZ_HASH_MD5:
-    kvz_image_md5(frame->rec, checksum, state->encoder_control->bitdepth);
-
     WRITE_U(stream, 1 + num_colors * 16, 8, "size");
     WRITE_U(stream, 0, 8, "hash_type");  // 0 = md5
 
@@ -938,6 +939,18 @@ static void add_checksum(encoder_state_t * const state)
 
     break;
 
+  case KVZ_HASH_CRC:
+    WRITE_U(stream, 1 + num_colors * 2, 8, "size");
+    WRITE_U(stream, 1, 8, "hash_type");  // 1 = crc
+
+    for (int i = 0; i < num_colors; ++i) {
+      const uint32_t crc_val = (checksum[i][0] << 8) + checksum[i][1];
+      WRITE_U(stream, crc_val, 16, "picture_crc");
+      CHECKPOINT("crc[%d] = %u", i, crc_val);
+    }
+
+    break;
+
   case KVZ_HASH_NONE:
     // Means we shouldn't be writing this SEI.
     assert(0);
@@ -961,6 +974,37 @@ static void encoder_state_write_slice_header(
   kvz_bitstream_add_rbsp_trailing_bits(stream);
 }
 
+/**
+ * \brief Check whether a dependent slice segment starts at a state.
+ */
+static bool encoder_state_starts_dependent_slice(const encoder_state_t * const state)
+{
+  return state->type == ENCODER_STATE_TYPE_WAVEFRONT_ROW &&
+         (state->encoder_control->cfg.slices & KVZ_SLICES_WPP) &&
+         state != &state->parent->children[0];
+}
+
+/**
+ * \brief Finish the bitstream of a leaf state.
+ *
+ * Called by the job coding the last LCU of the leaf. Writes the header of
+ * the dependent slice segment starting at the leaf to state->slice_header,
+ * so that the headers of WPP row slices are not left for the job writing
+ * the bitstream of the frame.
+ */
+void kvz_encoder_state_write_bitstream_leaf(encoder_state_t * const state)
+{
+  assert(state->is_leaf);
+
+  if (encoder_state_starts_dependent_slice(state)) {
+    // A dependent slice segment is never the first NAL unit of the
+    // access unit.
+    kvz_nal_write(&state->slice_header, state->frame->pictype, 0, 0);
+    kvz_encoder_state_write_bitstream_slice_header(&state->slice_header, state, false);
+    kvz_bitstream_add_rbsp_trailing_bits(&state->slice_header);
+  }
+}
+
 /**
  * \brief Move child state bitstreams to the parent stream.
  */
@@ -971,11 +1015,9 @@ static void encoder_state_write_bitstream_children(encoder_state_t * const state
   for (int i = 0; state->children[i].encoder_control; ++i) {
     if (state->children[i].type == ENCODER_STATE_TYPE_SLICE) {
       encoder_state_write_slice_header(&state->stream, &state->children[i], true);
-    } else if (state->children[i].type == ENCODER_STATE_TYPE_WAVEFRONT_ROW) {
-      if ((state->encoder_control->cfg.slices & KVZ_SLICES_WPP) && i != 0) {
-        // Add header for dependent WPP row slice.
-        encoder_state_write_slice_header(&state->stream, &state->children[i], false);
-      }
+    } else if (encoder_state_starts_dependent_slice(&state->children[i])) {
+      // The header was written when the row was finished.
+      kvz_bitstream_move(&state->stream, &state->children[i].slice_header);
     }
     kvz_encoder_state_write_bitstream(&state->children[i]);
     kvz_bitstream_move(&state->stream, &state->children[i].stream);
@@ -1068,7 +1110,13 @@ void kvz_encoder_state_write_bitstream(encoder_state_t * const state)
 
 void kvz_encoder_state_worker_write_bitstream(void * opaque)
 {
-  kvz_encoder_state_write_bitstream((encoder_state_t *) opaque);
+  encoder_state_t * const state = (encoder_state_t *) opaque;
+  const int64_t start_time = kvz_time_ns();
+
+  kvz_encoder_state_write_bitstream(state);
+
+  state->frame->end_time = kvz_time_ns();
+  state->frame->bitstream_time = state->frame->end_time - start_time;
 }
 
 void kvz_encoder_state_write_parameter_sets(bitstream_t *stream,
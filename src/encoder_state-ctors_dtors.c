@@ -32,6 +32,7 @@
 #include "image.h"
 #include "imagelist.h"
 #include "kvazaar.h"
+#include "subpel.h"
 #include "threadqueue.h"
 #include "videoframe.h"
 
@@ -43,8 +44,17 @@ static int encoder_state_config_frame_init(encoder_state_t * const state) {
     return 0;
   }
   state->frame->ref_list = REF_PIC_LIST_0;
+  for (int i = 0; i < ME_PYRAMID_LEVELS; i++) {
+    state->frame->pyramid[i] = NULL;
+  }
+  state->frame->subpel_planes = NULL;
+  state->frame->subpel_jobs = NULL;
+  state->frame->subpel_next_row = 0;
   state->frame->num = 0;
   state->frame->poc = 0;
+  state->frame->input_num = 0;
+  state->frame->is_scenecut = false;
+  state->frame->cut_num = 0;
   state->frame->total_bits_coded = 0;
   state->frame->cur_gop_bits_coded = 0;
   state->frame->prepared = 0;
@@ -56,6 +66,10 @@ static int encoder_state_config_frame_init(encoder_state_t * const state) {
   const int num_lcus = encoder->in.width_in_lcu * encoder->in.height_in_lcu;
   state->frame->lcu_stats = MALLOC(lcu_stats_t, num_lcus);
 
+  if (encoder->cfg.subpel_planes) {
+    state->frame->subpel_jobs = calloc(encoder->in.height_in_lcu, sizeof(threadqueue_job_t*));
+  }
+
   return 1;
 }
 
@@ -63,6 +77,16 @@ static void encoder_state_config_frame_finalize(encoder_state_t * const state) {
   if (state->frame == NULL) return;
 
   kvz_image_list_destroy(state->frame->ref);
+  for (int i = 0; i < ME_PYRAMID_LEVELS; i++) {
+    kvz_image_free(state->frame->pyramid[i]);
+  }
+  if (state->frame->subpel_jobs) {
+    for (int i = 0; i < state->encoder_control->in.height_in_lcu; i++) {
+      kvz_threadqueue_free_job(&state->frame->subpel_jobs[i]);
+    }
+    FREE_POINTER(state->frame->subpel_jobs);
+  }
+  kvz_subpel_planes_free(&state->frame->subpel_planes);
   FREE_POINTER(state->frame->lcu_stats);
 }
 
@@ -109,18 +133,41 @@ static int encoder_state_config_tile_init(encoder_state_t * const state,
     state->tile->ver_buf_before_sao = NULL;
   }
 
-  if (encoder->cfg.wpp) {
+  if (encoder->cfg.wpp || encoder->frame_filter) {
     int num_jobs = state->tile->frame->width_in_lcu * state->tile->frame->height_in_lcu;
+    state->tile->wf_search_jobs = MALLOC(threadqueue_job_t*, num_jobs);
+    state->tile->wf_filter_jobs = MALLOC(threadqueue_job_t*, num_jobs);
     state->tile->wf_jobs = MALLOC(threadqueue_job_t*, num_jobs);
+    if (!state->tile->wf_search_jobs || !state->tile->wf_filter_jobs || !state->tile->wf_jobs) {
+      printf("Error allocating wf_jobs array!\n");
+      return 0;
+    }
     for (int i = 0; i < num_jobs; ++i) {
+      state->tile->wf_search_jobs[i] = NULL;
+      state->tile->wf_filter_jobs[i] = NULL;
       state->tile->wf_jobs[i] = NULL;
     }
-    if (!state->tile->wf_jobs) {
-      printf("Error allocating wf_jobs array!\n");
+  } else {
+    state->tile->wf_search_jobs = NULL;
+    state->tile->wf_filter_jobs = NULL;
+    state->tile->wf_jobs = NULL;
+  }
+
+  if (encoder->frame_filter) {
+    int num_rows = state->tile->frame->height_in_lcu;
+    state->tile->deblock_ver_jobs = MALLOC(threadqueue_job_t*, num_rows);
+    state->tile->deblock_hor_jobs = MALLOC(threadqueue_job_t*, num_rows);
+    if (!state->tile->deblock_ver_jobs || !state->tile->deblock_hor_jobs) {
+      printf("Error allocating deblock_jobs array!\n");
       return 0;
     }
+    for (int i = 0; i < num_rows; ++i) {
+      state->tile->deblock_ver_jobs[i] = NULL;
+      state->tile->deblock_hor_jobs[i] = NULL;
+    }
   } else {
-    state->tile->wf_jobs = NULL;
+    state->tile->deblock_ver_jobs = NULL;
+    state->tile->deblock_hor_jobs = NULL;
   }
   state->tile->id = encoder->tiles_tile_id[state->tile->lcu_offset_in_ts];
   return 1;
@@ -134,16 +181,28 @@ static void encoder_state_config_tile_finalize(encoder_state_t * const state) {
   kvz_yuv_t_free(state->tile->hor_buf_before_sao);
   kvz_yuv_t_free(state->tile->ver_buf_before_sao);
 
-  if (state->encoder_control->cfg.wpp) {
+  if (state->tile->wf_jobs) {
     int num_jobs = state->tile->frame->width_in_lcu * state->tile->frame->height_in_lcu;
     for (int i = 0; i < num_jobs; ++i) {
+      kvz_threadqueue_free_job(&state->tile->wf_search_jobs[i]);
+      kvz_threadqueue_free_job(&state->tile->wf_filter_jobs[i]);
       kvz_threadqueue_free_job(&state->tile->wf_jobs[i]);
     }
   }
+  if (state->tile->deblock_ver_jobs) {
+    for (int i = 0; i < state->tile->frame->height_in_lcu; ++i) {
+      kvz_threadqueue_free_job(&state->tile->deblock_ver_jobs[i]);
+      kvz_threadqueue_free_job(&state->tile->deblock_hor_jobs[i]);
+    }
+  }
 
   kvz_videoframe_free(state->tile->frame);
   state->tile->frame = NULL;
+  FREE_POINTER(state->tile->wf_search_jobs);
+  FREE_POINTER(state->tile->wf_filter_jobs);
   FREE_POINTER(state->tile->wf_jobs);
+  FREE_POINTER(state->tile->deblock_ver_jobs);
+  FREE_POINTER(state->tile->deblock_hor_jobs);
 }
 
 static int encoder_state_config_slice_init(encoder_state_t * const state,
@@ -315,6 +374,15 @@ int kvz_encoder_state_init(encoder_state_t * const child_state, encoder_state_t
   child_state->must_code_qp_delta = false;
   child_state->tqj_bitstream_written = NULL;
   child_state->tqj_recon_done = NULL;
+  child_state->motion_cache = NULL;
+
+  // The coefficients of an LCU are kept from its search to its coding.
+  child_state->coeff = MALLOC(lcu_coeff_t, 1);
+  if (!child_state->coeff) {
+    fprintf(stderr, "Could not allocate encoder_state->coeff!\n");
+    return 0;
+  }
+  child_state->lcu_coeffs = NULL;
   
   if (!parent_state) {
     const encoder_control_t * const encoder = child_state->encoder_control;
@@ -350,6 +418,7 @@ int kvz_encoder_state_init(encoder_state_t * const child_state, encoder_state_t
   }
   
   kvz_bitstream_init(&child_state->stream);
+  kvz_bitstream_init(&child_state->slice_header);
   
   // Set CABAC output bitstream
   child_state->cabac.stream = &child_state->stream;
@@ -640,6 +709,16 @@ int kvz_encoder_state_init(encoder_state_t * const child_state, encoder_state_t
           child_state->lcu_order[i].left->right = &child_state->lcu_order[i];
         }
       }
+
+      if (encoder->frame_filter) {
+        FREE_POINTER(child_state->coeff);
+        child_state->lcu_coeffs = MALLOC(lcu_coeff_t, child_state->lcu_order_count);
+        if (!child_state->lcu_coeffs) {
+          fprintf(stderr, "Could not allocate encoder_state->lcu_coeffs!\n");
+          return 0;
+        }
+        child_state->coeff = child_state->lcu_coeffs;
+      }
     } else {
       child_state->lcu_order_count = 0;
       child_state->lcu_order = NULL;
@@ -687,6 +766,12 @@ void kvz_encoder_state_finalize(encoder_state_t * const state) {
   
   FREE_POINTER(state->lcu_order);
   state->lcu_order_count = 0;
+  if (state->lcu_coeffs) {
+    // The coeffs point to one of lcu_coeffs.
+    state->coeff = NULL;
+    FREE_POINTER(state->lcu_coeffs);
+  }
+  FREE_POINTER(state->coeff);
   
   if (!state->parent || (state->parent->wfrow != state->wfrow)) {
     FREE_POINTER(state->wfrow);
@@ -707,6 +792,7 @@ void kvz_encoder_state_finalize(encoder_state_t * const state) {
   }
   
   kvz_bitstream_finalize(&state->stream);
+  kvz_bitstream_finalize(&state->slice_header);
 
   kvz_threadqueue_free_job(&state->tqj_recon_done);
   kvz_threadqueue_free_job(&state->tqj_bitstream_written);
@@ -34,8 +34,12 @@
 #include "rate_control.h"
 #include "sao.h"
 #include "search.h"
+#include "subpel.h"
+#include "strategies/strategies-picture.h"
 #include "tables.h"
 #include "threadqueue.h"
+#include "threads.h"
+#include "trace.h"
 
 
 int kvz_encoder_state_match_children_of_previous_frame(encoder_state_t * const state) {
@@ -595,10 +599,14 @@ static void set_cu_qps(encoder_state_t *state, int x, int y, int depth, int *las
     }
 
     // Set the correct QP for all state->tile->frame->cu_array elements in
-    // the area covered by the CU.
+    // the area covered by the CU. Deblocking reads the QPs from the
+    // deblocking parameters of the LCU.
+    deblock_info_t *const deblock_info = &state->tile->frame->deblock_info[
+      (x >> LOG2_LCU_WIDTH) + (y >> LOG2_LCU_WIDTH) * state->tile->frame->width_in_lcu];
     for (int y_scu = y; y_scu < y + cu_width; y_scu += SCU_WIDTH) {
       for (int x_scu = x; x_scu < x + cu_width; x_scu += SCU_WIDTH) {
         kvz_cu_array_at(state->tile->frame->cu_array, x_scu, y_scu)->qp = qp;
+        deblock_info->qp[(y_scu % LCU_WIDTH) >> 2][(x_scu % LCU_WIDTH) >> 2] = qp;
       }
     }
 
@@ -609,20 +617,52 @@ static void set_cu_qps(encoder_state_t *state, int x, int y, int depth, int *las
 }
 
 
-static void encoder_state_worker_encode_lcu(void * opaque)
+/**
+ * \brief Finish a stage of encoding an LCU.
+ *
+ * Records the stage to the trace.
+ *
+ * \param kind    stage that was finished
+ * \param time    start time of the stage, set to the current time
+ *
+ * \return duration of the stage in nanoseconds
+ */
+static int64_t encoder_state_lcu_stage_done(const encoder_state_t * const state,
+                                            const lcu_order_element_t * const lcu,
+                                            kvz_trace_kind kind,
+                                            int64_t *time)
+{
+  const int64_t now = kvz_time_ns();
+  kvz_trace_span(state->encoder_control->trace, *time, now, kind,
+                 state->frame->poc, lcu->position.x, lcu->position.y);
+  const int64_t duration = now - *time;
+  *time = now;
+  return duration;
+}
+
+
+/**
+ * \brief Search and reconstruct an LCU.
+ *
+ * The search uses the CABAC contexts, so the previous LCU of the leaf must
+ * be coded before.
+ */
+static void encoder_state_worker_search_lcu(void * opaque)
 {
   const lcu_order_element_t * const lcu = opaque;
   encoder_state_t *state = lcu->encoder_state;
   const encoder_control_t * const encoder = state->encoder_control;
-  videoframe_t* const frame = state->tile->frame;
+  lcu_stats_t * const stats = kvz_get_lcu_stats(state, lcu->position.x, lcu->position.y);
+  int64_t time = kvz_time_ns();
 
   kvz_set_lcu_lambda_and_qp(state, lcu->position);
 
-  lcu_coeff_t coeff;
-  state->coeff = &coeff;
-
-  //This part doesn't write to bitstream, it's only search, deblock and sao
+  // The search adds the time spent reconstructing the chosen modes to
+  // recon_time.
+  stats->recon_time = 0;
   kvz_search_lcu(state, lcu->position_px.x, lcu->position_px.y, state->tile->hor_buf_search, state->tile->ver_buf_search);
+  stats->search_time = encoder_state_lcu_stage_done(state, lcu, KVZ_TRACE_SEARCH, &time) -
+                       stats->recon_time;
 
   encoder_state_recdata_to_bufs(state, lcu, state->tile->hor_buf_search, state->tile->ver_buf_search);
 
@@ -631,11 +671,34 @@ static void encoder_state_worker_encode_lcu(void * opaque)
     int prev_qp = -1;
     set_cu_qps(state, lcu->position_px.x, lcu->position_px.y, 0, &last_qp, &prev_qp);
   }
+  stats->recon_time += encoder_state_lcu_stage_done(state, lcu, KVZ_TRACE_RECON, &time);
+}
 
-  if (encoder->cfg.deblock_enable) {
-    kvz_filter_deblock_lcu(state, lcu->position_px.x, lcu->position_px.y);
+/**
+ * \brief Deblock an LCU and search and apply its SAO parameters.
+ *
+ * The LCU must be reconstructed and the LCUs to the left and above right
+ * filtered. With frame_filter, the LCU rows are deblocked by separate jobs
+ * and this only does SAO.
+ */
+static void encoder_state_worker_filter_lcu(void * opaque)
+{
+  const lcu_order_element_t * const lcu = opaque;
+  encoder_state_t *state = lcu->encoder_state;
+  const encoder_control_t * const encoder = state->encoder_control;
+  videoframe_t* const frame = state->tile->frame;
+  lcu_stats_t * const stats = kvz_get_lcu_stats(state, lcu->position.x, lcu->position.y);
+  int64_t time = kvz_time_ns();
+
+  if (!encoder->frame_filter) {
+    stats->deblock_time = 0;
+    if (encoder->cfg.deblock_enable) {
+      kvz_filter_deblock_lcu(state, lcu->position_px.x, lcu->position_px.y);
+      stats->deblock_time = encoder_state_lcu_stage_done(state, lcu, KVZ_TRACE_DEBLOCK, &time);
+    }
   }
 
+  stats->sao_time = 0;
   if (encoder->cfg.sao_type) {
     // Save the post-deblocking but pre-SAO pixels of the LCU to a buffer
     // so that they can be used in SAO reconstruction later.
@@ -643,24 +706,55 @@ static void encoder_state_worker_encode_lcu(void * opaque)
                                              lcu,
                                              state->tile->hor_buf_before_sao,
                                              state->tile->ver_buf_before_sao);
-    kvz_sao_search_lcu(state, lcu->position.x, lcu->position.y);
+    kvz_sao_search_lcu(state,
+                       encoder->frame_filter ? &state->sao_cabac : &state->cabac,
+                       stats->lambda,
+                       lcu->position.x,
+                       lcu->position.y);
     encoder_sao_reconstruct(state, lcu);
+    stats->sao_time = encoder_state_lcu_stage_done(state, lcu, KVZ_TRACE_SAO, &time);
+  }
+
+  if (encoder->cfg.hash != KVZ_HASH_NONE && !encoder->tiles_enable && lcu->last_column) {
+    // The LCU rows are finished in order. Filtering the next row changes
+    // at most SAO_DELAY_PX rows at the bottom of this one.
+    const int32_t final_rows = lcu->below ?
+      lcu->position_px.y + LCU_WIDTH - SAO_DELAY_PX : frame->height;
+    kvz_picture_hash_rows(&state->frame->hash, encoder->cfg.hash,
+                          frame->rec, final_rows, encoder->bitdepth);
+  }
+}
+
+/**
+ * \brief Code an LCU with CABAC.
+ *
+ * The LCU must be searched and its SAO parameters chosen.
+ */
+static void encoder_state_worker_code_lcu(void * opaque)
+{
+  const lcu_order_element_t * const lcu = opaque;
+  encoder_state_t *state = lcu->encoder_state;
+  const encoder_control_t * const encoder = state->encoder_control;
+  videoframe_t* const frame = state->tile->frame;
+  lcu_stats_t * const stats = kvz_get_lcu_stats(state, lcu->position.x, lcu->position.y);
+  int64_t time = kvz_time_ns();
+
+  if (state->lcu_coeffs) {
+    state->coeff = &state->lcu_coeffs[lcu->index];
   }
 
   //Now write data to bitstream (required to have a correct CABAC state)
-  const uint64_t existing_bits = kvz_bitstream_tell(&state->stream);
+  const uint64_t existing_bits = kvz_cabac_tell(&state->cabac);
 
   //Encode SAO
   if (encoder->cfg.sao_type) {
     encode_sao(state, lcu->position.x, lcu->position.y, &frame->sao_luma[lcu->position.y * frame->width_in_lcu + lcu->position.x], &frame->sao_chroma[lcu->position.y * frame->width_in_lcu + lcu->position.x]);
   }
+  stats->sao_bits = kvz_cabac_tell(&state->cabac) - existing_bits;
 
   //Encode coding tree
   kvz_encode_coding_tree(state, lcu->position.x * LCU_WIDTH, lcu->position.y * LCU_WIDTH, 0);
 
-  // Coeffs are not needed anymore.
-  state->coeff = NULL;
-
   bool end_of_slice_segment_flag;
   if (state->encoder_control->cfg.slices & KVZ_SLICES_WPP) {
     // Slice segments end after each WPP row.
@@ -699,11 +793,15 @@ static void encoder_state_worker_encode_lcu(void * opaque)
       kvz_cabac_start(&state->cabac);
 
       kvz_crypto_delete(&state->crypto_hdl);
+
+      // The substream is complete so the rest of its NAL unit can be
+      // written without waiting for the other substreams.
+      kvz_encoder_state_write_bitstream_leaf(state);
     }
   }
 
-  const uint32_t bits = kvz_bitstream_tell(&state->stream) - existing_bits;
-  kvz_get_lcu_stats(state, lcu->position.x, lcu->position.y)->bits = bits;
+  const uint32_t bits = kvz_cabac_tell(&state->cabac) - existing_bits;
+  stats->bits = bits;
 
   //Wavefronts need the context to be copied to the next row
   if (state->type == ENCODER_STATE_TYPE_WAVEFRONT_ROW && lcu->index == 1) {
@@ -716,6 +814,234 @@ static void encoder_state_worker_encode_lcu(void * opaque)
       }
     }
   }
+
+  stats->cabac_time = encoder_state_lcu_stage_done(state, lcu, KVZ_TRACE_CABAC, &time);
+}
+
+/**
+ * \brief Encode an LCU in the current thread.
+ */
+static void encoder_state_worker_encode_lcu(void * opaque)
+{
+  encoder_state_worker_search_lcu(opaque);
+  encoder_state_worker_filter_lcu(opaque);
+  encoder_state_worker_code_lcu(opaque);
+}
+
+/**
+ * \brief Deblock the edges of one direction in a row of LCUs.
+ *
+ * The time is counted in the stats of the first LCU of the row.
+ *
+ * \param lcu   first LCU of the row
+ * \param dir   direction of the edges
+ */
+static void encoder_state_deblock_row(const lcu_order_element_t * const lcu,
+                                      edge_dir dir)
+{
+  encoder_state_t *state = lcu->encoder_state;
+  lcu_stats_t * const stats = kvz_get_lcu_stats(state, lcu->position.x, lcu->position.y);
+  const int64_t time = kvz_time_ns();
+
+  kvz_filter_deblock_lcu_row(state, lcu->position_px.y, dir);
+
+  stats->deblock_time += kvz_time_ns() - time;
+}
+
+static void encoder_state_worker_deblock_row_ver(void * opaque)
+{
+  encoder_state_deblock_row(opaque, EDGE_VER);
+}
+
+static void encoder_state_worker_deblock_row_hor(void * opaque)
+{
+  encoder_state_deblock_row(opaque, EDGE_HOR);
+}
+
+/**
+ * \brief Get the priority for a job encoding a part of a frame.
+ *
+ * Jobs of older frames get a higher priority so that frames started
+ * earlier because of OWF finish first. Within a frame, LCUs on earlier
+ * wavefront diagonals get a higher priority, since the LCUs on later
+ * diagonals depend on them.
+ *
+ * \param state   encoder state
+ * \param lcu     LCU encoded by the job, or NULL if the job encodes
+ *                a whole tile or slice
+ */
+static int64_t encoder_state_job_priority(const encoder_state_t * const state,
+                                          const lcu_order_element_t * const lcu)
+{
+  const encoder_control_t * const ctrl = state->encoder_control;
+
+  // Each WPP row starts two LCUs after the row above it, so this is an
+  // upper bound for the number of diagonals in any tile.
+  const int64_t num_diagonals = ctrl->in.width_in_lcu + 2 * ctrl->in.height_in_lcu;
+  const int64_t diagonal = lcu ? lcu->position.x + 2 * lcu->position.y : 0;
+
+  return -(state->frame->num * num_diagonals + diagonal);
+}
+
+/**
+ * \brief Create a job filtering or coding a part of a frame with
+ * frame_filter.
+ *
+ * \param lcu     LCU of the job, or the first LCU of the row for row jobs
+ * \param fptr    function run by the job
+ * \param kind    kind of the job in the trace
+ * \param row     whether the job processes the whole LCU row
+ */
+static threadqueue_job_t *encoder_state_frame_filter_job(const encoder_state_t * const state,
+                                                         const lcu_order_element_t * const lcu,
+                                                         void (*fptr)(void *arg),
+                                                         kvz_trace_kind kind,
+                                                         bool row)
+{
+  threadqueue_job_t *job = kvz_threadqueue_job_create(state->encoder_control->threadqueue,
+                                                      fptr,
+                                                      (void*)lcu);
+  kvz_threadqueue_job_set_priority(job, encoder_state_job_priority(state, lcu));
+  kvz_threadqueue_job_set_node(job, state->frame->num);
+  kvz_threadqueue_job_set_trace(job, kind, state->frame->poc,
+                                row ? -1 : lcu->position.x, lcu->position.y);
+  return job;
+}
+
+/**
+ * \brief Add the jobs filtering the LCUs of a frame with frame_filter.
+ *
+ * Deblock the row and add the jobs doing SAO to the row above it, whose
+ * bottom edge is deblocked with the row.
+ *
+ * \param row   LCU row that has been searched, or the number of LCU rows
+ *              after the last row
+ */
+static void encoder_state_add_frame_filter_jobs(encoder_state_t * const state,
+                                                int row)
+{
+  const encoder_control_t * const ctrl = state->encoder_control;
+  encoder_state_config_tile_t * const tile = state->tile;
+  const int width_in_lcu = tile->frame->width_in_lcu;
+  const bool last = row == tile->frame->height_in_lcu;
+
+  if (!last && ctrl->cfg.deblock_enable) {
+    const lcu_order_element_t * const first = &state->lcu_order[row * width_in_lcu];
+
+    kvz_threadqueue_free_job(&tile->deblock_ver_jobs[row]);
+    kvz_threadqueue_free_job(&tile->deblock_hor_jobs[row]);
+    tile->deblock_ver_jobs[row] =
+      encoder_state_frame_filter_job(state, first, encoder_state_worker_deblock_row_ver,
+                                     KVZ_TRACE_DEBLOCK, true);
+    tile->deblock_hor_jobs[row] =
+      encoder_state_frame_filter_job(state, first, encoder_state_worker_deblock_row_hor,
+                                     KVZ_TRACE_DEBLOCK, true);
+
+    // The top edge of the row is filtered with the row, so the vertical
+    // edges above it must be filtered first.
+    kvz_threadqueue_job_dep_add(tile->deblock_hor_jobs[row], tile->deblock_ver_jobs[row]);
+    if (row > 0) {
+      kvz_threadqueue_job_dep_add(tile->deblock_hor_jobs[row], tile->deblock_ver_jobs[row - 1]);
+    }
+    kvz_threadqueue_submit(ctrl->threadqueue, tile->deblock_ver_jobs[row]);
+    kvz_threadqueue_submit(ctrl->threadqueue, tile->deblock_hor_jobs[row]);
+  }
+
+  if (row == 0) return;
+
+  for (int i = (row - 1) * width_in_lcu; i < row * width_in_lcu; i++) {
+    const lcu_order_element_t * const lcu = &state->lcu_order[i];
+    threadqueue_job_t **filter_job = &tile->wf_filter_jobs[lcu->id];
+
+    kvz_threadqueue_free_job(filter_job);
+    filter_job[0] = encoder_state_frame_filter_job(state, lcu, encoder_state_worker_filter_lcu,
+                                                   KVZ_TRACE_SAO, false);
+    if (ctrl->cfg.deblock_enable) {
+      kvz_threadqueue_job_dep_add(filter_job[0], tile->deblock_hor_jobs[row - 1]);
+      if (!last) {
+        kvz_threadqueue_job_dep_add(filter_job[0], tile->deblock_hor_jobs[row]);
+      }
+    }
+    // SAO uses the pixels of the LCUs to the left and above before they
+    // are filtered, so the same dependencies are needed as with WPP.
+    if (lcu->left) {
+      kvz_threadqueue_job_dep_add(filter_job[0], filter_job[-1]);
+    }
+    if (lcu->above) {
+      const int above_offset = lcu->above->right ? width_in_lcu - 1 : width_in_lcu;
+      kvz_threadqueue_job_dep_add(filter_job[0], filter_job[-above_offset]);
+    }
+    kvz_threadqueue_submit(ctrl->threadqueue, filter_job[0]);
+  }
+}
+
+/**
+ * \brief Encode a frame with frame_filter.
+ *
+ * The LCUs are searched in order in the current thread. The LCU rows are
+ * deblocked in parallel jobs, first the vertical edges and then the
+ * horizontal ones, and SAO follows in a wavefront of LCU jobs.
+ *
+ * The SAO parameters of an LCU are coded before its coding tree, so the
+ * LCUs are coded in jobs only after the whole frame is searched. The
+ * search uses the contexts of a CABAC that only counts the bins of the
+ * coding trees. The SAO syntax uses contexts of its own, so only the state
+ * of the arithmetic coder differs from coding each LCU after its search.
+ */
+static void encoder_state_encode_leaf_frame_filter(encoder_state_t * const state)
+{
+  const encoder_control_t * const ctrl = state->encoder_control;
+  encoder_state_config_tile_t * const tile = state->tile;
+
+  // The search of this thread needs the previous frame to be filtered.
+  if (state->previous_encoder_state != state &&
+      state->previous_encoder_state->tqj_recon_done)
+  {
+    kvz_threadqueue_waitfor(ctrl->threadqueue, state->previous_encoder_state->tqj_recon_done);
+  }
+
+  const cabac_data_t cabac = state->cabac;
+  const int8_t last_qp = state->last_qp;
+  state->sao_cabac = cabac;
+  state->cabac.only_count = 1;
+
+  for (int i = 0; i < state->lcu_order_count; ++i) {
+    const lcu_order_element_t * const lcu = &state->lcu_order[i];
+
+    kvz_get_lcu_stats(state, lcu->position.x, lcu->position.y)->deblock_time = 0;
+    state->coeff = &state->lcu_coeffs[i];
+    encoder_state_worker_search_lcu((void*)lcu);
+    kvz_encode_coding_tree(state, lcu->position_px.x, lcu->position_px.y, 0);
+    // end_of_slice_segment_flag
+    kvz_cabac_encode_bin_trm(&state->cabac, 0);
+
+    if (lcu->last_column) {
+      encoder_state_add_frame_filter_jobs(state, lcu->position.y);
+    }
+  }
+  encoder_state_add_frame_filter_jobs(state, tile->frame->height_in_lcu);
+
+  state->cabac = cabac;
+  state->last_qp = last_qp;
+
+  for (int i = 0; i < state->lcu_order_count; ++i) {
+    const lcu_order_element_t * const lcu = &state->lcu_order[i];
+    threadqueue_job_t **job = &tile->wf_jobs[lcu->id];
+
+    kvz_threadqueue_free_job(job);
+    job[0] = encoder_state_frame_filter_job(state, lcu, encoder_state_worker_code_lcu,
+                                            KVZ_TRACE_CABAC, false);
+    kvz_threadqueue_job_dep_add(job[0], tile->wf_filter_jobs[lcu->id]);
+    if (i > 0) {
+      kvz_threadqueue_job_dep_add(job[0], job[-1]);
+    }
+    kvz_threadqueue_submit(ctrl->threadqueue, job[0]);
+  }
+
+  // The last LCU is coded after all others are filtered and coded.
+  assert(!state->tqj_recon_done);
+  state->tqj_recon_done =
+    kvz_threadqueue_copy_ref(tile->wf_jobs[state->lcu_order[state->lcu_order_count - 1].id]);
 }
 
 static void encoder_state_encode_leaf(encoder_state_t * const state)
@@ -738,7 +1064,9 @@ static void encoder_state_encode_leaf(encoder_state_t * const state)
   // wavefront jobs for other threads to handle.
   bool wavefront = state->type == ENCODER_STATE_TYPE_WAVEFRONT_ROW;
   bool use_parallel_encoding = (wavefront && state->parent->children[1].encoder_control);
-  if (!use_parallel_encoding) {
+  if (ctrl->frame_filter) {
+    encoder_state_encode_leaf_frame_filter(state);
+  } else if (!use_parallel_encoding) {
     // Encode every LCU in order and perform SAO reconstruction after every
     // frame is encoded. Deblocking and SAO search is done during LCU encoding.
 
@@ -775,15 +1103,47 @@ static void encoder_state_encode_leaf(encoder_state_t * const state)
       ref_state = state->previous_encoder_state;
     }
 
+    // Each LCU is searched, filtered and coded in separate jobs. The search
+    // of an LCU needs the CABAC contexts after coding the previous LCU,
+    // which in turn needs its SAO parameters, so the jobs of a row run one
+    // after another. The next row only waits for the search of the LCU
+    // above right, so that its search may run alongside the filtering and
+    // coding of the row above.
+    const int width_in_lcu = state->tile->frame->width_in_lcu;
+
     for (int i = 0; i < state->lcu_order_count; ++i) {
       const lcu_order_element_t * const lcu = &state->lcu_order[i];
 
+      kvz_threadqueue_free_job(&state->tile->wf_search_jobs[lcu->id]);
+      kvz_threadqueue_free_job(&state->tile->wf_filter_jobs[lcu->id]);
       kvz_threadqueue_free_job(&state->tile->wf_jobs[lcu->id]);
-      state->tile->wf_jobs[lcu->id] = kvz_threadqueue_job_create(encoder_state_worker_encode_lcu, (void*)lcu);
+      state->tile->wf_search_jobs[lcu->id] = kvz_threadqueue_job_create(ctrl->threadqueue,
+                                                                        encoder_state_worker_search_lcu,
+                                                                        (void*)lcu);
+      state->tile->wf_filter_jobs[lcu->id] = kvz_threadqueue_job_create(ctrl->threadqueue,
+                                                                        encoder_state_worker_filter_lcu,
+                                                                        (void*)lcu);
+      state->tile->wf_jobs[lcu->id] = kvz_threadqueue_job_create(ctrl->threadqueue,
+                                                                 encoder_state_worker_code_lcu,
+                                                                 (void*)lcu);
+      threadqueue_job_t **search_job = &state->tile->wf_search_jobs[lcu->id];
+      threadqueue_job_t **filter_job = &state->tile->wf_filter_jobs[lcu->id];
       threadqueue_job_t **job = &state->tile->wf_jobs[lcu->id];
 
-      // If job object was returned, add dependancies and allow it to run.
-      if (job[0]) {
+      // If job objects were returned, add dependancies and allow them to run.
+      if (search_job[0] && filter_job[0] && job[0]) {
+        const int64_t priority = encoder_state_job_priority(state, lcu);
+        threadqueue_job_t *lcu_jobs[3] = { search_job[0], filter_job[0], job[0] };
+        for (int j = 0; j < 3; j++) {
+          kvz_threadqueue_job_set_priority(lcu_jobs[j], priority);
+          // Keep the LCUs of a frame on the same NUMA node.
+          kvz_threadqueue_job_set_node(lcu_jobs[j], state->frame->num);
+          kvz_threadqueue_job_set_trace(lcu_jobs[j], KVZ_TRACE_LCU, state->frame->poc,
+                                        lcu->position.x, lcu->position.y);
+        }
+        kvz_threadqueue_job_set_queue_time(search_job[0],
+                                           &kvz_get_lcu_stats(state, lcu->position.x, lcu->position.y)->queue_time);
+
         // Add inter frame dependancies when ecoding more than one frame at
         // once. The added dependancy is for the first LCU of each wavefront
         // row to depend on the reconstruction status of the row below in the
@@ -801,7 +1161,7 @@ static void encoder_state_encode_leaf(encoder_state_t * const state)
           for (int i = 0; dep_lcu->right && i < ctrl->max_inter_ref_lcu.right; i++) {
             dep_lcu = dep_lcu->right;
           }
-          kvz_threadqueue_job_dep_add(job[0], ref_state->tile->wf_jobs[dep_lcu->id]);
+          kvz_threadqueue_job_dep_add(search_job[0], ref_state->tile->wf_jobs[dep_lcu->id]);
 
           // Very spesific bug that happens when owf length is longer than the
           // gop length. Takes care of that.
@@ -815,23 +1175,34 @@ static void encoder_state_encode_leaf(encoder_state_t * const state)
             while (ref_state->frame->poc != state->frame->poc - state->encoder_control->cfg.gop_len){
               ref_state = ref_state->previous_encoder_state;
             }
-            kvz_threadqueue_job_dep_add(job[0], ref_state->tile->wf_jobs[dep_lcu->id]);
+            kvz_threadqueue_job_dep_add(search_job[0], ref_state->tile->wf_jobs[dep_lcu->id]);
           }
         }
 
         // Add local WPP dependancy to the LCU on the left.
         if (lcu->left) {
-          kvz_threadqueue_job_dep_add(job[0], job[-1]);
+          kvz_threadqueue_job_dep_add(search_job[0], job[-1]);
         }
         // Add local WPP dependancy to the LCU on the top right.
         if (lcu->above) {
-          if (lcu->above->right) {
-            kvz_threadqueue_job_dep_add(job[0], job[-state->tile->frame->width_in_lcu + 1]);
+          const int above_offset = lcu->above->right ? width_in_lcu - 1 : width_in_lcu;
+          if (lcu->left) {
+            kvz_threadqueue_job_dep_add(search_job[0], search_job[-above_offset]);
           } else {
-            kvz_threadqueue_job_dep_add(job[0], job[-state->tile->frame->width_in_lcu]);
+            // The CABAC contexts of the row are copied when the second LCU
+            // of the row above is coded.
+            kvz_threadqueue_job_dep_add(search_job[0], job[-above_offset]);
           }
+          // Deblocking the top edge needs the vertical edges above it to be
+          // filtered, and SAO needs the parameters and pixels of the LCUs
+          // above.
+          kvz_threadqueue_job_dep_add(filter_job[0], filter_job[-above_offset]);
         }
+        kvz_threadqueue_job_dep_add(filter_job[0], search_job[0]);
+        kvz_threadqueue_job_dep_add(job[0], filter_job[0]);
 
+        kvz_threadqueue_submit(state->encoder_control->threadqueue, search_job[0]);
+        kvz_threadqueue_submit(state->encoder_control->threadqueue, filter_job[0]);
         kvz_threadqueue_submit(state->encoder_control->threadqueue, state->tile->wf_jobs[lcu->id]);
 
         // The wavefront row is done when the last LCU in the row is done.
@@ -931,7 +1302,15 @@ static void encoder_state_encode(encoder_state_t * const main_state) {
         if (main_state->children[i].type != ENCODER_STATE_TYPE_WAVEFRONT_ROW) {
           kvz_threadqueue_free_job(&main_state->children[i].tqj_recon_done);
           main_state->children[i].tqj_recon_done =
-            kvz_threadqueue_job_create(encoder_state_worker_encode_children, &main_state->children[i]);
+            kvz_threadqueue_job_create(main_state->encoder_control->threadqueue,
+                                       encoder_state_worker_encode_children,
+                                       &main_state->children[i]);
+          kvz_threadqueue_job_set_priority(main_state->children[i].tqj_recon_done,
+                                           encoder_state_job_priority(&main_state->children[i], NULL));
+          kvz_threadqueue_job_set_trace(main_state->children[i].tqj_recon_done,
+                                        KVZ_TRACE_CHILDREN,
+                                        main_state->children[i].frame->poc,
+                                        -1, -1);
           if (main_state->children[i].previous_encoder_state != &main_state->children[i] &&
               main_state->children[i].previous_encoder_state->tqj_recon_done &&
               !main_state->children[i].frame->is_irap)
@@ -1150,8 +1529,27 @@ static void encoder_set_source_picture(encoder_state_t * const state, kvz_pictur
   kvz_videoframe_set_poc(state->tile->frame, state->frame->poc);
 }
 
+/**
+ * \brief Build the downscaled levels of the source picture for the
+ * pyramid motion search.
+ */
+static void encoder_build_pyramid(encoder_state_t * const state, const kvz_picture *frame)
+{
+  const kvz_picture *src = frame;
+  for (int i = 0; i < ME_PYRAMID_LEVELS; i++) {
+    assert(!state->frame->pyramid[i]);
+    state->frame->pyramid[i] = kvz_image_downscale(src);
+    if (!state->frame->pyramid[i]) {
+      fprintf(stderr, "Failed to allocate the motion search pyramid!\n");
+      break;
+    }
+    src = state->frame->pyramid[i];
+  }
+}
+
 static void encoder_state_init_children(encoder_state_t * const state) {
   kvz_bitstream_clear(&state->stream);
+  kvz_bitstream_clear(&state->slice_header);
 
   if (state->is_leaf) {
     //Leaf states have cabac and context
@@ -1184,6 +1582,41 @@ static void normalize_lcu_weights(encoder_state_t * const state)
   }
 }
 
+/**
+ * \brief Set the QP offsets of the LCUs from the variance of their luma.
+ *
+ * The QP of an LCU is raised by one for each doubling of its variance
+ * over the geometric mean of the variances of all LCUs of the frame, so
+ * flat LCUs get a lower QP and textured LCUs a higher one while the
+ * average QP of the frame stays about the same.
+ */
+static void init_aq_offsets(encoder_state_t * const state, const kvz_picture *frame)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const int num_lcus = encoder->in.width_in_lcu * encoder->in.height_in_lcu;
+
+  double sum = 0;
+  for (int y = 0; y < encoder->in.height_in_lcu; y++) {
+    for (int x = 0; x < encoder->in.width_in_lcu; x++) {
+      const int width  = MIN(LCU_WIDTH, frame->width  - x * LCU_WIDTH);
+      const int height = MIN(LCU_WIDTH, frame->height - y * LCU_WIDTH);
+      const kvz_pixel *data = &frame->y[y * LCU_WIDTH * frame->stride + x * LCU_WIDTH];
+
+      const double variance = kvz_pixel_var(data, width, height, frame->stride) /
+                              (double)(width * height);
+      lcu_stats_t *lcu = &state->frame->lcu_stats[x + y * encoder->in.width_in_lcu];
+      lcu->log_variance = log2(MAX(1.0, variance));
+      sum += lcu->log_variance;
+    }
+  }
+
+  const double mean = sum / num_lcus;
+  for (int i = 0; i < num_lcus; i++) {
+    lcu_stats_t *lcu = &state->frame->lcu_stats[i];
+    lcu->aq_dqp = CLIP(-51, 51, (int)lround(lcu->log_variance - mean));
+  }
+}
+
 static void encoder_state_init_new_frame(encoder_state_t * const state, kvz_picture* frame) {
   assert(state->type == ENCODER_STATE_TYPE_MAIN);
 
@@ -1191,6 +1624,12 @@ static void encoder_state_init_new_frame(encoder_state_t * const state, kvz_pict
 
   encoder_set_source_picture(state, frame);
 
+  kvz_picture_hash_init(&state->frame->hash);
+
+  if (cfg->ime_algorithm == KVZ_IME_PYRAMID) {
+    encoder_build_pyramid(state, frame);
+  }
+
   assert(!state->tile->frame->cu_array);
   state->tile->frame->cu_array = kvz_cu_array_alloc(
       state->tile->frame->width,
@@ -1202,12 +1641,19 @@ static void encoder_state_init_new_frame(encoder_state_t * const state, kvz_pict
   // setting it based on the intra period
   bool is_closed_normal_gop = false;
 
+  // The sequence starts over at scene cuts, so the POC and the intra period
+  // are counted from the last cut.
+  if (state->frame->is_scenecut) {
+    state->frame->cut_num = state->frame->num;
+  }
+  const int32_t num = state->frame->num - state->frame->cut_num;
+
   // Set POC.
-  if (state->frame->num == 0) {
+  if (num == 0) {
     state->frame->poc = 0;
   } else if (cfg->gop_len && !cfg->gop_lowdelay) {
 
-    int32_t framenum = state->frame->num - 1;
+    int32_t framenum = num - 1;
     // Handle closed GOP
     // Closed GOP structure has an extra IDR between the GOPs
     if (cfg->intra_period > 0 && !cfg->open_gop) {
@@ -1231,13 +1677,13 @@ static void encoder_state_init_new_frame(encoder_state_t * const state, kvz_pict
     
     kvz_videoframe_set_poc(state->tile->frame, state->frame->poc);
   } else if (cfg->intra_period > 0) {
-    state->frame->poc = state->frame->num % cfg->intra_period;
+    state->frame->poc = num % cfg->intra_period;
   } else {
-    state->frame->poc = state->frame->num;
+    state->frame->poc = num;
   }
 
   // Check whether the frame is a keyframe or not.
-  if (state->frame->num == 0 || state->frame->poc == 0) {
+  if (num == 0 || state->frame->poc == 0) {
     state->frame->is_irap = true;
   } else if(!is_closed_normal_gop) { // In closed-GOP IDR frames are poc==0 so skip this check
     state->frame->is_irap =
@@ -1250,7 +1696,7 @@ static void encoder_state_init_new_frame(encoder_state_t * const state, kvz_pict
 
   // Set pictype.
   if (state->frame->is_irap) {
-    if (state->frame->num == 0 ||
+    if (num == 0 ||
         cfg->intra_period == 1 ||
         cfg->gop_len == 0 ||
         cfg->gop_lowdelay ||
@@ -1278,9 +1724,25 @@ static void encoder_state_init_new_frame(encoder_state_t * const state, kvz_pict
     state->frame->slicetype = KVZ_SLICE_P;
   }
 
+  // Interpolate the fractional pixel planes of pictures that will be
+  // used as references.
+  if (cfg->subpel_planes &&
+      cfg->intra_period != 1 &&
+      (!cfg->gop_len || !state->frame->poc || cfg->gop[state->frame->gop_offset].is_ref))
+  {
+    assert(!state->frame->subpel_planes);
+    state->frame->subpel_planes = kvz_subpel_planes_alloc(frame->width, frame->height);
+    if (!state->frame->subpel_planes) {
+      fprintf(stderr, "Failed to allocate the fractional pixel planes!\n");
+    }
+  }
+
   if (cfg->target_bitrate > 0 && state->frame->num > cfg->owf) {
     normalize_lcu_weights(state);
   }
+  if (cfg->aq_mode == KVZ_AQ_VARIANCE) {
+    init_aq_offsets(state, frame);
+  }
   kvz_set_picture_lambda_and_qp(state);
 
   encoder_state_init_children(state);
@@ -1300,13 +1762,52 @@ static void _encode_one_frame_add_bitstream_deps(const encoder_state_t * const s
 }
 
 
+static void encoder_state_worker_interpolate_subpel(void *opaque)
+{
+  encoder_state_t *state = opaque;
+  const int row = KVZ_ATOMIC_INC(&state->frame->subpel_next_row) - 1;
+  kvz_subpel_planes_interpolate_row(state->encoder_control,
+                                    state->frame->subpel_planes,
+                                    state->tile->frame->rec,
+                                    row);
+}
+
+/**
+ * \brief Add jobs interpolating the fractional pixel planes of the frame
+ * once its reconstruction is complete.
+ */
+static void encoder_state_interpolate_subpel(encoder_state_t * const state)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+
+  state->frame->subpel_next_row = 0;
+  for (int i = 0; i < encoder->in.height_in_lcu; i++) {
+    assert(!state->frame->subpel_jobs[i]);
+    threadqueue_job_t *job =
+      kvz_threadqueue_job_create(encoder->threadqueue,
+                                 encoder_state_worker_interpolate_subpel,
+                                 state);
+    // Run before the LCUs of later frames, which use the planes.
+    kvz_threadqueue_job_set_priority(job, encoder_state_job_priority(state, NULL));
+    kvz_threadqueue_job_set_trace(job, KVZ_TRACE_SUBPEL, state->frame->poc, -1, i);
+    _encode_one_frame_add_bitstream_deps(state, job);
+    kvz_threadqueue_submit(encoder->threadqueue, job);
+    state->frame->subpel_jobs[i] = job;
+  }
+}
+
 void kvz_encode_one_frame(encoder_state_t * const state, kvz_picture* frame)
 {
+  const int64_t start_time = kvz_time_ns();
   encoder_state_init_new_frame(state, frame);
+  state->frame->start_time = start_time;
   encoder_state_encode(state);
 
   threadqueue_job_t *job =
-    kvz_threadqueue_job_create(kvz_encoder_state_worker_write_bitstream, state);
+    kvz_threadqueue_job_create(state->encoder_control->threadqueue,
+                               kvz_encoder_state_worker_write_bitstream,
+                               state);
+  kvz_threadqueue_job_set_trace(job, KVZ_TRACE_BITSTREAM, state->frame->poc, -1, -1);
 
   _encode_one_frame_add_bitstream_deps(state, job);
   if (state->previous_encoder_state != state && state->previous_encoder_state->tqj_bitstream_written) {
@@ -1317,6 +1818,10 @@ void kvz_encode_one_frame(encoder_state_t * const state, kvz_picture* frame)
   assert(!state->tqj_bitstream_written);
   state->tqj_bitstream_written = job;
 
+  if (state->frame->subpel_planes) {
+    encoder_state_interpolate_subpel(state);
+  }
+
   state->frame->done = 0;
 }
 
@@ -1341,6 +1846,7 @@ void kvz_encoder_prepare(encoder_state_t *state)
     state->frame->num = 0;
     state->frame->poc = 0;
     state->frame->irap_poc = 0;
+    state->frame->cut_num = 0;
     assert(!state->tile->frame->source);
     assert(!state->tile->frame->rec);
     assert(!state->tile->frame->cu_array);
@@ -1373,7 +1879,9 @@ void kvz_encoder_prepare(encoder_state_t *state)
                    prev_state->tile->frame->rec,
                    prev_state->tile->frame->cu_array,
                    prev_state->frame->poc,
-                   prev_state->frame->ref_LX);
+                   prev_state->frame->ref_LX,
+                   prev_state->frame->pyramid,
+                   prev_state->frame->subpel_planes);
     kvz_cu_array_free(&state->tile->frame->cu_array);
     unsigned height = state->tile->frame->height_in_lcu * LCU_WIDTH;
     unsigned width  = state->tile->frame->width_in_lcu  * LCU_WIDTH;
@@ -1384,6 +1892,22 @@ void kvz_encoder_prepare(encoder_state_t *state)
   kvz_image_free(state->tile->frame->source);
   state->tile->frame->source = NULL;
 
+  for (int i = 0; i < ME_PYRAMID_LEVELS; i++) {
+    kvz_image_free(state->frame->pyramid[i]);
+    state->frame->pyramid[i] = NULL;
+  }
+
+  if (state->frame->subpel_jobs) {
+    // The jobs use the reconstructed picture of this state.
+    for (int i = 0; i < encoder->in.height_in_lcu; i++) {
+      if (state->frame->subpel_jobs[i]) {
+        kvz_threadqueue_waitfor(encoder->threadqueue, state->frame->subpel_jobs[i]);
+        kvz_threadqueue_free_job(&state->frame->subpel_jobs[i]);
+      }
+    }
+  }
+  kvz_subpel_planes_free(&state->frame->subpel_planes);
+
   kvz_image_free(state->tile->frame->rec);
   state->tile->frame->rec = NULL;
 
@@ -1393,6 +1917,7 @@ void kvz_encoder_prepare(encoder_state_t *state)
   state->frame->num = prev_state->frame->num + 1;
   state->frame->poc = prev_state->frame->poc + 1;
   state->frame->irap_poc = prev_state->frame->irap_poc;
+  state->frame->cut_num = prev_state->frame->cut_num;
 
   state->frame->prepared = 1;
 }
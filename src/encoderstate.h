@@ -34,6 +34,8 @@
 #include "image.h"
 #include "imagelist.h"
 #include "kvazaar.h"
+#include "nal.h"
+#include "subpel.h"
 #include "tables.h"
 #include "threadqueue.h"
 #include "videoframe.h"
@@ -64,6 +66,29 @@ typedef struct lcu_stats_t {
 
   //! \brief Rate control beta parameter
   double rc_beta;
+
+  //! \brief Number of bits spent on SAO parameters
+  uint32_t sao_bits;
+
+  //! \brief QP offset from the temporal propagation of the lookahead
+  int8_t cutree_dqp;
+
+  //! \brief Base-2 logarithm of the variance of the luma of the LCU
+  double log_variance;
+
+  //! \brief QP offset from the variance of the luma of the LCU
+  int8_t aq_dqp;
+
+  //! \brief Nanoseconds spent in each stage of encoding the LCU
+  int64_t search_time;
+  int64_t recon_time;
+  int64_t deblock_time;
+  int64_t sao_time;
+  int64_t cabac_time;
+
+  //! \brief Nanoseconds the search job of the LCU waited in a queue for a
+  //! free thread
+  int64_t queue_time;
 } lcu_stats_t;
 
 
@@ -82,6 +107,9 @@ typedef struct encoder_state_config_frame_t {
   int32_t poc;       /*!< \brief Picture order count */
   int8_t gop_offset; /*!< \brief Offset in the gop structure */
   int32_t irap_poc;  /*!< \brief POC of the associated IRAP picture */
+  int64_t input_num; /*!< \brief Number of the picture in input order */
+  bool is_scenecut;  /*!< \brief Whether the frame starts a new sequence at a scene cut */
+  int32_t cut_num;   /*!< \brief Frame number of the last scene cut */
 
   /**
    * \brief Frame-level quantization parameter
@@ -94,6 +122,26 @@ typedef struct encoder_state_config_frame_t {
 
   //! Current pictures available for references
   image_list_t *ref;
+
+  /**
+   * \brief Downscaled luma of the source picture.
+   *
+   * Level i is downscaled by 2^(i+1). Only built for --me=pyramid.
+   */
+  kvz_picture *pyramid[ME_PYRAMID_LEVELS];
+
+  /**
+   * \brief Fractional pixel planes of the reconstructed picture.
+   *
+   * Only allocated for reference pictures with --subpel-planes.
+   */
+  subpel_planes_t *subpel_planes;
+
+  //! Jobs interpolating subpel_planes, one for each LCU row
+  threadqueue_job_t **subpel_jobs;
+
+  //! Index of the next LCU row of subpel_planes to interpolate
+  int32_t subpel_next_row;
   int8_t ref_list;
 
   //! L0 and L1 reference index list
@@ -146,6 +194,32 @@ typedef struct encoder_state_config_frame_t {
    */
   bool first_nal;
 
+  /**
+   * \brief Time when encoding the frame was started, in nanoseconds.
+   */
+  int64_t start_time;
+
+  /**
+   * \brief Time when the bitstream of the frame was written, in
+   * nanoseconds.
+   */
+  int64_t end_time;
+
+  /**
+   * \brief Nanoseconds spent writing the headers of the frame and joining
+   * the coded LCUs into NAL units.
+   */
+  int64_t bitstream_time;
+
+  /**
+   * \brief Decoded picture hash of the reconstructed frame.
+   *
+   * Without tiles, the rows are hashed in the LCU jobs as soon as they
+   * are final, so that only the bottom of the frame is left for the
+   * bitstream job.
+   */
+  picture_hash_t hash;
+
 } encoder_state_config_frame_t;
 
 typedef struct encoder_state_config_tile_t {
@@ -184,9 +258,23 @@ typedef struct encoder_state_config_tile_t {
   // x-coordinate.
   yuv_t *ver_buf_before_sao;
 
-  //Jobs for each individual LCU of a wavefront row.
+  //Jobs searching each individual LCU of a wavefront row.
+  threadqueue_job_t **wf_search_jobs;
+
+  //Jobs deblocking and applying SAO to each individual LCU of a wavefront
+  //row. With frame_filter, the jobs only apply SAO.
+  threadqueue_job_t **wf_filter_jobs;
+
+  //Jobs coding each individual LCU of a wavefront row with CABAC. The LCU
+  //is done when its job is done.
   threadqueue_job_t **wf_jobs;
 
+  //Jobs deblocking the vertical edges of each LCU row with frame_filter.
+  threadqueue_job_t **deblock_ver_jobs;
+
+  //Jobs deblocking the horizontal edges of each LCU row with frame_filter.
+  threadqueue_job_t **deblock_hor_jobs;
+
 } encoder_state_config_tile_t;
 
 typedef struct encoder_state_config_slice_t {
@@ -249,6 +337,22 @@ typedef struct encoder_state_t {
   bitstream_t stream;
   cabac_data_t cabac;
 
+  /**
+   * \brief CABAC whose contexts the SAO search uses with frame_filter.
+   *
+   * The LCUs are coded while the SAO search is still running, so the SAO
+   * search uses the contexts from the start of the leaf.
+   */
+  cabac_data_t sao_cabac;
+
+  /**
+   * \brief Header of the dependent slice segment starting at a leaf state.
+   *
+   * Written when the last LCU of the leaf is done. Empty if no dependent
+   * slice segment starts at the leaf.
+   */
+  bitstream_t slice_header;
+
   // Crypto stuff
   crypto_handle_t *crypto_hdl;
   uint32_t crypto_prev_pos;
@@ -282,9 +386,25 @@ typedef struct encoder_state_t {
 
   /**
    * \brief Coeffs for the LCU.
+   *
+   * Written by the search of an LCU and read when it is coded. With
+   * frame_filter, points to the coeffs of the LCU in lcu_coeffs.
    */
   lcu_coeff_t *coeff;
 
+  /**
+   * \brief Coeffs for every LCU of the leaf with frame_filter, NULL
+   * otherwise.
+   *
+   * The LCUs are coded only after the whole frame has been searched.
+   */
+  lcu_coeff_t *lcu_coeffs;
+
+  /**
+   * \brief Motion search results of the LCU, or NULL if not in use.
+   */
+  struct motion_cache_t *motion_cache;
+
   //Jobs to wait for
   threadqueue_job_t * tqj_recon_done; //Reconstruction is done
   threadqueue_job_t * tqj_bitstream_written; //Bitstream is written
@@ -25,6 +25,7 @@
 #include "cu.h"
 #include "encoder.h"
 #include "kvazaar.h"
+#include "strategies/strategies-filter.h"
 #include "transform.h"
 #include "videoframe.h"
 
@@ -74,126 +75,21 @@ const int8_t kvz_g_chroma_filter[8][4] =
 //////////////////////////////////////////////////////////////////////////
 // FUNCTIONS
 
-/**
- * \brief Perform in strong luma filtering in place.
- * \param line  line of 8 pixels, with center at index 4
- * \param tc  tc treshold
- * \return  Reach of the filter starting from center.
- */
-static INLINE int kvz_filter_deblock_luma_strong(
-    kvz_pixel *line,
-    int32_t tc)
-{
-  const kvz_pixel m0 = line[0];
-  const kvz_pixel m1 = line[1];
-  const kvz_pixel m2 = line[2];
-  const kvz_pixel m3 = line[3];
-  const kvz_pixel m4 = line[4];
-  const kvz_pixel m5 = line[5];
-  const kvz_pixel m6 = line[6];
-  const kvz_pixel m7 = line[7];
-
-  line[1] = CLIP(m1 - 2*tc, m1 + 2*tc, (2*m0 + 3*m1 +   m2 +   m3 +   m4 + 4) >> 3);
-  line[2] = CLIP(m2 - 2*tc, m2 + 2*tc, (  m1 +   m2 +   m3 +   m4        + 2) >> 2);
-  line[3] = CLIP(m3 - 2*tc, m3 + 2*tc, (  m1 + 2*m2 + 2*m3 + 2*m4 +   m5 + 4) >> 3);
-  line[4] = CLIP(m4 - 2*tc, m4 + 2*tc, (  m2 + 2*m3 + 2*m4 + 2*m5 +   m6 + 4) >> 3);
-  line[5] = CLIP(m5 - 2*tc, m5 + 2*tc, (  m3 +   m4 +   m5 +   m6        + 2) >> 2);
-  line[6] = CLIP(m6 - 2*tc, m6 + 2*tc, (  m3 +   m4 +   m5 + 3*m6 + 2*m7 + 4) >> 3);
-
-  return 3;
-}
-
-/**
- * \brief Perform in weak luma filtering in place.
- * \param encoder  Encoder
- * \param line  Line of 8 pixels, with center at index 4
- * \param tc  The tc treshold
- * \param p_2nd  Whether to filter the 2nd line of P
- * \param q_2nd  Whether to filter the 2nd line of Q
- */
-static INLINE int kvz_filter_deblock_luma_weak(
-    const encoder_control_t * const encoder,
-    kvz_pixel *line,
-    int32_t tc,
-    bool p_2nd,
-    bool q_2nd)
-{
-  const kvz_pixel m1 = line[1];
-  const kvz_pixel m2 = line[2];
-  const kvz_pixel m3 = line[3];
-  const kvz_pixel m4 = line[4];
-  const kvz_pixel m5 = line[5];
-  const kvz_pixel m6 = line[6];
-
-  int32_t delta = (9 * (m4 - m3) - 3 * (m5 - m2) + 8) >> 4;
-
-  if (abs(delta) >= tc * 10) {
-    return 0;
-  } else {
-    int32_t tc2 = tc >> 1;
-    delta = CLIP(-tc, tc, delta);
-    line[3] = CLIP(0, (1 << encoder->bitdepth) - 1, (m3 + delta));
-    line[4] = CLIP(0, (1 << encoder->bitdepth) - 1, (m4 - delta));
-
-    if (p_2nd) {
-      int32_t delta1 = CLIP(-tc2, tc2, (((m1 + m3 + 1) >> 1) - m2 + delta) >> 1);
-      line[2] = CLIP(0, (1 << encoder->bitdepth) - 1, m2 + delta1);
-    }
-    if (q_2nd) {
-      int32_t delta2 = CLIP(-tc2, tc2, (((m6 + m4 + 1) >> 1) - m5 - delta) >> 1);
-      line[5] = CLIP(0, (1 << encoder->bitdepth) - 1, m5 + delta2);
-    }
-    
-    if (p_2nd || q_2nd) {
-      return 2;
-    } else {
-      return 1;
-    }
-  }
-}
-
-/**
- * \brief
- */
-static INLINE void kvz_filter_deblock_chroma(const encoder_control_t * const encoder,
-                                             kvz_pixel *src,
-                                             int32_t offset,
-                                             int32_t tc,
-                                             int8_t part_P_nofilter,
-                                             int8_t part_Q_nofilter)
-{
-  int32_t delta;
-  int16_t m2 = src[-offset * 2];
-  int16_t m3 = src[-offset];
-  int16_t m4 = src[0];
-  int16_t m5 = src[offset];
-
-  delta = CLIP(-tc,tc, (((m4 - m3) * 4) + m2 - m5 + 4 ) >> 3);
-  if(!part_P_nofilter) {
-    src[-offset] = CLIP(0, (1 << encoder->bitdepth) - 1, m3 + delta);
-  }
-  if(!part_Q_nofilter) {
-    src[0] = CLIP(0, (1 << encoder->bitdepth) - 1, m4 - delta);
-  }
-}
-
-
 /**
  * \brief Check whether an edge is a TU boundary.
  *
- * \param state   encoder state
- * \param x       x-coordinate of the scu in pixels
- * \param y       y-coordinate of the scu in pixels
+ * \param lcu     LCU containing the scu
+ * \param x       x-coordinate of the scu in pixels relative to the LCU
+ * \param y       y-coordinate of the scu in pixels relative to the LCU
  * \param dir     direction of the edge to check
  * \return        true, if the edge is a TU boundary, otherwise false
  */
-static bool is_tu_boundary(const encoder_state_t *const state,
+static bool is_tu_boundary(const lcu_t *const lcu,
                            int32_t x,
                            int32_t y,
                            edge_dir dir)
 {
-  const cu_info_t *const scu =
-    kvz_cu_array_at_const(state->tile->frame->cu_array, x, y);
+  const cu_info_t *const scu = LCU_GET_CU_AT_PX(lcu, x, y);
   const int tu_width = LCU_WIDTH >> scu->tr_depth;
 
   if (dir == EDGE_HOR) {
@@ -207,25 +103,23 @@ static bool is_tu_boundary(const encoder_state_t *const state,
 /**
  * \brief Check whether an edge is a PU boundary.
  *
- * \param state   encoder state
- * \param x       x-coordinate of the scu in pixels
- * \param y       y-coordinate of the scu in pixels
+ * \param lcu     LCU containing the scu
+ * \param x       x-coordinate of the scu in pixels relative to the LCU
+ * \param y       y-coordinate of the scu in pixels relative to the LCU
  * \param dir     direction of the edge to check
  * \return        true, if the edge is a TU boundary, otherwise false
  */
-static bool is_pu_boundary(const encoder_state_t *const state,
+static bool is_pu_boundary(const lcu_t *const lcu,
                            int32_t x,
                            int32_t y,
                            edge_dir dir)
 {
-  const cu_info_t *const scu =
-    kvz_cu_array_at_const(state->tile->frame->cu_array, x, y);
+  const cu_info_t *const scu = LCU_GET_CU_AT_PX(lcu, x, y);
   // Get the containing CU.
   const int32_t cu_width = LCU_WIDTH >> scu->depth;
   const int32_t x_cu = x & ~(cu_width - 1);
   const int32_t y_cu = y & ~(cu_width - 1);
-  const cu_info_t *const cu =
-    kvz_cu_array_at_const(state->tile->frame->cu_array, x_cu, y_cu);
+  const cu_info_t *const cu = LCU_GET_CU_AT_PX(lcu, x_cu, y_cu);
 
   const int num_pu = kvz_part_mode_num_parts[cu->part_size];
   for (int i = 0; i < num_pu; i++) {
@@ -260,63 +154,252 @@ static bool is_on_8x8_grid(int x, int y, edge_dir dir)
   }
 }
 
-static int8_t get_qp_y_pred(const encoder_state_t* state, int x, int y, edge_dir dir)
+
+/**
+ * \brief Get the deblocking parameters of the LCU containing a pixel.
+ */
+static INLINE deblock_info_t * get_deblock_info(const videoframe_t *const frame,
+                                                int32_t x,
+                                                int32_t y)
 {
-  if (state->encoder_control->max_qp_delta_depth < 0) {
-    return state->qp;
-  }
+  return &frame->deblock_info[(x >> LOG2_LCU_WIDTH) +
+                              (y >> LOG2_LCU_WIDTH) * frame->width_in_lcu];
+}
 
-  int32_t qp_p;
-  if (dir == EDGE_HOR && y > 0) {
-    qp_p = kvz_cu_array_at_const(state->tile->frame->cu_array, x, y - 1)->qp;
-  } else if (dir == EDGE_VER && x > 0) {
-    qp_p = kvz_cu_array_at_const(state->tile->frame->cu_array, x - 1, y)->qp;
+
+/**
+ * \brief Get the boundary strengths of the segments of an edge.
+ *
+ * \param frame   frame containing the edge
+ * \param x       x-coordinate of the edge in pixels
+ * \param y       y-coordinate of the edge in pixels
+ * \param dir     direction of the edge
+ * \return        boundary strengths of the 4-pixel segments starting from
+ *                (x, y) along the edge
+ */
+static const uint8_t * get_edge_strengths(const videoframe_t *const frame,
+                                          int32_t x,
+                                          int32_t y,
+                                          edge_dir dir)
+{
+  const deblock_info_t *const info = get_deblock_info(frame, x, y);
+  const int32_t x_in_lcu = x & (LCU_WIDTH - 1);
+  const int32_t y_in_lcu = y & (LCU_WIDTH - 1);
+
+  if (dir == EDGE_VER) {
+    return &info->bs[EDGE_VER][x_in_lcu >> 3][y_in_lcu >> 2];
   } else {
-    // TODO: This seems to be dead code. Investigate.
-    qp_p = state->encoder_control->cfg.set_qp_in_cu ? 26 : state->frame->QP;
+    return &info->bs[EDGE_HOR][y_in_lcu >> 3][x_in_lcu >> 2];
   }
+}
 
-  const int32_t qp_q =
-    kvz_cu_array_at_const(state->tile->frame->cu_array, x, y)->qp;
 
-  return (qp_p + qp_q + 1) >> 1;
+/**
+ * \brief Get the boundary strength of an edge between two CUs.
+ *
+ * \param state         encoder state
+ * \param cu_p          CU on the left or top side of the edge
+ * \param cu_q          CU on the right or bottom side of the edge
+ * \param tu_boundary   whether the edge is a TU boundary
+ * \return              boundary strength 0, 1 or 2
+ */
+static uint8_t get_boundary_strength(const encoder_state_t *const state,
+                                     const cu_info_t *const cu_p,
+                                     const cu_info_t *const cu_q,
+                                     bool tu_boundary)
+{
+  bool nonzero_coeffs = cbf_is_set(cu_q->cbf, cu_q->tr_depth, COLOR_Y)
+                     || cbf_is_set(cu_p->cbf, cu_p->tr_depth, COLOR_Y);
+
+  uint8_t strength = 0;
+  if (cu_q->type == CU_INTRA || cu_p->type == CU_INTRA) {
+    strength = 2;
+  } else if (tu_boundary && nonzero_coeffs) {
+    // Non-zero residual/coeffs and transform boundary
+    // Neither CU is intra so tr_depth <= MAX_DEPTH.
+    strength = 1;
+  } else if (cu_p->inter.mv_dir != 3 && cu_q->inter.mv_dir != 3 &&
+           ((abs(cu_q->inter.mv[cu_q->inter.mv_dir - 1][0] - cu_p->inter.mv[cu_p->inter.mv_dir - 1][0]) >= 4) ||
+            (abs(cu_q->inter.mv[cu_q->inter.mv_dir - 1][1] - cu_p->inter.mv[cu_p->inter.mv_dir - 1][1]) >= 4))) {
+    // Absolute motion vector diff between blocks >= 1 (Integer pixel)
+    strength = 1;
+  } else if (cu_p->inter.mv_dir != 3 && cu_q->inter.mv_dir != 3 &&
+             cu_q->inter.mv_ref[cu_q->inter.mv_dir - 1] != cu_p->inter.mv_ref[cu_p->inter.mv_dir - 1]) {
+    strength = 1;
+  }
+
+  // B-slice related checks
+  if(!strength && state->frame->slicetype == KVZ_SLICE_B) {
+
+    // Zero all undefined motion vectors for easier usage.
+    int16_t mv_q[2][2] = { { 0, 0 }, { 0, 0 } };
+    int16_t mv_p[2][2] = { { 0, 0 }, { 0, 0 } };
+    for (int list = 0; list < 2; ++list) {
+      if (cu_q->inter.mv_dir & (1 << list)) {
+        mv_q[list][0] = cu_q->inter.mv[list][0];
+        mv_q[list][1] = cu_q->inter.mv[list][1];
+      }
+      if (cu_p->inter.mv_dir & (1 << list)) {
+        mv_p[list][0] = cu_p->inter.mv[list][0];
+        mv_p[list][1] = cu_p->inter.mv[list][1];
+      }
+    }
+    const int refP0 = (cu_p->inter.mv_dir & 1) ? state->frame->ref_LX[0][cu_p->inter.mv_ref[0]] : -1;
+    const int refP1 = (cu_p->inter.mv_dir & 2) ? state->frame->ref_LX[1][cu_p->inter.mv_ref[1]] : -1;
+    const int refQ0 = (cu_q->inter.mv_dir & 1) ? state->frame->ref_LX[0][cu_q->inter.mv_ref[0]] : -1;
+    const int refQ1 = (cu_q->inter.mv_dir & 2) ? state->frame->ref_LX[1][cu_q->inter.mv_ref[1]] : -1;
+    const int16_t* mvQ0 = mv_q[0];
+    const int16_t* mvQ1 = mv_q[1];
+
+    const int16_t* mvP0 = mv_p[0];
+    const int16_t* mvP1 = mv_p[1];
+
+    if(( refP0 == refQ0 &&  refP1 == refQ1 ) || ( refP0 == refQ1 && refP1==refQ0 ))
+    {
+      // Different L0 & L1
+      if ( refP0 != refP1 ) {
+        if ( refP0 == refQ0 ) {
+          strength  = ((abs(mvQ0[0] - mvP0[0]) >= 4) ||
+                       (abs(mvQ0[1] - mvP0[1]) >= 4) ||
+                       (abs(mvQ1[0] - mvP1[0]) >= 4) ||
+                       (abs(mvQ1[1] - mvP1[1]) >= 4)) ? 1 : 0;
+        } else {
+          strength  = ((abs(mvQ1[0] - mvP0[0]) >= 4) ||
+                       (abs(mvQ1[1] - mvP0[1]) >= 4) ||
+                       (abs(mvQ0[0] - mvP1[0]) >= 4) ||
+                       (abs(mvQ0[1] - mvP1[1]) >= 4)) ? 1 : 0;
+        }
+      // Same L0 & L1
+      } else {
+        strength  = ((abs(mvQ0[0] - mvP0[0]) >= 4) ||
+                     (abs(mvQ0[1] - mvP0[1]) >= 4) ||
+                     (abs(mvQ1[0] - mvP1[0]) >= 4) ||
+                     (abs(mvQ1[1] - mvP1[1]) >= 4)) &&
+                    ((abs(mvQ1[0] - mvP0[0]) >= 4) ||
+                     (abs(mvQ1[1] - mvP0[1]) >= 4) ||
+                     (abs(mvQ0[0] - mvP1[0]) >= 4) ||
+                     (abs(mvQ0[1] - mvP1[1]) >= 4)) ? 1 : 0;
+      }
+    } else {
+      strength = 1;
+    }
+  }
+
+  return strength;
+}
+
+
+/**
+ * \brief Set the boundary strengths of an 8-pixel edge unit.
+ *
+ * The strengths are left to zero if the edge is neither a TU boundary nor
+ * a PU boundary.
+ *
+ * \param state   encoder state
+ * \param lcu     LCU containing the edge
+ * \param x       x-coordinate of the edge in pixels relative to the LCU
+ * \param y       y-coordinate of the edge in pixels relative to the LCU
+ * \param dir     direction of the edge
+ * \param bs      boundary strengths of the two segments of the edge
+ */
+static void set_edge_strengths(const encoder_state_t *const state,
+                               const lcu_t *const lcu,
+                               int32_t x,
+                               int32_t y,
+                               edge_dir dir,
+                               uint8_t *bs)
+{
+  const bool tu_boundary = is_tu_boundary(lcu, x, y, dir);
+  if (!tu_boundary && !is_pu_boundary(lcu, x, y, dir)) return;
+
+  for (int i = 0; i < 2; i++) {
+    // CUs on both sides of the edge
+    const cu_info_t *cu_p;
+    const cu_info_t *cu_q;
+    if (dir == EDGE_VER) {
+      cu_p = LCU_GET_CU_AT_PX(lcu, x - 1, y + 4 * i);
+      cu_q = LCU_GET_CU_AT_PX(lcu, x,     y + 4 * i);
+    } else {
+      cu_p = LCU_GET_CU_AT_PX(lcu, x + 4 * i, y - 1);
+      cu_q = LCU_GET_CU_AT_PX(lcu, x + 4 * i, y    );
+    }
+    bs[i] = get_boundary_strength(state, cu_p, cu_q, tu_boundary);
+  }
 }
 
+
 /**
- * \brief Gather pixels needed for deblocking
+ * \brief Compute the boundary strengths of the edges of an LCU.
+ *
+ * Sets the boundary strengths of the left and top edges of the LCU and all
+ * edges within it. The CUs of the LCU and its left and top neighbours must
+ * be in the lcu_t. The QPs of the deblocking parameters are set separately
+ * once the QPs of the CUs are final.
+ *
+ * \param state   encoder state
+ * \param x_px    x-coordinate of the left edge of the LCU in pixels
+ * \param y_px    y-coordinate of the top edge of the LCU in pixels
+ * \param lcu     searched LCU
  */
-static INLINE void gather_deblock_pixels(
-    const kvz_pixel *src,
-    int step, 
-    int stride,
-    int reach,
-    kvz_pixel *dst)
+void kvz_filter_set_deblock_info(const encoder_state_t *const state,
+                                 int x_px,
+                                 int y_px,
+                                 const lcu_t *const lcu)
 {
-  for (int i = -reach; i < +reach; ++i) {
-    dst[i + 4] = src[i * step + stride];
+  const videoframe_t *const frame = state->tile->frame;
+  deblock_info_t *const info = get_deblock_info(frame, x_px, y_px);
+  const int width  = MIN(LCU_WIDTH, frame->width  - x_px);
+  const int height = MIN(LCU_WIDTH, frame->height - y_px);
+
+  FILL(info->bs, 0);
+
+  for (int y = 0; y < height; y += 8) {
+    for (int x = 0; x < width; x += 8) {
+      // The left and top edges of the frame are not filtered.
+      if (x_px + x > 0) {
+        set_edge_strengths(state, lcu, x, y, EDGE_VER, &info->bs[EDGE_VER][x >> 3][y >> 2]);
+      }
+      if (y_px + y > 0) {
+        set_edge_strengths(state, lcu, x, y, EDGE_HOR, &info->bs[EDGE_HOR][y >> 3][x >> 2]);
+      }
+    }
   }
 }
 
+
 /**
-* \brief Scatter pixels
-*/
-static INLINE void scatter_deblock_pixels(
-    const kvz_pixel *src,
-    int step, 
-    int stride,
-    int reach,
-    kvz_pixel *dst)
+ * \brief Get the luma QP of the 4x4 block containing a pixel.
+ */
+static INLINE int8_t get_block_qp(const videoframe_t *const frame, int32_t x, int32_t y)
+{
+  const deblock_info_t *const info = get_deblock_info(frame, x, y);
+  return info->qp[(y & (LCU_WIDTH - 1)) >> 2][(x & (LCU_WIDTH - 1)) >> 2];
+}
+
+static int8_t get_qp_y_pred(const encoder_state_t* state, int x, int y, edge_dir dir)
 {
-  for (int i = -reach; i < +reach; ++i) {
-    dst[i * step + stride] = src[i + 4];
+  if (state->encoder_control->max_qp_delta_depth < 0) {
+    return state->qp;
+  }
+
+  int32_t qp_p;
+  if (dir == EDGE_HOR && y > 0) {
+    qp_p = get_block_qp(state->tile->frame, x, y - 1);
+  } else if (dir == EDGE_VER && x > 0) {
+    qp_p = get_block_qp(state->tile->frame, x - 1, y);
+  } else {
+    // TODO: This seems to be dead code. Investigate.
+    qp_p = state->encoder_control->cfg.set_qp_in_cu ? 26 : state->frame->QP;
   }
+
+  const int32_t qp_q = get_block_qp(state->tile->frame, x, y);
+
+  return (qp_p + qp_q + 1) >> 1;
 }
 
 /**
  * \brief Apply the deblocking filter to luma pixels on a single edge.
  *
- * The caller should check that the edge is a TU boundary or a PU boundary.
- *
  \verbatim
 
          .-- filter this edge if dir == EDGE_HOR
@@ -335,194 +418,54 @@ static INLINE void scatter_deblock_pixels(
  * \param y         y-coordinate in pixels (see above)
  * \param length    length of the edge in pixels
  * \param dir       direction of the edge to filter
- * \param tu_boundary   whether the edge is a TU boundary
  */
 static void filter_deblock_edge_luma(encoder_state_t * const state,
                                      int32_t x,
                                      int32_t y,
                                      int32_t length,
-                                     edge_dir dir,
-                                     bool tu_boundary)
+                                     edge_dir dir)
 {
   videoframe_t * const frame = state->tile->frame;
   const encoder_control_t * const encoder = state->encoder_control;
 
+  const uint8_t *const strength = get_edge_strengths(frame, x, y, dir);
+  const uint32_t num_4px_parts  = length / 4;
+  assert(num_4px_parts <= 2);
+
+  bool nonzero_strength = false;
+  for (uint32_t block_idx = 0; block_idx < num_4px_parts; ++block_idx) {
+    nonzero_strength |= strength[block_idx] != 0;
+  }
+  if (!nonzero_strength) return;
+
   {
     int32_t stride = frame->rec->stride;
     int32_t beta_offset_div2 = encoder->cfg.deblock_beta;
     int32_t tc_offset_div2   = encoder->cfg.deblock_tc;
     // TODO: support 10+bits
-    kvz_pixel *orig_src = &frame->rec->y[x + y*stride];
-    kvz_pixel *src = orig_src;
+    kvz_pixel *src = &frame->rec->y[x + y*stride];
 
     const int32_t qp = get_qp_y_pred(state, x, y, dir);
 
-    int8_t strength = 0;
     int32_t bitdepth_scale  = 1 << (encoder->bitdepth - 8);
     int32_t b_index         = CLIP(0, 51, qp + (beta_offset_div2 << 1));
     int32_t beta            = kvz_g_beta_table_8x8[b_index] * bitdepth_scale;
-    int32_t side_threshold  = (beta + (beta >>1 )) >> 3;
     int32_t tc_index;
-    int32_t tc;
-
-    uint32_t num_4px_parts  = length / 4;
-
-    // Transpose the image by swapping x and y strides when doing horizontal
-    // edges.
-    const int32_t x_stride = (dir == EDGE_VER) ? 1 : stride;
-    const int32_t y_stride = (dir == EDGE_VER) ? stride : 1;
-
-    // TODO: add CU based QP calculation
+    int32_t tc[2]           = { 0, 0 };
+    bool filter             = false;
 
     // For each 4-pixel part in the edge
     for (uint32_t block_idx = 0; block_idx < num_4px_parts; ++block_idx) {
-      {
-        // CUs on both sides of the edge
-        cu_info_t *cu_p;
-        cu_info_t *cu_q;
-        if (dir == EDGE_VER) {
-          int32_t y_coord = y + 4 * block_idx;
-          cu_p = kvz_cu_array_at(frame->cu_array, x - 1, y_coord);
-          cu_q = kvz_cu_array_at(frame->cu_array, x,     y_coord);
-
-        } else {
-          int32_t x_coord = x + 4 * block_idx;
-          cu_p = kvz_cu_array_at(frame->cu_array, x_coord, y - 1);
-          cu_q = kvz_cu_array_at(frame->cu_array, x_coord, y    );
-        }
-
-        bool nonzero_coeffs = cbf_is_set(cu_q->cbf, cu_q->tr_depth, COLOR_Y)
-                           || cbf_is_set(cu_p->cbf, cu_p->tr_depth, COLOR_Y);
-
-        // Filter strength
-        strength = 0;
-        if (cu_q->type == CU_INTRA || cu_p->type == CU_INTRA) {
-          strength = 2;
-        } else if (tu_boundary && nonzero_coeffs) {
-          // Non-zero residual/coeffs and transform boundary
-          // Neither CU is intra so tr_depth <= MAX_DEPTH.
-          strength = 1;       
-        } else if (cu_p->inter.mv_dir != 3 && cu_q->inter.mv_dir != 3 &&
-                 ((abs(cu_q->inter.mv[cu_q->inter.mv_dir - 1][0] - cu_p->inter.mv[cu_p->inter.mv_dir - 1][0]) >= 4) ||
-                  (abs(cu_q->inter.mv[cu_q->inter.mv_dir - 1][1] - cu_p->inter.mv[cu_p->inter.mv_dir - 1][1]) >= 4))) {
-          // Absolute motion vector diff between blocks >= 1 (Integer pixel)
-          strength = 1;
-        } else if (cu_p->inter.mv_dir != 3 && cu_q->inter.mv_dir != 3 &&
-                   cu_q->inter.mv_ref[cu_q->inter.mv_dir - 1] != cu_p->inter.mv_ref[cu_p->inter.mv_dir - 1]) {
-          strength = 1;
-        }
-        
-        // B-slice related checks
-        if(!strength && state->frame->slicetype == KVZ_SLICE_B) {
-
-          // Zero all undefined motion vectors for easier usage
-          if(!(cu_q->inter.mv_dir & 1)) {
-            cu_q->inter.mv[0][0] = 0;
-            cu_q->inter.mv[0][1] = 0;
-          }
-          if(!(cu_q->inter.mv_dir & 2)) {
-            cu_q->inter.mv[1][0] = 0;
-            cu_q->inter.mv[1][1] = 0;
-          }
-
-          if(!(cu_p->inter.mv_dir & 1)) {
-            cu_p->inter.mv[0][0] = 0;
-            cu_p->inter.mv[0][1] = 0;
-          }
-          if(!(cu_p->inter.mv_dir & 2)) {
-            cu_p->inter.mv[1][0] = 0;
-            cu_p->inter.mv[1][1] = 0;
-          }
-          const int refP0 = (cu_p->inter.mv_dir & 1) ? state->frame->ref_LX[0][cu_p->inter.mv_ref[0]] : -1;
-          const int refP1 = (cu_p->inter.mv_dir & 2) ? state->frame->ref_LX[1][cu_p->inter.mv_ref[1]] : -1;
-          const int refQ0 = (cu_q->inter.mv_dir & 1) ? state->frame->ref_LX[0][cu_q->inter.mv_ref[0]] : -1;
-          const int refQ1 = (cu_q->inter.mv_dir & 2) ? state->frame->ref_LX[1][cu_q->inter.mv_ref[1]] : -1;
-          const int16_t* mvQ0 = cu_q->inter.mv[0];
-          const int16_t* mvQ1 = cu_q->inter.mv[1];
-
-          const int16_t* mvP0 = cu_p->inter.mv[0];
-          const int16_t* mvP1 = cu_p->inter.mv[1];
-
-          if(( refP0 == refQ0 &&  refP1 == refQ1 ) || ( refP0 == refQ1 && refP1==refQ0 ))
-          {
-            // Different L0 & L1
-            if ( refP0 != refP1 ) {          
-              if ( refP0 == refQ0 ) {
-                strength  = ((abs(mvQ0[0] - mvP0[0]) >= 4) ||
-                             (abs(mvQ0[1] - mvP0[1]) >= 4) ||
-                             (abs(mvQ1[0] - mvP1[0]) >= 4) ||
-                             (abs(mvQ1[1] - mvP1[1]) >= 4)) ? 1 : 0;
-              } else {
-                strength  = ((abs(mvQ1[0] - mvP0[0]) >= 4) ||
-                             (abs(mvQ1[1] - mvP0[1]) >= 4) ||
-                             (abs(mvQ0[0] - mvP1[0]) >= 4) ||
-                             (abs(mvQ0[1] - mvP1[1]) >= 4)) ? 1 : 0;
-              }
-            // Same L0 & L1
-            } else {  
-              strength  = ((abs(mvQ0[0] - mvP0[0]) >= 4) ||
-                           (abs(mvQ0[1] - mvP0[1]) >= 4) ||
-                           (abs(mvQ1[0] - mvP1[0]) >= 4) ||
-                           (abs(mvQ1[1] - mvP1[1]) >= 4)) &&
-                          ((abs(mvQ1[0] - mvP0[0]) >= 4) ||
-                           (abs(mvQ1[1] - mvP0[1]) >= 4) ||
-                           (abs(mvQ0[0] - mvP1[0]) >= 4) ||
-                           (abs(mvQ0[1] - mvP1[1]) >= 4)) ? 1 : 0;
-            }
-          } else {
-            strength = 1;
-          }
-        }
-
-        tc_index        = CLIP(0, 51 + 2, (int32_t)(qp + 2*(strength - 1) + (tc_offset_div2 << 1)));
-        tc              = kvz_g_tc_table_8x8[tc_index] * bitdepth_scale;
+      // Parts with zero strength are skipped by the filter.
+      if (strength[block_idx]) {
+        tc_index        = CLIP(0, 51 + 2, (int32_t)(qp + 2*(strength[block_idx] - 1) + (tc_offset_div2 << 1)));
+        tc[block_idx]   = kvz_g_tc_table_8x8[tc_index] * bitdepth_scale;
+        filter         |= tc[block_idx] != 0;
       }
+    }
 
-      if (strength == 0) continue;
-
-      //                   +-- edge_src
-      //                   v
-      // line0 p3 p2 p1 p0 q0 q1 q2 q3
-      kvz_pixel *edge_src = &src[block_idx * 4 * y_stride];
-
-      // Gather the lines of pixels required for the filter on/off decision.
-      kvz_pixel b[4][8];
-      gather_deblock_pixels(edge_src, x_stride, 0 * y_stride, 4, &b[0][0]);
-      gather_deblock_pixels(edge_src, x_stride, 3 * y_stride, 4, &b[3][0]);
-
-      int_fast32_t dp0 = abs(b[0][1] - 2 * b[0][2] + b[0][3]);
-      int_fast32_t dq0 = abs(b[0][4] - 2 * b[0][5] + b[0][6]);
-      int_fast32_t dp3 = abs(b[3][1] - 2 * b[3][2] + b[3][3]);
-      int_fast32_t dq3 = abs(b[3][4] - 2 * b[3][5] + b[3][6]);
-      int_fast32_t dp = dp0 + dp3;
-      int_fast32_t dq = dq0 + dq3;
-
-      if (dp + dq < beta) {
-        // Strong filtering flag checking
-        int8_t sw = 2 * (dp0 + dq0) < beta >> 2 &&
-                    2 * (dp3 + dq3) < beta >> 2 &&
-                    abs(b[0][3] - b[0][4]) < (5 * tc + 1) >> 1 &&
-                    abs(b[3][3] - b[3][4]) < (5 * tc + 1) >> 1 &&
-                    abs(b[0][0] - b[0][3]) + abs(b[0][4] - b[0][7]) < beta >> 3 &&
-                    abs(b[3][0] - b[3][3]) + abs(b[3][4] - b[3][7]) < beta >> 3;
-
-        // Read lines 1 and 2. Weak filtering doesn't use the outermost pixels
-        // but let's give them anyway to simplify control flow.
-        gather_deblock_pixels(edge_src, x_stride, 1 * y_stride, 4, &b[1][0]);
-        gather_deblock_pixels(edge_src, x_stride, 2 * y_stride, 4, &b[2][0]);
-
-        for (int i = 0; i < 4; ++i) {
-          int filter_reach;
-          if (sw) {
-            filter_reach = kvz_filter_deblock_luma_strong(&b[i][0], tc);
-          } else {
-            bool p_2nd = dp < side_threshold;
-            bool q_2nd = dq < side_threshold;
-            filter_reach = kvz_filter_deblock_luma_weak(encoder, &b[i][0], tc, p_2nd, q_2nd);
-          }
-          scatter_deblock_pixels(&b[i][0], x_stride, i * y_stride, filter_reach, edge_src);
-        }
-      }
+    if (filter) {
+      kvz_deblock_luma(src, stride, dir, num_4px_parts, tc, beta, encoder->bitdepth);
     }
   }
 }
@@ -530,8 +473,6 @@ static void filter_deblock_edge_luma(encoder_state_t * const state,
 /**
  * \brief Apply the deblocking filter to chroma pixels on a single edge.
  *
- * The caller should check that the edge is a TU boundary or a PU boundary.
- *
  \verbatim
 
          .-- filter this edge if dir == EDGE_HOR
@@ -550,18 +491,29 @@ static void filter_deblock_edge_luma(encoder_state_t * const state,
  * \param y             y-coordinate in chroma pixels (see above)
  * \param length        length of the edge in chroma pixels
  * \param dir           direction of the edge to filter
- * \param tu_boundary   whether the edge is a TU boundary
  */
 static void filter_deblock_edge_chroma(encoder_state_t * const state,
                                        int32_t x,
                                        int32_t y,
                                        int32_t length,
-                                       edge_dir dir,
-                                       bool tu_boundary)
+                                       edge_dir dir)
 {
   const encoder_control_t * const encoder = state->encoder_control;
   const videoframe_t * const frame = state->tile->frame;
 
+  // Each 4-pixel chroma part covers two luma segments. The strength of the
+  // first one is used.
+  const uint8_t *const strength = get_edge_strengths(frame, x << 1, y << 1, dir);
+  const uint32_t num_4px_parts = length / 4;
+  assert(num_4px_parts <= 2);
+
+  // Only filter when strenght == 2 (one of the blocks is intra coded)
+  bool intra = false;
+  for (uint32_t blk_idx = 0; blk_idx < num_4px_parts; ++blk_idx) {
+    intra |= strength[2 * blk_idx] == 2;
+  }
+  if (!intra) return;
+
   // For each subpart
   {
     int32_t stride = frame->rec->stride >> 1;
@@ -571,43 +523,23 @@ static void filter_deblock_edge_chroma(encoder_state_t * const state,
       &frame->rec->u[x + y*stride],
       &frame->rec->v[x + y*stride],
     };
-    int8_t strength = 2;
 
     const int32_t luma_qp  = get_qp_y_pred(state, x << 1, y << 1, dir);
     int32_t QP             = kvz_g_chroma_scale[luma_qp];
     int32_t bitdepth_scale = 1 << (encoder->bitdepth-8);
-    int32_t TC_index       = CLIP(0, 51+2, (int32_t)(QP + 2*(strength-1) + (tc_offset_div2 << 1)));
+    int32_t TC_index       = CLIP(0, 51+2, (int32_t)(QP + 2 + (tc_offset_div2 << 1)));
     int32_t Tc             = kvz_g_tc_table_8x8[TC_index]*bitdepth_scale;
+    if (Tc == 0) return;
 
-    const uint32_t num_4px_parts = length / 4;
-
-    const int32_t offset = (dir == EDGE_HOR) ? stride :      1;
-    const int32_t step   = (dir == EDGE_HOR) ?      1 : stride;
-
-    for (uint32_t blk_idx = 0; blk_idx < num_4px_parts; ++blk_idx)
-    {
-      // CUs on both sides of the edge
-      cu_info_t *cu_p;
-      cu_info_t *cu_q;
-      if (dir == EDGE_VER) {
-        int32_t y_coord = (y + 4 * blk_idx) << 1;
-        cu_p = kvz_cu_array_at(frame->cu_array, (x - 1) << 1, y_coord);
-        cu_q = kvz_cu_array_at(frame->cu_array,  x      << 1, y_coord);
-
-      } else {
-        int32_t x_coord = (x + 4 * blk_idx) << 1;
-        cu_p = kvz_cu_array_at(frame->cu_array, x_coord, (y - 1) << 1);
-        cu_q = kvz_cu_array_at(frame->cu_array, x_coord, (y    ) << 1);
+    int32_t tc[2] = { 0, 0 };
+    for (uint32_t blk_idx = 0; blk_idx < num_4px_parts; ++blk_idx) {
+      if (strength[2 * blk_idx] == 2) {
+        tc[blk_idx] = Tc;
       }
+    }
 
-      // Only filter when strenght == 2 (one of the blocks is intra coded)
-      if (cu_q->type == CU_INTRA || cu_p->type == CU_INTRA) {
-        for (int component = 0; component < 2; component++) {
-          for (int i = 0; i < 4; i++) {
-            kvz_filter_deblock_chroma(encoder, src[component] + step * (4*blk_idx + i), offset, Tc, 0, 0);
-          }
-        }
-      }
+    for (int component = 0; component < 2; component++) {
+      kvz_deblock_chroma(src[component], stride, dir, num_4px_parts, tc, encoder->bitdepth);
     }
   }
 }
@@ -622,15 +554,13 @@ static void filter_deblock_edge_chroma(encoder_state_t * const state,
  * \param width     block width in pixels
  * \param height    block height in pixels
  * \param dir       direction of the edges to filter
- * \param tu_boundary   whether the edge is a TU boundary
  */
 static void filter_deblock_unit(encoder_state_t * const state,
                                 int x,
                                 int y,
                                 int width,
                                 int height,
-                                edge_dir dir,
-                                bool tu_boundary)
+                                edge_dir dir)
 {
   // no filtering on borders (where filter would use pixels outside the picture)
   if (x == 0 && dir == EDGE_VER) return;
@@ -660,13 +590,13 @@ static void filter_deblock_unit(encoder_state_t * const state,
     length_c = height >> 1;
   }
 
-  filter_deblock_edge_luma(state, x, y, length, dir, tu_boundary);
+  filter_deblock_edge_luma(state, x, y, length, dir);
 
   // Chroma pixel coordinates.
   const int32_t x_c = x >> 1;
   const int32_t y_c = y >> 1;
   if (state->encoder_control->chroma_format != KVZ_CSP_400 && is_on_8x8_grid(x_c, y_c, dir)) {
-    filter_deblock_edge_chroma(state, x_c, y_c, length_c, dir, tu_boundary);
+    filter_deblock_edge_chroma(state, x_c, y_c, length_c, dir);
   }
 }
 
@@ -693,9 +623,11 @@ static void filter_deblock_lcu_inside(encoder_state_t * const state,
 
   for (int edge_y = y; edge_y < end_y; edge_y += 8) {
     for (int edge_x = x; edge_x < end_x; edge_x += 8) {
-      bool tu_boundary = is_tu_boundary(state, edge_x, edge_y, dir);
-      if (tu_boundary || is_pu_boundary(state, edge_x, edge_y, dir)) {
-        filter_deblock_unit(state, edge_x, edge_y, 8, 8, dir, tu_boundary);
+      // Edges that are not TU or PU boundaries have zero strength.
+      const uint8_t *const strength =
+        get_edge_strengths(state->tile->frame, edge_x, edge_y, dir);
+      if (strength[0] || strength[1]) {
+        filter_deblock_unit(state, edge_x, edge_y, 8, 8, dir);
       }
     }
   }
@@ -718,10 +650,8 @@ static void filter_deblock_lcu_rightmost(encoder_state_t * const state,
   const int end = MIN(y_px + LCU_WIDTH, state->tile->frame->height);
   for (int y = y_px; y < end; y += 8) {
     // The top edge of the whole frame is not filtered.
-    bool tu_boundary = is_tu_boundary(state, x, y, EDGE_HOR);
-    bool pu_boundary = is_pu_boundary(state, x, y, EDGE_HOR);
-    if (y > 0 && (tu_boundary || pu_boundary)) {
-      filter_deblock_edge_luma(state, x, y, 4, EDGE_HOR, tu_boundary);
+    if (y > 0) {
+      filter_deblock_edge_luma(state, x, y, 4, EDGE_HOR);
     }
   }
 
@@ -733,10 +663,8 @@ static void filter_deblock_lcu_rightmost(encoder_state_t * const state,
     const int end_c = MIN(y_px_c + LCU_WIDTH_C, state->tile->frame->height >> 1);
     for (int y_c = y_px_c; y_c < end_c; y_c += 8) {
       // The top edge of the whole frame is not filtered.
-      bool tu_boundary = is_tu_boundary(state, x_c << 1, y_c << 1, EDGE_HOR);
-      bool pu_boundary = is_pu_boundary(state, x_c << 1, y_c << 1, EDGE_HOR);
-      if (y_c > 0 && (tu_boundary || pu_boundary)) {
-        filter_deblock_edge_chroma(state, x_c, y_c, 4, EDGE_HOR, tu_boundary);
+      if (y_c > 0) {
+        filter_deblock_edge_chroma(state, x_c, y_c, 4, EDGE_HOR);
       }
     }
   }
@@ -764,6 +692,9 @@ static void filter_deblock_lcu_rightmost(encoder_state_t * const state,
  *  - The bottom edge of the LCU.
  *  - The right edge of the LCU.
  *
+ * The deblocking parameters of the LCU and the LCU to the left must be set
+ * with kvz_filter_set_deblock_info.
+ *
  * \param state   encoder state
  * \param x_px    x-coordinate of the left edge of the LCU in pixels
  * \param y_px    y-coordinate of the top edge of the LCU in pixels
@@ -778,3 +709,29 @@ void kvz_filter_deblock_lcu(encoder_state_t * const state, int x_px, int y_px)
   }
   filter_deblock_lcu_inside(state, x_px, y_px, EDGE_HOR);
 }
+
+
+/**
+ * \brief Deblock the edges of one direction in a row of LCUs.
+ *
+ * Filter the left and top edges of the LCUs and all edges within them.
+ * The vertical edges of the row and the row above must be filtered before
+ * the horizontal edges of the row. The rows may otherwise be filtered in
+ * any order, since filtering an edge modifies at most three pixels on each
+ * side and decisions read four.
+ *
+ * \param state   encoder state
+ * \param y_px    y-coordinate of the top edge of the LCU row in pixels
+ * \param dir     direction of the edges to filter
+ */
+void kvz_filter_deblock_lcu_row(encoder_state_t * const state, int y_px, edge_dir dir)
+{
+  assert(!state->encoder_control->cfg.lossless);
+
+  for (int x_px = 0; x_px < state->tile->frame->width; x_px += LCU_WIDTH) {
+    filter_deblock_lcu_inside(state, x_px, y_px, dir);
+    if (dir == EDGE_HOR && x_px > 0) {
+      filter_deblock_lcu_rightmost(state, x_px, y_px);
+    }
+  }
+}
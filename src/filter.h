@@ -39,6 +39,37 @@ typedef enum edge_dir {
 } edge_dir;
 
 
+/**
+ * \brief Deblocking parameters of the edges of an LCU.
+ *
+ * Filled when the LCU is searched so that deblocking does not need to
+ * look up the CUs on both sides of each edge.
+ */
+typedef struct deblock_info_t {
+  /**
+   * \brief Boundary strength of each 4-pixel edge segment on the 8x8 grid.
+   *
+   * Indexed by [dir][edge][segment] where edge is the index of the edge on
+   * the 8x8 grid and segment the index of the 4-pixel segment along the
+   * edge. Zero, if the segment is not on a TU or PU boundary.
+   */
+  uint8_t bs[2][LCU_WIDTH / 8][LCU_WIDTH / 4];
+
+  /**
+   * \brief Luma QP of each 4x4 block of the LCU, indexed by [y][x].
+   *
+   * Only set when QP deltas are used.
+   */
+  int8_t qp[LCU_WIDTH / 4][LCU_WIDTH / 4];
+} deblock_info_t;
+
+
+void kvz_filter_set_deblock_info(const encoder_state_t *state,
+                                 int x_px,
+                                 int y_px,
+                                 const lcu_t *lcu);
+
 void kvz_filter_deblock_lcu(encoder_state_t *state, int x_px, int y_px);
+void kvz_filter_deblock_lcu_row(encoder_state_t *state, int y_px, edge_dir dir);
 
 #endif
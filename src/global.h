@@ -176,6 +176,13 @@ typedef int16_t coeff_t;
 
 #define MAX_REF_PIC_COUNT 16
 
+/**
+ * \brief Number of downscaled levels in the pyramid used by --me=pyramid.
+ *
+ * Each level halves the width and height of the previous one.
+ */
+#define ME_PYRAMID_LEVELS 3
+
 #define AMVP_MAX_NUM_CANDS 2
 #define AMVP_MAX_NUM_CANDS_MEM 3
 #define MRG_MAX_NUM_CANDS 5
@@ -330,6 +337,9 @@ typedef enum { COLOR_Y = 0, COLOR_U, COLOR_V } color_t;
 #  if defined(__AVX2__)
 #    define COMPILE_INTEL_AVX2 1
 #   endif
+#  if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512VL__)
+#    define COMPILE_INTEL_AVX512 1
+#   endif
 #endif
 
 #if defined (_M_PPC) || defined(__powerpc64__) || defined(__powerpc__)
@@ -177,6 +177,53 @@ kvz_picture *kvz_image_make_subimage(kvz_picture *const orig_image,
   return im;
 }
 
+/**
+ * \brief Downscale the luma of an image by two.
+ *
+ * Each pixel of the result is the rounded average of a 2x2 block of the
+ * input. The size of the result is rounded up to an even number by
+ * repeating the last column and row.
+ *
+ * \param src  image to downscale
+ * \return     luma-only image or NULL on failure
+ */
+kvz_picture *kvz_image_downscale(const kvz_picture *const src)
+{
+  const int width  = (src->width  + 3) / 4 * 2;
+  const int height = (src->height + 3) / 4 * 2;
+
+  kvz_picture *dst = kvz_image_alloc(KVZ_CSP_400, width, height);
+  if (!dst) return NULL;
+
+  const int src_width  = src->width  / 2;
+  const int src_height = src->height / 2;
+
+  for (int y = 0; y < src_height; y++) {
+    const kvz_pixel *row0 = &src->y[(2 * y) * src->stride];
+    const kvz_pixel *row1 = row0 + src->stride;
+    kvz_pixel *out = &dst->y[y * dst->stride];
+
+    for (int x = 0; x < src_width; x++) {
+      out[x] = (row0[2 * x] + row0[2 * x + 1] +
+                row1[2 * x] + row1[2 * x + 1] + 2) >> 2;
+    }
+    for (int x = src_width; x < width; x++) {
+      out[x] = out[src_width - 1];
+    }
+  }
+
+  for (int y = src_height; y < height; y++) {
+    memcpy(&dst->y[y * dst->stride],
+           &dst->y[(src_height - 1) * dst->stride],
+           width * sizeof(kvz_pixel));
+  }
+
+  dst->pts = src->pts;
+  dst->dts = src->dts;
+
+  return dst;
+}
+
 yuv_t * kvz_yuv_t_alloc(int luma_size, int chroma_size)
 {
   yuv_t *yuv = (yuv_t *)malloc(sizeof(*yuv));
@@ -444,6 +491,68 @@ unsigned kvz_image_calc_sad(const kvz_picture *pic,
 }
 
 
+/**
+* \brief Calculate interpolated SADs between a block and several blocks.
+*
+* Gives the same results as kvz_image_calc_sad. The SADs of the reference
+* blocks that are completely inside the frame are calculated together.
+*
+* \param pic        Image for the block we are trying to find.
+* \param ref        Image where we are trying to find the block.
+* \param ref_x      x-coordinates of the reference blocks
+* \param ref_y      y-coordinates of the reference blocks
+* \param costs_out  SAD of each reference block
+*/
+void kvz_image_calc_sad_multi(const kvz_picture *pic,
+                              const kvz_picture *ref,
+                              int pic_x,
+                              int pic_y,
+                              const int *ref_x,
+                              const int *ref_y,
+                              int num_blocks,
+                              int block_width,
+                              int block_height,
+                              optimized_sad_func_ptr_t optimized_sad,
+                              unsigned *costs_out)
+{
+  assert(pic_x >= 0 && pic_x <= pic->width - block_width);
+  assert(pic_y >= 0 && pic_y <= pic->height - block_height);
+
+  enum { BATCH_SIZE = 8 };
+  const kvz_pixel *pic_data = &pic->y[pic_y * pic->stride + pic_x];
+  const kvz_pixel *ref_data[BATCH_SIZE];
+  int indices[BATCH_SIZE];
+  unsigned sads[BATCH_SIZE];
+  int num_batched = 0;
+
+  for (int i = 0; i < num_blocks; ++i) {
+    if (ref_x[i] >= 0 && ref_x[i] <= ref->width  - block_width &&
+        ref_y[i] >= 0 && ref_y[i] <= ref->height - block_height)
+    {
+      ref_data[num_batched] = &ref->y[ref_y[i] * ref->stride + ref_x[i]];
+      indices[num_batched] = i;
+      num_batched++;
+    } else {
+      costs_out[i] = image_interpolated_sad(pic, ref, pic_x, pic_y,
+                                            ref_x[i], ref_y[i],
+                                            block_width, block_height,
+                                            optimized_sad) >> (KVZ_BIT_DEPTH - 8);
+    }
+
+    if (num_batched == BATCH_SIZE || (i == num_blocks - 1 && num_batched > 0)) {
+      kvz_reg_sad_multi(pic_data, ref_data, num_batched,
+                        block_width, block_height,
+                        pic->stride, ref->stride,
+                        sads);
+      for (int j = 0; j < num_batched; ++j) {
+        costs_out[indices[j]] = sads[j] >> (KVZ_BIT_DEPTH - 8);
+      }
+      num_batched = 0;
+    }
+  }
+}
+
+
 /**
 * \brief Calculate interpolated SATD between two blocks.
 *
@@ -67,6 +67,8 @@ kvz_picture *kvz_image_make_subimage(kvz_picture *const orig_image,
                              const unsigned width,
                              const unsigned height);
 
+kvz_picture *kvz_image_downscale(const kvz_picture *src);
+
 yuv_t * kvz_yuv_t_alloc(int luma_size, int chroma_size);
 void kvz_yuv_t_free(yuv_t * yuv);
 
@@ -85,6 +87,18 @@ unsigned kvz_image_calc_sad(const kvz_picture *pic,
                             int block_height,
                             optimized_sad_func_ptr_t optimized_sad);
 
+void kvz_image_calc_sad_multi(const kvz_picture *pic,
+                              const kvz_picture *ref,
+                              int pic_x,
+                              int pic_y,
+                              const int *ref_x,
+                              const int *ref_y,
+                              int num_blocks,
+                              int block_width,
+                              int block_height,
+                              optimized_sad_func_ptr_t optimized_sad,
+                              unsigned *costs_out);
+
 
 unsigned kvz_image_calc_satd(const kvz_picture *pic,
                              const kvz_picture *ref,
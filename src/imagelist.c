@@ -40,6 +40,8 @@ image_list_t * kvz_image_list_alloc(int size)
   list->cu_arrays = malloc(sizeof(cu_array_t*)   * size);
   list->pocs      = malloc(sizeof(int32_t)       * size);
   list->ref_LXs   = malloc(sizeof(*list->ref_LXs) * size);
+  list->pyramids  = malloc(sizeof(*list->pyramids) * size);
+  list->subpel_planes = malloc(sizeof(subpel_planes_t*) * size);
   list->used_size = 0;
 
   return list;
@@ -57,8 +59,10 @@ int kvz_image_list_resize(image_list_t *list, unsigned size)
   list->cu_arrays = (cu_array_t**)realloc(list->cu_arrays, sizeof(cu_array_t*) * size);
   list->pocs = realloc(list->pocs, sizeof(int32_t) * size);
   list->ref_LXs = realloc(list->ref_LXs, sizeof(*list->ref_LXs) * size);
+  list->pyramids = realloc(list->pyramids, sizeof(*list->pyramids) * size);
+  list->subpel_planes = realloc(list->subpel_planes, sizeof(subpel_planes_t*) * size);
   list->size = size;
-  return size == 0 || (list->images && list->cu_arrays && list->pocs);
+  return size == 0 || (list->images && list->cu_arrays && list->pocs && list->pyramids && list->subpel_planes);
 }
 
 /**
@@ -75,11 +79,16 @@ int kvz_image_list_destroy(image_list_t *list)
       list->images[i] = NULL;
       kvz_cu_array_free(&list->cu_arrays[i]);
       list->cu_arrays[i] = NULL;
+      kvz_subpel_planes_free(&list->subpel_planes[i]);
       list->pocs[i] = 0;
       for (int j = 0; j < 16; j++) {
         list->ref_LXs[i][0][j] = 0;
         list->ref_LXs[i][1][j] = 0;
       }
+      for (int j = 0; j < ME_PYRAMID_LEVELS; j++) {
+        kvz_image_free(list->pyramids[i][j]);
+        list->pyramids[i][j] = NULL;
+      }
     }
   }
 
@@ -88,11 +97,15 @@ int kvz_image_list_destroy(image_list_t *list)
     free(list->cu_arrays);
     free(list->pocs);
     free(list->ref_LXs);
+    free(list->pyramids);
+    free(list->subpel_planes);
   }
   list->images = NULL;
   list->cu_arrays = NULL;
   list->pocs = NULL;
   list->ref_LXs = NULL;
+  list->pyramids = NULL;
+  list->subpel_planes = NULL;
   free(list);
   return 1;
 }
@@ -101,9 +114,13 @@ int kvz_image_list_destroy(image_list_t *list)
  * \brief Add picture to the front of the picturelist
  * \param pic picture pointer to add
  * \param picture_list list to use
+ * \param pyramid downscaled levels of the picture, entries may be NULL
+ * \param subpel_planes fractional pixel planes of the picture or NULL
  * \return 1 on success
  */
-int kvz_image_list_add(image_list_t *list, kvz_picture *im, cu_array_t *cua, int32_t poc, uint8_t ref_LX[2][16])
+int kvz_image_list_add(image_list_t *list, kvz_picture *im, cu_array_t *cua, int32_t poc, uint8_t ref_LX[2][16],
+                       kvz_picture *const pyramid[ME_PYRAMID_LEVELS],
+                       subpel_planes_t *subpel_planes)
 {
   int i = 0;
   if (KVZ_ATOMIC_INC(&(im->refcount)) == 1) {
@@ -126,20 +143,28 @@ int kvz_image_list_add(image_list_t *list, kvz_picture *im, cu_array_t *cua, int
   for (i = list->used_size; i > 0; i--) {
     list->images[i] = list->images[i - 1];
     list->cu_arrays[i] = list->cu_arrays[i - 1];
+    list->subpel_planes[i] = list->subpel_planes[i - 1];
     list->pocs[i] = list->pocs[i - 1];
     for (int j = 0; j < 16; j++) {
       list->ref_LXs[i][0][j] = list->ref_LXs[i - 1][0][j];
       list->ref_LXs[i][1][j] = list->ref_LXs[i - 1][1][j];
     }
+    for (int j = 0; j < ME_PYRAMID_LEVELS; j++) {
+      list->pyramids[i][j] = list->pyramids[i - 1][j];
+    }
   }
 
   list->images[0] = im;
   list->cu_arrays[0] = cua;
+  list->subpel_planes[0] = subpel_planes ? kvz_subpel_planes_copy_ref(subpel_planes) : NULL;
   list->pocs[0] = poc;
   for (int j = 0; j < 16; j++) {
     list->ref_LXs[0][0][j] = ref_LX[0][j];
     list->ref_LXs[0][1][j] = ref_LX[1][j];
   }
+  for (int j = 0; j < ME_PYRAMID_LEVELS; j++) {
+    list->pyramids[0][j] = pyramid[j] ? kvz_image_copy_ref(pyramid[j]) : NULL;
+  }
   
   list->used_size++;
   return 1;
@@ -163,6 +188,12 @@ int kvz_image_list_rem(image_list_t * const list, const unsigned n)
 
   kvz_cu_array_free(&list->cu_arrays[n]);
 
+  kvz_subpel_planes_free(&list->subpel_planes[n]);
+
+  for (int j = 0; j < ME_PYRAMID_LEVELS; j++) {
+    kvz_image_free(list->pyramids[n][j]);
+  }
+
   // The last item is easy to remove
   if (n == list->used_size - 1) {
     list->images[n] = NULL;
@@ -172,6 +203,9 @@ int kvz_image_list_rem(image_list_t * const list, const unsigned n)
       list->ref_LXs[n][0][j] = 0;
       list->ref_LXs[n][1][j] = 0;
     }
+    for (int j = 0; j < ME_PYRAMID_LEVELS; j++) {
+      list->pyramids[n][j] = NULL;
+    }
     list->used_size--;
   } else {
     int i = n;
@@ -179,19 +213,27 @@ int kvz_image_list_rem(image_list_t * const list, const unsigned n)
     for (i = n; i < list->used_size - 1; ++i) {
       list->images[i] = list->images[i + 1];
       list->cu_arrays[i] = list->cu_arrays[i + 1];
+      list->subpel_planes[i] = list->subpel_planes[i + 1];
       list->pocs[i] = list->pocs[i + 1];
       for (int j = 0; j < 16; j++) {
         list->ref_LXs[i][0][j] = list->ref_LXs[i + 1][0][j];
         list->ref_LXs[i][1][j] = list->ref_LXs[i + 1][1][j];
       }
+      for (int j = 0; j < ME_PYRAMID_LEVELS; j++) {
+        list->pyramids[i][j] = list->pyramids[i + 1][j];
+      }
     }
     list->images[list->used_size - 1] = NULL;
     list->cu_arrays[list->used_size - 1] = NULL;
+    list->subpel_planes[list->used_size - 1] = NULL;
     list->pocs[list->used_size - 1] = 0;
     for (int j = 0; j < 16; j++) {
       list->ref_LXs[list->used_size - 1][0][j] = 0;
       list->ref_LXs[list->used_size - 1][1][j] = 0;
     }
+    for (int j = 0; j < ME_PYRAMID_LEVELS; j++) {
+      list->pyramids[list->used_size - 1][j] = NULL;
+    }
     list->used_size--;
   }
 
@@ -205,7 +247,8 @@ int kvz_image_list_copy_contents(image_list_t *target, image_list_t *source) {
   }
   
   for (i = source->used_size - 1; i >= 0; --i) {
-    kvz_image_list_add(target, source->images[i], source->cu_arrays[i], source->pocs[i], source->ref_LXs[i]);
+    kvz_image_list_add(target, source->images[i], source->cu_arrays[i], source->pocs[i], source->ref_LXs[i],
+                       source->pyramids[i], source->subpel_planes[i]);
   }
   return 1;
 }
@@ -33,6 +33,27 @@ void kvz_init_input_frame_buffer(input_frame_buffer_t *input_buffer)
   input_buffer->num_out = 0;
   input_buffer->delay = 0;
   input_buffer->gop_skipped = 0;
+  input_buffer->first_num = 0;
+  input_buffer->scenecut = false;
+}
+
+/**
+ * \brief Start a new sequence at a scene cut.
+ *
+ * The next input frame is output first and the GOP structure starts over
+ * from it. All frames of the previous sequence must have been output.
+ *
+ * \param buf     an input frame buffer
+ */
+void kvz_input_frame_buffer_restart(input_frame_buffer_t *buf)
+{
+  assert(buf->num_out == buf->num_in);
+
+  buf->first_num += buf->num_in;
+  buf->num_in = 0;
+  buf->num_out = 0;
+  buf->gop_skipped = 0;
+  buf->scenecut = true;
 }
 
 /**
@@ -78,6 +99,8 @@ kvz_picture* kvz_encoder_feed_frame(input_frame_buffer_t *buf,
       }
       state->frame->gop_offset = (frame_num + cfg->gop_len - 1) % cfg->gop_len;
     }
+    state->frame->input_num = buf->first_num + buf->num_in;
+    state->frame->is_scenecut = buf->scenecut && buf->num_out == 0;
     buf->num_in++;
     buf->num_out++;
     return kvz_image_copy_ref(img_in);
@@ -192,6 +215,8 @@ kvz_picture* kvz_encoder_feed_frame(input_frame_buffer_t *buf,
   next_pic->dts = dts_out;
   buf->pic_buffer[buf_idx] = NULL;
   state->frame->gop_offset = gop_offset;
+  state->frame->input_num = buf->first_num + idx_out + 1;
+  state->frame->is_scenecut = buf->scenecut && buf->num_out == 0;
 
   buf->num_out++;
   return next_pic;
@@ -60,10 +60,18 @@ typedef struct input_frame_buffer_t {
    */
   int gop_skipped;
 
+  /** \brief Number of the first picture of the sequence in input order. */
+  int64_t first_num;
+
+  /** \brief Whether the sequence was started at a scene cut. */
+  bool scenecut;
+
 } input_frame_buffer_t;
 
 void kvz_init_input_frame_buffer(input_frame_buffer_t *input_buffer);
 
+void kvz_input_frame_buffer_restart(input_frame_buffer_t *buf);
+
 kvz_picture* kvz_encoder_feed_frame(input_frame_buffer_t *buf,
                                     struct encoder_state_t *const state,
                                     struct kvz_picture *const img_in);
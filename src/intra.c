@@ -25,6 +25,7 @@
 #include "image.h"
 #include "kvz_math.h"
 #include "strategies/strategies-intra.h"
+#include "strategies/strategies-picture.h"
 #include "tables.h"
 #include "transform.h"
 #include "videoframe.h"
@@ -278,13 +279,17 @@ static void intra_pred_filtered_dc(
 }
 
 
-void kvz_intra_predict(
+/**
+ * \brief Select the reference pixels used for predicting a mode.
+ *
+ * Filters the reference if the filtered reference is needed and has not
+ * been initialized yet.
+ */
+static const kvz_intra_ref * intra_select_reference(
   kvz_intra_references *refs,
   int_fast8_t log2_width,
   int_fast8_t mode,
-  color_t color,
-  kvz_pixel *dst,
-  bool filter_boundary)
+  color_t color)
 {
   const int_fast8_t width = 1 << log2_width;
 
@@ -309,6 +314,22 @@ void kvz_intra_predict(
     intra_filter_reference(log2_width, refs);
   }
 
+  return used_ref;
+}
+
+
+void kvz_intra_predict(
+  kvz_intra_references *refs,
+  int_fast8_t log2_width,
+  int_fast8_t mode,
+  color_t color,
+  kvz_pixel *dst,
+  bool filter_boundary)
+{
+  const int_fast8_t width = 1 << log2_width;
+
+  const kvz_intra_ref *used_ref = intra_select_reference(refs, log2_width, mode, color);
+
   if (mode == 0) {
     kvz_intra_pred_planar(log2_width, used_ref->top, used_ref->left, dst);
   } else if (mode == 1) {
@@ -331,6 +352,54 @@ void kvz_intra_predict(
 }
 
 
+void kvz_intra_angular_satd(
+  kvz_intra_references *refs,
+  int_fast8_t log2_width,
+  int_fast8_t num_modes,
+  const int8_t *modes,
+  const kvz_pixel *orig_block,
+  bool filter_boundary,
+  unsigned *costs_out)
+{
+  const int_fast8_t width = 1 << log2_width;
+
+  int8_t fused_modes[35];
+  int8_t fused_index[35];
+  const kvz_pixel *refs_above[35];
+  const kvz_pixel *refs_left[35];
+  int_fast8_t num_fused = 0;
+
+  for (int_fast8_t i = 0; i < num_modes; ++i) {
+    const int_fast8_t mode = modes[i];
+    assert(mode >= 2 && mode <= 34);
+
+    if (width < 32 && filter_boundary && (mode == 10 || mode == 26)) {
+      // The boundary filter is only done by the full prediction.
+      kvz_pixel pred[32 * 32];
+      kvz_intra_predict(refs, log2_width, mode, COLOR_Y, pred, filter_boundary);
+      costs_out[i] = kvz_pixels_get_satd_func(width)(pred, orig_block);
+      continue;
+    }
+
+    const kvz_intra_ref *used_ref = intra_select_reference(refs, log2_width, mode, COLOR_Y);
+    fused_modes[num_fused] = mode;
+    fused_index[num_fused] = i;
+    refs_above[num_fused] = used_ref->top;
+    refs_left[num_fused] = used_ref->left;
+    ++num_fused;
+  }
+
+  if (num_fused > 0) {
+    unsigned fused_costs[35];
+    kvz_angular_pred_satd(log2_width, num_fused, fused_modes,
+                          refs_above, refs_left, orig_block, fused_costs);
+    for (int_fast8_t i = 0; i < num_fused; ++i) {
+      costs_out[fused_index[i]] = fused_costs[i];
+    }
+  }
+}
+
+
 void kvz_intra_build_reference_any(
   const int_fast8_t log2_width,
   const color_t color,
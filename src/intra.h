@@ -117,6 +117,29 @@ void kvz_intra_predict(
   kvz_pixel *dst,
   bool filter_boundary);
 
+/**
+ * \brief Calculate SATD costs of luma angular predictions.
+ *
+ * Predicts the modes and computes their SATD against the original block
+ * without storing the predictions, when possible.
+ *
+ * \param refs            Reference pixels used for the prediction.
+ * \param log2_width      Width of the predicted block.
+ * \param num_modes       Number of modes in the set.
+ * \param modes           Angular modes in range 2..34.
+ * \param orig_block      Original pixels in continuous memory.
+ * \param filter_boundary Whether to filter the boundary on modes 10 and 26.
+ * \param costs_out       SATD of each mode.
+ */
+void kvz_intra_angular_satd(
+  kvz_intra_references *refs,
+  int_fast8_t log2_width,
+  int_fast8_t num_modes,
+  const int8_t *modes,
+  const kvz_pixel *orig_block,
+  bool filter_boundary,
+  unsigned *costs_out);
+
 void kvz_intra_recon_cu(
   encoder_state_t *const state,
   int x,
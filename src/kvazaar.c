@@ -20,6 +20,7 @@
 
 #include "kvazaar.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,8 +36,10 @@
 #include "image.h"
 #include "input_frame_buffer.h"
 #include "kvazaar_internal.h"
+#include "lookahead.h"
 #include "strategyselector.h"
 #include "threadqueue.h"
+#include "threads.h"
 #include "videoframe.h"
 
 
@@ -57,6 +60,8 @@ static void kvazaar_close(kvz_encoder *encoder)
         kvz_image_free(pic);
         pic = NULL;
       }
+      kvz_image_free(encoder->scenecut_frame);
+      encoder->scenecut_frame = NULL;
 
       for (unsigned i = 0; i < encoder->num_encoder_states; ++i) {
         kvz_encoder_state_finalize(&encoder->states[i]);
@@ -158,6 +163,60 @@ static void set_frame_info(kvz_frame_info *const info, const encoder_state_t *co
 }
 
 
+/**
+ * \brief Collect the statistics of an encoded frame.
+ *
+ * Must be called before the bitstream of the frame is taken.
+ *
+ * \param wait_time   nanoseconds spent waiting for the frame
+ */
+static void set_frame_stats(kvz_frame_stats *const stats,
+                            const encoder_state_t *const state,
+                            int64_t wait_time)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const int num_lcus = encoder->in.width_in_lcu * encoder->in.height_in_lcu;
+
+  int64_t search_time  = 0;
+  int64_t recon_time   = 0;
+  int64_t deblock_time = 0;
+  int64_t sao_time     = 0;
+  int64_t cabac_time   = 0;
+  int64_t queue_time   = 0;
+  uint64_t lcu_bits    = 0;
+  uint64_t sao_bits    = 0;
+  for (int i = 0; i < num_lcus; i++) {
+    const lcu_stats_t *lcu = &state->frame->lcu_stats[i];
+    search_time  += lcu->search_time;
+    recon_time   += lcu->recon_time;
+    deblock_time += lcu->deblock_time;
+    sao_time     += lcu->sao_time;
+    cabac_time   += lcu->cabac_time;
+    queue_time   += lcu->queue_time;
+    lcu_bits     += lcu->bits;
+    sao_bits     += lcu->sao_bits;
+  }
+
+  const uint64_t bits = kvz_bitstream_tell(&state->stream);
+
+  stats->version          = KVZ_FRAME_STATS_VERSION;
+  stats->poc              = state->frame->poc;
+  stats->wall_time        = (state->frame->end_time - state->frame->start_time) / 1e9;
+  stats->search_time      = search_time / 1e9;
+  stats->recon_time       = recon_time / 1e9;
+  stats->deblock_time     = deblock_time / 1e9;
+  stats->sao_time         = sao_time / 1e9;
+  stats->cabac_time       = cabac_time / 1e9;
+  stats->bitstream_time   = state->frame->bitstream_time / 1e9;
+  stats->queue_time       = queue_time / 1e9;
+  stats->wait_time        = wait_time / 1e9;
+  stats->bits             = bits;
+  stats->sao_bits         = sao_bits;
+  stats->coding_tree_bits = lcu_bits - sao_bits;
+  stats->header_bits      = bits > lcu_bits ? bits - lcu_bits : 0;
+}
+
+
 static int kvazaar_headers(kvz_encoder *enc,
                            kvz_data_chunk **data_out,
                            uint32_t *len_out)
@@ -222,6 +281,65 @@ static int yuv_io_extract_field(const kvz_picture *frame_in, unsigned source_sca
 }
 
 
+/**
+ * \brief Pass an input frame through the lookahead to the input buffer.
+ *
+ * At a scene cut, the frames before the cut are taken from the input buffer
+ * before a new sequence is started with the frame at the cut.
+ *
+ * \return  the next picture to encode, or NULL if no picture is available
+ */
+static kvz_picture * encoder_next_frame(kvz_encoder *enc,
+                                        encoder_state_t *state,
+                                        kvz_picture *pic_in)
+{
+  lookahead_t *const lookahead = enc->control->lookahead;
+  input_frame_buffer_t *const buf = &enc->input_buffer;
+  if (!lookahead) {
+    return kvz_encoder_feed_frame(buf, state, pic_in);
+  }
+
+  if (pic_in != NULL) {
+    kvz_lookahead_push(lookahead, pic_in);
+  }
+
+  // Move frames from the lookahead to the input buffer until one of them
+  // can be encoded. At the end of the input, this makes every call return
+  // a frame while there are frames left.
+  for (;;) {
+    kvz_picture *next = NULL;
+
+    if (enc->scenecut_frame) {
+      kvz_picture *frame = kvz_encoder_feed_frame(buf, state, NULL);
+      if (frame) return frame;
+
+      kvz_input_frame_buffer_restart(buf);
+      next = enc->scenecut_frame;
+      enc->scenecut_frame = NULL;
+
+    } else {
+      bool scenecut = false;
+      next = kvz_lookahead_pop(lookahead, pic_in == NULL, &scenecut);
+      if (!next) {
+        return pic_in != NULL ? NULL : kvz_encoder_feed_frame(buf, state, NULL);
+      }
+
+      if (scenecut) {
+        if (buf->num_out < buf->num_in) {
+          enc->scenecut_frame = next;
+          continue;
+        }
+        kvz_input_frame_buffer_restart(buf);
+      }
+    }
+
+    kvz_picture *frame = kvz_encoder_feed_frame(buf, state, next);
+    kvz_image_free(next);
+    if (frame) return frame;
+  }
+}
+
+
 static int kvazaar_encode(kvz_encoder *enc,
                           kvz_picture *pic_in,
                           kvz_data_chunk **data_out,
@@ -246,7 +364,7 @@ static int kvazaar_encode(kvz_encoder *enc,
     CHECKPOINT_MARK("read source frame: %d", state->frame->num + enc->control->cfg.seek);
   }
 
-  kvz_picture* frame = kvz_encoder_feed_frame(&enc->input_buffer, state, pic_in);
+  kvz_picture* frame = encoder_next_frame(enc, state, pic_in);
   if (frame) {
     assert(state->frame->num == enc->frames_started);
     // Start encoding.
@@ -268,11 +386,15 @@ static int kvazaar_encode(kvz_encoder *enc,
   if (!output_state->frame->done &&
       (pic_in == NULL || enc->cur_state_num == enc->out_state_num)) {
 
+    const int64_t wait_start = kvz_time_ns();
     kvz_threadqueue_waitfor(enc->control->threadqueue, output_state->tqj_bitstream_written);
+    const int64_t wait_time = kvz_time_ns() - wait_start;
     // The job pointer must be set to NULL here since it won't be usable after
     // the next frame is done.
     kvz_threadqueue_free_job(&output_state->tqj_bitstream_written);
 
+    set_frame_stats(&enc->frame_stats, output_state, wait_time);
+
     // Get stream length before taking chunks since that clears the stream.
     if (len_out) *len_out = kvz_bitstream_tell(&output_state->stream) / 8;
     if (data_out) *data_out = kvz_bitstream_take_chunks(&output_state->stream);
@@ -375,6 +497,35 @@ kvazaar_field_encoding_adapter_failure:
 }
 
 
+/**
+ * \brief Size of kvz_frame_stats in each version, indexed by version - 1.
+ *
+ * When fields are added, the entry of the previous version must become
+ * the offset of the first new field.
+ */
+static const size_t frame_stats_sizes[KVZ_FRAME_STATS_VERSION] = {
+  sizeof(kvz_frame_stats),
+};
+
+
+static int kvazaar_frame_stats(kvz_encoder *enc, kvz_frame_stats *stats_out)
+{
+  if (enc->frame_stats.version == 0 ||
+      stats_out->version < 1 ||
+      stats_out->version > KVZ_FRAME_STATS_VERSION)
+  {
+    return 0;
+  }
+
+  // Copy only the fields of the version the caller was built against and
+  // keep the version of the caller.
+  const size_t begin = offsetof(kvz_frame_stats, version) + sizeof(stats_out->version);
+  const size_t end = frame_stats_sizes[stats_out->version - 1];
+  memcpy((uint8_t*)stats_out + begin, (const uint8_t*)&enc->frame_stats + begin, end - begin);
+  return 1;
+}
+
+
 static const kvz_api kvz_8bit_api = {
   .config_alloc = kvz_config_alloc,
   .config_init = kvz_config_init,
@@ -392,6 +543,8 @@ static const kvz_api kvz_8bit_api = {
   .encoder_encode = kvazaar_field_encoding_adapter,
 
   .picture_alloc_csp = kvz_image_alloc,
+
+  .encoder_frame_stats = kvazaar_frame_stats,
 };
 
 
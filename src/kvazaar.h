@@ -64,6 +64,11 @@ extern "C" {
  */
 #define KVZ_MAX_GOP_LENGTH 32
 
+/**
+ * Maximum number of frames analysed ahead of encoding.
+ */
+#define KVZ_MAX_LOOKAHEAD 250
+
 /**
  * Size of data chunks.
  */
@@ -93,6 +98,7 @@ enum kvz_ime_algorithm {
   KVZ_IME_FULL32 = 5, //! \since 3.6.0
   KVZ_IME_FULL64 = 6, //! \since 3.6.0
   KVZ_IME_DIA = 7, // Experimental. TODO: change into a proper doc comment
+  KVZ_IME_PYRAMID = 8, //!< Coarse-to-fine search on downscaled frames
 };
 
 /**
@@ -128,6 +134,7 @@ enum kvz_hash
   KVZ_HASH_NONE = 0,
   KVZ_HASH_CHECKSUM = 1,
   KVZ_HASH_MD5 = 2,
+  KVZ_HASH_CRC = 3,
 };
 
 /**
@@ -213,6 +220,25 @@ enum kvz_scalinglist {
   KVZ_SCALING_LIST_DEFAULT = 2,  
 };
 
+/**
+ * \brief Placement of worker threads on CPUs.
+ * \since 4.2.0
+ */
+enum kvz_thread_affinity {
+  KVZ_THREAD_AFFINITY_NONE = 0,  // Let the operating system place the threads.
+  KVZ_THREAD_AFFINITY_CORES = 1, // Pin each worker thread to one core.
+  KVZ_THREAD_AFFINITY_NUMA = 2,  // Pin worker threads to NUMA nodes and run each frame on one node.
+};
+
+/**
+ * \brief Adaptive quantization mode.
+ * \since 4.2.0
+ */
+enum kvz_aq_mode {
+  KVZ_AQ_NONE = 0,
+  KVZ_AQ_VARIANCE = 1, // Set the QP of each LCU according to the variance of luma.
+};
+
 // Map from input format to chroma format.
 #define KVZ_FORMAT2CSP(format) ((enum kvz_chroma_format)"\0\1\2\3"[format])
 
@@ -390,6 +416,39 @@ typedef struct kvz_config
   /** \brief Enable Early Skip Mode Decision */
   uint8_t early_skip;
 
+  /** \brief Placement of worker threads on CPUs */
+  int8_t thread_affinity;
+
+  /** \brief File to write a trace of the jobs in Chrome trace format to, or NULL */
+  char *trace_file;
+
+  /** \brief Number of frames to analyse ahead of encoding, 0 to disable */
+  int32_t lookahead;
+
+  /** \brief Scene cut threshold in percent, 0 to disable scene cut detection */
+  int32_t scenecut;
+
+  /** \brief Lower the QP of LCUs referenced by later frames */
+  int8_t cutree;
+
+  /** \brief Adaptive quantization mode, see enum kvz_aq_mode */
+  int8_t aq_mode;
+
+  /** \brief Interpolate the fractional pixels of reference pictures once */
+  int8_t subpel_planes;
+
+  /** \brief Reuse the motion vectors of larger blocks in motion search */
+  int8_t me_cache;
+
+  /** \brief Estimate coefficient bits with context bit tables */
+  int8_t coeff_bit_table;
+
+  /**
+   * \brief Deblock and apply SAO to LCU rows in parallel after the search
+   * of the frame when WPP and tiles are not used
+   */
+  int8_t frame_filter;
+
 } kvz_config;
 
 /**
@@ -533,6 +592,119 @@ typedef struct kvz_frame_info {
 
 } kvz_frame_info;
 
+/**
+ * \brief Version of kvz_frame_stats defined in this header.
+ * \since 4.2.0
+ */
+#define KVZ_FRAME_STATS_VERSION 1
+
+/**
+ * \brief Timing and size statistics of an encoded frame
+ *
+ * Extension to kvz_frame_info returned by encoder_frame_stats. The caller
+ * must set version to KVZ_FRAME_STATS_VERSION. Fields added in later
+ * versions are appended to the end of the struct. The library fills
+ * exactly the fields of the version set by the caller and leaves version
+ * unchanged, so callers built against an older header keep working.
+ *
+ * Times of the encoding stages are measured on the threads doing the work
+ * and summed over all threads, so they can be larger than wall_time. They
+ * include any time the threads were not scheduled to run.
+ *
+ * \since 4.2.0
+ */
+typedef struct kvz_frame_stats {
+
+  /**
+   * \brief Version of the struct
+   */
+  uint32_t version;
+
+  /**
+   * \brief Picture order count
+   */
+  int32_t poc;
+
+  /**
+   * \brief Seconds from starting to encode the frame until its bitstream
+   * was written
+   */
+  double wall_time;
+
+  /**
+   * \brief Seconds spent in mode search
+   *
+   * Includes the predictions and reconstructions done for evaluating the
+   * cost of candidate modes but not the reconstruction of the chosen
+   * modes.
+   */
+  double search_time;
+
+  /**
+   * \brief Seconds spent reconstructing the chosen modes of the coding
+   * units and storing the reconstructed LCUs for neighbouring LCUs
+   */
+  double recon_time;
+
+  /**
+   * \brief Seconds spent in deblocking
+   */
+  double deblock_time;
+
+  /**
+   * \brief Seconds spent in SAO search and reconstruction
+   */
+  double sao_time;
+
+  /**
+   * \brief Seconds spent in CABAC coding of the LCUs
+   */
+  double cabac_time;
+
+  /**
+   * \brief Seconds spent writing the headers and assembling the bitstream
+   *
+   * Covers only the frame-level work of writing the parameter sets, slice
+   * headers and SEI messages and joining the coded LCUs into NAL units.
+   * The coding of the LCUs themselves is in cabac_time, so this is usually
+   * a small fraction of a millisecond.
+   */
+  double bitstream_time;
+
+  /**
+   * \brief Seconds LCUs were ready to be encoded but waiting for a free
+   * thread
+   */
+  double queue_time;
+
+  /**
+   * \brief Seconds encoder_encode was blocked waiting for the frame
+   */
+  double wait_time;
+
+  /**
+   * \brief Number of bits in the frame
+   */
+  uint64_t bits;
+
+  /**
+   * \brief Number of bits spent on SAO parameters
+   */
+  uint64_t sao_bits;
+
+  /**
+   * \brief Number of bits spent on the coding trees of the LCUs
+   */
+  uint64_t coding_tree_bits;
+
+  /**
+   * \brief Number of bits spent on NAL units, parameter sets, slice
+   * headers and other data outside the LCUs
+   */
+  uint64_t header_bits;
+
+} kvz_frame_stats;
+
 /**
  * \brief A linked list of chunks of data.
  *
@@ -708,6 +880,19 @@ typedef struct kvz_api {
    * \return        allocated picture, or NULL if allocation failed.
    */
   kvz_picture * (*picture_alloc_csp)(enum kvz_chroma_format chroma_fomat, int32_t width, int32_t height);
+
+  /**
+   * \brief Get statistics of the latest frame returned by encoder_encode.
+   *
+   * \since 4.2.0
+   * \param encoder    encoder
+   * \param stats_out  Returns the statistics. The caller must set
+   *                   stats_out->version to KVZ_FRAME_STATS_VERSION. Only
+   *                   the fields of that version are written.
+   * \return           1 on success, 0 if no frame has been returned yet or
+   *                   the version is not supported.
+   */
+  int           (*encoder_frame_stats)(kvz_encoder *encoder, kvz_frame_stats *stats_out);
 } kvz_api;
 
 
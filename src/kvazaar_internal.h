@@ -59,8 +59,21 @@ struct kvz_encoder {
    */
   input_frame_buffer_t input_buffer;
 
+  /**
+   * \brief Frame at a scene cut, held until the frames before it have been
+   * taken from the input buffer.
+   */
+  kvz_picture *scenecut_frame;
+
   unsigned frames_started;
   unsigned frames_done;
+
+  /**
+   * \brief Statistics of the latest frame returned by encoder_encode.
+   *
+   * Version is zero until the first frame has been returned.
+   */
+  kvz_frame_stats frame_stats;
 };
 
 #endif // KVAZAAR_INTERNAL_H_
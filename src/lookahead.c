@@ -0,0 +1,606 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "lookahead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+#include "strategies/strategies-picture.h"
+#include "trace.h"
+
+
+/**
+ * \brief Maximum length of the motion vectors in downscaled pixels.
+ */
+#define LOOKAHEAD_SEARCH_RANGE 32
+
+
+/**
+ * \brief Downscale the luma of a frame by two.
+ *
+ * The downscaled frame is padded to a multiple of LOOKAHEAD_BLOCK_SIZE by
+ * repeating the last column and row.
+ */
+static void lookahead_downscale_worker(void *opaque)
+{
+  lookahead_frame_t *const frame = opaque;
+  const kvz_picture *const src = frame->source;
+  kvz_picture *const dst = frame->lowres;
+
+  const int width  = MIN(src->width  / 2, dst->width);
+  const int height = MIN(src->height / 2, dst->height);
+
+  for (int y = 0; y < height; y++) {
+    const kvz_pixel *row0 = &src->y[(2 * y) * src->stride];
+    const kvz_pixel *row1 = row0 + src->stride;
+    kvz_pixel *out = &dst->y[y * dst->stride];
+
+    for (int x = 0; x < width; x++) {
+      out[x] = (row0[2 * x] + row0[2 * x + 1] +
+                row1[2 * x] + row1[2 * x + 1] + 2) >> 2;
+    }
+    for (int x = width; x < dst->width; x++) {
+      out[x] = out[width - 1];
+    }
+  }
+
+  for (int y = height; y < dst->height; y++) {
+    memcpy(&dst->y[y * dst->stride],
+           &dst->y[(height - 1) * dst->stride],
+           dst->width * sizeof(kvz_pixel));
+  }
+}
+
+
+/**
+ * \brief Estimate the cost of intra coding a block.
+ *
+ * Tries DC, planar, horizontal and vertical prediction from the
+ * neighbouring pixels of the downscaled frame and returns the smallest SATD.
+ */
+static uint32_t lookahead_intra_cost(const kvz_picture *const pic, int x, int y)
+{
+  const int size = LOOKAHEAD_BLOCK_SIZE;
+  const kvz_pixel *const orig = &pic->y[y * pic->stride + x];
+
+  kvz_pixel top[LOOKAHEAD_BLOCK_SIZE];
+  kvz_pixel left[LOOKAHEAD_BLOCK_SIZE];
+  for (int i = 0; i < size; i++) {
+    if (y > 0) {
+      top[i] = orig[i - pic->stride];
+    } else if (x > 0) {
+      top[i] = orig[-1];
+    } else {
+      top[i] = 1 << (KVZ_BIT_DEPTH - 1);
+    }
+    left[i] = x > 0 ? orig[i * pic->stride - 1] : top[0];
+  }
+
+  kvz_pixel pred[LOOKAHEAD_BLOCK_SIZE * LOOKAHEAD_BLOCK_SIZE];
+  uint32_t best_cost = UINT32_MAX;
+
+  // DC
+  int sum = 0;
+  for (int i = 0; i < size; i++) {
+    sum += top[i] + left[i];
+  }
+  memset(pred, (sum + size) / (2 * size), sizeof(pred));
+  best_cost = MIN(best_cost, kvz_satd_any_size(size, size, orig, pic->stride, pred, size));
+
+  // Planar
+  for (int j = 0; j < size; j++) {
+    for (int i = 0; i < size; i++) {
+      pred[j * size + i] = ((size - 1 - i) * left[j] + (i + 1) * top[size - 1] +
+                            (size - 1 - j) * top[i] + (j + 1) * left[size - 1] +
+                            size) / (2 * size);
+    }
+  }
+  best_cost = MIN(best_cost, kvz_satd_any_size(size, size, orig, pic->stride, pred, size));
+
+  // Horizontal
+  for (int j = 0; j < size; j++) {
+    for (int i = 0; i < size; i++) {
+      pred[j * size + i] = left[j];
+    }
+  }
+  best_cost = MIN(best_cost, kvz_satd_any_size(size, size, orig, pic->stride, pred, size));
+
+  // Vertical
+  for (int j = 0; j < size; j++) {
+    memcpy(&pred[j * size], top, size * sizeof(kvz_pixel));
+  }
+  best_cost = MIN(best_cost, kvz_satd_any_size(size, size, orig, pic->stride, pred, size));
+
+  return best_cost >> (KVZ_BIT_DEPTH - 8);
+}
+
+
+/**
+ * \brief Find the motion vector of a block with a diamond search.
+ *
+ * The search starts from the best of the zero vector and the given
+ * candidates and refines it with steps of four, two and one pixels.
+ */
+static vector2d_t lookahead_motion_search(const kvz_picture *const pic,
+                                          const kvz_picture *const ref,
+                                          int x,
+                                          int y,
+                                          const vector2d_t *const candidates,
+                                          int num_candidates,
+                                          optimized_sad_func_ptr_t optimized_sad)
+{
+  const int size = LOOKAHEAD_BLOCK_SIZE;
+  static const vector2d_t directions[4] = { { 0, -1 }, { -1, 0 }, { 1, 0 }, { 0, 1 } };
+
+  vector2d_t best = { 0, 0 };
+  uint32_t best_cost = kvz_image_calc_sad(pic, ref, x, y, x, y, size, size, optimized_sad);
+
+  for (int i = 0; i < num_candidates; i++) {
+    const vector2d_t mv = candidates[i];
+    if (mv.x == best.x && mv.y == best.y) continue;
+
+    const uint32_t cost = kvz_image_calc_sad(pic, ref, x, y, x + mv.x, y + mv.y,
+                                             size, size, optimized_sad);
+    if (cost < best_cost) {
+      best_cost = cost;
+      best = mv;
+    }
+  }
+
+  for (int step = 4; step > 0; step /= 2) {
+    for (int iter = 0; iter < LOOKAHEAD_SEARCH_RANGE; iter++) {
+      const vector2d_t center = best;
+
+      for (int i = 0; i < 4; i++) {
+        const vector2d_t mv = {
+          center.x + directions[i].x * step,
+          center.y + directions[i].y * step,
+        };
+        if (abs(mv.x) > LOOKAHEAD_SEARCH_RANGE || abs(mv.y) > LOOKAHEAD_SEARCH_RANGE) {
+          continue;
+        }
+
+        const uint32_t cost = kvz_image_calc_sad(pic, ref, x, y, x + mv.x, y + mv.y,
+                                                 size, size, optimized_sad);
+        if (cost < best_cost) {
+          best_cost = cost;
+          best = mv;
+        }
+      }
+
+      if (best.x == center.x && best.y == center.y) break;
+    }
+  }
+
+  return best;
+}
+
+
+/**
+ * \brief Compute the intra and inter costs of each block of a frame.
+ */
+static void lookahead_analysis_worker(void *opaque)
+{
+  lookahead_frame_t *const frame = opaque;
+  const kvz_picture *const pic = frame->lowres;
+  const kvz_picture *const ref = frame->prev_lowres;
+  const int size = LOOKAHEAD_BLOCK_SIZE;
+  const int width_in_blocks = frame->width_in_blocks;
+
+  optimized_sad_func_ptr_t optimized_sad = kvz_get_optimized_sad(size);
+
+  uint64_t intra_cost = 0;
+  uint64_t inter_cost = 0;
+
+  for (int by = 0; by < frame->height_in_blocks; by++) {
+    for (int bx = 0; bx < width_in_blocks; bx++) {
+      const int idx = by * width_in_blocks + bx;
+      const int x = bx * size;
+      const int y = by * size;
+
+      const uint32_t intra = lookahead_intra_cost(pic, x, y);
+      uint32_t cost = intra;
+      vector2d_t mv = { 0, 0 };
+
+      if (ref) {
+        vector2d_t candidates[2];
+        int num_candidates = 0;
+        if (bx > 0) candidates[num_candidates++] = frame->mvs[idx - 1];
+        if (by > 0) candidates[num_candidates++] = frame->mvs[idx - width_in_blocks];
+
+        mv = lookahead_motion_search(pic, ref, x, y,
+                                     candidates, num_candidates,
+                                     optimized_sad);
+        const uint32_t inter = kvz_image_calc_satd(pic, ref, x, y,
+                                                   x + mv.x, y + mv.y,
+                                                   size, size);
+        if (inter < intra) {
+          cost = inter;
+        } else {
+          mv.x = 0;
+          mv.y = 0;
+        }
+      }
+
+      frame->intra_costs[idx] = intra;
+      frame->inter_costs[idx] = cost;
+      frame->mvs[idx] = mv;
+      intra_cost += intra;
+      inter_cost += cost;
+    }
+  }
+
+  frame->intra_cost = intra_cost;
+  frame->inter_cost = inter_cost;
+}
+
+
+/**
+ * \brief Release the input frame and the jobs of a buffer element.
+ *
+ * Waits for the analysis of the frame and the frame after it, which reads
+ * the downscaled frame, unless wait is false.
+ */
+static void lookahead_frame_release(lookahead_t *const lookahead,
+                                    lookahead_frame_t *const frame,
+                                    bool wait)
+{
+  if (wait && frame->analysis_job) {
+    kvz_threadqueue_waitfor(lookahead->threadqueue, frame->analysis_job);
+
+    lookahead_frame_t *const next =
+      &lookahead->frames[(frame->num + 1) % lookahead->num_frames];
+    if (next->num == frame->num + 1 && next->analysis_job) {
+      kvz_threadqueue_waitfor(lookahead->threadqueue, next->analysis_job);
+    }
+  }
+
+  kvz_threadqueue_free_job(&frame->downscale_job);
+  kvz_threadqueue_free_job(&frame->analysis_job);
+  kvz_image_free(frame->source);
+  frame->source = NULL;
+  frame->prev_lowres = NULL;
+  frame->num = -1;
+}
+
+
+/**
+ * \brief Allocate a lookahead.
+ *
+ * \param threadqueue   threadqueue for running the analysis
+ * \param width         width of the input frames
+ * \param height        height of the input frames
+ * \param depth         number of frames to hold before passing them on
+ * \param gop_len       length of the GOP structure
+ * \param scenecut      scene cut threshold in percent, 0 to disable
+ * \return              lookahead, or NULL on failure
+ */
+lookahead_t * kvz_lookahead_alloc(threadqueue_queue_t *threadqueue,
+                                  int width,
+                                  int height,
+                                  int depth,
+                                  int gop_len,
+                                  int scenecut)
+{
+  lookahead_t *lookahead = calloc(1, sizeof(lookahead_t));
+  if (!lookahead) goto failure;
+
+  lookahead->threadqueue = threadqueue;
+  lookahead->depth = depth;
+  // Keep the analysis of the frames waiting for reordering in the input
+  // buffer and of the GOPs around them. At a scene cut, the frames input
+  // while the frames before the cut are encoded are also held.
+  lookahead->num_frames = depth + 8 * MAX(1, gop_len) + 2;
+  lookahead->scenecut = scenecut;
+  // Restarting the GOP structure more often would leave only short GOPs.
+  lookahead->min_cut_distance = MAX(1, gop_len);
+  lookahead->last_cut = 0;
+  lookahead->num_in = 0;
+  lookahead->num_out = 0;
+
+  lookahead->frames = calloc(lookahead->num_frames, sizeof(lookahead_frame_t));
+  if (!lookahead->frames) goto failure;
+
+  const int width_in_blocks  = CEILDIV(width,  2 * LOOKAHEAD_BLOCK_SIZE);
+  const int height_in_blocks = CEILDIV(height, 2 * LOOKAHEAD_BLOCK_SIZE);
+  const int num_blocks = width_in_blocks * height_in_blocks;
+
+  lookahead->propagate[0] = MALLOC(double, num_blocks);
+  lookahead->propagate[1] = MALLOC(double, num_blocks);
+  if (!lookahead->propagate[0] || !lookahead->propagate[1]) goto failure;
+
+  for (int i = 0; i < lookahead->num_frames; i++) {
+    lookahead_frame_t *frame = &lookahead->frames[i];
+    frame->num = -1;
+    frame->width_in_blocks  = width_in_blocks;
+    frame->height_in_blocks = height_in_blocks;
+    frame->lowres = kvz_image_alloc(KVZ_CSP_400,
+                                    width_in_blocks  * LOOKAHEAD_BLOCK_SIZE,
+                                    height_in_blocks * LOOKAHEAD_BLOCK_SIZE);
+    frame->intra_costs = MALLOC(uint32_t, num_blocks);
+    frame->inter_costs = MALLOC(uint32_t, num_blocks);
+    frame->mvs = MALLOC(vector2d_t, num_blocks);
+    if (!frame->lowres || !frame->intra_costs || !frame->inter_costs || !frame->mvs) {
+      goto failure;
+    }
+  }
+
+  return lookahead;
+
+failure:
+  fprintf(stderr, "Failed to allocate lookahead.\n");
+  kvz_lookahead_free(lookahead);
+  return NULL;
+}
+
+
+/**
+ * \brief Free a lookahead.
+ *
+ * The threadqueue must be stopped before calling this function, unless no
+ * frames have been input.
+ */
+void kvz_lookahead_free(lookahead_t *lookahead)
+{
+  if (!lookahead) return;
+
+  if (lookahead->frames) {
+    for (int i = 0; i < lookahead->num_frames; i++) {
+      lookahead_frame_t *frame = &lookahead->frames[i];
+      lookahead_frame_release(lookahead, frame, false);
+      kvz_image_free(frame->lowres);
+      FREE_POINTER(frame->intra_costs);
+      FREE_POINTER(frame->inter_costs);
+      FREE_POINTER(frame->mvs);
+    }
+    FREE_POINTER(lookahead->frames);
+  }
+  FREE_POINTER(lookahead->propagate[0]);
+  FREE_POINTER(lookahead->propagate[1]);
+
+  free(lookahead);
+}
+
+
+/**
+ * \brief Pass an input frame to the lookahead.
+ *
+ * Starts the analysis of the frame.
+ *
+ * \param lookahead   lookahead
+ * \param img_in      input frame
+ */
+void kvz_lookahead_push(lookahead_t *lookahead, kvz_picture *img_in)
+{
+  threadqueue_queue_t *const threadqueue = lookahead->threadqueue;
+
+  const int64_t num = lookahead->num_in;
+  // Frames that have not been passed on must not be overwritten.
+  assert(num - lookahead->num_out < lookahead->num_frames);
+
+  lookahead_frame_t *const frame = &lookahead->frames[num % lookahead->num_frames];
+  lookahead_frame_release(lookahead, frame, true);
+
+  frame->num = num;
+  frame->source = kvz_image_copy_ref(img_in);
+
+  lookahead_frame_t *prev = NULL;
+  if (num > 0) {
+    prev = &lookahead->frames[(num - 1) % lookahead->num_frames];
+    assert(prev->num == num - 1);
+    frame->prev_lowres = prev->lowres;
+  }
+
+  // The analysis jobs keep the default priority, which is not lower than
+  // that of any LCU job. They are cheap and must be done before the
+  // frames can be encoded.
+  frame->downscale_job = kvz_threadqueue_job_create(threadqueue,
+                                                    lookahead_downscale_worker,
+                                                    frame);
+  kvz_threadqueue_job_set_trace(frame->downscale_job, KVZ_TRACE_LOOKAHEAD,
+                                (int32_t)num, -1, -1);
+
+  frame->analysis_job = kvz_threadqueue_job_create(threadqueue,
+                                                   lookahead_analysis_worker,
+                                                   frame);
+  kvz_threadqueue_job_set_trace(frame->analysis_job, KVZ_TRACE_LOOKAHEAD,
+                                (int32_t)num, -1, -1);
+  kvz_threadqueue_job_dep_add(frame->analysis_job, frame->downscale_job);
+  if (prev) {
+    kvz_threadqueue_job_dep_add(frame->analysis_job, prev->downscale_job);
+  }
+
+  kvz_threadqueue_submit(threadqueue, frame->downscale_job);
+  kvz_threadqueue_submit(threadqueue, frame->analysis_job);
+
+  lookahead->num_in++;
+}
+
+
+/**
+ * \brief Take the next frame out of the lookahead.
+ *
+ * Returns the oldest frame once depth frames after it have been input, or
+ * at the end of the input, any remaining frame.
+ *
+ * \param lookahead   lookahead
+ * \param flush       true at the end of the input
+ * \param scenecut    set to true if the frame starts a new scene
+ * \return            next frame to encode, or NULL if no frame is
+ *                    available; the caller must free the frame
+ */
+kvz_picture * kvz_lookahead_pop(lookahead_t *lookahead, bool flush, bool *scenecut)
+{
+  *scenecut = false;
+
+  if (lookahead->num_out == lookahead->num_in ||
+      (!flush && lookahead->num_in - lookahead->num_out <= lookahead->depth)) {
+    return NULL;
+  }
+
+  lookahead_frame_t *const frame =
+    &lookahead->frames[lookahead->num_out % lookahead->num_frames];
+  assert(frame->num == lookahead->num_out);
+
+  if (lookahead->scenecut > 0 &&
+      frame->num - lookahead->last_cut >= lookahead->min_cut_distance)
+  {
+    kvz_threadqueue_waitfor(lookahead->threadqueue, frame->analysis_job);
+    // The frame starts a new scene if inter prediction from the previous
+    // frame saves less than the threshold compared to intra prediction.
+    if (frame->inter_cost * 100 >= frame->intra_cost * (100 - lookahead->scenecut)) {
+      *scenecut = true;
+      lookahead->last_cut = frame->num;
+    }
+  }
+
+  // The downscaling reads the frame.
+  kvz_threadqueue_waitfor(lookahead->threadqueue, frame->downscale_job);
+  kvz_picture *const pic = frame->source;
+  frame->source = NULL;
+
+  lookahead->num_out++;
+  return pic;
+}
+
+
+/**
+ * \brief Get the analysis of a frame.
+ *
+ * Waits for the analysis to be done.
+ *
+ * \param lookahead   lookahead
+ * \param num         number of the frame in input order
+ * \return            analysis of the frame, or NULL if the frame has not
+ *                    been input or is no longer available
+ */
+const lookahead_frame_t * kvz_lookahead_get(lookahead_t *lookahead, int64_t num)
+{
+  if (num < 0 || num >= lookahead->num_in) return NULL;
+
+  lookahead_frame_t *const frame = &lookahead->frames[num % lookahead->num_frames];
+  if (frame->num != num) return NULL;
+
+  kvz_threadqueue_waitfor(lookahead->threadqueue, frame->analysis_job);
+  return frame;
+}
+
+
+/**
+ * \brief Add the propagated cost of a block to the blocks it overlaps.
+ *
+ * \param propagate   propagated costs of the blocks of a frame
+ * \param frame       analysis of the frame
+ * \param x           horizontal position of the block in downscaled pixels
+ * \param y           vertical position of the block in downscaled pixels
+ * \param amount      cost to add
+ */
+static void propagate_to_blocks(double *const propagate,
+                                const lookahead_frame_t *const frame,
+                                int x,
+                                int y,
+                                double amount)
+{
+  const int size = LOOKAHEAD_BLOCK_SIZE;
+  // Top left block and the overlap with it in pixels.
+  const int bx = (x >= 0 ? x : x - size + 1) / size;
+  const int by = (y >= 0 ? y : y - size + 1) / size;
+  const int overlap_x = size - (x - bx * size);
+  const int overlap_y = size - (y - by * size);
+
+  for (int j = 0; j < 2; j++) {
+    const int block_y = by + j;
+    const int height  = j == 0 ? overlap_y : size - overlap_y;
+    if (block_y < 0 || block_y >= frame->height_in_blocks || height == 0) continue;
+
+    for (int i = 0; i < 2; i++) {
+      const int block_x = bx + i;
+      const int width   = i == 0 ? overlap_x : size - overlap_x;
+      if (block_x < 0 || block_x >= frame->width_in_blocks || width == 0) continue;
+
+      propagate[block_y * frame->width_in_blocks + block_x] +=
+        amount * (width * height) / (size * size);
+    }
+  }
+}
+
+
+/**
+ * \brief Estimate how much the blocks of a frame are referenced by the
+ * frames after it.
+ *
+ * Starting from the last frame, the part of the cost of each block that
+ * inter prediction saves, including the cost propagated to the block
+ * itself, is passed on to the blocks of the previous frame that the block
+ * is predicted from. This is the MB-tree algorithm of x264 applied to the
+ * previous frame references of the lookahead.
+ *
+ * \param lookahead   lookahead
+ * \param num         number of the frame in input order
+ * \param max_frames  maximum number of frames after the frame to use
+ * \return            propagated cost of each block, valid until the next
+ *                    call, or NULL if the frame is not available
+ */
+const double * kvz_lookahead_propagate(lookahead_t *lookahead,
+                                       int64_t num,
+                                       int max_frames)
+{
+  const lookahead_frame_t *const frame = kvz_lookahead_get(lookahead, num);
+  if (!frame) return NULL;
+
+  const int num_blocks = frame->width_in_blocks * frame->height_in_blocks;
+
+  int64_t last = num;
+  while (last < num + max_frames && kvz_lookahead_get(lookahead, last + 1)) {
+    last++;
+  }
+
+  double *propagate_in  = lookahead->propagate[0];
+  double *propagate_out = lookahead->propagate[1];
+  memset(propagate_in, 0, num_blocks * sizeof(double));
+
+  for (int64_t i = last; i > num; i--) {
+    const lookahead_frame_t *const cur = kvz_lookahead_get(lookahead, i);
+    memset(propagate_out, 0, num_blocks * sizeof(double));
+
+    for (int by = 0; by < cur->height_in_blocks; by++) {
+      for (int bx = 0; bx < cur->width_in_blocks; bx++) {
+        const int idx = by * cur->width_in_blocks + bx;
+        const uint32_t intra = cur->intra_costs[idx];
+        const uint32_t inter = cur->inter_costs[idx];
+        if (inter >= intra) continue;
+
+        const double amount = (intra + propagate_in[idx]) *
+                              (intra - inter) / (double)intra;
+        propagate_to_blocks(propagate_out, cur,
+                            bx * LOOKAHEAD_BLOCK_SIZE + cur->mvs[idx].x,
+                            by * LOOKAHEAD_BLOCK_SIZE + cur->mvs[idx].y,
+                            amount);
+      }
+    }
+
+    SWAP(propagate_in, propagate_out, double*);
+  }
+
+  return propagate_in;
+}
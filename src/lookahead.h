@@ -0,0 +1,154 @@
+#ifndef LOOKAHEAD_H_
+#define LOOKAHEAD_H_
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+/**
+ * \ingroup Control
+ * \file
+ * \brief Analysis of input frames ahead of encoding.
+ *
+ * Input frames are downscaled by two and the SATD costs of intra and inter
+ * prediction are estimated for each block of the downscaled frame. The
+ * analysis runs as jobs in the threadqueue while the frames wait in the
+ * lookahead buffer before they are passed on to the encoder. The costs are
+ * also used for detecting scene cuts and for lowering the QP of blocks that
+ * are referenced by later frames.
+ */
+
+#include "global.h" // IWYU pragma: keep
+
+#include "cu.h"
+#include "kvazaar.h"
+#include "threadqueue.h"
+
+
+/**
+ * \brief Width and height of the analysed blocks in the downscaled frame.
+ *
+ * Each block covers 16x16 pixels of the input frame.
+ */
+#define LOOKAHEAD_BLOCK_SIZE 8
+
+/**
+ * \brief Analysis of a single input frame.
+ */
+typedef struct lookahead_frame_t {
+  /** \brief Number of the frame in input order. */
+  int64_t num;
+
+  /** \brief Input frame, or NULL after it has been passed on. */
+  kvz_picture *source;
+
+  /** \brief Luma of the input frame downscaled by two. */
+  kvz_picture *lowres;
+
+  /** \brief Downscaled luma of the previous frame, or NULL. */
+  kvz_picture *prev_lowres;
+
+  /** \brief SATD of the best intra prediction of each block. */
+  uint32_t *intra_costs;
+
+  /**
+   * \brief SATD of the best prediction of each block, intra or inter from
+   * the previous frame.
+   */
+  uint32_t *inter_costs;
+
+  /**
+   * \brief Motion vector of each block in downscaled pixels.
+   *
+   * Zero for blocks for which intra prediction is better.
+   */
+  vector2d_t *mvs;
+
+  /** \brief Sum of intra_costs. */
+  uint64_t intra_cost;
+
+  /** \brief Sum of inter_costs. */
+  uint64_t inter_cost;
+
+  /** \brief Job downscaling the frame. */
+  threadqueue_job_t *downscale_job;
+
+  /** \brief Job computing the costs. */
+  threadqueue_job_t *analysis_job;
+
+  /** \brief Number of blocks in the downscaled frame horizontally. */
+  int width_in_blocks;
+
+  /** \brief Number of blocks in the downscaled frame vertically. */
+  int height_in_blocks;
+} lookahead_frame_t;
+
+typedef struct lookahead_t {
+  threadqueue_queue_t *threadqueue;
+
+  /** \brief Number of frames held before passing them on. */
+  int depth;
+
+  /** \brief Ring buffer of analysed frames indexed by frame number. */
+  lookahead_frame_t *frames;
+
+  /** \brief Number of elements in frames. */
+  int num_frames;
+
+  /** \brief Number of frames input. */
+  int64_t num_in;
+
+  /** \brief Number of frames passed on. */
+  int64_t num_out;
+
+  /**
+   * \brief Scene cut threshold in percent, 0 to disable.
+   *
+   * A frame starts a new scene if inter prediction from the previous frame
+   * saves less than this percentage of the intra cost.
+   */
+  int scenecut;
+
+  /** \brief Minimum number of frames between scene cuts. */
+  int min_cut_distance;
+
+  /** \brief Number of the frame at the last scene cut. */
+  int64_t last_cut;
+
+  /** \brief Propagated costs of the blocks of two consecutive frames. */
+  double *propagate[2];
+} lookahead_t;
+
+lookahead_t * kvz_lookahead_alloc(threadqueue_queue_t *threadqueue,
+                                  int width,
+                                  int height,
+                                  int depth,
+                                  int gop_len,
+                                  int scenecut);
+void kvz_lookahead_free(lookahead_t *lookahead);
+
+void kvz_lookahead_push(lookahead_t *lookahead, kvz_picture *img_in);
+kvz_picture * kvz_lookahead_pop(lookahead_t *lookahead, bool flush, bool *scenecut);
+
+const lookahead_frame_t * kvz_lookahead_get(lookahead_t *lookahead, int64_t num);
+
+const double * kvz_lookahead_propagate(lookahead_t *lookahead,
+                                       int64_t num,
+                                       int max_frames);
+
+#endif // LOOKAHEAD_H_
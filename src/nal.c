@@ -64,12 +64,12 @@ void kvz_nal_write(bitstream_t * const bitstream, const uint8_t nal_type,
 */
 void kvz_image_checksum(const kvz_picture *im, unsigned char checksum_out[][SEI_HASH_MAX_LENGTH], const uint8_t bitdepth)
 {
-  kvz_array_checksum(im->y, im->height, im->width, im->width, checksum_out[0], bitdepth);
+  kvz_array_checksum(im->y, im->height, im->width, im->width, 0, checksum_out[0], bitdepth);
 
   /* The number of chroma pixels is half that of luma. */
   if (im->chroma_format != KVZ_CSP_400) {
-    kvz_array_checksum(im->u, im->height >> 1, im->width >> 1, im->width >> 1, checksum_out[1], bitdepth);
-    kvz_array_checksum(im->v, im->height >> 1, im->width >> 1, im->width >> 1, checksum_out[2], bitdepth);
+    kvz_array_checksum(im->u, im->height >> 1, im->width >> 1, im->width >> 1, 0, checksum_out[1], bitdepth);
+    kvz_array_checksum(im->v, im->height >> 1, im->width >> 1, im->width >> 1, 0, checksum_out[2], bitdepth);
   }
 }
 
@@ -81,11 +81,162 @@ void kvz_image_checksum(const kvz_picture *im, unsigned char checksum_out[][SEI_
 */
 void kvz_image_md5(const kvz_picture *im, unsigned char checksum_out[][SEI_HASH_MAX_LENGTH], const uint8_t bitdepth)
 {
-  kvz_array_md5(im->y, im->height, im->width, im->width, checksum_out[0], bitdepth);
+  kvz_array_md5(im->y, im->height, im->width, im->width, 0, checksum_out[0], bitdepth);
 
   /* The number of chroma pixels is half that of luma. */
   if (im->chroma_format != KVZ_CSP_400) {
-    kvz_array_md5(im->u, im->height >> 1, im->width >> 1, im->width >> 1, checksum_out[1], bitdepth);
-    kvz_array_md5(im->v, im->height >> 1, im->width >> 1, im->width >> 1, checksum_out[2], bitdepth);
+    kvz_array_md5(im->u, im->height >> 1, im->width >> 1, im->width >> 1, 0, checksum_out[1], bitdepth);
+    kvz_array_md5(im->v, im->height >> 1, im->width >> 1, im->width >> 1, 0, checksum_out[2], bitdepth);
+  }
+}
+
+
+/**
+ * \brief Start the decoded picture hash of a new picture.
+ */
+void kvz_picture_hash_init(picture_hash_t *hash)
+{
+  for (int i = 0; i < 3; ++i) {
+    kvz_md5_init(&hash->md5[i]);
+    hash->crc[i] = 0xffff;
+    hash->checksum[i] = 0;
+  }
+  hash->rows_done = 0;
+}
+
+
+/**
+ * \brief Add rows of one color plane to the hash.
+ *
+ * \param data       first pixel of the plane
+ * \param first_row  first row to add
+ * \param rows       number of rows to add
+ */
+static void picture_hash_plane(picture_hash_t *hash,
+                               enum kvz_hash type,
+                               int color,
+                               const kvz_pixel *data,
+                               int32_t first_row,
+                               int32_t rows,
+                               int32_t width,
+                               int32_t stride,
+                               uint8_t bitdepth)
+{
+  if (rows <= 0) return;
+
+  data += first_row * stride;
+
+  switch (type) {
+    case KVZ_HASH_CHECKSUM:
+    {
+      unsigned char bytes[SEI_HASH_MAX_LENGTH];
+      kvz_array_checksum(data, rows, width, stride, first_row, bytes, bitdepth);
+      hash->checksum[color] += ((uint32_t)bytes[0] << 24) | (bytes[1] << 16) |
+                               (bytes[2] << 8) | bytes[3];
+      break;
+    }
+
+    case KVZ_HASH_MD5:
+      for (int y = 0; y < rows; ++y) {
+        kvz_md5_update(&hash->md5[color],
+                       (const unsigned char *)&data[y * stride],
+                       width * sizeof(kvz_pixel));
+      }
+      break;
+
+    case KVZ_HASH_CRC:
+      hash->crc[color] = kvz_array_crc(hash->crc[color], data, rows, width, stride);
+      break;
+
+    case KVZ_HASH_NONE:
+      break;
+  }
+}
+
+
+/**
+ * \brief Add the rows above a given row of a picture to the hash.
+ *
+ * The rows must not change any more. Rows added already are skipped.
+ *
+ * \param hash   hash state
+ * \param type   hash algorithm
+ * \param im     picture
+ * \param rows   number of luma rows from the top of the picture
+ */
+void kvz_picture_hash_rows(picture_hash_t *hash,
+                           enum kvz_hash type,
+                           const kvz_picture *im,
+                           int32_t rows,
+                           uint8_t bitdepth)
+{
+  rows = MIN(rows, im->height);
+  if (rows <= hash->rows_done) return;
+
+  picture_hash_plane(hash, type, 0, im->y,
+                     hash->rows_done, rows - hash->rows_done,
+                     im->width, im->stride, bitdepth);
+
+  /* The number of chroma pixels is half that of luma. */
+  if (im->chroma_format != KVZ_CSP_400) {
+    const int32_t first_row_c = hash->rows_done >> 1;
+    const int32_t rows_c = (rows >> 1) - first_row_c;
+    picture_hash_plane(hash, type, 1, im->u, first_row_c, rows_c,
+                       im->width >> 1, im->stride >> 1, bitdepth);
+    picture_hash_plane(hash, type, 2, im->v, first_row_c, rows_c,
+                       im->width >> 1, im->stride >> 1, bitdepth);
+  }
+
+  hash->rows_done = rows;
+}
+
+
+/**
+ * \brief Add the remaining rows of a picture to the hash and output the
+ * hash of each color.
+ *
+ * \param hash          hash state
+ * \param type          hash algorithm
+ * \param im            picture
+ * \param checksum_out  hash values as they are written to the SEI message
+ */
+void kvz_picture_hash_final(picture_hash_t *hash,
+                            enum kvz_hash type,
+                            const kvz_picture *im,
+                            unsigned char checksum_out[][SEI_HASH_MAX_LENGTH],
+                            uint8_t bitdepth)
+{
+  kvz_picture_hash_rows(hash, type, im, im->height, bitdepth);
+
+  const int num_colors = im->chroma_format == KVZ_CSP_400 ? 1 : 3;
+  for (int i = 0; i < num_colors; ++i) {
+    switch (type) {
+      case KVZ_HASH_CHECKSUM:
+        checksum_out[i][0] = (hash->checksum[i] >> 24) & 0xff;
+        checksum_out[i][1] = (hash->checksum[i] >> 16) & 0xff;
+        checksum_out[i][2] = (hash->checksum[i] >> 8) & 0xff;
+        checksum_out[i][3] = hash->checksum[i] & 0xff;
+        break;
+
+      case KVZ_HASH_MD5:
+        kvz_md5_final(checksum_out[i], &hash->md5[i]);
+        break;
+
+      case KVZ_HASH_CRC:
+      {
+        // Feed the 16 zero bits that end the message.
+        uint32_t crc = hash->crc[i];
+        for (int bit = 0; bit < 16; ++bit) {
+          const uint32_t msb = (crc >> 15) & 1;
+          crc = ((crc << 1) & 0xffff) ^ (msb * 0x1021);
+        }
+        checksum_out[i][0] = (crc >> 8) & 0xff;
+        checksum_out[i][1] = crc & 0xff;
+        break;
+      }
+
+      case KVZ_HASH_NONE:
+        break;
+    }
   }
 }
@@ -29,10 +29,27 @@
 #include "bitstream.h"
 #include "global.h" // IWYU pragma: keep
 #include "kvazaar.h"
+#include "extras/libmd5.h"
 
 
 #define SEI_HASH_MAX_LENGTH 16
 
+/**
+ * \brief State of the decoded picture hash of a picture.
+ *
+ * The rows of the picture are added to the hash in order, starting from
+ * the top.
+ */
+typedef struct {
+  context_md5_t md5[3];
+  //! \brief CRC registers, without the final 16 zero bits.
+  uint32_t crc[3];
+  //! \brief Sums of the checksum.
+  uint32_t checksum[3];
+  //! \brief Number of luma rows added to the hash.
+  int32_t rows_done;
+} picture_hash_t;
+
 //////////////////////////////////////////////////////////////////////////
 // FUNCTIONS
 void kvz_nal_write(bitstream_t * const bitstream, const uint8_t nal_type,
@@ -43,6 +60,18 @@ void kvz_image_md5(const kvz_picture *im,
                    unsigned char checksum_out[][SEI_HASH_MAX_LENGTH],
                    const uint8_t bitdepth);
 
+void kvz_picture_hash_init(picture_hash_t *hash);
+void kvz_picture_hash_rows(picture_hash_t *hash,
+                           enum kvz_hash type,
+                           const kvz_picture *im,
+                           int32_t rows,
+                           uint8_t bitdepth);
+void kvz_picture_hash_final(picture_hash_t *hash,
+                            enum kvz_hash type,
+                            const kvz_picture *im,
+                            unsigned char checksum_out[][SEI_HASH_MAX_LENGTH],
+                            uint8_t bitdepth);
+
 
 
 #endif
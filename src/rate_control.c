@@ -24,12 +24,21 @@
 
 #include "encoder.h"
 #include "kvazaar.h"
+#include "lookahead.h"
 
 
 static const int SMOOTHING_WINDOW = 40;
 static const double MIN_LAMBDA    = 0.1;
 static const double MAX_LAMBDA    = 10000;
 
+// Bits are allocated in proportion to the estimated complexity of the
+// frames raised to this power.
+static const double COMPLEXITY_EXPONENT = 0.4;
+
+// QP offset of a block per doubling of its cost by the propagation from
+// later frames. This is the default strength of MB-tree in x264.
+static const double CUTREE_STRENGTH = 2.0;
+
 /**
  * \brief Clip lambda value to a valid range.
  */
@@ -64,6 +73,53 @@ static void update_parameters(uint32_t bits,
   *beta  = CLIP(-3, -0.1, *beta);
 }
 
+/**
+ * \brief Weight the bits of the current GOP by the complexity of its frames.
+ *
+ * The weight is the complexity of the frames of the GOP relative to the
+ * frames analysed by the lookahead, so that the bits are spread over the
+ * upcoming frames according to their complexity.
+ *
+ * \param state   the main encoder state
+ * \return        weight of the GOP
+ */
+static double lookahead_gop_weight(encoder_state_t * const state)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const int gop_len = MAX(1, encoder->cfg.gop_len);
+
+  // Number of the first frame of the GOP in input order.
+  int64_t first = state->frame->input_num;
+  if (encoder->cfg.gop_len > 0) {
+    first -= encoder->cfg.gop[state->frame->gop_offset].poc_offset - 1;
+  }
+  first = MAX(0, first);
+
+  const int64_t window = MAX(gop_len, encoder->cfg.lookahead);
+  double gop_complexity    = 0;
+  double window_complexity = 0;
+  int gop_frames    = 0;
+  int window_frames = 0;
+  for (int64_t i = first; i < first + window; i++) {
+    const lookahead_frame_t *frame = kvz_lookahead_get(encoder->lookahead, i);
+    if (!frame) break;
+
+    const double complexity = pow(MAX(1, frame->inter_cost), COMPLEXITY_EXPONENT);
+    if (i < first + gop_len) {
+      gop_complexity += complexity;
+      gop_frames++;
+    }
+    window_complexity += complexity;
+    window_frames++;
+  }
+
+  if (gop_frames == 0) return 1.0;
+
+  const double weight = (gop_complexity / gop_frames) /
+                        (window_complexity / window_frames);
+  return CLIP(0.5, 2.0, weight);
+}
+
 /**
  * \brief Allocate bits for the current GOP.
  * \param state   the main encoder state
@@ -91,6 +147,9 @@ static double gop_allocate_bits(encoder_state_t * const state)
   double gop_target_bits =
     (encoder->target_avg_bppic * (pictures_coded + SMOOTHING_WINDOW) - bits_coded)
     * MAX(1, encoder->cfg.gop_len) / SMOOTHING_WINDOW;
+  if (encoder->lookahead) {
+    gop_target_bits *= lookahead_gop_weight(state);
+  }
   // Allocate at least 200 bits for each GOP like HM does.
   return MAX(200, gop_target_bits);
 }
@@ -119,6 +178,10 @@ static uint64_t pic_header_bits(encoder_state_t * const state)
       bits += 456;
       break;
 
+    case KVZ_HASH_CRC:
+      bits += 120;
+      break;
+
     case KVZ_HASH_NONE:
       break;
   }
@@ -167,6 +230,104 @@ static double pic_allocate_bits(encoder_state_t * const state)
   return MAX(100, pic_target_bits);
 }
 
+/**
+ * \brief Set the LCU weights of a picture without history from the
+ * lookahead.
+ *
+ * The weight of each LCU is its share of the estimated cost of the picture.
+ *
+ * \param state   the main encoder state
+ */
+static void lookahead_lcu_weights(encoder_state_t * const state)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const lookahead_frame_t *frame = kvz_lookahead_get(encoder->lookahead,
+                                                     state->frame->input_num);
+  assert(frame != NULL);
+
+  const uint32_t *costs = state->frame->slicetype == KVZ_SLICE_I ?
+                          frame->intra_costs : frame->inter_costs;
+  const uint64_t total_cost = state->frame->slicetype == KVZ_SLICE_I ?
+                              frame->intra_cost : frame->inter_cost;
+  const int num_lcus = encoder->in.width_in_lcu * encoder->in.height_in_lcu;
+  // Number of lookahead blocks along each side of an LCU.
+  const int lcu_blocks = LCU_WIDTH / (2 * LOOKAHEAD_BLOCK_SIZE);
+
+  for (int y = 0; y < encoder->in.height_in_lcu; y++) {
+    for (int x = 0; x < encoder->in.width_in_lcu; x++) {
+      uint64_t lcu_cost = 0;
+      const int last_by = MIN((y + 1) * lcu_blocks, frame->height_in_blocks);
+      const int last_bx = MIN((x + 1) * lcu_blocks, frame->width_in_blocks);
+      for (int by = y * lcu_blocks; by < last_by; by++) {
+        for (int bx = x * lcu_blocks; bx < last_bx; bx++) {
+          lcu_cost += costs[by * frame->width_in_blocks + bx];
+        }
+      }
+
+      lcu_stats_t *lcu = &state->frame->lcu_stats[x + y * encoder->in.width_in_lcu];
+      lcu->weight = total_cost > 0 ? lcu_cost / (double)total_cost : 1.0 / num_lcus;
+    }
+  }
+}
+
+/**
+ * \brief Set the QP offsets of the LCUs of the current picture from the
+ * temporal propagation of the lookahead.
+ *
+ * The offset of each lookahead block is CUTREE_STRENGTH times the base-2
+ * logarithm of the ratio of its intra cost to its intra cost plus the cost
+ * propagated to it from later frames. The offset of an LCU is the mean of
+ * the offsets of its blocks.
+ *
+ * \param state   the main encoder state
+ */
+static void cutree_lcu_dqps(encoder_state_t * const state)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const lookahead_frame_t *frame = kvz_lookahead_get(encoder->lookahead,
+                                                     state->frame->input_num);
+  assert(frame != NULL);
+
+  // No picture is predicted from pictures that are not used as references.
+  const double *propagate = NULL;
+  if (state->frame->slicetype == KVZ_SLICE_I ||
+      encoder->cfg.gop_len == 0 ||
+      encoder->cfg.gop[state->frame->gop_offset].is_ref)
+  {
+    propagate = kvz_lookahead_propagate(encoder->lookahead,
+                                        state->frame->input_num,
+                                        encoder->cfg.lookahead);
+  }
+
+  // Number of lookahead blocks along each side of an LCU.
+  const int lcu_blocks = LCU_WIDTH / (2 * LOOKAHEAD_BLOCK_SIZE);
+
+  for (int y = 0; y < encoder->in.height_in_lcu; y++) {
+    for (int x = 0; x < encoder->in.width_in_lcu; x++) {
+      lcu_stats_t *lcu = &state->frame->lcu_stats[x + y * encoder->in.width_in_lcu];
+      lcu->cutree_dqp = 0;
+      if (!propagate) continue;
+
+      double offset = 0;
+      int num_blocks = 0;
+      const int last_by = MIN((y + 1) * lcu_blocks, frame->height_in_blocks);
+      const int last_bx = MIN((x + 1) * lcu_blocks, frame->width_in_blocks);
+      for (int by = y * lcu_blocks; by < last_by; by++) {
+        for (int bx = x * lcu_blocks; bx < last_bx; bx++) {
+          const int idx = by * frame->width_in_blocks + bx;
+          const double intra = MAX(1, frame->intra_costs[idx]);
+          offset -= CUTREE_STRENGTH * log2((intra + propagate[idx]) / intra);
+          num_blocks++;
+        }
+      }
+
+      if (num_blocks > 0) {
+        lcu->cutree_dqp = CLIP(-51, 51, (int)lround(offset / num_blocks));
+      }
+    }
+  }
+}
+
 static int8_t lambda_to_qp(const double lambda)
 {
   const int8_t qp = 4.2005 * log(lambda) + 13.7223 + 0.5;
@@ -214,6 +375,10 @@ void kvz_set_picture_lambda_and_qp(encoder_state_t * const state)
 {
   const encoder_control_t * const ctrl = state->encoder_control;
 
+  if (ctrl->cfg.cutree) {
+    cutree_lcu_dqps(state);
+  }
+
   if (ctrl->cfg.target_bitrate > 0) {
     // Rate control enabled
 
@@ -226,6 +391,10 @@ void kvz_set_picture_lambda_and_qp(encoder_state_t * const state)
                         &state->frame->rc_beta);
     }
 
+    if (ctrl->lookahead && state->frame->num <= ctrl->cfg.owf) {
+      lookahead_lcu_weights(state);
+    }
+
     const double pic_target_bits = pic_allocate_bits(state);
     const double target_bpp = pic_target_bits / ctrl->in.pixels_per_pic;
     double lambda = state->frame->rc_alpha * pow(target_bpp, state->frame->rc_beta);
@@ -260,7 +429,8 @@ static double lcu_allocate_bits(encoder_state_t * const state,
                                 vector2d_t pos)
 {
   double lcu_weight;
-  if (state->frame->num > state->encoder_control->cfg.owf) {
+  if (state->frame->num > state->encoder_control->cfg.owf ||
+      state->encoder_control->lookahead) {
     lcu_weight = kvz_get_lcu_stats(state, pos.x, pos.y)->weight;
   } else {
     const uint32_t num_lcus = state->encoder_control->in.width_in_lcu *
@@ -280,6 +450,15 @@ void kvz_set_lcu_lambda_and_qp(encoder_state_t * const state,
 {
   const encoder_control_t * const ctrl = state->encoder_control;
 
+  // Adaptive QP offset of the LCU.
+  int lcu_dqp = 0;
+  if (ctrl->cfg.cutree) {
+    lcu_dqp += kvz_get_lcu_stats(state, pos.x, pos.y)->cutree_dqp;
+  }
+  if (ctrl->cfg.aq_mode != KVZ_AQ_NONE) {
+    lcu_dqp += kvz_get_lcu_stats(state, pos.x, pos.y)->aq_dqp;
+  }
+
   if (ctrl->cfg.roi.dqps != NULL) {
     vector2d_t lcu = {
       pos.x + state->tile->lcu_offset_x,
@@ -290,7 +469,7 @@ void kvz_set_lcu_lambda_and_qp(encoder_state_t * const state,
       lcu.y * ctrl->cfg.roi.height / ctrl->in.height_in_lcu
     };
     int roi_index = roi.x + roi.y * ctrl->cfg.roi.width;
-    int dqp = ctrl->cfg.roi.dqps[roi_index];
+    int dqp = ctrl->cfg.roi.dqps[roi_index] + lcu_dqp;
     state->qp = CLIP_TO_QP(state->frame->QP + dqp);
     state->lambda = qp_to_lamba(state, state->qp);
     state->lambda_sqrt = sqrt(state->lambda);
@@ -327,16 +506,24 @@ void kvz_set_lcu_lambda_and_qp(encoder_state_t * const state,
     lambda = CLIP(state->frame->lambda * 0.6299605249474366,
                   state->frame->lambda * 1.5874010519681994,
                   lambda);
+    // Lambda doubles every three QP steps.
+    lambda *= pow(2.0, lcu_dqp / 3.0);
     lambda = clip_lambda(lambda);
 
-    lcu->lambda        = lambda;
     state->lambda      = lambda;
     state->lambda_sqrt = sqrt(lambda);
     state->qp          = lambda_to_qp(lambda);
 
+  } else if (lcu_dqp != 0) {
+    state->qp          = CLIP_TO_QP(state->frame->QP + lcu_dqp);
+    state->lambda      = qp_to_lamba(state, state->qp);
+    state->lambda_sqrt = sqrt(state->lambda);
+
   } else {
     state->qp          = state->frame->QP;
     state->lambda      = state->frame->lambda;
     state->lambda_sqrt = sqrt(state->frame->lambda);
   }
+
+  kvz_get_lcu_stats(state, pos.x, pos.y)->lambda = state->lambda;
 }
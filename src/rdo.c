@@ -29,6 +29,7 @@
 #include "encoder.h"
 #include "imagelist.h"
 #include "inter.h"
+#include "kvz_math.h"
 #include "scalinglist.h"
 #include "strategyselector.h"
 #include "tables.h"
@@ -194,6 +195,281 @@ static INLINE uint32_t get_coeff_cabac_cost(
   return (23 - cabac_copy.bits_left) + (cabac_copy.num_buffered_bytes << 3);
 }
 
+/**
+ * \brief Copies of the contexts used for coding the coefficients of a block.
+ */
+typedef struct {
+  cabac_ctx_t transform_skip;
+  cabac_ctx_t sig_coeff_group[2];
+  cabac_ctx_t sig_coeff[27];
+  cabac_ctx_t last_x[15];
+  cabac_ctx_t last_y[15];
+  cabac_ctx_t greater1[16];
+  cabac_ctx_t greater2[4];
+} coeff_ctx_t;
+
+
+/**
+ * \brief Get the fractional bits of a bin and update the context state.
+ */
+static INLINE uint32_t ctx_bin_bits(cabac_ctx_t *ctx, uint32_t bin)
+{
+  const uint32_t bits = CTX_ENTROPY_BITS(ctx, bin);
+  if (bin == CTX_MPS(ctx)) {
+    CTX_UPDATE_MPS(ctx);
+  } else {
+    CTX_UPDATE_LPS(ctx);
+  }
+  return bits;
+}
+
+
+/**
+ * \brief Number of bypass bins of coeff_abs_level_remaining.
+ */
+static INLINE uint32_t coeff_remain_bins(uint32_t symbol, uint32_t r_param)
+{
+  if (symbol < (3u << r_param)) {
+    return (symbol >> r_param) + 1 + r_param;
+  }
+
+  uint32_t length = r_param;
+  symbol -= 3 << r_param;
+  while (symbol >= (1u << length)) {
+    symbol -= 1 << length;
+    ++length;
+  }
+  return 3 + length + 1 - r_param + length;
+}
+
+
+/**
+ * \brief Estimate the bitcost of coding coefficients with bit tables.
+ *
+ * Goes through the same bins as kvz_encode_coeff_nxn but sums their
+ * fractional costs from kvz_entropy_bits instead of running the CABAC.
+ * Only the contexts of the coefficient coding are copied and they are
+ * updated after each bin like in the real coder.
+ *
+ * \param coeff coefficient array
+ * \param width coeff block width
+ * \param type data type (0 == luma)
+ *
+ * \returns estimated bits needed to code input coefficients
+ */
+static uint32_t get_coeff_table_cost(const encoder_state_t * const state,
+                                     const coeff_t *coeff,
+                                     int32_t width,
+                                     int32_t type,
+                                     int8_t scan_mode)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+
+  const uint32_t num_blk_side    = width >> TR_MIN_LOG2_SIZE;
+  const uint32_t log2_block_size = kvz_g_convert_to_bit[width] + 2;
+  const uint32_t *scan           = kvz_g_sig_last_scan[scan_mode][log2_block_size - 1];
+  const uint32_t *scan_cg        = g_sig_last_scan_cg[log2_block_size - 2][scan_mode];
+
+  uint32_t sig_coeffgroup_flag[8 * 8] = { 0 };
+  bool found = false;
+  for (int i = 0; i < width * width; i++) {
+    if (coeff[i] != 0) {
+      sig_coeffgroup_flag[((i >> log2_block_size) >> TR_MIN_LOG2_SIZE) * num_blk_side +
+                          ((i & (width - 1)) >> TR_MIN_LOG2_SIZE)] = 1;
+      found = true;
+    }
+  }
+  if (!found) return 0;
+
+  // Find the last coeff group and the last coeff in scan order.
+  int32_t scan_cg_last = num_blk_side * num_blk_side - 1;
+  while (!sig_coeffgroup_flag[scan_cg[scan_cg_last]]) {
+    --scan_cg_last;
+  }
+  int32_t scan_pos_last = scan_cg_last * 16 + 15;
+  while (!coeff[scan[scan_pos_last]]) {
+    --scan_pos_last;
+  }
+  const int pos_last = scan[scan_pos_last];
+
+  const cabac_data_t * const cabac = &state->cabac;
+  coeff_ctx_t ctx;
+  if (type == 0) {
+    ctx.transform_skip = cabac->ctx.transform_skip_model_luma;
+    memcpy(ctx.sig_coeff, cabac->ctx.cu_sig_model_luma, sizeof(cabac->ctx.cu_sig_model_luma));
+    memcpy(ctx.last_x, cabac->ctx.cu_ctx_last_x_luma, sizeof(cabac->ctx.cu_ctx_last_x_luma));
+    memcpy(ctx.last_y, cabac->ctx.cu_ctx_last_y_luma, sizeof(cabac->ctx.cu_ctx_last_y_luma));
+    memcpy(ctx.greater1, cabac->ctx.cu_one_model_luma, sizeof(cabac->ctx.cu_one_model_luma));
+    memcpy(ctx.greater2, cabac->ctx.cu_abs_model_luma, sizeof(cabac->ctx.cu_abs_model_luma));
+  } else {
+    ctx.transform_skip = cabac->ctx.transform_skip_model_chroma;
+    memcpy(ctx.sig_coeff, cabac->ctx.cu_sig_model_chroma, sizeof(cabac->ctx.cu_sig_model_chroma));
+    memcpy(ctx.last_x, cabac->ctx.cu_ctx_last_x_chroma, sizeof(cabac->ctx.cu_ctx_last_x_chroma));
+    memcpy(ctx.last_y, cabac->ctx.cu_ctx_last_y_chroma, sizeof(cabac->ctx.cu_ctx_last_y_chroma));
+    memcpy(ctx.greater1, cabac->ctx.cu_one_model_chroma, sizeof(cabac->ctx.cu_one_model_chroma));
+    memcpy(ctx.greater2, cabac->ctx.cu_abs_model_chroma, sizeof(cabac->ctx.cu_abs_model_chroma));
+  }
+  memcpy(ctx.sig_coeff_group, &cabac->ctx.cu_sig_coeff_group_model[type], sizeof(ctx.sig_coeff_group));
+
+  uint64_t cost = 0;
+
+  if (width == 4 && encoder->cfg.trskip_enable) {
+    cost += ctx_bin_bits(&ctx.transform_skip, 0);
+  }
+
+  // last_sig_coeff_x_prefix, last_sig_coeff_y_prefix and their suffixes
+  {
+    uint8_t last_x = pos_last & (width - 1);
+    uint8_t last_y = (uint8_t)(pos_last >> log2_block_size);
+    if (scan_mode == SCAN_VER) {
+      SWAP(last_x, last_y, uint8_t);
+    }
+
+    const int index = kvz_math_floor_log2(width) - 2;
+    const int ctx_offset = type ? 0 : (index * 3 + (index + 1) / 4);
+    const int shift = type ? index : (index + 3) / 4;
+    const int group_idx_x = g_group_idx[last_x];
+    const int group_idx_y = g_group_idx[last_y];
+
+    for (int i = 0; i < group_idx_x; i++) {
+      cost += ctx_bin_bits(&ctx.last_x[ctx_offset + (i >> shift)], 1);
+    }
+    if (group_idx_x < g_group_idx[width - 1]) {
+      cost += ctx_bin_bits(&ctx.last_x[ctx_offset + (group_idx_x >> shift)], 0);
+    }
+    for (int i = 0; i < group_idx_y; i++) {
+      cost += ctx_bin_bits(&ctx.last_y[ctx_offset + (i >> shift)], 1);
+    }
+    if (group_idx_y < g_group_idx[width - 1]) {
+      cost += ctx_bin_bits(&ctx.last_y[ctx_offset + (group_idx_y >> shift)], 0);
+    }
+    if (group_idx_x > 3) {
+      cost += ((group_idx_x - 2) / 2) * CTX_FRAC_ONE_BIT;
+    }
+    if (group_idx_y > 3) {
+      cost += ((group_idx_y - 2) / 2) * CTX_FRAC_ONE_BIT;
+    }
+  }
+
+  const int8_t be_valid = encoder->cfg.signhide_enable;
+  int c1 = 1;
+  int32_t scan_pos_sig = scan_pos_last;
+
+  for (int32_t i = scan_cg_last; i >= 0; i--) {
+    const int32_t sub_pos    = i << LOG2_SCAN_SET_SIZE;
+    const int32_t cg_blk_pos = scan_cg[i];
+    const int32_t cg_pos_y   = cg_blk_pos / num_blk_side;
+    const int32_t cg_pos_x   = cg_blk_pos - (cg_pos_y * num_blk_side);
+
+    int32_t abs_coeff[16];
+    int32_t last_nz_pos_in_cg = -1;
+    int32_t first_nz_pos_in_cg = 16;
+    int32_t num_non_zero = 0;
+    uint32_t go_rice_param = 0;
+
+    if (scan_pos_sig == scan_pos_last) {
+      abs_coeff[0] = abs(coeff[pos_last]);
+      num_non_zero = 1;
+      last_nz_pos_in_cg  = scan_pos_sig;
+      first_nz_pos_in_cg = scan_pos_sig;
+      scan_pos_sig--;
+    }
+
+    if (i == scan_cg_last || i == 0) {
+      sig_coeffgroup_flag[cg_blk_pos] = 1;
+    } else {
+      const uint32_t sig_coeff_group = (sig_coeffgroup_flag[cg_blk_pos] != 0);
+      const uint32_t ctx_sig = kvz_context_get_sig_coeff_group(sig_coeffgroup_flag, cg_pos_x,
+                                                               cg_pos_y, width);
+      cost += ctx_bin_bits(&ctx.sig_coeff_group[ctx_sig], sig_coeff_group);
+    }
+
+    if (sig_coeffgroup_flag[cg_blk_pos]) {
+      const int32_t pattern_sig_ctx = kvz_context_calc_pattern_sig_ctx(sig_coeffgroup_flag,
+                                                                       cg_pos_x, cg_pos_y, width);
+
+      for (; scan_pos_sig >= sub_pos; scan_pos_sig--) {
+        const uint32_t blk_pos = scan[scan_pos_sig];
+        const uint32_t pos_y   = blk_pos >> log2_block_size;
+        const uint32_t pos_x   = blk_pos - (pos_y << log2_block_size);
+        const uint32_t sig     = (coeff[blk_pos] != 0) ? 1 : 0;
+
+        if (scan_pos_sig > sub_pos || i == 0 || num_non_zero) {
+          const uint32_t ctx_sig = kvz_context_get_sig_ctx_inc(pattern_sig_ctx, scan_mode,
+                                                               pos_x, pos_y,
+                                                               log2_block_size, type);
+          cost += ctx_bin_bits(&ctx.sig_coeff[ctx_sig], sig);
+        }
+
+        if (sig) {
+          abs_coeff[num_non_zero] = abs(coeff[blk_pos]);
+          num_non_zero++;
+          if (last_nz_pos_in_cg == -1) {
+            last_nz_pos_in_cg = scan_pos_sig;
+          }
+          first_nz_pos_in_cg = scan_pos_sig;
+        }
+      }
+    } else {
+      scan_pos_sig = sub_pos - 1;
+    }
+
+    if (num_non_zero == 0) continue;
+
+    const bool sign_hidden = last_nz_pos_in_cg - first_nz_pos_in_cg >= SBH_THRESHOLD
+                             && !encoder->cfg.lossless;
+    uint32_t ctx_set = (i > 0 && type == 0) ? 2 : 0;
+    if (c1 == 0) {
+      ctx_set++;
+    }
+    c1 = 1;
+
+    cabac_ctx_t *greater1_ctx = &ctx.greater1[4 * ctx_set];
+    const int32_t num_c1_flag = MIN(num_non_zero, C1FLAG_NUMBER);
+    int32_t first_c2_flag_idx = -1;
+
+    for (int32_t idx = 0; idx < num_c1_flag; idx++) {
+      const uint32_t symbol = (abs_coeff[idx] > 1) ? 1 : 0;
+      cost += ctx_bin_bits(&greater1_ctx[c1], symbol);
+      if (symbol) {
+        c1 = 0;
+        if (first_c2_flag_idx == -1) {
+          first_c2_flag_idx = idx;
+        }
+      } else if ((c1 < 3) && (c1 > 0)) {
+        c1++;
+      }
+    }
+
+    if (c1 == 0 && first_c2_flag_idx != -1) {
+      const uint32_t symbol = (abs_coeff[first_c2_flag_idx] > 2) ? 1 : 0;
+      cost += ctx_bin_bits(&ctx.greater2[ctx_set], symbol);
+    }
+
+    // coeff_sign_flag
+    cost += (be_valid && sign_hidden ? num_non_zero - 1 : num_non_zero) * CTX_FRAC_ONE_BIT;
+
+    if (c1 == 0 || num_non_zero > C1FLAG_NUMBER) {
+      int32_t first_coeff2 = 1;
+      for (int32_t idx = 0; idx < num_non_zero; idx++) {
+        const int32_t base_level = (idx < C1FLAG_NUMBER) ? (2 + first_coeff2) : 1;
+        if (abs_coeff[idx] >= base_level) {
+          cost += coeff_remain_bins(abs_coeff[idx] - base_level, go_rice_param) * CTX_FRAC_ONE_BIT;
+          if (abs_coeff[idx] > 3 * (1 << go_rice_param)) {
+            go_rice_param = MIN(go_rice_param + 1, 4);
+          }
+        }
+        if (abs_coeff[idx] >= 2) {
+          first_coeff2 = 0;
+        }
+      }
+    }
+  }
+
+  return (uint32_t)((cost + CTX_FRAC_HALF_BIT) >> CTX_FRAC_BITS);
+}
+
+
 /**
  * \brief Estimate bitcost for coding coefficients.
  *
@@ -210,6 +486,9 @@ uint32_t kvz_get_coeff_cost(const encoder_state_t * const state,
                             int8_t scan_mode)
 {
   if (state->qp >= state->encoder_control->cfg.fast_residual_cost_limit) {
+    if (state->encoder_control->cfg.coeff_bit_table) {
+      return get_coeff_table_cost(state, coeff, width, type, scan_mode);
+    }
     return get_coeff_cabac_cost(state, coeff, width, type, scan_mode);
 
   } else {
@@ -37,10 +37,9 @@ static void init_sao_info(sao_info_t *sao) {
 }
 
 
-static float sao_mode_bits_none(const encoder_state_t * const state, sao_info_t *sao_top, sao_info_t *sao_left)
+static float sao_mode_bits_none(const cabac_data_t * const cabac, sao_info_t *sao_top, sao_info_t *sao_left)
 {
   float mode_bits = 0.0;
-  const cabac_data_t * const cabac = &state->cabac;
   const cabac_ctx_t *ctx = NULL;
   // FL coded merges.
   if (sao_left != NULL) {
@@ -59,10 +58,9 @@ static float sao_mode_bits_none(const encoder_state_t * const state, sao_info_t
   return mode_bits;
 }
 
-static float sao_mode_bits_merge(const encoder_state_t * const state,
+static float sao_mode_bits_merge(const cabac_data_t * const cabac,
                                  int8_t merge_cand) {
   float mode_bits = 0.0;
-  const cabac_data_t * const cabac = &state->cabac;
   const cabac_ctx_t *ctx = NULL;
   // FL coded merges.
   ctx = &(cabac->ctx.sao_merge_flag_model);
@@ -74,12 +72,11 @@ static float sao_mode_bits_merge(const encoder_state_t * const state,
 }
 
 
-static float sao_mode_bits_edge(const encoder_state_t * const state,
+static float sao_mode_bits_edge(const cabac_data_t * const cabac,
                               int edge_class, int offsets[NUM_SAO_EDGE_CATEGORIES],
                               sao_info_t *sao_top, sao_info_t *sao_left, unsigned buf_cnt)
 {
   float mode_bits = 0.0;
-  const cabac_data_t * const cabac = &state->cabac;
   const cabac_ctx_t *ctx = NULL;
   // FL coded merges.
   if (sao_left != NULL) {
@@ -114,12 +111,11 @@ static float sao_mode_bits_edge(const encoder_state_t * const state,
 }
 
 
-static float sao_mode_bits_band(const encoder_state_t * const state,
+static float sao_mode_bits_band(const cabac_data_t * const cabac,
                               int band_position[2], int offsets[10],
                               sao_info_t *sao_top, sao_info_t *sao_left, unsigned buf_cnt)
 {
   float mode_bits = 0.0;
-  const cabac_data_t * const cabac = &state->cabac;
   const cabac_ctx_t *ctx = NULL;
   // FL coded merges.
   if (sao_left != NULL) {
@@ -347,7 +343,8 @@ void kvz_sao_reconstruct(const encoder_state_t *state,
 }
 
 
-static void sao_search_edge_sao(const encoder_state_t * const state, 
+static void sao_search_edge_sao(const encoder_state_t * const state,
+                                const cabac_data_t * const cabac, double lambda,
                                 const kvz_pixel * data[], const kvz_pixel * recdata[],
                                 int block_width, int block_height,
                                 unsigned buf_cnt,
@@ -409,8 +406,8 @@ static void sao_search_edge_sao(const encoder_state_t * const state,
     }
 
     {
-      float mode_bits = sao_mode_bits_edge(state, edge_class, edge_offset, sao_top, sao_left, buf_cnt);
-      sum_ddistortion += (int)((double)mode_bits*state->lambda +0.5);
+      float mode_bits = sao_mode_bits_edge(cabac, edge_class, edge_offset, sao_top, sao_left, buf_cnt);
+      sum_ddistortion += (int)((double)mode_bits*lambda +0.5);
     }
     // SAO is not applied for category 0.
     edge_offset[SAO_EO_CAT0] = 0;
@@ -426,7 +423,9 @@ static void sao_search_edge_sao(const encoder_state_t * const state,
 }
 
 
-static void sao_search_band_sao(const encoder_state_t * const state, const kvz_pixel * data[], const kvz_pixel * recdata[],
+static void sao_search_band_sao(const encoder_state_t * const state,
+                                const cabac_data_t * const cabac, double lambda,
+                                const kvz_pixel * data[], const kvz_pixel * recdata[],
                                int block_width, int block_height,
                                unsigned buf_cnt,
                                sao_info_t *sao_out, sao_info_t *sao_top,
@@ -453,8 +452,8 @@ static void sao_search_band_sao(const encoder_state_t * const state, const kvz_p
       ddistortion += calc_sao_band_offsets(sao_bands, &temp_offsets[1+5*i], &sao_out->band_position[i]);      
     }
 
-    temp_rate = sao_mode_bits_band(state, sao_out->band_position, temp_offsets, sao_top, sao_left, buf_cnt);
-    ddistortion += (int)((double)temp_rate*state->lambda + 0.5);
+    temp_rate = sao_mode_bits_band(cabac, sao_out->band_position, temp_offsets, sao_top, sao_left, buf_cnt);
+    ddistortion += (int)((double)temp_rate*lambda + 0.5);
 
     // Select band sao over edge sao when distortion is lower
     if (ddistortion < sao_out->ddistortion) {
@@ -474,7 +473,9 @@ static void sao_search_band_sao(const encoder_state_t * const state, const kvz_p
  * \param buf_cnt  Number of pointers data and recdata have.
  * \param sao_out  Output parameter for the best sao parameters.
  */
-static void sao_search_best_mode(const encoder_state_t * const state, const kvz_pixel * data[], const kvz_pixel * recdata[],
+static void sao_search_best_mode(const encoder_state_t * const state,
+                                 const cabac_data_t * const cabac, double lambda,
+                                 const kvz_pixel * data[], const kvz_pixel * recdata[],
                                  int block_width, int block_height,
                                  unsigned buf_cnt,
                                  sao_info_t *sao_out, sao_info_t *sao_top,
@@ -494,9 +495,9 @@ static void sao_search_best_mode(const encoder_state_t * const state, const kvz_
   band_sao.eo_class = SAO_EO0;
 
   if (state->encoder_control->cfg.sao_type & 1){
-    sao_search_edge_sao(state, data, recdata, block_width, block_height, buf_cnt, &edge_sao, sao_top, sao_left);
-    float mode_bits = sao_mode_bits_edge(state, edge_sao.eo_class, edge_sao.offsets, sao_top, sao_left, buf_cnt);
-    int ddistortion = (int)(mode_bits * state->lambda + 0.5);
+    sao_search_edge_sao(state, cabac, lambda, data, recdata, block_width, block_height, buf_cnt, &edge_sao, sao_top, sao_left);
+    float mode_bits = sao_mode_bits_edge(cabac, edge_sao.eo_class, edge_sao.offsets, sao_top, sao_left, buf_cnt);
+    int ddistortion = (int)(mode_bits * lambda + 0.5);
     unsigned buf_i;
     
     for (buf_i = 0; buf_i < buf_cnt; ++buf_i) {
@@ -512,9 +513,9 @@ static void sao_search_best_mode(const encoder_state_t * const state, const kvz_
   }
 
   if (state->encoder_control->cfg.sao_type & 2){
-    sao_search_band_sao(state, data, recdata, block_width, block_height, buf_cnt, &band_sao, sao_top, sao_left);
-    float mode_bits = sao_mode_bits_band(state, band_sao.band_position, band_sao.offsets, sao_top, sao_left, buf_cnt);
-    int ddistortion = (int)(mode_bits * state->lambda + 0.5);
+    sao_search_band_sao(state, cabac, lambda, data, recdata, block_width, block_height, buf_cnt, &band_sao, sao_top, sao_left);
+    float mode_bits = sao_mode_bits_band(cabac, band_sao.band_position, band_sao.offsets, sao_top, sao_left, buf_cnt);
+    int ddistortion = (int)(mode_bits * lambda + 0.5);
     unsigned buf_i;
     
     for (buf_i = 0; buf_i < buf_cnt; ++buf_i) {
@@ -540,7 +541,7 @@ static void sao_search_best_mode(const encoder_state_t * const state, const kvz_
   // Choose between SAO and doing nothing, taking into account the
   // rate-distortion cost of coding do nothing.
   {
-    int cost_of_nothing = (int)(sao_mode_bits_none(state, sao_top, sao_left) * state->lambda + 0.5);
+    int cost_of_nothing = (int)(sao_mode_bits_none(cabac, sao_top, sao_left) * lambda + 0.5);
     if (sao_out->ddistortion >= cost_of_nothing) {
       sao_out->type = SAO_TYPE_NONE;
       merge_cost[0] = cost_of_nothing;
@@ -556,8 +557,8 @@ static void sao_search_best_mode(const encoder_state_t * const state, const kvz_
 
       if (merge_cand) {
         unsigned buf_i;
-        float mode_bits = sao_mode_bits_merge(state, i + 1);
-        int ddistortion = (int)(mode_bits * state->lambda + 0.5);
+        float mode_bits = sao_mode_bits_merge(cabac, i + 1);
+        int ddistortion = (int)(mode_bits * lambda + 0.5);
 
         switch (merge_cand->type) {
           case SAO_TYPE_EDGE:
@@ -587,7 +588,9 @@ static void sao_search_best_mode(const encoder_state_t * const state, const kvz_
   return;
 }
 
-static void sao_search_chroma(const encoder_state_t * const state, const videoframe_t *frame, unsigned x_ctb, unsigned y_ctb, sao_info_t *sao, sao_info_t *sao_top, sao_info_t *sao_left, int32_t merge_cost[3])
+static void sao_search_chroma(const encoder_state_t * const state,
+                              const cabac_data_t * const cabac, double lambda,
+                              const videoframe_t *frame, unsigned x_ctb, unsigned y_ctb, sao_info_t *sao, sao_info_t *sao_top, sao_info_t *sao_left, int32_t merge_cost[3])
 {
   int block_width  = (LCU_WIDTH / 2);
   int block_height = (LCU_WIDTH / 2);
@@ -620,10 +623,12 @@ static void sao_search_chroma(const encoder_state_t * const state, const videofr
   }
 
   // Calculate
-  sao_search_best_mode(state, orig_list, rec_list, block_width, block_height, 2, sao, sao_top, sao_left, merge_cost);
+  sao_search_best_mode(state, cabac, lambda, orig_list, rec_list, block_width, block_height, 2, sao, sao_top, sao_left, merge_cost);
 }
 
-static void sao_search_luma(const encoder_state_t * const state, const videoframe_t *frame, unsigned x_ctb, unsigned y_ctb, sao_info_t *sao, sao_info_t *sao_top, sao_info_t *sao_left, int32_t merge_cost[3])
+static void sao_search_luma(const encoder_state_t * const state,
+                            const cabac_data_t * const cabac, double lambda,
+                            const videoframe_t *frame, unsigned x_ctb, unsigned y_ctb, sao_info_t *sao, sao_info_t *sao_top, sao_info_t *sao_left, int32_t merge_cost[3])
 {
   kvz_pixel orig[LCU_LUMA_SIZE];
   kvz_pixel rec[LCU_LUMA_SIZE];
@@ -650,10 +655,21 @@ static void sao_search_luma(const encoder_state_t * const state, const videofram
 
   orig_list[0] = orig;
   rec_list[0] = rec;
-  sao_search_best_mode(state, orig_list, rec_list, block_width, block_height, 1, sao, sao_top, sao_left, merge_cost);
+  sao_search_best_mode(state, cabac, lambda, orig_list, rec_list, block_width, block_height, 1, sao, sao_top, sao_left, merge_cost);
 }
 
-void kvz_sao_search_lcu(const encoder_state_t* const state, int lcu_x, int lcu_y)
+/**
+ * \brief Search the SAO parameters of an LCU.
+ *
+ * \param cabac   CABAC whose contexts are used to estimate the bits of the
+ *                SAO syntax
+ * \param lambda  lambda of the LCU
+ */
+void kvz_sao_search_lcu(const encoder_state_t* const state,
+                        const cabac_data_t * const cabac,
+                        double lambda,
+                        int lcu_x,
+                        int lcu_y)
 {
   assert(!state->encoder_control->cfg.lossless);
 
@@ -678,9 +694,9 @@ void kvz_sao_search_lcu(const encoder_state_t* const state, int lcu_x, int lcu_y
     if (lcu_x != 0) sao_left_chroma = &frame->sao_chroma[lcu_y       * stride + lcu_x - 1];
   }
 
-  sao_search_luma(state, frame, lcu_x, lcu_y, sao_luma, sao_top_luma, sao_left_luma, merge_cost_luma);
+  sao_search_luma(state, cabac, lambda, frame, lcu_x, lcu_y, sao_luma, sao_top_luma, sao_left_luma, merge_cost_luma);
   if (enable_chroma) {
-    sao_search_chroma(state, frame, lcu_x, lcu_y, sao_chroma, sao_top_chroma, sao_left_chroma, merge_cost_chroma);
+    sao_search_chroma(state, cabac, lambda, frame, lcu_x, lcu_y, sao_chroma, sao_top_chroma, sao_left_chroma, merge_cost_chroma);
   } else {
     merge_cost_chroma[0] = 0;
     merge_cost_chroma[1] = 0;
@@ -25,6 +25,7 @@
 
 #include "cabac.h"
 #include "encoder.h"
+#include "filter.h"
 #include "imagelist.h"
 #include "inter.h"
 #include "intra.h"
@@ -435,6 +436,17 @@ static uint8_t get_ctx_cu_split_model(const lcu_t *lcu, int x, int y, int depth)
   return condA + condL;
 }
 
+
+/**
+ * \brief Add the time since recon_start to the reconstruction time of the
+ * LCU containing pixel (x, y).
+ */
+static void add_recon_time(encoder_state_t * const state, int x, int y, int64_t recon_start)
+{
+  kvz_get_lcu_stats(state, x / LCU_WIDTH, y / LCU_WIDTH)->recon_time +=
+    kvz_time_ns() - recon_start;
+}
+
 /**
  * Search every mode from 0 to MAX_PU_DEPTH and return cost of best mode.
  * - The recursion is started at depth 0 and goes in Z-order to MAX_PU_DEPTH.
@@ -567,6 +579,7 @@ static double search_cu(encoder_state_t * const state, int x, int y, int depth,
 
     // Reconstruct best mode because we need the reconstructed pixels for
     // mode search of adjacent CUs.
+    const int64_t recon_start = kvz_time_ns();
     if (cur_cu->type == CU_INTRA) {
       assert(cur_cu->part_size == SIZE_2Nx2N || cur_cu->part_size == SIZE_NxN);
       cur_cu->intra.mode_chroma = cur_cu->intra.mode;
@@ -633,6 +646,7 @@ static double search_cu(encoder_state_t * const state, int x, int y, int depth,
       lcu_fill_inter(lcu, x_local, y_local, cu_width);
       lcu_fill_cbf(lcu, x_local, y_local, cu_width, cur_cu);
     }
+    add_recon_time(state, x, y, recon_start);
   }
 
   if (cur_cu->type == CU_INTRA || cur_cu->type == CU_INTER) {
@@ -738,11 +752,13 @@ static double search_cu(encoder_state_t * const state, int x, int y, int depth,
 
         const bool has_chroma = state->encoder_control->chroma_format != KVZ_CSP_400;
         const int8_t mode_chroma = has_chroma ? cur_cu->intra.mode_chroma : -1;
+        const int64_t recon_start = kvz_time_ns();
         kvz_intra_recon_cu(state,
                            x, y,
                            depth,
                            cur_cu->intra.mode, mode_chroma,
                            NULL, lcu);
+        add_recon_time(state, x, y, recon_start);
 
         cost += kvz_cu_rd_cost_luma(state, x_local, y_local, depth, cur_cu, lcu);
         if (has_chroma) {
@@ -898,6 +914,11 @@ static void copy_lcu_to_cu_data(const encoder_state_t * const state, int x_px, i
   // Copy non-reference CUs to picture.
   kvz_cu_array_copy_from_lcu(state->tile->frame->cu_array, x_px, y_px, lcu);
 
+  // Compute the boundary strengths for deblocking while the CUs are at hand.
+  if (state->encoder_control->cfg.deblock_enable) {
+    kvz_filter_set_deblock_info(state, x_px, y_px, lcu);
+  }
+
   // Copy pixels to picture.
   {
     videoframe_t * const pic = state->tile->frame;
@@ -937,9 +958,19 @@ void kvz_search_lcu(encoder_state_t * const state, const int x, const int y, con
     work_tree[depth] = work_tree[0];
   }
 
+  motion_cache_t motion_cache;
+  if (state->encoder_control->cfg.me_cache &&
+      state->frame->slicetype != KVZ_SLICE_I)
+  {
+    kvz_motion_cache_clear(&motion_cache);
+    state->motion_cache = &motion_cache;
+  }
+
   // Start search from depth 0.
   double cost = search_cu(state, x, y, 0, work_tree);
 
+  state->motion_cache = NULL;
+
   // Save squared cost for rate control.
   kvz_get_lcu_stats(state, x / LCU_WIDTH, y / LCU_WIDTH)->weight = cost * cost;
 
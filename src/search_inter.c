@@ -33,9 +33,20 @@
 #include "search.h"
 #include "strategies/strategies-ipol.h"
 #include "strategies/strategies-picture.h"
+#include "subpel.h"
 #include "transform.h"
 #include "videoframe.h"
 
+/**
+ * \brief Number of containing CUs whose results are used in the search.
+ */
+#define MOTION_CACHE_SEEDS 2
+
+/**
+ * \brief Maximum number of vectors checked with one check_mv_cost_multi call.
+ */
+#define CHECK_MV_COST_MULTI_MAX 8
+
 typedef struct {
   encoder_state_t *state;
 
@@ -85,6 +96,21 @@ typedef struct {
    */
   optimized_sad_func_ptr_t optimized_sad;
 
+  /**
+   * \brief Cached results of the CUs containing the PU, nearest first
+   */
+  const motion_cache_entry_t *cached[MOTION_CACHE_SEEDS];
+  /**
+   * \brief Width of the CUs of the cached results
+   */
+  int32_t cached_width[MOTION_CACHE_SEEDS];
+  int32_t num_cached;
+
+  /**
+   * \brief Where to store the result of the search, or NULL
+   */
+  motion_cache_entry_t *cache_out;
+
 } inter_search_info_t;
 
 
@@ -188,6 +214,42 @@ static INLINE bool intmv_within_tile(const inter_search_info_t *info, int x, int
 }
 
 
+/**
+ * \brief Update the best motion vector if an integer vector is better.
+ *
+ * \param x      horizontal component of the vector in integer pixels
+ * \param y      vertical component of the vector in integer pixels
+ * \param cost   SAD of the vector
+ * \return true if info->best_mv was changed, false otherwise
+ */
+static bool update_best_mv(inter_search_info_t *info, int x, int y, uint32_t cost)
+{
+  if (cost >= info->best_cost) return false;
+
+  uint32_t bitcost = 0;
+
+  cost += info->mvd_cost_func(
+      info->state,
+      x, y, 2,
+      info->mv_cand,
+      info->merge_cand,
+      info->num_merge_cand,
+      info->ref_idx,
+      &bitcost
+  );
+
+  if (cost >= info->best_cost) return false;
+
+  // Set to motion vector in quarter pixel precision.
+  info->best_mv.x = x * 4;
+  info->best_mv.y = y * 4;
+  info->best_cost = cost;
+  info->best_bitcost = bitcost;
+
+  return true;
+}
+
+
 /**
  * \brief Calculate cost for an integer motion vector.
  *
@@ -203,7 +265,6 @@ static bool check_mv_cost(inter_search_info_t *info, int x, int y)
 {
   if (!intmv_within_tile(info, x, y)) return false;
 
-  uint32_t bitcost = 0;
   uint32_t cost = kvz_image_calc_sad(
       info->pic,
       info->ref,
@@ -216,27 +277,64 @@ static bool check_mv_cost(inter_search_info_t *info, int x, int y)
       info->optimized_sad
   );
 
-  if (cost >= info->best_cost) return false;
+  return update_best_mv(info, x, y, cost);
+}
 
-  cost += info->mvd_cost_func(
-      info->state,
-      x, y, 2,
-      info->mv_cand,
-      info->merge_cand,
-      info->num_merge_cand,
-      info->ref_idx,
-      &bitcost
-  );
 
-  if (cost >= info->best_cost) return false;
+/**
+ * \brief Calculate costs for several integer motion vectors.
+ *
+ * Gives the same result as calling check_mv_cost for each vector in order,
+ * but the SADs of the vectors are calculated with a single call.
+ *
+ * \param mvs       motion vectors in integer pixels
+ * \param num_mvs   number of vectors, at most CHECK_MV_COST_MULTI_MAX
+ * \return index of the last vector that changed info->best_mv, or -1 if
+ *         none did
+ */
+static int check_mv_cost_multi(inter_search_info_t *info,
+                               const vector2d_t *mvs,
+                               int num_mvs)
+{
+  assert(num_mvs <= CHECK_MV_COST_MULTI_MAX);
 
-  // Set to motion vector in quarter pixel precision.
-  info->best_mv.x = x * 4;
-  info->best_mv.y = y * 4;
-  info->best_cost = cost;
-  info->best_bitcost = bitcost;
+  int ref_x[CHECK_MV_COST_MULTI_MAX];
+  int ref_y[CHECK_MV_COST_MULTI_MAX];
+  int indices[CHECK_MV_COST_MULTI_MAX];
+  unsigned sads[CHECK_MV_COST_MULTI_MAX];
+  int num_valid = 0;
 
-  return true;
+  for (int i = 0; i < num_mvs; ++i) {
+    if (!intmv_within_tile(info, mvs[i].x, mvs[i].y)) continue;
+
+    ref_x[num_valid] = info->state->tile->offset_x + info->origin.x + mvs[i].x;
+    ref_y[num_valid] = info->state->tile->offset_y + info->origin.y + mvs[i].y;
+    indices[num_valid] = i;
+    num_valid++;
+  }
+
+  if (num_valid == 0) return -1;
+
+  kvz_image_calc_sad_multi(info->pic,
+                           info->ref,
+                           info->origin.x,
+                           info->origin.y,
+                           ref_x,
+                           ref_y,
+                           num_valid,
+                           info->width,
+                           info->height,
+                           info->optimized_sad,
+                           sads);
+
+  int best_index = -1;
+  for (int i = 0; i < num_valid; ++i) {
+    const vector2d_t mv = mvs[indices[i]];
+    if (update_best_mv(info, mv.x, mv.y, sads[i])) {
+      best_index = indices[i];
+    }
+  }
+  return best_index;
 }
 
 
@@ -284,8 +382,8 @@ static bool mv_in_merge(const inter_search_info_t *info, vector2d_t mv)
 /**
  * \brief Select starting point for integer motion estimation search.
  *
- * Checks the zero vector, extra_mv and merge candidates and updates
- * info->best_mv to the best one.
+ * Checks the zero vector, extra_mv, the cached vectors of the containing
+ * CUs and merge candidates and updates info->best_mv to the best one.
  */
 static void select_starting_point(inter_search_info_t *info, vector2d_t extra_mv)
 {
@@ -301,6 +399,16 @@ static void select_starting_point(inter_search_info_t *info, vector2d_t extra_mv
     check_mv_cost(info, extra_mv.x, extra_mv.y);
   }
 
+  for (int i = 0; i < info->num_cached; ++i) {
+    const vector2d_t mv = {
+      (info->cached[i]->mv.x + 2) >> 2,
+      (info->cached[i]->mv.y + 2) >> 2
+    };
+    if ((mv.x != 0 || mv.y != 0) && !mv_in_merge(info, mv)) {
+      check_mv_cost(info, mv.x, mv.y);
+    }
+  }
+
   // Go through candidates
   for (unsigned i = 0; i < info->num_merge_cand; ++i) {
     if (info->merge_cand[i].dir == 3) continue;
@@ -442,14 +550,16 @@ static bool early_terminate(inter_search_info_t *info)
       threshold = info->best_cost;
     }
 
-    int best_index = 6;
+    vector2d_t mvs[4];
     for (int i = first_index; i <= last_index; i++) {
-      int x = mv.x + small_hexbs[i].x;
-      int y = mv.y + small_hexbs[i].y;
+      mvs[i - first_index].x = mv.x + small_hexbs[i].x;
+      mvs[i - first_index].y = mv.y + small_hexbs[i].y;
+    }
 
-      if (check_mv_cost(info, x, y)) {
-        best_index = i;
-      }
+    int best_index = 6;
+    const int best_mv_index = check_mv_cost_multi(info, mvs, last_index - first_index + 1);
+    if (best_mv_index >= 0) {
+      best_index = first_index + best_mv_index;
     }
 
     // Adjust the movement vector
@@ -568,18 +678,13 @@ void kvz_tz_pattern_search(inter_search_info_t *info,
   }
 
   // Compute SAD values for all chosen points.
-  int best_index = -1;
+  vector2d_t mvs[8];
   for (int i = 0; i < n_points; i++) {
-    vector2d_t offset = pattern[pattern_type][i];
-    int x = mv.x + offset.x;
-    int y = mv.y + offset.y;
-
-    if (check_mv_cost(info, x, y)) {
-      best_index = i;
-    }
+    mvs[i].x = mv.x + pattern[pattern_type][i].x;
+    mvs[i].y = mv.y + pattern[pattern_type][i].y;
   }
 
-  if (best_index >= 0) {
+  if (check_mv_cost_multi(info, mvs, n_points) >= 0) {
     *best_dist = iDist;
   }
 }
@@ -739,10 +844,14 @@ static void hexagon_search(inter_search_info_t *info, vector2d_t extra_mv, uint3
   int best_index = 0;
 
   // Search the initial 7 points of the hexagon.
+  vector2d_t mvs[8];
   for (int i = 1; i < 7; ++i) {
-    if (check_mv_cost(info, mv.x + large_hexbs[i].x, mv.y + large_hexbs[i].y)) {
-      best_index = i;
-    }
+    mvs[i - 1].x = mv.x + large_hexbs[i].x;
+    mvs[i - 1].y = mv.y + large_hexbs[i].y;
+  }
+  const int initial_index = check_mv_cost_multi(info, mvs, 6);
+  if (initial_index >= 0) {
+    best_index = initial_index + 1;
   }
 
   // Iteratively search the 3 new points around the best match, until the best
@@ -768,10 +877,12 @@ static void hexagon_search(inter_search_info_t *info, vector2d_t extra_mv, uint3
 
     // Iterate through the next 3 points.
     for (int i = 0; i < 3; ++i) {
-      vector2d_t offset = large_hexbs[start + i];
-      if (check_mv_cost(info, mv.x + offset.x, mv.y + offset.y)) {
-        best_index = start + i;
-      }
+      mvs[i].x = mv.x + large_hexbs[start + i].x;
+      mvs[i].y = mv.y + large_hexbs[start + i].y;
+    }
+    const int best_mv_index = check_mv_cost_multi(info, mvs, 3);
+    if (best_mv_index >= 0) {
+      best_index = start + best_mv_index;
     }
   }
 
@@ -781,10 +892,142 @@ static void hexagon_search(inter_search_info_t *info, vector2d_t extra_mv, uint3
 
   // Do the final step of the search with a small pattern.
   for (int i = 1; i < 9; ++i) {
-    check_mv_cost(info, mv.x + small_hexbs[i].x, mv.y + small_hexbs[i].y);
+    mvs[i - 1].x = mv.x + small_hexbs[i].x;
+    mvs[i - 1].y = mv.y + small_hexbs[i].y;
   }
+  check_mv_cost_multi(info, mvs, 8);
 }
 
+/**
+ * \brief Minimum width and height of the block on a level of the pyramid.
+ */
+#define PYRAMID_MIN_BLOCK 4
+
+/**
+ * \brief Range of the full search on the coarsest level of the pyramid.
+ */
+#define PYRAMID_SEARCH_RANGE 8
+
+/**
+ * \brief Do motion search on downscaled versions of the frames.
+ *
+ * A full search is done with SAD on the coarsest level of the pyramid that
+ * the block is at least PYRAMID_MIN_BLOCK pixels wide and high on. The best
+ * vector is refined by one pixel on each finer level and finally with a
+ * diamond search at full resolution. On the coarsest of the
+ * ME_PYRAMID_LEVELS levels, the search covers motion of
+ * PYRAMID_SEARCH_RANGE << ME_PYRAMID_LEVELS pixels from the starting point.
+ */
+static void pyramid_search(inter_search_info_t *info, vector2d_t extra_mv, uint32_t steps)
+{
+  static const vector2d_t diamond[4] = {
+    {0, -1}, {1, 0}, {0, 1}, {-1, 0},
+  };
+
+  const encoder_state_t *state = info->state;
+  kvz_picture *const *cur_pyramid = state->frame->pyramid;
+  kvz_picture *const *ref_pyramid = state->frame->ref->pyramids[info->ref_idx];
+
+  info->best_cost = UINT32_MAX;
+
+  // Select starting point from among merge candidates. These should
+  // include both mv_cand vectors and (0, 0).
+  select_starting_point(info, extra_mv);
+
+  // Check if we should stop search
+  if (state->encoder_control->cfg.me_early_termination &&
+      early_terminate(info))
+  {
+    return;
+  }
+
+  // Find the coarsest level the block is large enough for.
+  int levels = 0;
+  while (levels < ME_PYRAMID_LEVELS &&
+         cur_pyramid[levels] && ref_pyramid[levels] &&
+         (info->width  >> (levels + 1)) >= PYRAMID_MIN_BLOCK &&
+         (info->height >> (levels + 1)) >= PYRAMID_MIN_BLOCK)
+  {
+    levels++;
+  }
+
+  if (levels > 0) {
+    // Position of the block in the whole frame.
+    const int x = state->tile->offset_x + info->origin.x;
+    const int y = state->tile->offset_y + info->origin.y;
+
+    vector2d_t mv = {
+      (info->best_mv.x >> 2) >> levels,
+      (info->best_mv.y >> 2) >> levels,
+    };
+
+    for (int level = levels; level > 0; level--) {
+      const kvz_picture *pic = cur_pyramid[level - 1];
+      const kvz_picture *ref = ref_pyramid[level - 1];
+      const int pic_x  = x >> level;
+      const int pic_y  = y >> level;
+      const int width  = info->width  >> level;
+      const int height = info->height >> level;
+      const int range  = level == levels ? PYRAMID_SEARCH_RANGE : 1;
+      optimized_sad_func_ptr_t optimized_sad = kvz_get_optimized_sad(width);
+
+      // Check the center first so that it is kept on ties.
+      vector2d_t best = mv;
+      uint32_t best_sad = kvz_image_calc_sad(pic, ref,
+                                             pic_x, pic_y,
+                                             pic_x + mv.x, pic_y + mv.y,
+                                             width, height,
+                                             optimized_sad);
+
+      for (int dy = -range; dy <= range; dy++) {
+        for (int dx = -range; dx <= range; dx++) {
+          if (dx == 0 && dy == 0) continue;
+
+          const uint32_t sad = kvz_image_calc_sad(pic, ref,
+                                                  pic_x, pic_y,
+                                                  pic_x + mv.x + dx,
+                                                  pic_y + mv.y + dy,
+                                                  width, height,
+                                                  optimized_sad);
+          if (sad < best_sad) {
+            best_sad = sad;
+            best.x = mv.x + dx;
+            best.y = mv.y + dy;
+          }
+        }
+      }
+
+      // Move to the next finer level.
+      mv.x = best.x * 2;
+      mv.y = best.y * 2;
+    }
+
+    check_mv_cost(info, mv.x, mv.y);
+  }
+
+  // Refine the best vector at full resolution.
+  vector2d_t mv = { info->best_mv.x >> 2, info->best_mv.y >> 2 };
+  bool better_found;
+  do {
+    better_found = false;
+    if (steps > 0) steps -= 1;
+
+    vector2d_t mvs[4];
+    for (int i = 0; i < 4; ++i) {
+      mvs[i].x = mv.x + diamond[i].x;
+      mvs[i].y = mv.y + diamond[i].y;
+    }
+
+    const int best_index = check_mv_cost_multi(info, mvs, 4);
+    if (best_index >= 0) {
+      mv.x += diamond[best_index].x;
+      mv.y += diamond[best_index].y;
+      better_found = true;
+    }
+  } while (better_found && steps != 0);
+}
+
+
 /**
 * \brief Do motion search using the diamond algorithm.
 *
@@ -840,10 +1083,14 @@ static void diamond_search(inter_search_info_t *info, vector2d_t extra_mv, uint3
   enum diapos best_index = DIA_CENTER;
 
   // initial search of the points of the diamond
+  vector2d_t mvs[5];
   for (int i = 0; i < 5; ++i) {
-    if (check_mv_cost(info, mv.x + diamond[i].x, mv.y + diamond[i].y)) {
-      best_index = i;
-    }
+    mvs[i].x = mv.x + diamond[i].x;
+    mvs[i].y = mv.y + diamond[i].y;
+  }
+  const int initial_index = check_mv_cost_multi(info, mvs, 5);
+  if (initial_index >= 0) {
+    best_index = initial_index;
   }
 
   if (best_index == DIA_CENTER) {
@@ -867,14 +1114,22 @@ static void diamond_search(inter_search_info_t *info, vector2d_t extra_mv, uint3
     if (steps > 0) steps -= 1;
 
     // search the points of the diamond
+    enum diapos dirs[4];
+    int num_dirs = 0;
     for (int i = 0; i < 4; ++i) {
       // this is where we came from so it's checked already
       if (i == from_dir) continue;
 
-      if (check_mv_cost(info, mv.x + diamond[i].x, mv.y + diamond[i].y)) {
-        best_index = i;
-        better_found = 1;
-      }
+      dirs[num_dirs] = i;
+      mvs[num_dirs].x = mv.x + diamond[i].x;
+      mvs[num_dirs].y = mv.y + diamond[i].y;
+      num_dirs++;
+    }
+
+    const int dir_index = check_mv_cost_multi(info, mvs, num_dirs);
+    if (dir_index >= 0) {
+      best_index = dirs[dir_index];
+      better_found = 1;
     }
 
     if (better_found) {
@@ -891,16 +1146,33 @@ static void diamond_search(inter_search_info_t *info, vector2d_t extra_mv, uint3
 }
 
 
+/**
+ * \brief Check all vectors within search_range of center in raster order.
+ */
+static void search_mv_area(inter_search_info_t *info,
+                           vector2d_t center,
+                           int32_t search_range)
+{
+  vector2d_t mvs[CHECK_MV_COST_MULTI_MAX];
+  for (int y = -search_range; y <= search_range; y++) {
+    for (int x = -search_range; x <= search_range; x += CHECK_MV_COST_MULTI_MAX) {
+      const int num_mvs = MIN(CHECK_MV_COST_MULTI_MAX, search_range - x + 1);
+      for (int i = 0; i < num_mvs; i++) {
+        mvs[i].x = center.x + x + i;
+        mvs[i].y = center.y + y;
+      }
+      check_mv_cost_multi(info, mvs, num_mvs);
+    }
+  }
+}
+
+
 static void search_mv_full(inter_search_info_t *info,
                            int32_t search_range,
                            vector2d_t extra_mv)
 {
   // Search around the 0-vector.
-  for (int y = -search_range; y <= search_range; y++) {
-    for (int x = -search_range; x <= search_range; x++) {
-      check_mv_cost(info, x, y);
-    }
-  }
+  search_mv_area(info, (vector2d_t){ 0, 0 }, search_range);
 
   // Change to integer precision.
   extra_mv.x >>= 2;
@@ -908,11 +1180,7 @@ static void search_mv_full(inter_search_info_t *info,
 
   // Check around extra_mv if it's not one of the merge candidates.
   if (!mv_in_merge(info, extra_mv)) {
-    for (int y = -search_range; y <= search_range; y++) {
-      for (int x = -search_range; x <= search_range; x++) {
-        check_mv_cost(info, extra_mv.x + x, extra_mv.y + y);
-      }
-    }
+    search_mv_area(info, extra_mv, search_range);
   }
 
   // Select starting point from among merge candidates. These should include
@@ -1013,6 +1281,17 @@ static void search_frac(inter_search_info_t *info)
   int8_t sample_off_x = 0;
   int8_t sample_off_y = 0;
 
+  // Read the fractional pixels from the precomputed planes of the
+  // reference when they are ready and cover the searched area.
+  const subpel_planes_t *planes = state->frame->ref->subpel_planes[info->ref_idx];
+  const int pu_x = state->tile->offset_x + orig.x;
+  const int pu_y = state->tile->offset_y + orig.y;
+  if (!kvz_subpel_planes_ready(planes) ||
+      !kvz_subpel_planes_contain(planes, pu_x + mv.x - 2, pu_y + mv.y - 2, width + 4, height + 4))
+  {
+    planes = NULL;
+  }
+
   kvz_get_extended_block(orig.x, orig.y, mv.x - 1, mv.y - 1,
                 state->tile->offset_x,
                 state->tile->offset_y,
@@ -1055,33 +1334,44 @@ static void search_frac(inter_search_info_t *info)
 
     const int mv_shift = (step < 2) ? 1 : 0;
 
-    filter_steps[step](state->encoder_control,
-      src.orig_topleft,
-      src.stride,
-      internal_width,
-      internal_height,
-      filtered,
-      intermediate,
-      fme_level,
-      hor_first_cols,
-      sample_off_x,
-      sample_off_y);
-          
     const vector2d_t *pattern[4] = { &square[i], &square[i + 1], &square[i + 2], &square[i + 3] };
 
+    const kvz_pixel *filtered_pos[4] = { 0 };
+    int filtered_stride;
+    if (planes) {
+      for (int j = 0; j < 4; j++) {
+        filtered_pos[j] = kvz_subpel_planes_at(planes,
+                                               pu_x * 4 + (mv.x + pattern[j]->x) * (1 << mv_shift),
+                                               pu_y * 4 + (mv.y + pattern[j]->y) * (1 << mv_shift));
+      }
+      filtered_stride = planes->stride;
+    } else {
+      filter_steps[step](state->encoder_control,
+        src.orig_topleft,
+        src.stride,
+        internal_width,
+        internal_height,
+        filtered,
+        intermediate,
+        fme_level,
+        hor_first_cols,
+        sample_off_x,
+        sample_off_y);
+
+      filtered_pos[0] = &filtered[0][0];
+      filtered_pos[1] = &filtered[1][0];
+      filtered_pos[2] = &filtered[2][0];
+      filtered_pos[3] = &filtered[3][0];
+      filtered_stride = LCU_WIDTH;
+    }
+
     int8_t within_tile[4];
     for (int j = 0; j < 4; j++) {
       within_tile[j] =
         fracmv_within_tile(info, (mv.x + pattern[j]->x) * (1 << mv_shift), (mv.y + pattern[j]->y) * (1 << mv_shift));
     };
 
-    kvz_pixel *filtered_pos[4] = { 0 };
-    filtered_pos[0] = &filtered[0][0];
-    filtered_pos[1] = &filtered[1][0];
-    filtered_pos[2] = &filtered[2][0];
-    filtered_pos[3] = &filtered[3][0];
-
-    kvz_satd_any_size_quad(width, height, (const kvz_pixel **)filtered_pos, LCU_WIDTH, tmp_pic, tmp_stride, 4, costs, within_tile);
+    kvz_satd_any_size_quad(width, height, filtered_pos, filtered_stride, tmp_pic, tmp_stride, 4, costs, within_tile);
 
     for (int j = 0; j < 4; j++) {
       if (within_tile[j]) {
@@ -1224,28 +1514,57 @@ static void search_pu_inter_ref(inter_search_info_t *info,
 
   info->best_cost = UINT32_MAX;
 
-  switch (cfg->ime_algorithm) {
-    case KVZ_IME_TZ:
-      tz_search(info, mv);
-      break;
+  bool skip_ime = false;
+  if (info->num_cached == MOTION_CACHE_SEEDS &&
+      info->cached[0]->mv.x == info->cached[1]->mv.x &&
+      info->cached[0]->mv.y == info->cached[1]->mv.y)
+  {
+    // The containing CUs agree on the motion. Skip the integer search if
+    // their vector fits this PU at least as well as the nearest CU and no
+    // other starting point is better.
+    const int x = (info->cached[0]->mv.x + 2) >> 2;
+    const int y = (info->cached[0]->mv.y + 2) >> 2;
+    const uint64_t area = info->width * info->height;
+    const uint64_t cached_area = info->cached_width[0] * info->cached_width[0];
+    if (check_mv_cost(info, x, y) &&
+        (uint64_t)info->best_cost * cached_area <=
+        (uint64_t)info->cached[0]->cost * area)
+    {
+      select_starting_point(info, mv);
+      skip_ime = info->best_mv.x == x * 4 && info->best_mv.y == y * 4;
+    }
+  }
 
-    case KVZ_IME_FULL64:
-    case KVZ_IME_FULL32:
-    case KVZ_IME_FULL16:
-    case KVZ_IME_FULL8:
-    case KVZ_IME_FULL:
-      search_mv_full(info, search_range, mv);
-      break;
+  if (!skip_ime) {
+    switch (cfg->ime_algorithm) {
+      case KVZ_IME_TZ:
+        tz_search(info, mv);
+        break;
 
-    case KVZ_IME_DIA:
-      diamond_search(info, mv, info->state->encoder_control->cfg.me_max_steps);
-      break;
+      case KVZ_IME_FULL64:
+      case KVZ_IME_FULL32:
+      case KVZ_IME_FULL16:
+      case KVZ_IME_FULL8:
+      case KVZ_IME_FULL:
+        search_mv_full(info, search_range, mv);
+        break;
 
-    default:
-      hexagon_search(info, mv, info->state->encoder_control->cfg.me_max_steps);
-      break;
+      case KVZ_IME_DIA:
+        diamond_search(info, mv, info->state->encoder_control->cfg.me_max_steps);
+        break;
+
+      case KVZ_IME_PYRAMID:
+        pyramid_search(info, mv, info->state->encoder_control->cfg.me_max_steps);
+        break;
+
+      default:
+        hexagon_search(info, mv, info->state->encoder_control->cfg.me_max_steps);
+        break;
+    }
   }
 
+  const uint32_t ime_cost = info->best_cost;
+
   if (cfg->fme_level > 0 && info->best_cost < *inter_cost) {
     search_frac(info);
 
@@ -1263,6 +1582,11 @@ static void search_pu_inter_ref(inter_search_info_t *info,
     info->best_cost += info->best_bitcost * (int)(info->state->lambda_sqrt + 0.5);
   }
 
+  if (info->cache_out && ime_cost < UINT32_MAX) {
+    info->cache_out->mv   = info->best_mv;
+    info->cache_out->cost = ime_cost;
+  }
+
   mv = info->best_mv;
 
   int merged = 0;
@@ -1474,6 +1798,71 @@ static bool merge_candidate_in_list(inter_merge_cand_t * all_cands,
   return found;
 }
 
+/**
+ * \brief Get the index of a CU in the motion cache.
+ *
+ * CUs are stored depth by depth and in raster order within each depth.
+ */
+static INLINE int motion_cache_index(int x, int y, int depth)
+{
+  static const int depth_offsets[MAX_DEPTH + 1] = { 0, 1, 5, 21 };
+  const int shift = LOG2_LCU_WIDTH - depth;
+  return depth_offsets[depth] +
+         (SUB_SCU(y) >> shift) * (1 << depth) +
+         (SUB_SCU(x) >> shift);
+}
+
+
+/**
+ * \brief Mark all entries of the motion cache as unset.
+ */
+void kvz_motion_cache_clear(motion_cache_t *cache)
+{
+  for (int i = 0; i < MOTION_CACHE_CUS; ++i) {
+    for (int ref_idx = 0; ref_idx < MAX_REF_PIC_COUNT; ++ref_idx) {
+      cache->entries[i][ref_idx].cost = UINT32_MAX;
+    }
+  }
+}
+
+
+/**
+ * \brief Set the motion cache entries used in the search of a PU.
+ *
+ * A 2Nx2N PU uses the results of the CUs at the lower depths. Other
+ * partitions use the result of the 2Nx2N PU of the same CU first.
+ *
+ * \param cache       motion cache of the LCU
+ * \param info        search info with ref_idx set
+ * \param x_cu        x-coordinate of the containing CU
+ * \param y_cu        y-coordinate of the containing CU
+ * \param depth       depth of the CU in the quadtree
+ * \param part_mode   partition mode of the CU
+ */
+static void motion_cache_lookup(motion_cache_t *cache,
+                                inter_search_info_t *info,
+                                int x_cu, int y_cu,
+                                int depth,
+                                part_mode_t part_mode)
+{
+  info->num_cached = 0;
+  const int first_depth = part_mode == SIZE_2Nx2N ? depth - 1 : depth;
+  for (int d = first_depth; d >= 0 && info->num_cached < MOTION_CACHE_SEEDS; --d) {
+    const motion_cache_entry_t *entry =
+      &cache->entries[motion_cache_index(x_cu, y_cu, d)][info->ref_idx];
+    if (entry->cost == UINT32_MAX) continue;
+
+    info->cached[info->num_cached]       = entry;
+    info->cached_width[info->num_cached] = LCU_WIDTH >> d;
+    info->num_cached++;
+  }
+
+  info->cache_out = part_mode == SIZE_2Nx2N ?
+    &cache->entries[motion_cache_index(x_cu, y_cu, depth)][info->ref_idx] :
+    NULL;
+}
+
+
 /**
  * \brief Update PU to have best modes at this depth.
  *
@@ -1643,6 +2032,10 @@ static void search_pu_inter(encoder_state_t * const state,
     info.ref_idx = ref_idx;
     info.ref = state->frame->ref->images[ref_idx];
 
+    if (state->motion_cache) {
+      motion_cache_lookup(state->motion_cache, &info, x_cu, y_cu, depth, part_mode);
+    }
+
     search_pu_inter_ref(&info, depth, lcu, cur_cu, inter_cost, inter_bitcost);
   }
 
@@ -52,6 +52,34 @@ enum hpel_position {
   HPEL_POS_DIA = 2
 };
 
+/**
+ * \brief Number of CUs of all inter depths in an LCU.
+ */
+#define MOTION_CACHE_CUS (1 + 4 + 16 + 64)
+
+/**
+ * \brief Result of the motion search of a 2Nx2N PU for one reference.
+ */
+typedef struct {
+  /** \brief Best motion vector in quarter pixels */
+  vector2d_t mv;
+  /** \brief SAD and bit cost of the integer part of mv, UINT32_MAX if unset */
+  uint32_t cost;
+} motion_cache_entry_t;
+
+/**
+ * \brief Motion search results of the 2Nx2N PUs of an LCU.
+ *
+ * Filled as the CUs are searched from depth 0 down, so that the search of
+ * a CU can start from the vectors of the CUs containing it.
+ */
+typedef struct motion_cache_t {
+  /** \brief Indexed by the CU (see motion_cache_index) and the reference */
+  motion_cache_entry_t entries[MOTION_CACHE_CUS][MAX_REF_PIC_COUNT];
+} motion_cache_t;
+
+void kvz_motion_cache_clear(motion_cache_t *cache);
+
 typedef uint32_t kvz_mvd_cost_func(const encoder_state_t *state,
                                   int x, int y,
                                   int mv_shift,
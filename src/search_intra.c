@@ -151,6 +151,61 @@ static void get_cost_dual(encoder_state_t * const state,
   #undef PARALLEL_BLKS
 }
 
+
+/**
+ * \brief Calculate costs of a set of angular modes.
+ *
+ * SATDs are calculated by the fused prediction and SATD strategy, unless
+ * SAD is needed for estimating transform skip.
+ *
+ * \param refs  Reference pixels of the block.
+ * \param log2_width  Log2 of the width of the block.
+ * \param num_modes  Number of modes in param modes.
+ * \param modes  Angular modes in range 2..34.
+ * \param orig_block  Original pixels in continuous memory.
+ * \param filter_boundary  Whether to filter the boundary on modes 10 and 26.
+ * \param[out] costs_out  Costs of the modes.
+ */
+static void get_angular_costs(encoder_state_t * const state,
+                              kvz_intra_references *refs, int log2_width,
+                              int num_modes, const int8_t *modes,
+                              const kvz_pixel *orig_block, bool filter_boundary,
+                              double *costs_out)
+{
+  const int width = 1 << log2_width;
+
+  if (TRSKIP_RATIO == 0 || width != 4 || !state->encoder_control->cfg.trskip_enable) {
+    unsigned satd_costs[35];
+    kvz_intra_angular_satd(refs, log2_width, num_modes, modes, orig_block,
+                           filter_boundary, satd_costs);
+    for (int i = 0; i < num_modes; ++i) {
+      costs_out[i] = (double)satd_costs[i];
+    }
+    return;
+  }
+
+  cost_pixel_nxn_multi_func *satd_dual_func = kvz_pixels_get_satd_dual_func(width);
+  cost_pixel_nxn_multi_func *sad_dual_func = kvz_pixels_get_sad_dual_func(width);
+
+  kvz_pixel _preds[2 * 32 * 32 + SIMD_ALIGNMENT];
+  pred_buffer preds = ALIGNED_POINTER(_preds, SIMD_ALIGNMENT);
+
+  for (int i = 0; i < num_modes; i += 2) {
+    double dual_costs[2] = { 0 };
+    kvz_intra_predict(refs, log2_width, modes[i], COLOR_Y, preds[0], filter_boundary);
+    if (i + 1 < num_modes) {
+      kvz_intra_predict(refs, log2_width, modes[i + 1], COLOR_Y, preds[1], filter_boundary);
+    }
+
+    get_cost_dual(state, preds, orig_block, satd_dual_func, sad_dual_func, width, dual_costs);
+
+    costs_out[i] = dual_costs[0];
+    if (i + 1 < num_modes) {
+      costs_out[i + 1] = dual_costs[1];
+    }
+  }
+}
+
 /**
 * \brief Perform search for best intra transform split configuration.
 *
@@ -384,20 +439,17 @@ static int8_t search_intra_rough(encoder_state_t * const state,
                                  int log2_width, int8_t *intra_preds,
                                  int8_t modes[35], double costs[35])
 {
-  #define PARALLEL_BLKS 2 // TODO: use 4 for AVX-512 in the future?
   assert(log2_width >= 2 && log2_width <= 5);
   int_fast8_t width = 1 << log2_width;
   cost_pixel_nxn_func *satd_func = kvz_pixels_get_satd_func(width);
   cost_pixel_nxn_func *sad_func = kvz_pixels_get_sad_func(width);
-  cost_pixel_nxn_multi_func *satd_dual_func = kvz_pixels_get_satd_dual_func(width);
-  cost_pixel_nxn_multi_func *sad_dual_func = kvz_pixels_get_sad_dual_func(width);
 
   const kvz_config *cfg = &state->encoder_control->cfg;
   const bool filter_boundary = !(cfg->lossless && cfg->implicit_rdpcm);
 
   // Temporary block arrays
-  kvz_pixel _preds[PARALLEL_BLKS * 32 * 32 + SIMD_ALIGNMENT];
-  pred_buffer preds = ALIGNED_POINTER(_preds, SIMD_ALIGNMENT);
+  kvz_pixel _pred[32 * 32 + SIMD_ALIGNMENT];
+  kvz_pixel *pred = ALIGNED_POINTER(_pred, SIMD_ALIGNMENT);
   
   kvz_pixel _orig_block[32 * 32 + SIMD_ALIGNMENT];
   kvz_pixel *orig_block = ALIGNED_POINTER(_orig_block, SIMD_ALIGNMENT);
@@ -421,27 +473,14 @@ static int8_t search_intra_rough(encoder_state_t * const state,
 
   // Calculate SAD for evenly spaced modes to select the starting point for 
   // the recursive search.
-  for (int mode = 2; mode <= 34; mode += PARALLEL_BLKS * offset) {
-    
-    double costs_out[PARALLEL_BLKS] = { 0 };
-    for (int i = 0; i < PARALLEL_BLKS; ++i) {
-      if (mode + i * offset <= 34) {
-        kvz_intra_predict(refs, log2_width, mode + i * offset, COLOR_Y, preds[i], filter_boundary);
-      }
-    }
-    
-    //TODO: add generic version of get cost  multi
-    get_cost_dual(state, preds, orig_block, satd_dual_func, sad_dual_func, width, costs_out);
-
-    for (int i = 0; i < PARALLEL_BLKS; ++i) {
-      if (mode + i * offset <= 34) {
-        costs[modes_selected] = costs_out[i];
-        modes[modes_selected] = mode + i * offset;
-        min_cost = MIN(min_cost, costs[modes_selected]);
-        max_cost = MAX(max_cost, costs[modes_selected]);
-        ++modes_selected;
-      }
-    }
+  for (int mode = 2; mode <= 34; mode += offset) {
+    modes[modes_selected++] = mode;
+  }
+  get_angular_costs(state, refs, log2_width, modes_selected, modes,
+                    orig_block, filter_boundary, costs);
+  for (int mode_i = 0; mode_i < modes_selected; ++mode_i) {
+    min_cost = MIN(min_cost, costs[mode_i]);
+    max_cost = MAX(max_cost, costs[mode_i]);
   }
 
   int8_t best_mode = modes[select_best_mode_index(modes, costs, modes_selected)];
@@ -457,32 +496,25 @@ static int8_t search_intra_rough(encoder_state_t * const state,
       int8_t center_node = best_mode;
       int8_t test_modes[] = { center_node - offset, center_node + offset };
 
-      double costs_out[PARALLEL_BLKS] = { 0 };
-      char mode_in_range = 0;
-
-      for (int i = 0; i < PARALLEL_BLKS; ++i) mode_in_range |= (test_modes[i] >= 2 && test_modes[i] <= 34);
-
-      if (mode_in_range) {
-        for (int i = 0; i < PARALLEL_BLKS; ++i) {
-          if (test_modes[i] >= 2 && test_modes[i] <= 34) {
-            kvz_intra_predict(refs, log2_width, test_modes[i], COLOR_Y, preds[i], filter_boundary);
-          }
+      int8_t num_test_modes = 0;
+      for (int i = 0; i < 2; ++i) {
+        if (test_modes[i] >= 2 && test_modes[i] <= 34) {
+          modes[modes_selected + num_test_modes] = test_modes[i];
+          ++num_test_modes;
         }
+      }
+      if (num_test_modes == 0) continue;
+
+      get_angular_costs(state, refs, log2_width, num_test_modes,
+                        &modes[modes_selected], orig_block, filter_boundary,
+                        &costs[modes_selected]);
 
-        //TODO: add generic version of get cost multi
-        get_cost_dual(state, preds, orig_block, satd_dual_func, sad_dual_func, width, costs_out);
-
-        for (int i = 0; i < PARALLEL_BLKS; ++i) {
-          if (test_modes[i] >= 2 && test_modes[i] <= 34) {
-            costs[modes_selected] = costs_out[i];
-            modes[modes_selected] = test_modes[i];
-            if (costs[modes_selected] < best_cost) {
-              best_cost = costs[modes_selected];
-              best_mode = modes[modes_selected];
-            }
-            ++modes_selected;
-          }
+      for (int i = 0; i < num_test_modes; ++i) {
+        if (costs[modes_selected] < best_cost) {
+          best_cost = costs[modes_selected];
+          best_mode = modes[modes_selected];
         }
+        ++modes_selected;
       }
     }
   }
@@ -502,8 +534,8 @@ static int8_t search_intra_rough(encoder_state_t * const state,
     }
 
     if (!has_mode) {
-      kvz_intra_predict(refs, log2_width, mode, COLOR_Y, preds[0], filter_boundary);
-      costs[modes_selected] = get_cost(state, preds[0], orig_block, satd_func, sad_func, width);
+      kvz_intra_predict(refs, log2_width, mode, COLOR_Y, pred, filter_boundary);
+      costs[modes_selected] = get_cost(state, pred, orig_block, satd_func, sad_func, width);
       modes[modes_selected] = mode;
       ++modes_selected;
     }
@@ -516,8 +548,6 @@ static int8_t search_intra_rough(encoder_state_t * const state,
     costs[mode_i] += lambda_cost * kvz_luma_mode_bits(state, modes[mode_i], intra_preds);
   }
 
-  #undef PARALLEL_BLKS
-
   return modes_selected;
 }
 
@@ -0,0 +1,351 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "strategies/avx2/filter-avx2.h"
+
+#if COMPILE_INTEL_AVX2
+#include <immintrin.h>
+#include <string.h>
+
+#include "filter.h"
+#include "strategies/strategies-filter.h"
+#include "strategyselector.h"
+
+
+/**
+ * \brief Transpose an 8x8 block of bytes.
+ *
+ * Each vector holds two rows of 8 bytes, the first row in the low half.
+ * The rows of the result are the columns of the input.
+ */
+static INLINE void transpose_8x8_u8(__m128i *r01, __m128i *r23, __m128i *r45, __m128i *r67)
+{
+  // Interleave rows 0 and 2, 1 and 3, 4 and 6, and 5 and 7.
+  const __m128i t0 = _mm_unpacklo_epi8(*r01, *r23);
+  const __m128i t1 = _mm_unpackhi_epi8(*r01, *r23);
+  const __m128i t2 = _mm_unpacklo_epi8(*r45, *r67);
+  const __m128i t3 = _mm_unpackhi_epi8(*r45, *r67);
+
+  // 4x4 blocks: columns 0-3 and 4-7 of rows 0-3 and 4-7.
+  const __m128i u0 = _mm_unpacklo_epi8(t0, t1);
+  const __m128i u1 = _mm_unpackhi_epi8(t0, t1);
+  const __m128i u2 = _mm_unpacklo_epi8(t2, t3);
+  const __m128i u3 = _mm_unpackhi_epi8(t2, t3);
+
+  *r01 = _mm_unpacklo_epi32(u0, u2);
+  *r23 = _mm_unpackhi_epi32(u0, u2);
+  *r45 = _mm_unpacklo_epi32(u1, u3);
+  *r67 = _mm_unpackhi_epi32(u1, u3);
+}
+
+static INLINE __m128i load_line(const kvz_pixel *src, int32_t num_lines)
+{
+  if (num_lines == 8) {
+    return _mm_loadl_epi64((const __m128i*)src);
+  } else {
+    int32_t pixels;
+    memcpy(&pixels, src, sizeof(pixels));
+    return _mm_cvtsi32_si128(pixels);
+  }
+}
+
+static INLINE void store_line(kvz_pixel *dst, __m128i v, int32_t num_lines)
+{
+  if (num_lines == 8) {
+    _mm_storel_epi64((__m128i*)dst, v);
+  } else {
+    const int32_t pixels = _mm_cvtsi128_si32(v);
+    memcpy(dst, &pixels, sizeof(pixels));
+  }
+}
+
+/**
+ * \brief Load the pixels on both sides of an edge.
+ *
+ * The 16-bit lanes of x[k] hold pk of each line in the low half and qk of
+ * each line in the high half.
+ *
+ * \param src         first pixel after the edge (q0 of the first line)
+ * \param num_lines   number of lines, 4 or 8
+ */
+static INLINE void load_edge(const kvz_pixel *src,
+                             int32_t stride,
+                             edge_dir dir,
+                             int32_t num_lines,
+                             __m256i x[4])
+{
+  __m128i pq[4];
+
+  if (dir == EDGE_VER) {
+    // Read the lines p3..q3 and transpose them.
+    __m128i rows[4] = { _mm_setzero_si128(), _mm_setzero_si128(),
+                        _mm_setzero_si128(), _mm_setzero_si128() };
+    for (int i = 0; i < num_lines; i += 2) {
+      const __m128i r0 = _mm_loadl_epi64((const __m128i*)&src[ i      * stride - 4]);
+      const __m128i r1 = _mm_loadl_epi64((const __m128i*)&src[(i + 1) * stride - 4]);
+      rows[i >> 1] = _mm_unpacklo_epi64(r0, r1);
+    }
+    transpose_8x8_u8(&rows[0], &rows[1], &rows[2], &rows[3]);
+
+    // The columns are p3 p2 | p1 p0 | q0 q1 | q2 q3.
+    pq[0] = _mm_alignr_epi8(rows[2], rows[1], 8);
+    pq[1] = _mm_blend_epi16(rows[1], rows[2], 0xF0);
+    pq[2] = _mm_alignr_epi8(rows[3], rows[0], 8);
+    pq[3] = _mm_blend_epi16(rows[0], rows[3], 0xF0);
+
+  } else {
+    for (int k = 0; k < 4; k++) {
+      const __m128i p = load_line(&src[-(k + 1) * stride], num_lines);
+      const __m128i q = load_line(&src[k * stride], num_lines);
+      pq[k] = _mm_unpacklo_epi64(p, q);
+    }
+  }
+
+  for (int k = 0; k < 4; k++) {
+    x[k] = _mm256_cvtepu8_epi16(pq[k]);
+  }
+}
+
+/**
+ * \brief Store the pixels p2..q2 loaded by load_edge.
+ */
+static INLINE void store_edge(kvz_pixel *src,
+                              int32_t stride,
+                              edge_dir dir,
+                              int32_t num_lines,
+                              const __m256i x[4])
+{
+  __m128i pq[4];
+  for (int k = 0; k < 4; k++) {
+    pq[k] = _mm_packus_epi16(_mm256_castsi256_si128(x[k]),
+                             _mm256_extracti128_si256(x[k], 1));
+  }
+
+  if (dir == EDGE_VER) {
+    __m128i rows[4] = {
+      _mm_unpacklo_epi64(pq[3], pq[2]),
+      _mm_unpacklo_epi64(pq[1], pq[0]),
+      _mm_unpackhi_epi64(pq[0], pq[1]),
+      _mm_unpackhi_epi64(pq[2], pq[3]),
+    };
+    transpose_8x8_u8(&rows[0], &rows[1], &rows[2], &rows[3]);
+
+    for (int i = 0; i < num_lines; i++) {
+      const __m128i row = (i & 1) ? _mm_unpackhi_epi64(rows[i >> 1], rows[i >> 1]) : rows[i >> 1];
+      _mm_storel_epi64((__m128i*)&src[i * stride - 4], row);
+    }
+
+  } else {
+    for (int k = 0; k < 3; k++) {
+      store_line(&src[-(k + 1) * stride], pq[k], num_lines);
+      store_line(&src[k * stride], _mm_unpackhi_epi64(pq[k], pq[k]), num_lines);
+    }
+  }
+}
+
+/**
+ * \brief Swap the P and Q halves of a vector.
+ */
+static INLINE __m256i swap_pq(__m256i v)
+{
+  return _mm256_permute2x128_si256(v, v, 0x01);
+}
+
+/**
+ * \brief Broadcast the low half of a vector to both halves and negate the
+ * high half.
+ */
+static INLINE __m256i to_pq_delta(__m256i v)
+{
+  const __m256i sign = _mm256_setr_epi16( 1,  1,  1,  1,  1,  1,  1,  1,
+                                         -1, -1, -1, -1, -1, -1, -1, -1);
+  return _mm256_sign_epi16(_mm256_permute2x128_si256(v, v, 0x00), sign);
+}
+
+static INLINE __m256i clip_epi16(__m256i low, __m256i high, __m256i v)
+{
+  return _mm256_min_epi16(_mm256_max_epi16(v, low), high);
+}
+
+static void deblock_luma_avx2(kvz_pixel *src,
+                              int32_t stride,
+                              edge_dir dir,
+                              int32_t num_parts,
+                              const int32_t *tc,
+                              int32_t beta,
+                              int32_t bitdepth)
+{
+  const int32_t num_lines = num_parts * 4;
+  const int32_t side_threshold = (beta + (beta >> 1)) >> 3;
+
+  __m256i x[4];
+  load_edge(src, stride, dir, num_lines, x);
+  const __m256i y0 = swap_pq(x[0]);
+  const __m256i y1 = swap_pq(x[1]);
+
+  // Second derivatives |p2 - 2p1 + p0| and |q2 - 2q1 + q0|, the flatness
+  // |p3 - p0| and |q3 - q0|, and the step |p0 - q0| of each line.
+  const __m256i d = _mm256_abs_epi16(_mm256_add_epi16(_mm256_sub_epi16(x[2], _mm256_slli_epi16(x[1], 1)), x[0]));
+  const __m256i flat = _mm256_abs_epi16(_mm256_sub_epi16(x[3], x[0]));
+  const __m256i step = _mm256_abs_epi16(_mm256_sub_epi16(x[0], y0));
+
+  ALIGNED(32) int16_t d_lines[16];
+  ALIGNED(32) int16_t flat_lines[16];
+  ALIGNED(32) int16_t step_lines[16];
+  _mm256_store_si256((__m256i*)d_lines, d);
+  _mm256_store_si256((__m256i*)flat_lines, flat);
+  _mm256_store_si256((__m256i*)step_lines, step);
+
+  // Make the filter decisions of each part from its first and last line.
+  ALIGNED(32) int16_t tc_lanes[16] = { 0 };
+  ALIGNED(32) int16_t strong_lanes[16] = { 0 };
+  ALIGNED(32) int16_t weak_lanes[16] = { 0 };
+  ALIGNED(32) int16_t second_lanes[16] = { 0 };
+  bool filter = false;
+
+  for (int32_t part = 0; part < num_parts; part++) {
+    if (tc[part] == 0) continue;
+
+    const int i0 = part * 4;
+    const int i3 = part * 4 + 3;
+    const int32_t dp = d_lines[i0] + d_lines[i3];
+    const int32_t dq = d_lines[8 + i0] + d_lines[8 + i3];
+    if (dp + dq >= beta) continue;
+
+    const bool sw = 2 * (d_lines[i0] + d_lines[8 + i0]) < beta >> 2 &&
+                    2 * (d_lines[i3] + d_lines[8 + i3]) < beta >> 2 &&
+                    step_lines[i0] < (5 * tc[part] + 1) >> 1 &&
+                    step_lines[i3] < (5 * tc[part] + 1) >> 1 &&
+                    flat_lines[i0] + flat_lines[8 + i0] < beta >> 3 &&
+                    flat_lines[i3] + flat_lines[8 + i3] < beta >> 3;
+    const bool p_2nd = dp < side_threshold;
+    const bool q_2nd = dq < side_threshold;
+
+    for (int i = i0; i <= i3; i++) {
+      tc_lanes[i] = tc_lanes[8 + i] = tc[part];
+      strong_lanes[i] = strong_lanes[8 + i] = sw ? -1 : 0;
+      weak_lanes[i] = weak_lanes[8 + i] = sw ? 0 : -1;
+      second_lanes[i] = p_2nd ? -1 : 0;
+      second_lanes[8 + i] = q_2nd ? -1 : 0;
+    }
+    filter = true;
+  }
+
+  if (!filter) return;
+
+  const __m256i tcv = _mm256_load_si256((const __m256i*)tc_lanes);
+  const __m256i strong = _mm256_load_si256((const __m256i*)strong_lanes);
+  const __m256i second = _mm256_load_si256((const __m256i*)second_lanes);
+  const __m256i four = _mm256_set1_epi16(4);
+
+  // Strong filter
+  const __m256i tc2 = _mm256_slli_epi16(tcv, 1);
+  const __m256i sum = _mm256_add_epi16(_mm256_add_epi16(x[2], x[1]), _mm256_add_epi16(x[0], y0));
+  __m256i s[3];
+  s[0] = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_add_epi16(x[2], y1),
+                                                             _mm256_slli_epi16(_mm256_add_epi16(_mm256_add_epi16(x[1], x[0]), y0), 1)),
+                                            four), 3);
+  s[1] = _mm256_srai_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+  s[2] = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(sum, _mm256_slli_epi16(_mm256_add_epi16(x[3], x[2]), 1)),
+                                            four), 3);
+  for (int k = 0; k < 3; k++) {
+    s[k] = clip_epi16(_mm256_sub_epi16(x[k], tc2), _mm256_add_epi16(x[k], tc2), s[k]);
+  }
+
+  // Weak filter
+  const __m256i max_pixel = _mm256_set1_epi16((1 << bitdepth) - 1);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i delta_lines = _mm256_srai_epi16(
+    _mm256_add_epi16(_mm256_sub_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(y0, x[0]), _mm256_set1_epi16(9)),
+                                      _mm256_mullo_epi16(_mm256_sub_epi16(y1, x[1]), _mm256_set1_epi16(3))),
+                     _mm256_set1_epi16(8)), 4);
+  const __m256i delta_full = to_pq_delta(delta_lines);
+  const __m256i weak = _mm256_and_si256(
+    _mm256_load_si256((const __m256i*)weak_lanes),
+    _mm256_cmpgt_epi16(_mm256_mullo_epi16(tcv, _mm256_set1_epi16(10)), _mm256_abs_epi16(delta_full)));
+
+  const __m256i delta = clip_epi16(_mm256_sub_epi16(zero, tcv), tcv, delta_full);
+  const __m256i w0 = clip_epi16(zero, max_pixel, _mm256_add_epi16(x[0], delta));
+
+  const __m256i tc_half = _mm256_srai_epi16(tcv, 1);
+  const __m256i delta1 = clip_epi16(
+    _mm256_sub_epi16(zero, tc_half), tc_half,
+    _mm256_srai_epi16(_mm256_add_epi16(_mm256_sub_epi16(_mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(x[2], x[0]),
+                                                                                           _mm256_set1_epi16(1)), 1),
+                                                        x[1]),
+                                       delta), 1));
+  const __m256i w1 = clip_epi16(zero, max_pixel, _mm256_add_epi16(x[1], delta1));
+
+  x[0] = _mm256_blendv_epi8(_mm256_blendv_epi8(x[0], w0, weak), s[0], strong);
+  x[1] = _mm256_blendv_epi8(_mm256_blendv_epi8(x[1], w1, _mm256_and_si256(weak, second)), s[1], strong);
+  x[2] = _mm256_blendv_epi8(x[2], s[2], strong);
+
+  store_edge(src, stride, dir, num_lines, x);
+}
+
+static void deblock_chroma_avx2(kvz_pixel *src,
+                                int32_t stride,
+                                edge_dir dir,
+                                int32_t num_parts,
+                                const int32_t *tc,
+                                int32_t bitdepth)
+{
+  const int32_t num_lines = num_parts * 4;
+
+  ALIGNED(32) int16_t tc_lanes[16] = { 0 };
+  for (int32_t part = 0; part < num_parts; part++) {
+    for (int i = part * 4; i < part * 4 + 4; i++) {
+      tc_lanes[i] = tc_lanes[8 + i] = tc[part];
+    }
+  }
+  const __m256i tcv = _mm256_load_si256((const __m256i*)tc_lanes);
+
+  __m256i x[4];
+  load_edge(src, stride, dir, num_lines, x);
+  const __m256i y0 = swap_pq(x[0]);
+  const __m256i y1 = swap_pq(x[1]);
+
+  // ((q0 - p0) * 4 + p1 - q1 + 4) >> 3 in the low half
+  const __m256i delta_lines = _mm256_srai_epi16(
+    _mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y0, x[0]), 2),
+                                      _mm256_sub_epi16(x[1], y1)),
+                     _mm256_set1_epi16(4)), 3);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i delta = to_pq_delta(clip_epi16(_mm256_sub_epi16(zero, tcv), tcv, delta_lines));
+
+  x[0] = clip_epi16(zero, _mm256_set1_epi16((1 << bitdepth) - 1), _mm256_add_epi16(x[0], delta));
+
+  store_edge(src, stride, dir, num_lines, x);
+}
+
+#endif //COMPILE_INTEL_AVX2
+
+
+int kvz_strategy_register_filter_avx2(void* opaque, uint8_t bitdepth)
+{
+  bool success = true;
+#if COMPILE_INTEL_AVX2
+  if (bitdepth == 8) {
+    success &= kvz_strategyselector_register(opaque, "deblock_luma", "avx2", 40, &deblock_luma_avx2);
+    success &= kvz_strategyselector_register(opaque, "deblock_chroma", "avx2", 40, &deblock_chroma_avx2);
+  }
+#endif //COMPILE_INTEL_AVX2
+  return success;
+}
@@ -514,6 +514,386 @@ static void kvz_intra_pred_planar_avx2(
 }
 
 
+/**
+ * \brief Transpose a square block of 8-bit pixels.
+ * \param src     Source block in continuous memory.
+ * \param dst     Destination block in continuous memory.
+ * \param width   Width of the block, 4, 8, 16 or 32.
+ */
+static void transpose_block_avx2(const kvz_pixel *src, kvz_pixel *dst, int_fast8_t width)
+{
+  if (width == 4) {
+    const __m128i shuf = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    _mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)src), shuf));
+    return;
+  }
+
+  for (int_fast8_t y = 0; y < width; y += 8) {
+    for (int_fast8_t x = 0; x < width; x += 8) {
+      const kvz_pixel *s = src + y * width + x;
+      __m128i r0 = _mm_loadl_epi64((const __m128i*)(s + 0 * width));
+      __m128i r1 = _mm_loadl_epi64((const __m128i*)(s + 1 * width));
+      __m128i r2 = _mm_loadl_epi64((const __m128i*)(s + 2 * width));
+      __m128i r3 = _mm_loadl_epi64((const __m128i*)(s + 3 * width));
+      __m128i r4 = _mm_loadl_epi64((const __m128i*)(s + 4 * width));
+      __m128i r5 = _mm_loadl_epi64((const __m128i*)(s + 5 * width));
+      __m128i r6 = _mm_loadl_epi64((const __m128i*)(s + 6 * width));
+      __m128i r7 = _mm_loadl_epi64((const __m128i*)(s + 7 * width));
+
+      __m128i a0 = _mm_unpacklo_epi8(r0, r1);
+      __m128i a1 = _mm_unpacklo_epi8(r2, r3);
+      __m128i a2 = _mm_unpacklo_epi8(r4, r5);
+      __m128i a3 = _mm_unpacklo_epi8(r6, r7);
+
+      __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+      __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+      __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+      __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+
+      // Each register holds two columns of the source.
+      __m128i c[4];
+      c[0] = _mm_unpacklo_epi32(b0, b2);
+      c[1] = _mm_unpackhi_epi32(b0, b2);
+      c[2] = _mm_unpacklo_epi32(b1, b3);
+      c[3] = _mm_unpackhi_epi32(b1, b3);
+
+      kvz_pixel *d = dst + x * width + y;
+      for (int i = 0; i < 4; ++i) {
+        _mm_storel_epi64((__m128i*)(d + (2 * i + 0) * width), c[i]);
+        _mm_storel_epi64((__m128i*)(d + (2 * i + 1) * width), _mm_unpackhi_epi64(c[i], c[i]));
+      }
+    }
+  }
+}
+
+
+/**
+ * \brief Horizontal 8-point Hadamard transform of each 128-bit lane.
+ */
+static INLINE __m256i hadamard_hor_8_avx2(__m256i row)
+{
+  const __m256i pos = _mm256_set1_epi16(1);
+  const __m256i neg = _mm256_set1_epi16(-1);
+
+  row = _mm256_add_epi16(_mm256_sign_epi16(row, _mm256_unpacklo_epi64(pos, neg)),
+                         _mm256_shuffle_epi32(row, _MM_SHUFFLE(1, 0, 3, 2)));
+  row = _mm256_add_epi16(_mm256_sign_epi16(row, _mm256_unpacklo_epi32(pos, neg)),
+                         _mm256_shuffle_epi32(row, _MM_SHUFFLE(2, 3, 0, 1)));
+  __m256i swapped = _mm256_shufflelo_epi16(row, _MM_SHUFFLE(2, 3, 0, 1));
+  swapped = _mm256_shufflehi_epi16(swapped, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm256_add_epi16(_mm256_sign_epi16(row, _mm256_unpacklo_epi16(pos, neg)), swapped);
+}
+
+
+/**
+ * \brief Sum of absolute 8x8 Hadamard coefficients of residual rows.
+ *
+ * Each 128-bit lane of the rows is a separate 8x8 block. The horizontal
+ * transform must already have been applied to the rows.
+ *
+ * \return Sum of lane 0 in the low and lane 1 in the high 32 bits.
+ */
+static INLINE uint64_t hadamard_ver_8_sum_avx2(__m256i r[8])
+{
+  __m256i t[8];
+  for (int i = 0; i < 8; i += 2) {
+    t[i + 0] = _mm256_add_epi16(r[i], r[i + 1]);
+    t[i + 1] = _mm256_sub_epi16(r[i], r[i + 1]);
+  }
+  for (int i = 0; i < 8; i += 4) {
+    r[i + 0] = _mm256_add_epi16(t[i + 0], t[i + 2]);
+    r[i + 1] = _mm256_add_epi16(t[i + 1], t[i + 3]);
+    r[i + 2] = _mm256_sub_epi16(t[i + 0], t[i + 2]);
+    r[i + 3] = _mm256_sub_epi16(t[i + 1], t[i + 3]);
+  }
+  __m256i sum = _mm256_setzero_si256();
+  for (int i = 0; i < 4; ++i) {
+    sum = _mm256_add_epi16(sum, _mm256_abs_epi16(_mm256_add_epi16(r[i], r[i + 4])));
+    sum = _mm256_add_epi16(sum, _mm256_abs_epi16(_mm256_sub_epi16(r[i], r[i + 4])));
+  }
+  // The 16-bit sums fit in unsigned but not in signed 16 bits.
+  sum = _mm256_add_epi32(_mm256_and_si256(sum, _mm256_set1_epi32(0xffff)),
+                         _mm256_srli_epi32(sum, 16));
+  sum = _mm256_add_epi32(sum, _mm256_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm256_add_epi32(sum, _mm256_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  uint64_t sum0 = (uint32_t)_mm256_extract_epi32(sum, 0);
+  uint64_t sum1 = (uint32_t)_mm256_extract_epi32(sum, 4);
+  return sum0 | (sum1 << 32);
+}
+
+
+/**
+ * \brief Interpolation weights of one row for _mm_maddubs_epi16.
+ */
+static INLINE int16_t angular_weights(int_fast16_t delta_pos)
+{
+  const int_fast16_t delta_fract = delta_pos & (32 - 1);
+  return (int16_t)((delta_fract << 8) | (32 - delta_fract));
+}
+
+
+/**
+ * \brief SATD of a 4x4 angular prediction.
+ * \param ref_main      Reference pixels, index 0 at block coordinate 0.
+ * \param sample_disp   Sample displacement per row.
+ * \param orig          Original block, transposed for horizontal modes.
+ */
+static unsigned pred_satd_4x4_avx2(const kvz_pixel *ref_main, int_fast8_t sample_disp, const kvz_pixel *orig)
+{
+  __m128i pairs[4];
+  __m128i weights[4];
+  for (int_fast8_t y = 0; y < 4; ++y) {
+    const int_fast16_t delta_pos = (y + 1) * sample_disp;
+    const int_fast8_t delta_int = delta_pos >> 5;
+    __m128i sample0 = _mm_cvtsi32_si128(*(uint32_t*)&ref_main[delta_int]);
+    __m128i sample1 = _mm_cvtsi32_si128(*(uint32_t*)&ref_main[delta_int + 1]);
+    pairs[y] = _mm_unpacklo_epi8(sample0, sample1);
+    weights[y] = _mm_set1_epi16(angular_weights(delta_pos));
+  }
+
+  const __m128i round = _mm_set1_epi16(16);
+  __m128i pred_lo = _mm_maddubs_epi16(_mm_unpacklo_epi64(pairs[0], pairs[1]),
+                                      _mm_unpacklo_epi64(weights[0], weights[1]));
+  __m128i pred_hi = _mm_maddubs_epi16(_mm_unpacklo_epi64(pairs[2], pairs[3]),
+                                      _mm_unpacklo_epi64(weights[2], weights[3]));
+  pred_lo = _mm_srli_epi16(_mm_add_epi16(pred_lo, round), 5);
+  pred_hi = _mm_srli_epi16(_mm_add_epi16(pred_hi, round), 5);
+
+  __m128i orig_px = _mm_loadu_si128((const __m128i*)orig);
+  __m128i diff_lo = _mm_sub_epi16(pred_lo, _mm_cvtepu8_epi16(orig_px));
+  __m128i diff_hi = _mm_sub_epi16(pred_hi, _mm_unpackhi_epi8(orig_px, _mm_setzero_si128()));
+
+  __m128i row0 = _mm_hadd_epi16(diff_lo, diff_hi);
+  __m128i row1 = _mm_hsub_epi16(diff_lo, diff_hi);
+  __m128i row2 = _mm_hadd_epi16(row0, row1);
+  __m128i row3 = _mm_hsub_epi16(row0, row1);
+  row0 = _mm_hadd_epi16(row2, row3);
+  row1 = _mm_hsub_epi16(row2, row3);
+  row2 = _mm_hadd_epi16(row0, row1);
+  row3 = _mm_hsub_epi16(row0, row1);
+
+  __m128i sum = _mm_add_epi16(_mm_abs_epi16(row2), _mm_abs_epi16(row3));
+  sum = _mm_madd_epi16(sum, _mm_set1_epi16(1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  return (_mm_cvtsi128_si32(sum) + 1) >> 1;
+}
+
+
+/**
+ * \brief SATD of an 8x8 angular prediction.
+ * \param ref_main      Reference pixels, index 0 at block coordinate 0.
+ * \param sample_disp   Sample displacement per row.
+ * \param orig          Original block, transposed for horizontal modes.
+ */
+static unsigned pred_satd_8x8_avx2(const kvz_pixel *ref_main, int_fast8_t sample_disp, const kvz_pixel *orig)
+{
+  const __m256i round = _mm256_set1_epi16(16);
+  __m256i rows[4];
+
+  // Two rows are predicted at a time, one in each lane.
+  for (int_fast8_t y = 0; y < 8; y += 2) {
+    const int_fast16_t delta_pos0 = (y + 1) * sample_disp;
+    const int_fast16_t delta_pos1 = (y + 2) * sample_disp;
+    const kvz_pixel *ref0 = &ref_main[delta_pos0 >> 5];
+    const kvz_pixel *ref1 = &ref_main[delta_pos1 >> 5];
+
+    __m128i pairs0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)ref0),
+                                       _mm_loadl_epi64((const __m128i*)(ref0 + 1)));
+    __m128i pairs1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)ref1),
+                                       _mm_loadl_epi64((const __m128i*)(ref1 + 1)));
+    __m256i pairs = _mm256_inserti128_si256(_mm256_castsi128_si256(pairs0), pairs1, 1);
+    __m256i weights = _mm256_inserti128_si256(
+      _mm256_set1_epi16(angular_weights(delta_pos0)),
+      _mm_set1_epi16(angular_weights(delta_pos1)), 1);
+
+    __m256i pred = _mm256_maddubs_epi16(pairs, weights);
+    pred = _mm256_srli_epi16(_mm256_add_epi16(pred, round), 5);
+
+    __m256i orig_px = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)&orig[y * 8]));
+    rows[y / 2] = hadamard_hor_8_avx2(_mm256_sub_epi16(pred, orig_px));
+  }
+
+  // Vertical transform. The first stage is between the lanes and the rest
+  // are between the registers.
+  const __m256i sign = _mm256_setr_epi16(1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1, -1, -1, -1);
+  for (int i = 0; i < 4; ++i) {
+    rows[i] = _mm256_add_epi16(_mm256_sign_epi16(rows[i], sign),
+                               _mm256_permute2x128_si256(rows[i], rows[i], 0x01));
+  }
+  __m256i t0 = _mm256_add_epi16(rows[0], rows[1]);
+  __m256i t1 = _mm256_sub_epi16(rows[0], rows[1]);
+  __m256i t2 = _mm256_add_epi16(rows[2], rows[3]);
+  __m256i t3 = _mm256_sub_epi16(rows[2], rows[3]);
+
+  __m256i sum = _mm256_abs_epi16(_mm256_add_epi16(t0, t2));
+  sum = _mm256_add_epi16(sum, _mm256_abs_epi16(_mm256_sub_epi16(t0, t2)));
+  sum = _mm256_add_epi16(sum, _mm256_abs_epi16(_mm256_add_epi16(t1, t3)));
+  sum = _mm256_add_epi16(sum, _mm256_abs_epi16(_mm256_sub_epi16(t1, t3)));
+
+  // A sum of four coefficients is at most 2 * 64 * 255, so it fits in int16.
+  sum = _mm256_madd_epi16(sum, _mm256_set1_epi16(1));
+  __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  const unsigned sum_abs = _mm_cvtsi128_si32(sum128);
+  return (sum_abs + 2) >> 2;
+}
+
+
+/**
+ * \brief SATD of an angular prediction of a block of width 16 or 32.
+ * \param ref_main      Reference pixels, index 0 at block coordinate 0.
+ * \param sample_disp   Sample displacement per row.
+ * \param orig          Original block, transposed for horizontal modes.
+ * \param width         Width of the block.
+ */
+static unsigned pred_satd_NxN_avx2(const kvz_pixel *ref_main, int_fast8_t sample_disp, const kvz_pixel *orig, int_fast8_t width)
+{
+  const __m256i round = _mm256_set1_epi16(16);
+  unsigned satd = 0;
+
+  for (int_fast8_t y = 0; y < width; y += 8) {
+    const kvz_pixel *refs[8];
+    __m256i weights[8];
+    for (int_fast8_t i = 0; i < 8; ++i) {
+      const int_fast16_t delta_pos = (y + i + 1) * sample_disp;
+      refs[i] = &ref_main[delta_pos >> 5];
+      weights[i] = _mm256_set1_epi16(angular_weights(delta_pos));
+    }
+
+    // Each 16 pixel wide strip is two 8x8 blocks, one in each lane.
+    for (int_fast8_t x = 0; x < width; x += 16) {
+      __m256i rows[8];
+      for (int_fast8_t i = 0; i < 8; ++i) {
+        __m128i sample0 = _mm_loadu_si128((const __m128i*)(refs[i] + x));
+        __m128i sample1 = _mm_loadu_si128((const __m128i*)(refs[i] + x + 1));
+        __m256i pairs = _mm256_inserti128_si256(
+          _mm256_castsi128_si256(_mm_unpacklo_epi8(sample0, sample1)),
+          _mm_unpackhi_epi8(sample0, sample1), 1);
+
+        __m256i pred = _mm256_maddubs_epi16(pairs, weights[i]);
+        pred = _mm256_srli_epi16(_mm256_add_epi16(pred, round), 5);
+
+        __m256i orig_px = _mm256_cvtepu8_epi16(
+          _mm_loadu_si128((const __m128i*)&orig[(y + i) * width + x]));
+        rows[i] = hadamard_hor_8_avx2(_mm256_sub_epi16(pred, orig_px));
+      }
+
+      const uint64_t sums = hadamard_ver_8_sum_avx2(rows);
+      satd += (((uint32_t)sums) + 2) >> 2;
+      satd += (((uint32_t)(sums >> 32)) + 2) >> 2;
+    }
+  }
+
+  return satd;
+}
+
+
+/**
+ * \brief Calculate SATD costs of angular predictions for a set of modes.
+ *
+ * The predictions are never written to memory. Horizontal modes are
+ * predicted transposed and compared against the transposed original block,
+ * which gives the same SATD.
+ *
+ * Boundary filtering of modes 10 and 26 is not done.
+ *
+ * \param log2_width    Log2 of width, range 2..5.
+ * \param num_modes     Number of modes in the set.
+ * \param modes         Angular modes in range 2..34.
+ * \param refs_above    Pointers to -1 index of above reference of each mode.
+ * \param refs_left     Pointers to -1 index of left reference of each mode.
+ * \param orig_block    Original block in continuous memory.
+ * \param costs_out     SATD of each mode.
+ */
+static void kvz_angular_pred_satd_avx2(
+  const int_fast8_t log2_width,
+  const int_fast8_t num_modes,
+  const int8_t *const modes,
+  const kvz_pixel *const *const refs_above,
+  const kvz_pixel *const *const refs_left,
+  const kvz_pixel *const orig_block,
+  unsigned *const costs_out)
+{
+  assert(log2_width >= 2 && log2_width <= 5);
+
+  static const int8_t modedisp2sampledisp[9] = { 0, 2, 5, 9, 13, 17, 21, 26, 32 };
+  static const int16_t modedisp2invsampledisp[9] = { 0, 4096, 1638, 910, 630, 482, 390, 315, 256 }; // (256 * 32) / sampledisp
+
+  const int_fast8_t width = 1 << log2_width;
+
+  ALIGNED(32) kvz_pixel orig_transposed[32 * 32];
+  bool transposed = false;
+
+  // Temporary main reference with room for indices from -32 to 64 and the
+  // unused pixels loaded past the end of the reference.
+  ALIGNED(32) kvz_pixel ref_buf[32 + 2 * 32 + 32] = { 0 };
+  kvz_pixel *const tmp_ref = &ref_buf[32];
+
+  for (int_fast8_t i = 0; i < num_modes; ++i) {
+    const int_fast8_t intra_mode = modes[i];
+    assert(intra_mode >= 2 && intra_mode <= 34);
+
+    const bool vertical_mode = intra_mode >= 18;
+    const int_fast8_t mode_disp = vertical_mode ? intra_mode - 26 : 10 - intra_mode;
+    const int_fast8_t sample_disp = (mode_disp < 0 ? -1 : 1) * modedisp2sampledisp[abs(mode_disp)];
+
+    const kvz_pixel *ref_side = (vertical_mode ? refs_left[i] : refs_above[i]) + 1;
+    const kvz_pixel *ref_main = (vertical_mode ? refs_above[i] : refs_left[i]) + 1;
+
+    if (sample_disp < 0) {
+      // Move the reference pixels to ref_buf, so there is room for negative
+      // indices.
+      const kvz_pixel *src_main = ref_main;
+      ref_main = tmp_ref;
+      for (int_fast8_t x = -1; x < width; ++x) {
+        tmp_ref[x] = src_main[x];
+      }
+      // Extend the side reference to the negative indices of main reference.
+      int_fast32_t col_sample_disp = 128; // rounding for the ">> 8"
+      int_fast16_t inv_abs_sample_disp = modedisp2invsampledisp[abs(mode_disp)];
+      int_fast8_t most_negative_index = (width * sample_disp) >> 5;
+      for (int_fast8_t x = -2; x >= most_negative_index; --x) {
+        col_sample_disp += inv_abs_sample_disp;
+        int_fast8_t side_index = col_sample_disp >> 8;
+        tmp_ref[x] = ref_side[side_index - 1];
+      }
+    } else if (sample_disp == 32 && width == 32) {
+      // The last row would load one pixel past the end of the reference.
+      const __m256i *src_main = (const __m256i*)ref_main;
+      _mm256_store_si256((__m256i*)&tmp_ref[0], _mm256_loadu_si256(src_main));
+      _mm256_store_si256((__m256i*)&tmp_ref[32], _mm256_loadu_si256(src_main + 1));
+      ref_main = tmp_ref;
+    }
+
+    const kvz_pixel *orig = orig_block;
+    if (!vertical_mode) {
+      if (!transposed) {
+        transpose_block_avx2(orig_block, orig_transposed, width);
+        transposed = true;
+      }
+      orig = orig_transposed;
+    }
+
+    switch (width) {
+      case 4:
+        costs_out[i] = pred_satd_4x4_avx2(ref_main, sample_disp, orig);
+        break;
+      case 8:
+        costs_out[i] = pred_satd_8x8_avx2(ref_main, sample_disp, orig);
+        break;
+      default:
+        costs_out[i] = pred_satd_NxN_avx2(ref_main, sample_disp, orig, width);
+        break;
+    }
+  }
+}
+
+
 #endif //COMPILE_INTEL_AVX2 && defined X86_64
 
 int kvz_strategy_register_intra_avx2(void* opaque, uint8_t bitdepth)
@@ -523,6 +903,7 @@ int kvz_strategy_register_intra_avx2(void* opaque, uint8_t bitdepth)
   if (bitdepth == 8) {
     success &= kvz_strategyselector_register(opaque, "angular_pred", "avx2", 40, &kvz_angular_pred_avx2);
     success &= kvz_strategyselector_register(opaque, "intra_pred_planar", "avx2", 40, &kvz_intra_pred_planar_avx2);
+    success &= kvz_strategyselector_register(opaque, "angular_pred_satd", "avx2", 40, &kvz_angular_pred_satd_avx2);
   }
 #endif //COMPILE_INTEL_AVX2 && defined X86_64
   return success;
@@ -0,0 +1,115 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "strategies/avx2/nal-avx2.h"
+
+#if COMPILE_INTEL_AVX2
+#include <immintrin.h>
+#include <wmmintrin.h>
+
+#include "kvazaar.h"
+#include "strategyselector.h"
+
+// x^192 mod P and x^128 mod P for the CRC polynomial
+// P = x^16 + x^12 + x^5 + 1 of the decoded picture hash.
+#define CRC_FOLD_K1 0x650b
+#define CRC_FOLD_K2 0xaefc
+
+
+// Built in kvz_strategy_register_nal_avx2 before any worker can read it.
+static uint16_t crc_table[256];
+
+static void init_crc_table(void)
+{
+  // Entry h is the register after feeding 8 zero bits to register h << 8.
+  for (int h = 0; h < 256; ++h) {
+    uint32_t r = h << 8;
+    for (int bit = 0; bit < 8; ++bit) {
+      r = ((r << 1) & 0xffff) ^ (((r >> 15) & 1) * 0x1021);
+    }
+    crc_table[h] = r;
+  }
+}
+
+static INLINE uint32_t crc_bytes(uint32_t crc, const uint8_t *bytes, int num_bytes)
+{
+  for (int i = 0; i < num_bytes; ++i) {
+    crc = (((crc << 8) | bytes[i]) & 0xffff) ^ crc_table[crc >> 8];
+  }
+  return crc;
+}
+
+/**
+ * \brief Update the CRC of the decoded picture hash with carry-less
+ * multiplication.
+ *
+ * Each row is read in 16 byte blocks, with the first byte as the most
+ * significant one. A 128-bit remainder congruent to the CRC register is
+ * folded over the blocks and reduced to 16 bits with the table at the end
+ * of the row.
+ */
+static uint32_t array_crc_avx2(uint32_t crc, const kvz_pixel *data,
+                               int height, int width, int stride)
+{
+  const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                        7, 6, 5, 4, 3, 2, 1, 0);
+  const __m128i k = _mm_set_epi64x(CRC_FOLD_K1, CRC_FOLD_K2);
+  const int num_bytes = width * sizeof(kvz_pixel);
+
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *bytes = (const uint8_t *)&data[y * stride];
+
+    if (num_bytes < 16) {
+      crc = crc_bytes(crc, bytes, num_bytes);
+      continue;
+    }
+
+    // The register is multiplied by x^128 for each block like a remainder
+    // of the previous blocks.
+    __m128i acc = _mm_cvtsi32_si128(crc);
+
+    int i = 0;
+    for (; i + 16 <= num_bytes; i += 16) {
+      const __m128i block = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&bytes[i]), reverse);
+      const __m128i hi = _mm_clmulepi64_si128(acc, k, 0x11);
+      const __m128i lo = _mm_clmulepi64_si128(acc, k, 0x00);
+      acc = _mm_xor_si128(_mm_xor_si128(hi, lo), block);
+    }
+
+    ALIGNED(16) uint8_t rem[16];
+    _mm_store_si128((__m128i *)rem, _mm_shuffle_epi8(acc, reverse));
+    crc = crc_bytes(0, rem, 16);
+    crc = crc_bytes(crc, &bytes[i], num_bytes - i);
+  }
+
+  return crc;
+}
+
+#endif //COMPILE_INTEL_AVX2
+
+int kvz_strategy_register_nal_avx2(void* opaque, uint8_t bitdepth)
+{
+  bool success = true;
+#if COMPILE_INTEL_AVX2
+  init_crc_table();
+  success &= kvz_strategyselector_register(opaque, "array_crc", "avx2", 40, &array_crc_avx2);
+#endif //COMPILE_INTEL_AVX2
+  return success;
+}
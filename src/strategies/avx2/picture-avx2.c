@@ -123,6 +123,70 @@ static INLINE uint32_t m256i_horizontal_sum(const __m256i sum)
 }
 
 
+/**
+ * \brief Load rows of a block into a 256-bit register.
+ *
+ * Blocks narrower than 32 pixels have several rows packed in one register.
+ */
+static INLINE __m256i load_sad_rows_avx2(const kvz_pixel *data, unsigned stride, int width)
+{
+  if (width >= 32) {
+    return _mm256_loadu_si256((const __m256i *)data);
+  } else if (width == 16) {
+    const __m128i row0 = _mm_loadu_si128((const __m128i *)(data));
+    const __m128i row1 = _mm_loadu_si128((const __m128i *)(data + stride));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(row0), row1, 1);
+  } else {
+    const __m128i rows01 = _mm_unpacklo_epi64(
+        _mm_loadl_epi64((const __m128i *)(data)),
+        _mm_loadl_epi64((const __m128i *)(data + stride)));
+    const __m128i rows23 = _mm_unpacklo_epi64(
+        _mm_loadl_epi64((const __m128i *)(data + 2 * stride)),
+        _mm_loadl_epi64((const __m128i *)(data + 3 * stride)));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(rows01), rows23, 1);
+  }
+}
+
+/**
+ * \brief Calculate SADs of a block against four blocks.
+ *
+ * The pixels of the first block are loaded only once for all four blocks.
+ * Width must be 8, 16, 32 or 64 and height a multiple of the number of
+ * rows that fit in a 256-bit register.
+ */
+static INLINE void reg_sad_quad_avx2(const kvz_pixel *data1, const kvz_pixel *const *data2,
+                                     const int width, int height,
+                                     unsigned stride1, unsigned stride2,
+                                     unsigned *costs_out)
+{
+  const int rows = width >= 32 ? 1 : 32 / width;
+  const kvz_pixel *const ref0 = data2[0];
+  const kvz_pixel *const ref1 = data2[1];
+  const kvz_pixel *const ref2 = data2[2];
+  const kvz_pixel *const ref3 = data2[3];
+
+  __m256i sum0 = _mm256_setzero_si256();
+  __m256i sum1 = _mm256_setzero_si256();
+  __m256i sum2 = _mm256_setzero_si256();
+  __m256i sum3 = _mm256_setzero_si256();
+
+  for (int y = 0; y < height; y += rows) {
+    for (int x = 0; x < width; x += 32) {
+      const __m256i a = load_sad_rows_avx2(data1 + y * stride1 + x, stride1, width);
+      const unsigned offset = y * stride2 + x;
+      sum0 = _mm256_add_epi64(sum0, _mm256_sad_epu8(a, load_sad_rows_avx2(ref0 + offset, stride2, width)));
+      sum1 = _mm256_add_epi64(sum1, _mm256_sad_epu8(a, load_sad_rows_avx2(ref1 + offset, stride2, width)));
+      sum2 = _mm256_add_epi64(sum2, _mm256_sad_epu8(a, load_sad_rows_avx2(ref2 + offset, stride2, width)));
+      sum3 = _mm256_add_epi64(sum3, _mm256_sad_epu8(a, load_sad_rows_avx2(ref3 + offset, stride2, width)));
+    }
+  }
+
+  costs_out[0] = m256i_horizontal_sum(sum0);
+  costs_out[1] = m256i_horizontal_sum(sum1);
+  costs_out[2] = m256i_horizontal_sum(sum2);
+  costs_out[3] = m256i_horizontal_sum(sum3);
+}
+
 static unsigned sad_8bit_8x8_avx2(const kvz_pixel *buf1, const kvz_pixel *buf2)
 {
   const __m256i *const a = (const __m256i *)buf1;
@@ -1293,6 +1357,54 @@ static optimized_sad_func_ptr_t get_optimized_sad_avx2(int32_t width)
     return NULL;
 }
 
+/**
+ * \brief Calculate SADs of a block against several blocks.
+ *
+ * Blocks of the common sizes are processed four at a time. A group of two
+ * or three blocks is padded to four by repeating the last one. Other sizes
+ * and a single remaining block are calculated one block at a time.
+ */
+static void reg_sad_multi_avx2(const kvz_pixel *data1, const kvz_pixel *const *data2,
+                               int num_blocks, int width, int height,
+                               unsigned stride1, unsigned stride2, unsigned *costs_out)
+{
+  const bool quad_ok = (width == 8  && height % 4 == 0) ||
+                       (width == 16 && height % 2 == 0) ||
+                       width == 32 || width == 64;
+  int i = 0;
+  if (quad_ok) {
+    for (; i + 2 <= num_blocks; i += 4) {
+      const kvz_pixel *blocks[4];
+      unsigned costs[4];
+      const int num_left = MIN(4, num_blocks - i);
+      for (int k = 0; k < 4; ++k) {
+        blocks[k] = data2[i + MIN(k, num_left - 1)];
+      }
+      switch (width) {
+        case 8:  reg_sad_quad_avx2(data1, blocks,  8, height, stride1, stride2, costs); break;
+        case 16: reg_sad_quad_avx2(data1, blocks, 16, height, stride1, stride2, costs); break;
+        case 32: reg_sad_quad_avx2(data1, blocks, 32, height, stride1, stride2, costs); break;
+        default: reg_sad_quad_avx2(data1, blocks, 64, height, stride1, stride2, costs); break;
+      }
+      for (int k = 0; k < num_left; ++k) {
+        costs_out[i + k] = costs[k];
+      }
+    }
+    // GCC does not always clear the upper halves of the registers here,
+    // which slows down the SSE code of the caller.
+    _mm256_zeroupper();
+  }
+
+  const optimized_sad_func_ptr_t optimized_sad = get_optimized_sad_avx2(width);
+  for (; i < num_blocks; ++i) {
+    if (optimized_sad) {
+      costs_out[i] = optimized_sad(data1, data2[i], height, stride1, stride2);
+    } else {
+      costs_out[i] = kvz_reg_sad_avx2(data1, data2[i], width, height, stride1, stride2);
+    }
+  }
+}
+
 static uint32_t ver_sad_avx2(const kvz_pixel *pic_data, const kvz_pixel *ref_data,
                              int32_t width, int32_t height, uint32_t stride)
 {
@@ -1331,6 +1443,51 @@ static uint32_t hor_sad_avx2(const kvz_pixel *pic_data, const kvz_pixel *ref_dat
                                    pic_stride, ref_stride, left, right);
 }
 
+static uint64_t pixel_var_avx2(const kvz_pixel *data, int32_t width,
+                               int32_t height, int32_t stride)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const int32_t width_vec = width & ~15;
+
+  // Sums of the pixels and of their squares in 64-bit lanes.
+  __m128i sum = _mm_setzero_si128();
+  __m256i sum_sq = zero;
+  uint64_t sum_tail = 0;
+  uint64_t sum_sq_tail = 0;
+
+  for (int y = 0; y < height; y++) {
+    const kvz_pixel *row = &data[y * stride];
+
+    // The 32-bit sums of the squares of a single row cannot overflow, so
+    // they are widened to 64 bits once per row.
+    __m256i row_sq = zero;
+    for (int x = 0; x < width_vec; x += 16) {
+      const __m128i pixels = _mm_loadu_si128((const __m128i *)&row[x]);
+      const __m256i pixels_epi16 = _mm256_cvtepu8_epi16(pixels);
+      row_sq = _mm256_add_epi32(row_sq, _mm256_madd_epi16(pixels_epi16, pixels_epi16));
+      sum = _mm_add_epi64(sum, _mm_sad_epu8(pixels, _mm_setzero_si128()));
+    }
+    sum_sq = _mm256_add_epi64(sum_sq, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(row_sq)));
+    sum_sq = _mm256_add_epi64(sum_sq, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(row_sq, 1)));
+
+    for (int x = width_vec; x < width; x++) {
+      const uint32_t pixel = row[x];
+      sum_tail += pixel;
+      sum_sq_tail += pixel * pixel;
+    }
+  }
+
+  __m128i sum_sq_128 = _mm_add_epi64(_mm256_castsi256_si128(sum_sq),
+                                     _mm256_extracti128_si256(sum_sq, 1));
+  sum        = _mm_add_epi64(sum,        _mm_unpackhi_epi64(sum,        sum));
+  sum_sq_128 = _mm_add_epi64(sum_sq_128, _mm_unpackhi_epi64(sum_sq_128, sum_sq_128));
+
+  const uint64_t total    = (uint64_t)_mm_cvtsi128_si64(sum)        + sum_tail;
+  const uint64_t total_sq = (uint64_t)_mm_cvtsi128_si64(sum_sq_128) + sum_sq_tail;
+
+  return total_sq - total * total / (width * height);
+}
+
 #endif //COMPILE_INTEL_AVX2
 
 int kvz_strategy_register_picture_avx2(void* opaque, uint8_t bitdepth)
@@ -1344,6 +1501,7 @@ int kvz_strategy_register_picture_avx2(void* opaque, uint8_t bitdepth)
   if (bitdepth == 8){
 
     success &= kvz_strategyselector_register(opaque, "reg_sad", "avx2", 40, &kvz_reg_sad_avx2);
+    success &= kvz_strategyselector_register(opaque, "reg_sad_multi", "avx2", 40, &reg_sad_multi_avx2);
     success &= kvz_strategyselector_register(opaque, "sad_8x8", "avx2", 40, &sad_8bit_8x8_avx2);
     success &= kvz_strategyselector_register(opaque, "sad_16x16", "avx2", 40, &sad_8bit_16x16_avx2);
     success &= kvz_strategyselector_register(opaque, "sad_32x32", "avx2", 40, &sad_8bit_32x32_avx2);
@@ -1368,6 +1526,7 @@ int kvz_strategy_register_picture_avx2(void* opaque, uint8_t bitdepth)
     success &= kvz_strategyselector_register(opaque, "get_optimized_sad", "avx2", 40, &get_optimized_sad_avx2);
     success &= kvz_strategyselector_register(opaque, "ver_sad", "avx2", 40, &ver_sad_avx2);
     success &= kvz_strategyselector_register(opaque, "hor_sad", "avx2", 40, &hor_sad_avx2);
+    success &= kvz_strategyselector_register(opaque, "pixel_var", "avx2", 40, &pixel_var_avx2);
 
   }
 #endif
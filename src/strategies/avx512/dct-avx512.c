@@ -0,0 +1,111 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+/*
+ * \file
+ * \brief AVX-512 version of the 32x32 transforms.
+ */
+
+#include "strategies/avx512/dct-avx512.h"
+
+#if COMPILE_INTEL_AVX512
+#include <immintrin.h>
+
+#include "strategyselector.h"
+#include "tables.h"
+
+extern const int16_t kvz_g_dct_32[32][32];
+extern const int16_t kvz_g_dct_32_t[32][32];
+
+
+/**
+ * \brief Multiply two 32x32 matrices and round and clip the result to 16 bits.
+ *
+ * Calculates dst = (left * right + (1 << (shift - 1))) >> shift. Each row of
+ * the result fits in one register. Pairs of rows of the right matrix are
+ * interleaved so that each multiply-add handles two elements of a row of
+ * the left matrix.
+ */
+static void mul_clip_matrix_32x32_avx512(const int16_t *left, const int16_t *right, int16_t *dst, const int32_t shift)
+{
+  __m512i right_lo[16], right_hi[16];
+
+  for (int k = 0; k < 16; ++k) {
+    __m512i row0 = _mm512_loadu_si512((const __m512i *)(right + (2 * k + 0) * 32));
+    __m512i row1 = _mm512_loadu_si512((const __m512i *)(right + (2 * k + 1) * 32));
+    right_lo[k] = _mm512_unpacklo_epi16(row0, row1);
+    right_hi[k] = _mm512_unpackhi_epi16(row0, row1);
+  }
+
+  const __m512i add = _mm512_set1_epi32(1 << (shift - 1));
+  const int32_t *left_pairs = (const int32_t *)left;
+
+  for (int i = 0; i < 32; ++i) {
+    __m512i accu_lo = add;
+    __m512i accu_hi = add;
+
+    for (int k = 0; k < 16; ++k) {
+      __m512i pair = _mm512_set1_epi32(left_pairs[i * 16 + k]);
+      accu_lo = _mm512_add_epi32(accu_lo, _mm512_madd_epi16(pair, right_lo[k]));
+      accu_hi = _mm512_add_epi32(accu_hi, _mm512_madd_epi16(pair, right_hi[k]));
+    }
+
+    accu_lo = _mm512_srai_epi32(accu_lo, shift);
+    accu_hi = _mm512_srai_epi32(accu_hi, shift);
+
+    // The unpacking and packing are done within 128-bit lanes, so the
+    // result is in the original order.
+    _mm512_storeu_si512((__m512i *)(dst + i * 32), _mm512_packs_epi32(accu_lo, accu_hi));
+  }
+}
+
+static void matrix_dct_32x32_avx512(int8_t bitdepth, const int16_t *input, int16_t *output)
+{
+  int32_t shift_1st = kvz_g_convert_to_bit[32] + 1 + (bitdepth - 8);
+  int32_t shift_2nd = kvz_g_convert_to_bit[32] + 8;
+  ALIGNED(64) int16_t tmp[32 * 32];
+
+  mul_clip_matrix_32x32_avx512(input, &kvz_g_dct_32_t[0][0], tmp, shift_1st);
+  mul_clip_matrix_32x32_avx512(&kvz_g_dct_32[0][0], tmp, output, shift_2nd);
+}
+
+static void matrix_idct_32x32_avx512(int8_t bitdepth, const int16_t *input, int16_t *output)
+{
+  int32_t shift_1st = 7;
+  int32_t shift_2nd = 12 - (bitdepth - 8);
+  ALIGNED(64) int16_t tmp[32 * 32];
+
+  mul_clip_matrix_32x32_avx512(&kvz_g_dct_32_t[0][0], input, tmp, shift_1st);
+  mul_clip_matrix_32x32_avx512(tmp, &kvz_g_dct_32[0][0], output, shift_2nd);
+}
+
+#endif //COMPILE_INTEL_AVX512
+
+int kvz_strategy_register_dct_avx512(void* opaque, uint8_t bitdepth)
+{
+  bool success = true;
+#if COMPILE_INTEL_AVX512
+  if (bitdepth == 8) {
+    success &= kvz_strategyselector_register(opaque, "dct_32x32", "avx512", 50, &matrix_dct_32x32_avx512);
+    success &= kvz_strategyselector_register(opaque, "idct_32x32", "avx512", 50, &matrix_idct_32x32_avx512);
+  }
+#endif //COMPILE_INTEL_AVX512
+  return success;
+}
@@ -0,0 +1,827 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+/*
+ * \file
+ * \brief AVX-512 versions of luma interpolation.
+ *
+ * The intermediate buffers use the same layout as the generic functions.
+ */
+
+#include "strategies/avx512/ipol-avx512.h"
+
+#if COMPILE_INTEL_AVX512
+#include <immintrin.h>
+#include <string.h>
+
+#include "encoder.h"
+#include "kvazaar.h"
+#include "search_inter.h"
+#include "strategies/generic/picture-generic.h"
+#include "strategies/strategies-ipol.h"
+#include "strategyselector.h"
+
+
+extern int8_t kvz_g_luma_filter[4][8];
+
+/**
+ * \brief Get a mask of the first n bytes.
+ */
+static INLINE __mmask64 first_n_mask64(int n)
+{
+  if (n <= 0) return 0;
+  return n >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << n) - 1;
+}
+
+/**
+ * \brief Get a mask of the first n 16-bit elements.
+ */
+static INLINE __mmask32 first_n_mask32(int n)
+{
+  if (n <= 0) return 0;
+  return n >= 32 ? 0xFFFFFFFF : (1u << n) - 1;
+}
+
+/**
+ * \brief Filter the first column of a block horizontally.
+ *
+ * Eight rows are filtered at once from a gather of 8 pixels per row.
+ *
+ * \param src    first pixel of the filter window of row 0
+ * \param col    column array indexed by row
+ */
+static void filter_col_hor_avx512(const int8_t *filter, const kvz_pixel *src, int src_stride,
+                                  int first_y, int end_y, int16_t *col)
+{
+  const __m512i taps = _mm512_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)filter));
+  const __m512i offsets = _mm512_setr_epi64(0, src_stride, 2 * src_stride, 3 * src_stride,
+                                            4 * src_stride, 5 * src_stride, 6 * src_stride, 7 * src_stride);
+
+  for (int y = first_y; y < end_y; y += 8) {
+    const __mmask8 mask = (__mmask8)first_n_mask32(end_y - y);
+    __m512i rows = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), mask, offsets,
+                                               (const void *)(src + y * src_stride), 1);
+    __m512i sums = _mm512_madd_epi16(_mm512_maddubs_epi16(rows, taps), _mm512_set1_epi16(1));
+    sums = _mm512_add_epi32(sums, _mm512_srli_epi64(sums, 32));
+    _mm_mask_storeu_epi16(col + y, mask, _mm512_cvtepi64_epi16(sums));
+  }
+}
+
+/**
+ * \brief Filter a column of 16-bit samples vertically to pixels.
+ *
+ * \param col    first sample of the filter window of the first pixel
+ * \param out    contiguous output pixels
+ */
+static void filter_col_ver_avx512(const int8_t *filter, const int16_t *col, int height, kvz_pixel *out)
+{
+  __m512i taps[8];
+  for (int k = 0; k < 8; ++k) {
+    taps[k] = _mm512_set1_epi32(filter[k]);
+  }
+
+  for (int y = 0; y < height; y += 16) {
+    const __mmask16 mask = (__mmask16)first_n_mask32(height - y);
+    __m512i sum = _mm512_setzero_si512();
+    for (int k = 0; k < 8; ++k) {
+      __m512i samples = _mm512_cvtepi16_epi32(_mm256_maskz_loadu_epi16(mask, col + y + k));
+      sum = _mm512_add_epi32(sum, _mm512_mullo_epi32(samples, taps[k]));
+    }
+
+    __m256i samples = _mm512_cvtsepi32_epi16(_mm512_srai_epi32(sum, 6));
+    samples = _mm256_srai_epi16(_mm256_add_epi16(samples, _mm256_set1_epi16(32)), 6);
+    samples = _mm256_max_epi16(samples, _mm256_setzero_si256());
+    _mm_mask_storeu_epi8(out + y, mask, _mm256_cvtusepi16_epi8(samples));
+  }
+}
+
+/**
+ * \brief Broadcast pairs of 8-bit filter taps for maddubs.
+ */
+static INLINE void init_hor_filter_taps(const int8_t *filter, __m512i taps[4])
+{
+  for (int i = 0; i < 4; ++i) {
+    taps[i] = _mm512_set1_epi16((int16_t)((uint8_t)filter[2 * i] | ((uint8_t)filter[2 * i + 1] << 8)));
+  }
+}
+
+/**
+ * \brief Broadcast pairs of filter taps for 16-bit madd.
+ */
+static INLINE void init_ver_filter_taps(const int8_t *filter, __m512i taps[4])
+{
+  for (int i = 0; i < 4; ++i) {
+    taps[i] = _mm512_set1_epi32((uint16_t)filter[2 * i] | ((uint32_t)(uint16_t)filter[2 * i + 1] << 16));
+  }
+}
+
+/**
+ * \brief Masks for filtering rows of a given width horizontally.
+ *
+ * The masks are set up once per block because moving them to mask
+ * registers on every row is slow.
+ */
+typedef struct {
+  __mmask64 load[8];   //!< \brief masks of the loads at offsets 0 to 7
+  __mmask32 store[2];  //!< \brief masks of the two halves of the output
+} hor_masks_t;
+
+static INLINE void init_hor_masks(int n, hor_masks_t *masks)
+{
+  for (int k = 0; k < 8; ++k) {
+    masks->load[k] = first_n_mask64(n + 7 - k);
+  }
+  masks->store[0] = first_n_mask32(n);
+  masks->store[1] = first_n_mask32(n - 32);
+}
+
+/**
+ * \brief Filter up to 64 pixels of a row horizontally.
+ *
+ * Even and odd output samples are filtered separately with maddubs and
+ * interleaved back in order.
+ *
+ * \param src   first pixel of the filter window of the first sample
+ */
+static INLINE void filter_row_hor_avx512(const kvz_pixel *src, const hor_masks_t *masks,
+                                         const __m512i taps[4], int16_t *out)
+{
+  __m512i even = _mm512_setzero_si512();
+  __m512i odd = _mm512_setzero_si512();
+
+  for (int k = 0; k < 8; k += 2) {
+    __m512i a = _mm512_maskz_loadu_epi8(masks->load[k], src + k);
+    __m512i b = _mm512_maskz_loadu_epi8(masks->load[k + 1], src + k + 1);
+    even = _mm512_add_epi16(even, _mm512_maddubs_epi16(a, taps[k >> 1]));
+    odd  = _mm512_add_epi16(odd,  _mm512_maddubs_epi16(b, taps[k >> 1]));
+  }
+
+  const __m512i idx_lo = _mm512_setr_epi64(0, 1, 8, 9, 2, 3, 10, 11);
+  const __m512i idx_hi = _mm512_setr_epi64(4, 5, 12, 13, 6, 7, 14, 15);
+  __m512i lo = _mm512_unpacklo_epi16(even, odd);
+  __m512i hi = _mm512_unpackhi_epi16(even, odd);
+
+  // Full stores are forwarded to the loads of the vertical filter.
+  _mm512_storeu_si512((__m512i *)out, _mm512_permutex2var_epi64(lo, idx_lo, hi));
+  if (masks->store[1]) {
+    _mm512_storeu_si512((__m512i *)(out + 32), _mm512_permutex2var_epi64(lo, idx_hi, hi));
+  }
+}
+
+/**
+ * \brief Filter four groups of 8 pixels horizontally.
+ *
+ * Each 128-bit lane holds the 15 source pixels of one group, so narrow
+ * blocks fill the whole vector with several rows.
+ *
+ * \param src0   first pixel of the filter window of the first group
+ * \param masks  masks of the source pixels of each group
+ * \return       8 filtered samples in each lane
+ */
+static INLINE __m512i filter_hor_8x4_avx512(const kvz_pixel *src0, const kvz_pixel *src1,
+                                            const kvz_pixel *src2, const kvz_pixel *src3,
+                                            const __mmask16 masks[4], const __m512i shuf[4],
+                                            const __m512i taps[4])
+{
+  __m512i data = _mm512_castsi128_si512(_mm_maskz_loadu_epi8(masks[0], src0));
+  data = _mm512_inserti32x4(data, _mm_maskz_loadu_epi8(masks[1], src1), 1);
+  data = _mm512_inserti32x4(data, _mm_maskz_loadu_epi8(masks[2], src2), 2);
+  data = _mm512_inserti32x4(data, _mm_maskz_loadu_epi8(masks[3], src3), 3);
+
+  __m512i sum01 = _mm512_maddubs_epi16(_mm512_shuffle_epi8(data, shuf[0]), taps[0]);
+  __m512i sum23 = _mm512_maddubs_epi16(_mm512_shuffle_epi8(data, shuf[1]), taps[1]);
+  __m512i sum45 = _mm512_maddubs_epi16(_mm512_shuffle_epi8(data, shuf[2]), taps[2]);
+  __m512i sum67 = _mm512_maddubs_epi16(_mm512_shuffle_epi8(data, shuf[3]), taps[3]);
+
+  return _mm512_add_epi16(_mm512_add_epi16(sum01, sum23), _mm512_add_epi16(sum45, sum67));
+}
+
+/**
+ * \brief Filter rows of at most 16 pixels horizontally.
+ *
+ * Each vector filters four rows of 8 pixels or two rows of 16 pixels. The
+ * last vector repeats the last row when the rows do not divide evenly.
+ */
+static void filter_hor_rows_narrow_avx512(const kvz_pixel *src, int src_stride, const __m512i taps[4],
+                                          int width, int first_y, int end_y, int16_t *out)
+{
+  // Pairs of pixels for taps 0 and 1, 2 and 3, 4 and 5, 6 and 7
+  const __m512i shuf[4] = {
+    _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8)),
+    _mm512_broadcast_i32x4(_mm_setr_epi8(2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10)),
+    _mm512_broadcast_i32x4(_mm_setr_epi8(4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12)),
+    _mm512_broadcast_i32x4(_mm_setr_epi8(6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14)),
+  };
+
+  const int last_y = end_y - 1;
+
+  if (width <= 8) {
+    const __mmask16 mask = (__mmask16)first_n_mask32(width + 7);
+    const __mmask16 masks[4] = { mask, mask, mask, mask };
+
+    for (int y = first_y; y < end_y; y += 4) {
+      const int y1 = MIN(y + 1, last_y);
+      const int y2 = MIN(y + 2, last_y);
+      const int y3 = MIN(y + 3, last_y);
+      __m512i samples = filter_hor_8x4_avx512(src + y * src_stride, src + y1 * src_stride,
+                                              src + y2 * src_stride, src + y3 * src_stride,
+                                              masks, shuf, taps);
+      _mm_storeu_si128((__m128i *)(out + y * LCU_WIDTH), _mm512_castsi512_si128(samples));
+      _mm_storeu_si128((__m128i *)(out + y1 * LCU_WIDTH), _mm512_extracti32x4_epi32(samples, 1));
+      _mm_storeu_si128((__m128i *)(out + y2 * LCU_WIDTH), _mm512_extracti32x4_epi32(samples, 2));
+      _mm_storeu_si128((__m128i *)(out + y3 * LCU_WIDTH), _mm512_extracti32x4_epi32(samples, 3));
+    }
+  } else {
+    const __mmask16 mask_lo = (__mmask16)first_n_mask32(width + 7);
+    const __mmask16 mask_hi = (__mmask16)first_n_mask32(width - 1);
+    const __mmask16 masks[4] = { mask_lo, mask_hi, mask_lo, mask_hi };
+
+    for (int y = first_y; y < end_y; y += 2) {
+      const int y1 = MIN(y + 1, last_y);
+      const kvz_pixel *row0 = src + y * src_stride;
+      const kvz_pixel *row1 = src + y1 * src_stride;
+      __m512i samples = filter_hor_8x4_avx512(row0, row0 + 8, row1, row1 + 8, masks, shuf, taps);
+      // Whole rows are stored at once so that they are forwarded to the
+      // loads of the vertical filter.
+      _mm256_storeu_si256((__m256i *)(out + y * LCU_WIDTH), _mm512_castsi512_si256(samples));
+      _mm256_storeu_si256((__m256i *)(out + y1 * LCU_WIDTH), _mm512_extracti64x4_epi64(samples, 1));
+    }
+  }
+}
+
+/**
+ * \brief Filter rows horizontally into an intermediate buffer.
+ *
+ * \param src    first pixel of the filter window of the first sample of row 0
+ * \param out    intermediate buffer with a stride of LCU_WIDTH
+ */
+static void filter_hor_rows_avx512(const int8_t *filter, const kvz_pixel *src, int src_stride,
+                                   int width, int first_y, int end_y, int16_t *out)
+{
+  __m512i taps[4];
+  init_hor_filter_taps(filter, taps);
+
+  if (width <= 16) {
+    filter_hor_rows_narrow_avx512(src, src_stride, taps, width, first_y, end_y, out);
+    return;
+  }
+
+  hor_masks_t masks;
+  init_hor_masks(width, &masks);
+
+  for (int y = first_y; y < end_y; ++y) {
+    filter_row_hor_avx512(src + y * src_stride, &masks, taps, out + y * LCU_WIDTH);
+  }
+}
+
+/**
+ * \brief Store integer pixels of a row scaled to the intermediate precision.
+ */
+static INLINE void scale_row_avx512(const kvz_pixel *src, const __mmask32 masks[2], int16_t *out)
+{
+  for (int i = 0; i < 2 && masks[i]; ++i) {
+    __m512i pixels = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(masks[i], src + 32 * i));
+    _mm512_storeu_si512((__m512i *)(out + 32 * i), _mm512_slli_epi16(pixels, 6));
+  }
+}
+
+/**
+ * \brief Filter 32 columns of 16-bit samples vertically.
+ *
+ * \return  filtered samples shifted down by 6
+ */
+static INLINE __m512i filter_ver_16bit_32_avx512(const int16_t *data, int stride, const __m512i taps[4])
+{
+  __m512i lo = _mm512_setzero_si512();
+  __m512i hi = _mm512_setzero_si512();
+
+  for (int k = 0; k < 4; ++k) {
+    __m512i r0 = _mm512_loadu_si512((const __m512i *)(data + (2 * k) * stride));
+    __m512i r1 = _mm512_loadu_si512((const __m512i *)(data + (2 * k + 1) * stride));
+    lo = _mm512_add_epi32(lo, _mm512_madd_epi16(_mm512_unpacklo_epi16(r0, r1), taps[k]));
+    hi = _mm512_add_epi32(hi, _mm512_madd_epi16(_mm512_unpackhi_epi16(r0, r1), taps[k]));
+  }
+
+  return _mm512_packs_epi32(_mm512_srai_epi32(lo, 6), _mm512_srai_epi32(hi, 6));
+}
+
+/**
+ * \brief Filter 4 rows of 8 columns of 16-bit samples vertically.
+ *
+ * Each 128-bit lane holds one output row. The window of input rows is
+ * shifted through the lanes so every row is loaded only once.
+ *
+ * \return  filtered samples shifted down by 6
+ */
+static INLINE __m512i filter_ver_16bit_8x4_avx512(const int16_t *data, int stride, const __m512i taps[4])
+{
+  __m512i rows = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)data));
+  rows = _mm512_inserti32x4(rows, _mm_loadu_si128((const __m128i *)(data + 1 * stride)), 1);
+  rows = _mm512_inserti32x4(rows, _mm_loadu_si128((const __m128i *)(data + 2 * stride)), 2);
+  rows = _mm512_inserti32x4(rows, _mm_loadu_si128((const __m128i *)(data + 3 * stride)), 3);
+
+  __m512i lo = _mm512_setzero_si512();
+  __m512i hi = _mm512_setzero_si512();
+
+  for (int k = 0; k < 4; ++k) {
+    __m512i row = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)(data + (2 * k + 4) * stride)));
+    __m512i next = _mm512_alignr_epi64(row, rows, 2);
+    lo = _mm512_add_epi32(lo, _mm512_madd_epi16(_mm512_unpacklo_epi16(rows, next), taps[k]));
+    hi = _mm512_add_epi32(hi, _mm512_madd_epi16(_mm512_unpackhi_epi16(rows, next), taps[k]));
+    if (k < 3) {
+      row = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)(data + (2 * k + 5) * stride)));
+      rows = _mm512_alignr_epi64(row, next, 2);
+    }
+  }
+
+  return _mm512_packs_epi32(_mm512_srai_epi32(lo, 6), _mm512_srai_epi32(hi, 6));
+}
+
+/**
+ * \brief Filter 2 rows of 16 columns of 16-bit samples vertically.
+ *
+ * Same as filter_ver_16bit_8x4_avx512 with a 256-bit lane for each row.
+ *
+ * \return  filtered samples shifted down by 6
+ */
+static INLINE __m512i filter_ver_16bit_16x2_avx512(const int16_t *data, int stride, const __m512i taps[4])
+{
+  __m512i rows = _mm512_castsi256_si512(_mm256_loadu_si256((const __m256i *)data));
+  rows = _mm512_inserti64x4(rows, _mm256_loadu_si256((const __m256i *)(data + stride)), 1);
+
+  __m512i lo = _mm512_setzero_si512();
+  __m512i hi = _mm512_setzero_si512();
+
+  for (int k = 0; k < 4; ++k) {
+    __m512i row = _mm512_castsi256_si512(_mm256_loadu_si256((const __m256i *)(data + (2 * k + 2) * stride)));
+    __m512i next = _mm512_alignr_epi64(row, rows, 4);
+    lo = _mm512_add_epi32(lo, _mm512_madd_epi16(_mm512_unpacklo_epi16(rows, next), taps[k]));
+    hi = _mm512_add_epi32(hi, _mm512_madd_epi16(_mm512_unpackhi_epi16(rows, next), taps[k]));
+    if (k < 3) {
+      row = _mm512_castsi256_si512(_mm256_loadu_si256((const __m256i *)(data + (2 * k + 3) * stride)));
+      rows = _mm512_alignr_epi64(row, next, 4);
+    }
+  }
+
+  return _mm512_packs_epi32(_mm512_srai_epi32(lo, 6), _mm512_srai_epi32(hi, 6));
+}
+
+/**
+ * \brief Round samples of the intermediate precision to pixels.
+ */
+static INLINE __m256i round_pixels_avx512(__m512i samples)
+{
+  samples = _mm512_srai_epi16(_mm512_add_epi16(samples, _mm512_set1_epi16(32)), 6);
+  samples = _mm512_max_epi16(samples, _mm512_setzero_si512());
+  return _mm512_cvtusepi16_epi8(samples);
+}
+
+/**
+ * \brief Round 32 samples of the intermediate precision to pixels and store them.
+ */
+static INLINE void store_pixels_avx512(__m512i samples, __mmask32 mask, kvz_pixel *out)
+{
+  _mm256_mask_storeu_epi8(out, mask, round_pixels_avx512(samples));
+}
+
+static void filter_ver_16bit_block_avx512(const int8_t *filter, const int16_t *data, int data_stride,
+                                          int width, int height, kvz_pixel *out, int out_stride)
+{
+  __m512i taps[4];
+  init_ver_filter_taps(filter, taps);
+  const __mmask32 masks[2] = { first_n_mask32(width), first_n_mask32(width - 32) };
+
+  // The last rows of narrow blocks are filtered again when the rows do not
+  // divide evenly.
+  if (width <= 8 && height >= 4) {
+    const __mmask16 mask = (__mmask16)masks[0];
+    for (int y = 0; y < height; y += 4) {
+      const int row = MIN(y, height - 4);
+      __m256i pixels = round_pixels_avx512(filter_ver_16bit_8x4_avx512(data + row * data_stride, data_stride, taps));
+      __m128i rows01 = _mm256_castsi256_si128(pixels);
+      __m128i rows23 = _mm256_extracti128_si256(pixels, 1);
+      kvz_pixel *dst = out + row * out_stride;
+      _mm_mask_storeu_epi8(dst, mask, rows01);
+      _mm_mask_storeu_epi8(dst + 1 * out_stride, mask, _mm_srli_si128(rows01, 8));
+      _mm_mask_storeu_epi8(dst + 2 * out_stride, mask, rows23);
+      _mm_mask_storeu_epi8(dst + 3 * out_stride, mask, _mm_srli_si128(rows23, 8));
+    }
+    return;
+  }
+
+  if (width <= 16 && height >= 2) {
+    const __mmask16 mask = (__mmask16)masks[0];
+    for (int y = 0; y < height; y += 2) {
+      const int row = MIN(y, height - 2);
+      __m256i pixels = round_pixels_avx512(filter_ver_16bit_16x2_avx512(data + row * data_stride, data_stride, taps));
+      kvz_pixel *dst = out + row * out_stride;
+      _mm_mask_storeu_epi8(dst, mask, _mm256_castsi256_si128(pixels));
+      _mm_mask_storeu_epi8(dst + out_stride, mask, _mm256_extracti128_si256(pixels, 1));
+    }
+    return;
+  }
+
+  for (int y = 0; y < height; ++y) {
+    for (int i = 0; i < 2 && masks[i]; ++i) {
+      __m512i samples = filter_ver_16bit_32_avx512(data + y * data_stride + 32 * i, data_stride, taps);
+      store_pixels_avx512(samples, masks[i], out + y * out_stride + 32 * i);
+    }
+  }
+}
+
+static void filter_ver_16bit_block_no_round_avx512(const int8_t *filter, const int16_t *data, int data_stride,
+                                                   int width, int height, int16_t *out, int out_stride)
+{
+  __m512i taps[4];
+  init_ver_filter_taps(filter, taps);
+  const __mmask32 masks[2] = { first_n_mask32(width), first_n_mask32(width - 32) };
+
+  if (width <= 8 && height >= 4) {
+    const __mmask8 mask = (__mmask8)masks[0];
+    for (int y = 0; y < height; y += 4) {
+      const int row = MIN(y, height - 4);
+      __m512i samples = filter_ver_16bit_8x4_avx512(data + row * data_stride, data_stride, taps);
+      int16_t *dst = out + row * out_stride;
+      _mm_mask_storeu_epi16(dst, mask, _mm512_castsi512_si128(samples));
+      _mm_mask_storeu_epi16(dst + 1 * out_stride, mask, _mm512_extracti32x4_epi32(samples, 1));
+      _mm_mask_storeu_epi16(dst + 2 * out_stride, mask, _mm512_extracti32x4_epi32(samples, 2));
+      _mm_mask_storeu_epi16(dst + 3 * out_stride, mask, _mm512_extracti32x4_epi32(samples, 3));
+    }
+    return;
+  }
+
+  if (width <= 16 && height >= 2) {
+    const __mmask16 mask = (__mmask16)masks[0];
+    for (int y = 0; y < height; y += 2) {
+      const int row = MIN(y, height - 2);
+      __m512i samples = filter_ver_16bit_16x2_avx512(data + row * data_stride, data_stride, taps);
+      int16_t *dst = out + row * out_stride;
+      _mm256_mask_storeu_epi16(dst, mask, _mm512_castsi512_si256(samples));
+      _mm256_mask_storeu_epi16(dst + out_stride, mask, _mm512_extracti64x4_epi64(samples, 1));
+    }
+    return;
+  }
+
+  for (int y = 0; y < height; ++y) {
+    for (int i = 0; i < 2 && masks[i]; ++i) {
+      __m512i samples = filter_ver_16bit_32_avx512(data + y * data_stride + 32 * i, data_stride, taps);
+      _mm512_mask_storeu_epi16(out + y * out_stride + 32 * i, masks[i], samples);
+    }
+  }
+}
+
+/**
+ * \brief Filter rows horizontally into the intermediate buffer and the first column.
+ *
+ * \param first_y  first row to filter
+ */
+static void filter_hor_block_avx512(const int8_t *filter, const kvz_pixel *src, int16_t src_stride,
+                                    int width, int first_y, int rows,
+                                    int16_t *hor_pos, int16_t *col_pos)
+{
+  const kvz_pixel *first_row = &src[-src_stride * KVZ_LUMA_FILTER_OFFSET - KVZ_LUMA_FILTER_OFFSET];
+  filter_hor_rows_avx512(filter, first_row + 1, src_stride, width, first_y, rows, hor_pos);
+
+  filter_col_hor_avx512(filter, first_row, src_stride, first_y, rows, col_pos);
+}
+
+/**
+ * \brief Filter a quarter-pixel block vertically.
+ *
+ * When off_x is zero, the samples are shifted right by one pixel and the
+ * first column is filtered from the column array.
+ */
+static void filter_qpel_block_avx512(const int8_t *filter, const int16_t *hor_pos, const int16_t *col_pos,
+                                     int off_x, int off_y, int width, int height, kvz_pixel *out)
+{
+  const int first_x = !off_x;
+  filter_ver_16bit_block_avx512(filter, &hor_pos[off_y * LCU_WIDTH], LCU_WIDTH,
+                                width - first_x, height, out + first_x, LCU_WIDTH);
+
+  if (first_x) {
+    kvz_pixel first_col[LCU_WIDTH];
+    filter_col_ver_avx512(filter, &col_pos[off_y], height, first_col);
+    for (int y = 0; y < height; ++y) {
+      out[y * LCU_WIDTH] = first_col[y];
+    }
+  }
+}
+
+/**
+ * \brief Copy a row shifted right by one pixel.
+ *
+ * \param mask   mask of the first width - 1 pixels
+ */
+static INLINE void shift_row_avx512(const kvz_pixel *src, __mmask64 mask, kvz_pixel first, kvz_pixel *dst)
+{
+  _mm512_mask_storeu_epi8(dst + 1, mask, _mm512_maskz_loadu_epi8(mask, src));
+  dst[0] = first;
+}
+
+static void filter_hpel_blocks_hor_ver_luma_avx512(const encoder_control_t * encoder,
+  kvz_pixel *src,
+  int16_t src_stride,
+  int width,
+  int height,
+  kvz_pixel filtered[4][LCU_WIDTH * LCU_WIDTH],
+  int16_t hor_intermediate[5][(KVZ_EXT_BLOCK_W_LUMA + 1) * LCU_WIDTH],
+  int8_t fme_level,
+  int16_t hor_first_cols[5][KVZ_EXT_BLOCK_W_LUMA + 1],
+  int8_t hpel_off_x, int8_t hpel_off_y)
+{
+  const int rows = height + KVZ_EXT_PADDING_LUMA + 1;
+
+  int16_t *hor_pos0 = hor_intermediate[0];
+  int16_t *hor_pos2 = hor_intermediate[1];
+  int16_t *col_pos0 = hor_first_cols[0];
+  int16_t *col_pos2 = hor_first_cols[2];
+
+  // Horizontally filtered samples from the top row are
+  // not needed unless samples for diagonal positions are filtered later.
+  const int first_y = fme_level > 1 ? 0 : 1;
+
+  const __mmask32 masks[2] = { first_n_mask32(width), first_n_mask32(width - 32) };
+  const __mmask64 shift_mask = first_n_mask64(width - 1);
+
+  // HORIZONTAL STEP
+  // Integer pixels
+  for (int y = 0; y < rows; ++y) {
+    const kvz_pixel *row = &src[src_stride * (y - KVZ_LUMA_FILTER_OFFSET)];
+    scale_row_avx512(row + 1, masks, &hor_pos0[y * LCU_WIDTH]);
+    col_pos0[y] = row[0] << 6;
+  }
+
+  // Half pixels
+  filter_hor_block_avx512(kvz_g_luma_filter[2], src, src_stride, width, first_y, rows, hor_pos2, col_pos2);
+
+  // VERTICAL STEP
+  kvz_pixel *out_l = filtered[0];
+  kvz_pixel *out_r = filtered[1];
+  kvz_pixel *out_t = filtered[2];
+  kvz_pixel *out_b = filtered[3];
+
+  // Right
+  // Only horizontal filter
+  for (int y = 0; y < height; ++y) {
+    const int16_t *row = &hor_pos2[(y + KVZ_LUMA_FILTER_OFFSET + 1) * LCU_WIDTH];
+    for (int i = 0; i < 2 && masks[i]; ++i) {
+      __m512i samples = _mm512_loadu_si512((const __m512i *)(row + 32 * i));
+      store_pixels_avx512(samples, masks[i], &out_r[y * LCU_WIDTH + 32 * i]);
+    }
+  }
+
+  // Left
+  // Copy from the right filtered block and the extra column
+  for (int y = 0; y < height; ++y) {
+    kvz_pixel first = kvz_fast_clip_16bit_to_pixel((col_pos2[y + KVZ_LUMA_FILTER_OFFSET + 1] + 32) >> 6);
+    shift_row_avx512(&out_r[y * LCU_WIDTH], shift_mask, first, &out_l[y * LCU_WIDTH]);
+  }
+
+  // Top
+  // Only vertical filter
+  filter_ver_16bit_block_avx512(kvz_g_luma_filter[2], hor_pos0, LCU_WIDTH, width, height, out_t, LCU_WIDTH);
+
+  // Bottom
+  // Copy what can be copied from the top filtered values.
+  // Then filter the last row from horizontal intermediate buffer.
+  for (int y = 0; y < height - 1; ++y) {
+    memcpy(&out_b[y * LCU_WIDTH], &out_t[(y + 1) * LCU_WIDTH], width);
+  }
+  filter_ver_16bit_block_avx512(kvz_g_luma_filter[2], &hor_pos0[height * LCU_WIDTH], LCU_WIDTH,
+                                width, 1, &out_b[(height - 1) * LCU_WIDTH], LCU_WIDTH);
+}
+
+static void filter_hpel_blocks_diag_luma_avx512(const encoder_control_t * encoder,
+  kvz_pixel *src,
+  int16_t src_stride,
+  int width,
+  int height,
+  kvz_pixel filtered[4][LCU_WIDTH * LCU_WIDTH],
+  int16_t hor_intermediate[5][(KVZ_EXT_BLOCK_W_LUMA + 1) * LCU_WIDTH],
+  int8_t fme_level,
+  int16_t hor_first_cols[5][KVZ_EXT_BLOCK_W_LUMA + 1],
+  int8_t hpel_off_x, int8_t hpel_off_y)
+{
+  int8_t *fir2 = kvz_g_luma_filter[2];
+
+  int16_t *hor_pos2 = hor_intermediate[1];
+  int16_t *col_pos2 = hor_first_cols[2];
+
+  // VERTICAL STEP
+  kvz_pixel *out_tl = filtered[0];
+  kvz_pixel *out_tr = filtered[1];
+  kvz_pixel *out_bl = filtered[2];
+  kvz_pixel *out_br = filtered[3];
+
+  const __mmask64 shift_mask = first_n_mask64(width - 1);
+
+  // The extra column of the left blocks
+  kvz_pixel first_col[LCU_WIDTH + 1];
+  filter_col_ver_avx512(fir2, col_pos2, height + 1, first_col);
+
+  // Top-right
+  filter_ver_16bit_block_avx512(fir2, hor_pos2, LCU_WIDTH, width, height, out_tr, LCU_WIDTH);
+
+  // Top-left
+  // Copy from the top-right filtered block and the extra column
+  for (int y = 0; y < height; ++y) {
+    shift_row_avx512(&out_tr[y * LCU_WIDTH], shift_mask, first_col[y], &out_tl[y * LCU_WIDTH]);
+  }
+
+  // Bottom-right
+  // Copy what can be copied from top-right filtered values. Filter the last row.
+  for (int y = 0; y < height - 1; ++y) {
+    memcpy(&out_br[y * LCU_WIDTH], &out_tr[(y + 1) * LCU_WIDTH], width);
+  }
+  filter_ver_16bit_block_avx512(fir2, &hor_pos2[height * LCU_WIDTH], LCU_WIDTH,
+                                width, 1, &out_br[(height - 1) * LCU_WIDTH], LCU_WIDTH);
+
+  // Bottom-left
+  // Copy what can be copied from the top-left filtered values.
+  // Copy what can be copied from the bottom-right filtered values.
+  // Finally take the last pixel from the extra column.
+  for (int y = 0; y < height - 1; ++y) {
+    memcpy(&out_bl[y * LCU_WIDTH], &out_tl[(y + 1) * LCU_WIDTH], width);
+  }
+  shift_row_avx512(&out_br[(height - 1) * LCU_WIDTH], shift_mask, first_col[height], &out_bl[(height - 1) * LCU_WIDTH]);
+}
+
+static void filter_qpel_blocks_hor_ver_luma_avx512(const encoder_control_t * encoder,
+  kvz_pixel *src,
+  int16_t src_stride,
+  int width,
+  int height,
+  kvz_pixel filtered[4][LCU_WIDTH * LCU_WIDTH],
+  int16_t hor_intermediate[5][(KVZ_EXT_BLOCK_W_LUMA + 1) * LCU_WIDTH],
+  int8_t fme_level,
+  int16_t hor_first_cols[5][KVZ_EXT_BLOCK_W_LUMA + 1],
+  int8_t hpel_off_x, int8_t hpel_off_y)
+{
+  const int rows = height + KVZ_EXT_PADDING_LUMA + 1;
+
+  int8_t *fir0 = kvz_g_luma_filter[0];
+  int8_t *fir2 = kvz_g_luma_filter[2];
+  int8_t *fir1 = kvz_g_luma_filter[1];
+  int8_t *fir3 = kvz_g_luma_filter[3];
+
+  // Horiziontal positions. Positions 0 and 2 have already been calculated in filtered.
+  int16_t *hor_pos0 = hor_intermediate[0];
+  int16_t *hor_pos2 = hor_intermediate[1];
+  int16_t *hor_pos_l = hor_intermediate[3];
+  int16_t *hor_pos_r = hor_intermediate[4];
+  int8_t *hor_fir_l = hpel_off_x != 0 ? fir1 : fir3;
+  int8_t *hor_fir_r = hpel_off_x != 0 ? fir3 : fir1;
+  int16_t *col_pos_l = hor_first_cols[1];
+  int16_t *col_pos_r = hor_first_cols[3];
+
+  int16_t *hor_hpel_pos = hpel_off_x != 0 ? hor_pos2 : hor_pos0;
+  int16_t *col_pos_hor = hpel_off_x != 0 ? hor_first_cols[2] : hor_first_cols[0];
+
+  // Specify if integer pixels are filtered from left or/and top integer samples
+  int off_x_fir_l = hpel_off_x < 1 ? 0 : 1;
+  int off_x_fir_r = hpel_off_x < 0 ? 0 : 1;
+  int off_y_fir_t = hpel_off_y < 1 ? 0 : 1;
+  int off_y_fir_b = hpel_off_y < 0 ? 0 : 1;
+
+  // HORIZONTAL STEP
+  filter_hor_block_avx512(hor_fir_l, src, src_stride, width, 0, rows, hor_pos_l, col_pos_l);
+  filter_hor_block_avx512(hor_fir_r, src, src_stride, width, 0, rows, hor_pos_r, col_pos_r);
+
+  // VERTICAL STEP
+  int8_t *ver_fir_l = hpel_off_y != 0 ? fir2 : fir0;
+  int8_t *ver_fir_r = hpel_off_y != 0 ? fir2 : fir0;
+  int8_t *ver_fir_t = hpel_off_y != 0 ? fir1 : fir3;
+  int8_t *ver_fir_b = hpel_off_y != 0 ? fir3 : fir1;
+
+  int sample_off_x = (hpel_off_x > -1 ? 1 : 0);
+  int sample_off_y = (hpel_off_y < 0 ? 0 : 1);
+
+  // Left and right QPEL (1/4 or 3/4 x positions)
+  filter_qpel_block_avx512(ver_fir_l, hor_pos_l, col_pos_l, off_x_fir_l, sample_off_y, width, height, filtered[0]);
+  filter_qpel_block_avx512(ver_fir_r, hor_pos_r, col_pos_r, off_x_fir_r, sample_off_y, width, height, filtered[1]);
+
+  // Top and bottom QPEL (1/4 or 3/4 y positions)
+  filter_qpel_block_avx512(ver_fir_t, hor_hpel_pos, col_pos_hor, sample_off_x, off_y_fir_t, width, height, filtered[2]);
+  filter_qpel_block_avx512(ver_fir_b, hor_hpel_pos, col_pos_hor, sample_off_x, off_y_fir_b, width, height, filtered[3]);
+}
+
+static void filter_qpel_blocks_diag_luma_avx512(const encoder_control_t * encoder,
+  kvz_pixel *src,
+  int16_t src_stride,
+  int width,
+  int height,
+  kvz_pixel filtered[4][LCU_WIDTH * LCU_WIDTH],
+  int16_t hor_intermediate[5][(KVZ_EXT_BLOCK_W_LUMA + 1) * LCU_WIDTH],
+  int8_t fme_level,
+  int16_t hor_first_cols[5][KVZ_EXT_BLOCK_W_LUMA + 1],
+  int8_t hpel_off_x, int8_t hpel_off_y)
+{
+  int8_t *fir1 = kvz_g_luma_filter[1];
+  int8_t *fir3 = kvz_g_luma_filter[3];
+
+  int16_t *hor_pos_l = hor_intermediate[3];
+  int16_t *hor_pos_r = hor_intermediate[4];
+
+  int16_t *col_pos_l = hor_first_cols[1];
+  int16_t *col_pos_r = hor_first_cols[3];
+
+  int8_t *ver_fir_t = hpel_off_y != 0 ? fir1 : fir3;
+  int8_t *ver_fir_b = hpel_off_y != 0 ? fir3 : fir1;
+
+  // Specify if integer pixels are filtered from left or/and top integer samples
+  int off_x_fir_l = hpel_off_x < 1 ? 0 : 1;
+  int off_x_fir_r = hpel_off_x < 0 ? 0 : 1;
+  int off_y_fir_t = hpel_off_y < 1 ? 0 : 1;
+  int off_y_fir_b = hpel_off_y < 0 ? 0 : 1;
+
+  filter_qpel_block_avx512(ver_fir_t, hor_pos_l, col_pos_l, off_x_fir_l, off_y_fir_t, width, height, filtered[0]);
+  filter_qpel_block_avx512(ver_fir_t, hor_pos_r, col_pos_r, off_x_fir_r, off_y_fir_t, width, height, filtered[1]);
+  filter_qpel_block_avx512(ver_fir_b, hor_pos_l, col_pos_l, off_x_fir_l, off_y_fir_b, width, height, filtered[2]);
+  filter_qpel_block_avx512(ver_fir_b, hor_pos_r, col_pos_r, off_x_fir_r, off_y_fir_b, width, height, filtered[3]);
+}
+
+/**
+ * \brief Filter a block horizontally for the second pass.
+ */
+static void sample_hor_block_avx512(const int16_t mv[2], const kvz_pixel *src, int16_t src_stride,
+                                    int width, int height, int16_t *hor_intermediate)
+{
+  const kvz_pixel *first_row = &src[-src_stride * KVZ_LUMA_FILTER_OFFSET - KVZ_LUMA_FILTER_OFFSET];
+  filter_hor_rows_avx512(kvz_g_luma_filter[mv[0] & 3], first_row, src_stride,
+                         width, 0, height + KVZ_EXT_PADDING_LUMA, hor_intermediate);
+}
+
+static void sample_quarterpel_luma_avx512(const encoder_control_t * const encoder,
+  kvz_pixel *src,
+  int16_t src_stride,
+  int width,
+  int height,
+  kvz_pixel *dst,
+  int16_t dst_stride,
+  int8_t hor_flag,
+  int8_t ver_flag,
+  const int16_t mv[2])
+{
+  assert(width <= LCU_WIDTH && height <= LCU_WIDTH);
+
+  int16_t hor_intermediate[KVZ_EXT_BLOCK_W_LUMA * LCU_WIDTH];
+
+  sample_hor_block_avx512(mv, src, src_stride, width, height, hor_intermediate);
+  filter_ver_16bit_block_avx512(kvz_g_luma_filter[mv[1] & 3], hor_intermediate, LCU_WIDTH,
+                                width, height, dst, dst_stride);
+}
+
+static void sample_14bit_quarterpel_luma_avx512(const encoder_control_t * const encoder,
+  kvz_pixel *src,
+  int16_t src_stride,
+  int width,
+  int height,
+  int16_t *dst,
+  int16_t dst_stride,
+  int8_t hor_flag,
+  int8_t ver_flag,
+  const int16_t mv[2])
+{
+  assert(width <= LCU_WIDTH && height <= LCU_WIDTH);
+
+  int16_t hor_intermediate[KVZ_EXT_BLOCK_W_LUMA * LCU_WIDTH];
+
+  sample_hor_block_avx512(mv, src, src_stride, width, height, hor_intermediate);
+  filter_ver_16bit_block_no_round_avx512(kvz_g_luma_filter[mv[1] & 3], hor_intermediate, LCU_WIDTH,
+                                         width, height, dst, dst_stride);
+}
+
+#endif //COMPILE_INTEL_AVX512
+
+int kvz_strategy_register_ipol_avx512(void* opaque, uint8_t bitdepth)
+{
+  bool success = true;
+#if COMPILE_INTEL_AVX512
+  if (bitdepth == 8) {
+    success &= kvz_strategyselector_register(opaque, "filter_hpel_blocks_hor_ver_luma", "avx512", 50, &filter_hpel_blocks_hor_ver_luma_avx512);
+    success &= kvz_strategyselector_register(opaque, "filter_hpel_blocks_diag_luma", "avx512", 50, &filter_hpel_blocks_diag_luma_avx512);
+    success &= kvz_strategyselector_register(opaque, "filter_qpel_blocks_hor_ver_luma", "avx512", 50, &filter_qpel_blocks_hor_ver_luma_avx512);
+    success &= kvz_strategyselector_register(opaque, "filter_qpel_blocks_diag_luma", "avx512", 50, &filter_qpel_blocks_diag_luma_avx512);
+    success &= kvz_strategyselector_register(opaque, "sample_quarterpel_luma", "avx512", 50, &sample_quarterpel_luma_avx512);
+    success &= kvz_strategyselector_register(opaque, "sample_14bit_quarterpel_luma", "avx512", 50, &sample_14bit_quarterpel_luma_avx512);
+  }
+#endif //COMPILE_INTEL_AVX512
+  return success;
+}
@@ -0,0 +1,373 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "strategies/avx512/picture-avx512.h"
+
+#if COMPILE_INTEL_AVX512
+#include <immintrin.h>
+
+#include "kvazaar.h"
+#include "strategies/generic/picture-generic.h"
+#include "strategies/strategies-picture.h"
+#include "strategyselector.h"
+
+
+/**
+ * \brief Get a mask of the first n elements.
+ */
+static INLINE __mmask64 first_n_mask64(int n)
+{
+  return n >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << n) - 1;
+}
+
+/**
+ * \brief Load a row or zeros if the row is past the end.
+ */
+static INLINE __m128i load_row_or_zero(const kvz_pixel *data, __mmask16 mask, int row, int num_rows)
+{
+  return row < num_rows ? _mm_maskz_loadu_epi8(mask, data) : _mm_setzero_si128();
+}
+
+/**
+ * \brief Load 16 byte parts of four rows.
+ *
+ * Only the first num_rows rows are loaded.
+ */
+static INLINE __m512i load_rows_x4(const kvz_pixel *data, unsigned stride,
+                                   __mmask16 mask, int num_rows)
+{
+  __m512i rows = _mm512_castsi128_si512(_mm_maskz_loadu_epi8(mask, data));
+  rows = _mm512_inserti32x4(rows, load_row_or_zero(data + 1 * stride, mask, 1, num_rows), 1);
+  rows = _mm512_inserti32x4(rows, load_row_or_zero(data + 2 * stride, mask, 2, num_rows), 2);
+  rows = _mm512_inserti32x4(rows, load_row_or_zero(data + 3 * stride, mask, 3, num_rows), 3);
+  return rows;
+}
+
+/**
+ * \brief Load 8 byte parts of eight rows.
+ *
+ * Only the first num_rows rows are loaded.
+ */
+static INLINE __m512i load_rows_x8(const kvz_pixel *data, unsigned stride,
+                                   __mmask16 mask, int num_rows)
+{
+  __m128i rows01 = _mm_unpacklo_epi64(_mm_maskz_loadu_epi8(mask, data),
+                                      load_row_or_zero(data + 1 * stride, mask, 1, num_rows));
+  __m128i rows23 = _mm_unpacklo_epi64(load_row_or_zero(data + 2 * stride, mask, 2, num_rows),
+                                      load_row_or_zero(data + 3 * stride, mask, 3, num_rows));
+  __m128i rows45 = _mm_unpacklo_epi64(load_row_or_zero(data + 4 * stride, mask, 4, num_rows),
+                                      load_row_or_zero(data + 5 * stride, mask, 5, num_rows));
+  __m128i rows67 = _mm_unpacklo_epi64(load_row_or_zero(data + 6 * stride, mask, 6, num_rows),
+                                      load_row_or_zero(data + 7 * stride, mask, 7, num_rows));
+
+  __m512i rows = _mm512_castsi128_si512(rows01);
+  rows = _mm512_inserti32x4(rows, rows23, 1);
+  rows = _mm512_inserti32x4(rows, rows45, 2);
+  rows = _mm512_inserti32x4(rows, rows67, 3);
+  return rows;
+}
+
+/**
+ * \brief Load four full rows of 16 pixels.
+ */
+static INLINE __m512i load_full_rows_x4(const kvz_pixel *data, unsigned stride)
+{
+  __m512i rows = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)data));
+  rows = _mm512_inserti32x4(rows, _mm_loadu_si128((const __m128i *)(data + 1 * stride)), 1);
+  rows = _mm512_inserti32x4(rows, _mm_loadu_si128((const __m128i *)(data + 2 * stride)), 2);
+  rows = _mm512_inserti32x4(rows, _mm_loadu_si128((const __m128i *)(data + 3 * stride)), 3);
+  return rows;
+}
+
+/**
+ * \brief Load two rows of 8 pixels.
+ */
+static INLINE __m128i load_8x2(const kvz_pixel *row0, const kvz_pixel *row1)
+{
+  __m128d rows = _mm_castsi128_pd(_mm_loadl_epi64((const __m128i *)row0));
+  return _mm_castpd_si128(_mm_loadh_pd(rows, (const double *)row1));
+}
+
+/**
+ * \brief Load eight full rows of 8 pixels.
+ */
+static INLINE __m512i load_full_rows_x8(const kvz_pixel *data, unsigned stride)
+{
+  __m128i rows01 = load_8x2(data, data + 1 * stride);
+  __m128i rows23 = load_8x2((data + 2 * stride), data + 3 * stride);
+  __m128i rows45 = load_8x2((data + 4 * stride), data + 5 * stride);
+  __m128i rows67 = load_8x2((data + 6 * stride), data + 7 * stride);
+
+  __m512i rows = _mm512_castsi128_si512(rows01);
+  rows = _mm512_inserti32x4(rows, rows23, 1);
+  rows = _mm512_inserti32x4(rows, rows45, 2);
+  rows = _mm512_inserti32x4(rows, rows67, 3);
+  return rows;
+}
+
+/**
+ * \brief Calculate SAD of two blocks of any size.
+ *
+ * Narrow blocks are packed several rows to a register. Masked loads are
+ * used for the parts of the registers outside the block, so nothing is read
+ * outside the rows. The masks are set up before the loops because moving
+ * them to mask registers on every row is slow.
+ */
+static uint32_t reg_sad_avx512(const kvz_pixel * const data1, const kvz_pixel * const data2,
+                               const int width, const int height,
+                               const unsigned stride1, const unsigned stride2)
+{
+  __m512i sum = _mm512_setzero_si512();
+  int y = 0;
+
+  if (width == 64) {
+    // Two accumulators hide the latency of the additions.
+    __m512i sum_odd = _mm512_setzero_si512();
+    for (; y + 1 < height; y += 2) {
+      __m512i a0 = _mm512_loadu_si512((const __m512i *)(data1 + y * stride1));
+      __m512i b0 = _mm512_loadu_si512((const __m512i *)(data2 + y * stride2));
+      __m512i a1 = _mm512_loadu_si512((const __m512i *)(data1 + (y + 1) * stride1));
+      __m512i b1 = _mm512_loadu_si512((const __m512i *)(data2 + (y + 1) * stride2));
+      sum     = _mm512_add_epi64(sum,     _mm512_sad_epu8(a0, b0));
+      sum_odd = _mm512_add_epi64(sum_odd, _mm512_sad_epu8(a1, b1));
+    }
+    if (y < height) {
+      __m512i a = _mm512_loadu_si512((const __m512i *)(data1 + y * stride1));
+      __m512i b = _mm512_loadu_si512((const __m512i *)(data2 + y * stride2));
+      sum = _mm512_add_epi64(sum, _mm512_sad_epu8(a, b));
+    }
+    sum = _mm512_add_epi64(sum, sum_odd);
+
+  } else if (width > 32) {
+    const int full_width = width & ~63;
+    const __mmask64 mask = first_n_mask64(width - full_width);
+    for (; y < height; y++) {
+      const kvz_pixel *row1 = data1 + y * stride1;
+      const kvz_pixel *row2 = data2 + y * stride2;
+      for (int x = 0; x < full_width; x += 64) {
+        __m512i a = _mm512_loadu_si512((const __m512i *)(row1 + x));
+        __m512i b = _mm512_loadu_si512((const __m512i *)(row2 + x));
+        sum = _mm512_add_epi64(sum, _mm512_sad_epu8(a, b));
+      }
+      if (mask) {
+        __m512i a = _mm512_maskz_loadu_epi8(mask, row1 + full_width);
+        __m512i b = _mm512_maskz_loadu_epi8(mask, row2 + full_width);
+        sum = _mm512_add_epi64(sum, _mm512_sad_epu8(a, b));
+      }
+    }
+
+  } else if (width > 16) {
+    if (width == 32) {
+      __m512i sum_odd = _mm512_setzero_si512();
+      for (; y + 3 < height; y += 4) {
+        __m512i a0 = _mm512_castsi256_si512(_mm256_loadu_si256((const __m256i *)(data1 + y * stride1)));
+        __m512i b0 = _mm512_castsi256_si512(_mm256_loadu_si256((const __m256i *)(data2 + y * stride2)));
+        __m512i a1 = _mm512_castsi256_si512(_mm256_loadu_si256((const __m256i *)(data1 + (y + 2) * stride1)));
+        __m512i b1 = _mm512_castsi256_si512(_mm256_loadu_si256((const __m256i *)(data2 + (y + 2) * stride2)));
+        a0 = _mm512_inserti64x4(a0, _mm256_loadu_si256((const __m256i *)(data1 + (y + 1) * stride1)), 1);
+        b0 = _mm512_inserti64x4(b0, _mm256_loadu_si256((const __m256i *)(data2 + (y + 1) * stride2)), 1);
+        a1 = _mm512_inserti64x4(a1, _mm256_loadu_si256((const __m256i *)(data1 + (y + 3) * stride1)), 1);
+        b1 = _mm512_inserti64x4(b1, _mm256_loadu_si256((const __m256i *)(data2 + (y + 3) * stride2)), 1);
+        sum     = _mm512_add_epi64(sum,     _mm512_sad_epu8(a0, b0));
+        sum_odd = _mm512_add_epi64(sum_odd, _mm512_sad_epu8(a1, b1));
+      }
+      sum = _mm512_add_epi64(sum, sum_odd);
+    }
+
+    // Remaining rows and other widths
+    const __mmask32 mask = (__mmask32)first_n_mask64(width);
+    for (; y + 1 < height; y += 2) {
+      __m512i a = _mm512_castsi256_si512(_mm256_maskz_loadu_epi8(mask, data1 + y * stride1));
+      __m512i b = _mm512_castsi256_si512(_mm256_maskz_loadu_epi8(mask, data2 + y * stride2));
+      a = _mm512_inserti64x4(a, _mm256_maskz_loadu_epi8(mask, data1 + (y + 1) * stride1), 1);
+      b = _mm512_inserti64x4(b, _mm256_maskz_loadu_epi8(mask, data2 + (y + 1) * stride2), 1);
+      sum = _mm512_add_epi64(sum, _mm512_sad_epu8(a, b));
+    }
+    if (y < height) {
+      __m256i a = _mm256_maskz_loadu_epi8(mask, data1 + y * stride1);
+      __m256i b = _mm256_maskz_loadu_epi8(mask, data2 + y * stride2);
+      sum = _mm512_add_epi64(sum, _mm512_castsi256_si512(_mm256_sad_epu8(a, b)));
+    }
+
+  } else if (width > 8) {
+    if (width == 16) {
+      for (; y + 3 < height; y += 4) {
+        __m512i a = load_full_rows_x4(data1 + y * stride1, stride1);
+        __m512i b = load_full_rows_x4(data2 + y * stride2, stride2);
+        sum = _mm512_add_epi64(sum, _mm512_sad_epu8(a, b));
+      }
+    }
+
+    const __mmask16 mask = (__mmask16)first_n_mask64(width);
+    for (; y + 3 < height; y += 4) {
+      __m512i a = load_rows_x4(data1 + y * stride1, stride1, mask, 4);
+      __m512i b = load_rows_x4(data2 + y * stride2, stride2, mask, 4);
+      sum = _mm512_add_epi64(sum, _mm512_sad_epu8(a, b));
+    }
+    if (y < height) {
+      __m512i a = load_rows_x4(data1 + y * stride1, stride1, mask, height - y);
+      __m512i b = load_rows_x4(data2 + y * stride2, stride2, mask, height - y);
+      sum = _mm512_add_epi64(sum, _mm512_sad_epu8(a, b));
+    }
+
+  } else {
+    if (width == 8) {
+      for (; y + 7 < height; y += 8) {
+        __m512i a = load_full_rows_x8(data1 + y * stride1, stride1);
+        __m512i b = load_full_rows_x8(data2 + y * stride2, stride2);
+        sum = _mm512_add_epi64(sum, _mm512_sad_epu8(a, b));
+      }
+    }
+
+    const __mmask16 mask = (__mmask16)first_n_mask64(width);
+    for (; y + 7 < height; y += 8) {
+      __m512i a = load_rows_x8(data1 + y * stride1, stride1, mask, 8);
+      __m512i b = load_rows_x8(data2 + y * stride2, stride2, mask, 8);
+      sum = _mm512_add_epi64(sum, _mm512_sad_epu8(a, b));
+    }
+    if (y < height) {
+      __m512i a = load_rows_x8(data1 + y * stride1, stride1, mask, height - y);
+      __m512i b = load_rows_x8(data2 + y * stride2, stride2, mask, height - y);
+      sum = _mm512_add_epi64(sum, _mm512_sad_epu8(a, b));
+    }
+  }
+
+  return (uint32_t)_mm512_reduce_add_epi64(sum);
+}
+
+/**
+ * \brief Get the differences of four rows of 8 pixels as 16-bit values.
+ */
+static INLINE __m512i diff_rows_8x4(const kvz_pixel *buf1, unsigned stride1,
+                                    const kvz_pixel *buf2, unsigned stride2)
+{
+  __m128i a01 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(buf1)),
+                                   _mm_loadl_epi64((const __m128i *)(buf1 + stride1)));
+  __m128i a23 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(buf1 + 2 * stride1)),
+                                   _mm_loadl_epi64((const __m128i *)(buf1 + 3 * stride1)));
+  __m128i b01 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(buf2)),
+                                   _mm_loadl_epi64((const __m128i *)(buf2 + stride2)));
+  __m128i b23 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(buf2 + 2 * stride2)),
+                                   _mm_loadl_epi64((const __m128i *)(buf2 + 3 * stride2)));
+
+  __m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(a01), a23, 1);
+  __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(b01), b23, 1);
+
+  return _mm512_sub_epi16(_mm512_cvtepu8_epi16(a), _mm512_cvtepu8_epi16(b));
+}
+
+/**
+ * \brief Do one butterfly step of the Hadamard transform.
+ *
+ * \param v         values
+ * \param partners  the values permuted so that each element is paired with
+ *                  the element it is combined with
+ * \param upper     mask of the elements that get the difference
+ */
+static INLINE __m512i hadamard_butterfly(__m512i v, __m512i partners, __mmask32 upper)
+{
+  return _mm512_mask_sub_epi16(_mm512_add_epi16(v, partners), upper, partners, v);
+}
+
+/**
+ * \brief Transform four rows of 8 values horizontally.
+ */
+static INLINE __m512i hor_transform_8x4(__m512i v)
+{
+  v = hadamard_butterfly(v, _mm512_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)), 0xF0F0F0F0);
+  v = hadamard_butterfly(v, _mm512_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)), 0xCCCCCCCC);
+  v = hadamard_butterfly(v, _mm512_rol_epi32(v, 16), 0xAAAAAAAA);
+  return v;
+}
+
+/**
+ * \brief Transform four rows of 8 values vertically.
+ */
+static INLINE __m512i ver_transform_8x4(__m512i v)
+{
+  v = hadamard_butterfly(v, _mm512_shuffle_i64x2(v, v, _MM_SHUFFLE(1, 0, 3, 2)), 0xFFFF0000);
+  v = hadamard_butterfly(v, _mm512_shuffle_i64x2(v, v, _MM_SHUFFLE(2, 3, 0, 1)), 0xFF00FF00);
+  return v;
+}
+
+/**
+ * \brief Calculate SATD between two 8x8 blocks inside bigger arrays.
+ *
+ * The rows 0-3 and 4-7 of the differences are kept in two registers. The
+ * order of the transformed values differs from the generic version, which
+ * does not matter for the sum of their absolute values.
+ */
+static unsigned satd_8x8_subblock_avx512(const kvz_pixel * buf1, unsigned stride1,
+                                         const kvz_pixel * buf2, unsigned stride2)
+{
+  __m512i rows_0123 = diff_rows_8x4(buf1, stride1, buf2, stride2);
+  __m512i rows_4567 = diff_rows_8x4(buf1 + 4 * stride1, stride1, buf2 + 4 * stride2, stride2);
+
+  // The first vertical step combines the two registers.
+  __m512i a = _mm512_add_epi16(rows_0123, rows_4567);
+  __m512i b = _mm512_sub_epi16(rows_0123, rows_4567);
+
+  a = hor_transform_8x4(ver_transform_8x4(a));
+  b = hor_transform_8x4(ver_transform_8x4(b));
+
+  // The absolute values are at most 64 * 255, so the sum fits in 16 bits.
+  __m512i abs_sum = _mm512_add_epi16(_mm512_abs_epi16(a), _mm512_abs_epi16(b));
+  __m512i sum = _mm512_madd_epi16(abs_sum, _mm512_set1_epi16(1));
+
+  unsigned sad = _mm512_reduce_add_epi32(sum);
+  return (sad + 2) >> 2;
+}
+
+/**
+ * \brief Calculate SATD between two 4x4 blocks inside bigger arrays.
+ */
+static unsigned kvz_satd_4x4_subblock_avx512(const kvz_pixel * buf1,
+                                             const int32_t     stride1,
+                                             const kvz_pixel * buf2,
+                                             const int32_t     stride2)
+{
+  // Only used for the edges of blocks that are not multiples of 8.
+  return kvz_satd_4x4_subblock_generic(buf1, stride1, buf2, stride2);
+}
+
+SATD_NxN(avx512,  8)
+SATD_NxN(avx512, 16)
+SATD_NxN(avx512, 32)
+SATD_NxN(avx512, 64)
+SATD_ANY_SIZE(avx512)
+
+#endif //COMPILE_INTEL_AVX512
+
+int kvz_strategy_register_picture_avx512(void* opaque, uint8_t bitdepth)
+{
+  bool success = true;
+#if COMPILE_INTEL_AVX512
+  if (bitdepth == 8) {
+    success &= kvz_strategyselector_register(opaque, "reg_sad", "avx512", 50, &reg_sad_avx512);
+
+    success &= kvz_strategyselector_register(opaque, "satd_8x8", "avx512", 50, &satd_8x8_avx512);
+    success &= kvz_strategyselector_register(opaque, "satd_16x16", "avx512", 50, &satd_16x16_avx512);
+    success &= kvz_strategyselector_register(opaque, "satd_32x32", "avx512", 50, &satd_32x32_avx512);
+    success &= kvz_strategyselector_register(opaque, "satd_64x64", "avx512", 50, &satd_64x64_avx512);
+    success &= kvz_strategyselector_register(opaque, "satd_any_size", "avx512", 50, &satd_any_size_avx512);
+  }
+#endif //COMPILE_INTEL_AVX512
+  return success;
+}
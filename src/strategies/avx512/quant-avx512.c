@@ -0,0 +1,249 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+/*
+ * \file
+ * \brief AVX-512 versions of quantization.
+ */
+
+#include "strategies/avx512/quant-avx512.h"
+
+#if COMPILE_INTEL_AVX512
+#include <immintrin.h>
+#include <string.h>
+
+#include "cu.h"
+#include "encoder.h"
+#include "encoderstate.h"
+#include "kvazaar.h"
+#include "rdo.h"
+#include "scalinglist.h"
+#include "strategies/generic/quant-generic.h"
+#include "strategies/generic/quant_shared_generics.h"
+#include "strategies/strategies-quant.h"
+#include "strategyselector.h"
+#include "tables.h"
+#include "transform.h"
+
+
+/**
+ * \brief Get a mask of the first n elements.
+ */
+static INLINE __mmask32 first_n_mask32(int n)
+{
+  return n >= 32 ? 0xFFFFFFFF : (1u << n) - 1;
+}
+
+/**
+ * \brief quantize transformed coefficents
+ *
+ * Uses the same 32-bit arithmetic as the AVX2 version. The rounding errors
+ * for sign bit hiding are calculated in the same pass.
+ */
+static void quant_avx512(const encoder_state_t * const state, coeff_t *coef, coeff_t *q_coef, int32_t width,
+  int32_t height, int8_t type, int8_t scan_idx, int8_t block_type)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const uint32_t log2_block_size = kvz_g_convert_to_bit[width] + 2;
+  const uint32_t * const scan = kvz_g_sig_last_scan[scan_idx][log2_block_size - 1];
+
+  int32_t qp_scaled = kvz_get_scaled_qp(type, state->qp, (encoder->bitdepth - 8) * 6);
+  const uint32_t log2_tr_size = kvz_g_convert_to_bit[width] + 2;
+  const int32_t scalinglist_type = (block_type == CU_INTRA ? 0 : 3) + (int8_t)("\0\3\1\2"[type]);
+  const int32_t *quant_coeff = encoder->scaling_list.quant_coeff[log2_tr_size - 2][scalinglist_type][qp_scaled % 6];
+  const int32_t transform_shift = MAX_TR_DYNAMIC_RANGE - encoder->bitdepth - log2_tr_size; //!< Represents scaling through forward transform
+  const int32_t q_bits = QUANT_SHIFT + qp_scaled / 6 + transform_shift;
+  const int32_t add = ((state->frame->slicetype == KVZ_SLICE_I) ? 171 : 85) << (q_bits - 9);
+  const int32_t q_bits8 = q_bits - 8;
+
+  const bool scaling_list = encoder->scaling_list.enable;
+  const bool signhide = encoder->cfg.signhide_enable;
+
+  ALIGNED(64) int32_t delta_u[LCU_WIDTH*LCU_WIDTH >> 2];
+
+  const __m512i v_add = _mm512_set1_epi32(add);
+  __m512i v_quant_coeff = _mm512_set1_epi32(quant_coeff[0]);
+  __m512i v_ac_sum = _mm512_setzero_si512();
+
+  for (int32_t n = 0; n < width * height; n += 16) {
+    __m512i v_coef = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)(coef + n)));
+    __mmask16 negative = _mm512_cmplt_epi32_mask(v_coef, _mm512_setzero_si512());
+
+    if (scaling_list) {
+      v_quant_coeff = _mm512_loadu_si512((const __m512i *)(quant_coeff + n));
+    }
+
+    __m512i v_scaled = _mm512_mullo_epi32(_mm512_abs_epi32(v_coef), v_quant_coeff);
+    __m512i v_level = _mm512_srai_epi32(_mm512_add_epi32(v_scaled, v_add), q_bits);
+    v_ac_sum = _mm512_add_epi32(v_ac_sum, v_level);
+
+    // Saturate before applying the sign, like the AVX2 version does.
+    __m256i v_level16 = _mm512_cvtsepi32_epi16(v_level);
+    v_level16 = _mm256_mask_sub_epi16(v_level16, negative, _mm256_setzero_si256(), v_level16);
+    _mm256_storeu_si256((__m256i *)(q_coef + n), v_level16);
+
+    if (signhide) {
+      __m512i v_delta = _mm512_sub_epi32(v_scaled, _mm512_slli_epi32(v_level, q_bits));
+      _mm512_store_si512((__m512i *)(delta_u + n), _mm512_srai_epi32(v_delta, q_bits8));
+    }
+  }
+
+  uint32_t ac_sum = _mm512_reduce_add_epi32(v_ac_sum);
+
+  if (!signhide || ac_sum < 2) return;
+
+  quant_sign_hiding_generic(coef, q_coef, delta_u, scan, width, height);
+}
+
+/**
+ * \brief Calculate the residual of a block.
+ */
+static void get_residual_avx512(const kvz_pixel *ref_in, const kvz_pixel *pred_in,
+                                int16_t *residual, int width, int in_stride)
+{
+  const __mmask32 mask = first_n_mask32(width);
+  for (int y = 0; y < width; ++y) {
+    __m512i ref  = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask, ref_in  + y * in_stride));
+    __m512i pred = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask, pred_in + y * in_stride));
+    _mm512_mask_storeu_epi16(residual + y * width, mask, _mm512_sub_epi16(ref, pred));
+  }
+}
+
+/**
+ * \brief Add the residual to the prediction and clip to pixels.
+ */
+static void get_quantized_recon_avx512(const int16_t *residual, const kvz_pixel *pred_in, int in_stride,
+                                       kvz_pixel *rec_out, int out_stride, int width)
+{
+  const __mmask32 mask = first_n_mask32(width);
+  for (int y = 0; y < width; ++y) {
+    __m512i res  = _mm512_maskz_loadu_epi16(mask, residual + y * width);
+    __m512i pred = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask, pred_in + y * in_stride));
+    __m512i rec  = _mm512_max_epi16(_mm512_add_epi16(res, pred), _mm512_setzero_si512());
+    _mm256_mask_storeu_epi8(rec_out + y * out_stride, mask, _mm512_cvtusepi16_epi8(rec));
+  }
+}
+
+/**
+ * \brief Check whether a block has any non-zero coefficients.
+ */
+static bool has_coeffs_avx512(const coeff_t *coeffs, int length)
+{
+  for (int i = 0; i < length; i += 32) {
+    __m512i v = _mm512_maskz_loadu_epi16(first_n_mask32(length - i), coeffs + i);
+    if (_mm512_test_epi16_mask(v, v)) return true;
+  }
+  return false;
+}
+
+/**
+* \brief Quantize residual and get both the reconstruction and coeffs.
+*
+* \param width  Transform width.
+* \param color  Color.
+* \param scan_order  Coefficient scan order.
+* \param use_trskip  Whether transform skip is used.
+* \param stride  Stride for ref_in, pred_in and rec_out.
+* \param ref_in  Reference pixels.
+* \param pred_in  Predicted pixels.
+* \param rec_out  Reconstructed pixels.
+* \param coeff_out  Coefficients used for reconstruction of rec_out.
+*
+* \returns  Whether coeff_out contains any non-zero coefficients.
+*/
+static int quantize_residual_avx512(encoder_state_t *const state,
+  const cu_info_t *const cur_cu, const int width, const color_t color,
+  const coeff_scan_order_t scan_order, const int use_trskip,
+  const int in_stride, const int out_stride,
+  const kvz_pixel *const ref_in, const kvz_pixel *const pred_in,
+  kvz_pixel *rec_out, coeff_t *coeff_out)
+{
+  // Temporary arrays to pass data to and from kvz_quant and transform functions.
+  ALIGNED(64) int16_t residual[TR_MAX_WIDTH * TR_MAX_WIDTH];
+  ALIGNED(64) coeff_t coeff[TR_MAX_WIDTH * TR_MAX_WIDTH];
+
+  assert(width <= TR_MAX_WIDTH);
+  assert(width >= TR_MIN_WIDTH);
+
+  // Get residual. (ref_in - pred_in -> residual)
+  get_residual_avx512(ref_in, pred_in, residual, width, in_stride);
+
+  // Transform residual. (residual -> coeff)
+  if (use_trskip) {
+    kvz_transformskip(state->encoder_control, residual, coeff, width);
+  }
+  else {
+    kvz_transform2d(state->encoder_control, residual, coeff, width, color, cur_cu->type);
+  }
+
+  // Quantize coeffs. (coeff -> coeff_out)
+  if (state->encoder_control->cfg.rdoq_enable &&
+      (width > 4 || !state->encoder_control->cfg.rdoq_skip))
+  {
+    int8_t tr_depth = cur_cu->tr_depth - cur_cu->depth;
+    tr_depth += (cur_cu->part_size == SIZE_NxN ? 1 : 0);
+    kvz_rdoq(state, coeff, coeff_out, width, width, (color == COLOR_Y ? 0 : 2),
+      scan_order, cur_cu->type, tr_depth);
+  } else {
+    kvz_quant(state, coeff, coeff_out, width, width, (color == COLOR_Y ? 0 : 2),
+      scan_order, cur_cu->type);
+  }
+
+  int has_coeffs = has_coeffs_avx512(coeff_out, width * width);
+
+  // Do the inverse quantization and transformation and the reconstruction to
+  // rec_out.
+  if (has_coeffs) {
+    // Get quantized residual. (coeff_out -> coeff -> residual)
+    kvz_dequant(state, coeff_out, coeff, width, width, (color == COLOR_Y ? 0 : (color == COLOR_U ? 2 : 3)), cur_cu->type);
+    if (use_trskip) {
+      kvz_itransformskip(state->encoder_control, residual, coeff, width);
+    }
+    else {
+      kvz_itransform2d(state->encoder_control, residual, coeff, width, color, cur_cu->type);
+    }
+
+    // Get quantized reconstruction. (residual + pred_in -> rec_out)
+    get_quantized_recon_avx512(residual, pred_in, in_stride, rec_out, out_stride, width);
+  }
+  else if (rec_out != pred_in) {
+    // With no coeffs and rec_out == pred_int we skip copying the coefficients
+    // because the reconstruction is just the prediction.
+    for (int y = 0; y < width; ++y) {
+      memcpy(&rec_out[y * out_stride], &pred_in[y * in_stride], width * sizeof(kvz_pixel));
+    }
+  }
+
+  return has_coeffs;
+}
+
+#endif //COMPILE_INTEL_AVX512
+
+int kvz_strategy_register_quant_avx512(void* opaque, uint8_t bitdepth)
+{
+  bool success = true;
+#if COMPILE_INTEL_AVX512
+  success &= kvz_strategyselector_register(opaque, "quant", "avx512", 50, &quant_avx512);
+  if (bitdepth == 8) {
+    success &= kvz_strategyselector_register(opaque, "quantize_residual", "avx512", 50, &quantize_residual_avx512);
+  }
+#endif //COMPILE_INTEL_AVX512
+  return success;
+}
@@ -0,0 +1,101 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "strategies/avx512/sao-avx512.h"
+
+#if COMPILE_INTEL_AVX512
+#include <immintrin.h>
+
+#include "kvazaar.h"
+#include "sao.h"
+#include "strategyselector.h"
+
+
+static int32_t sao_edge_ddistortion_avx512(const kvz_pixel *orig_data,
+                                           const kvz_pixel *rec_data,
+                                                 int32_t    block_width,
+                                                 int32_t    block_height,
+                                                 int32_t    eo_class,
+                                           const int32_t    offsets[NUM_SAO_EDGE_CATEGORIES])
+{
+  vector2d_t a_ofs = g_sao_edge_offsets[eo_class][0];
+  vector2d_t b_ofs = g_sao_edge_offsets[eo_class][1];
+
+  // The offset is multiplied by offset - 2 * diff in 16 bits below. The
+  // offsets are much smaller than this limit for 8-bit video.
+  for (int i = 0; i < NUM_SAO_EDGE_CATEGORIES; ++i) {
+    assert(offsets[i] >= -1024 && offsets[i] <= 1024);
+  }
+
+  // Offsets indexed by eo_idx = 2 + sign(c - a) + sign(c - b).
+  const __m512i offset_table = _mm512_castsi256_si512(_mm256_setr_epi16(
+    offsets[1], offsets[2], offsets[0], offsets[3], offsets[4], 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0));
+
+  const __m512i one = _mm512_set1_epi16(1);
+  const __m512i two = _mm512_set1_epi16(2);
+
+  __m512i sum = _mm512_setzero_si512();
+
+  for (int32_t y = 1; y < block_height - 1; y++) {
+    for (int32_t x = 1; x < block_width - 1; x += 32) {
+      const int32_t n = block_width - 1 - x;
+      const __mmask32 mask = n >= 32 ? 0xFFFFFFFF : (1u << n) - 1;
+
+      const uint32_t c_pos =  y            * block_width + x;
+      const uint32_t a_pos = (y + a_ofs.y) * block_width + x + a_ofs.x;
+      const uint32_t b_pos = (y + b_ofs.y) * block_width + x + b_ofs.x;
+
+      __m512i a    = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask, rec_data  + a_pos));
+      __m512i b    = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask, rec_data  + b_pos));
+      __m512i c    = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask, rec_data  + c_pos));
+      __m512i orig = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask, orig_data + c_pos));
+
+      __m512i eo_idx = two;
+      eo_idx = _mm512_mask_add_epi16(eo_idx, _mm512_cmpgt_epi16_mask(c, a), eo_idx, one);
+      eo_idx = _mm512_mask_sub_epi16(eo_idx, _mm512_cmplt_epi16_mask(c, a), eo_idx, one);
+      eo_idx = _mm512_mask_add_epi16(eo_idx, _mm512_cmpgt_epi16_mask(c, b), eo_idx, one);
+      eo_idx = _mm512_mask_sub_epi16(eo_idx, _mm512_cmplt_epi16_mask(c, b), eo_idx, one);
+
+      // Pixels outside the block get a zero offset.
+      __m512i offset = _mm512_maskz_permutexvar_epi16(mask, eo_idx, offset_table);
+
+      // delta * delta - diff * diff == offset * (offset - 2 * diff)
+      __m512i diff = _mm512_sub_epi16(orig, c);
+      __m512i factor = _mm512_sub_epi16(offset, _mm512_add_epi16(diff, diff));
+      sum = _mm512_add_epi32(sum, _mm512_madd_epi16(offset, factor));
+    }
+  }
+
+  return _mm512_reduce_add_epi32(sum);
+}
+
+#endif //COMPILE_INTEL_AVX512
+
+int kvz_strategy_register_sao_avx512(void* opaque, uint8_t bitdepth)
+{
+  bool success = true;
+#if COMPILE_INTEL_AVX512
+  if (bitdepth == 8) {
+    success &= kvz_strategyselector_register(opaque, "sao_edge_ddistortion", "avx512", 50, &sao_edge_ddistortion_avx512);
+  }
+#endif //COMPILE_INTEL_AVX512
+  return success;
+}
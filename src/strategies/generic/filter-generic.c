@@ -0,0 +1,238 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "strategies/generic/filter-generic.h"
+
+#include <stdlib.h>
+
+#include "filter.h"
+#include "strategies/strategies-filter.h"
+#include "strategyselector.h"
+
+
+/**
+ * \brief Perform in strong luma filtering in place.
+ * \param line  line of 8 pixels, with center at index 4
+ * \param tc  tc treshold
+ * \return  Reach of the filter starting from center.
+ */
+static INLINE int deblock_luma_strong(
+    kvz_pixel *line,
+    int32_t tc)
+{
+  const kvz_pixel m0 = line[0];
+  const kvz_pixel m1 = line[1];
+  const kvz_pixel m2 = line[2];
+  const kvz_pixel m3 = line[3];
+  const kvz_pixel m4 = line[4];
+  const kvz_pixel m5 = line[5];
+  const kvz_pixel m6 = line[6];
+  const kvz_pixel m7 = line[7];
+
+  line[1] = CLIP(m1 - 2*tc, m1 + 2*tc, (2*m0 + 3*m1 +   m2 +   m3 +   m4 + 4) >> 3);
+  line[2] = CLIP(m2 - 2*tc, m2 + 2*tc, (  m1 +   m2 +   m3 +   m4        + 2) >> 2);
+  line[3] = CLIP(m3 - 2*tc, m3 + 2*tc, (  m1 + 2*m2 + 2*m3 + 2*m4 +   m5 + 4) >> 3);
+  line[4] = CLIP(m4 - 2*tc, m4 + 2*tc, (  m2 + 2*m3 + 2*m4 + 2*m5 +   m6 + 4) >> 3);
+  line[5] = CLIP(m5 - 2*tc, m5 + 2*tc, (  m3 +   m4 +   m5 +   m6        + 2) >> 2);
+  line[6] = CLIP(m6 - 2*tc, m6 + 2*tc, (  m3 +   m4 +   m5 + 3*m6 + 2*m7 + 4) >> 3);
+
+  return 3;
+}
+
+/**
+ * \brief Perform in weak luma filtering in place.
+ * \param bitdepth  Bit depth of the pixels
+ * \param line  Line of 8 pixels, with center at index 4
+ * \param tc  The tc treshold
+ * \param p_2nd  Whether to filter the 2nd line of P
+ * \param q_2nd  Whether to filter the 2nd line of Q
+ */
+static INLINE int deblock_luma_weak(
+    int32_t bitdepth,
+    kvz_pixel *line,
+    int32_t tc,
+    bool p_2nd,
+    bool q_2nd)
+{
+  const kvz_pixel m1 = line[1];
+  const kvz_pixel m2 = line[2];
+  const kvz_pixel m3 = line[3];
+  const kvz_pixel m4 = line[4];
+  const kvz_pixel m5 = line[5];
+  const kvz_pixel m6 = line[6];
+
+  int32_t delta = (9 * (m4 - m3) - 3 * (m5 - m2) + 8) >> 4;
+
+  if (abs(delta) >= tc * 10) {
+    return 0;
+  } else {
+    int32_t tc2 = tc >> 1;
+    delta = CLIP(-tc, tc, delta);
+    line[3] = CLIP(0, (1 << bitdepth) - 1, (m3 + delta));
+    line[4] = CLIP(0, (1 << bitdepth) - 1, (m4 - delta));
+
+    if (p_2nd) {
+      int32_t delta1 = CLIP(-tc2, tc2, (((m1 + m3 + 1) >> 1) - m2 + delta) >> 1);
+      line[2] = CLIP(0, (1 << bitdepth) - 1, m2 + delta1);
+    }
+    if (q_2nd) {
+      int32_t delta2 = CLIP(-tc2, tc2, (((m6 + m4 + 1) >> 1) - m5 - delta) >> 1);
+      line[5] = CLIP(0, (1 << bitdepth) - 1, m5 + delta2);
+    }
+    
+    if (p_2nd || q_2nd) {
+      return 2;
+    } else {
+      return 1;
+    }
+  }
+}
+
+/**
+ * \brief Gather pixels needed for deblocking
+ */
+static INLINE void gather_deblock_pixels(
+    const kvz_pixel *src,
+    int step, 
+    int stride,
+    int reach,
+    kvz_pixel *dst)
+{
+  for (int i = -reach; i < +reach; ++i) {
+    dst[i + 4] = src[i * step + stride];
+  }
+}
+
+/**
+* \brief Scatter pixels
+*/
+static INLINE void scatter_deblock_pixels(
+    const kvz_pixel *src,
+    int step, 
+    int stride,
+    int reach,
+    kvz_pixel *dst)
+{
+  for (int i = -reach; i < +reach; ++i) {
+    dst[i * step + stride] = src[i + 4];
+  }
+}
+
+static void deblock_luma_generic(kvz_pixel *src,
+                                 int32_t stride,
+                                 edge_dir dir,
+                                 int32_t num_parts,
+                                 const int32_t *tc,
+                                 int32_t beta,
+                                 int32_t bitdepth)
+{
+  const int32_t side_threshold = (beta + (beta >> 1)) >> 3;
+
+  // Transpose the image by swapping x and y strides when doing horizontal
+  // edges.
+  const int32_t x_stride = (dir == EDGE_VER) ? 1 : stride;
+  const int32_t y_stride = (dir == EDGE_VER) ? stride : 1;
+
+  for (int32_t part = 0; part < num_parts; ++part) {
+    if (tc[part] == 0) continue;
+
+    //                   +-- edge_src
+    //                   v
+    // line0 p3 p2 p1 p0 q0 q1 q2 q3
+    kvz_pixel *edge_src = &src[part * 4 * y_stride];
+
+    // Gather the lines of pixels required for the filter on/off decision.
+    kvz_pixel b[4][8];
+    gather_deblock_pixels(edge_src, x_stride, 0 * y_stride, 4, &b[0][0]);
+    gather_deblock_pixels(edge_src, x_stride, 3 * y_stride, 4, &b[3][0]);
+
+    int_fast32_t dp0 = abs(b[0][1] - 2 * b[0][2] + b[0][3]);
+    int_fast32_t dq0 = abs(b[0][4] - 2 * b[0][5] + b[0][6]);
+    int_fast32_t dp3 = abs(b[3][1] - 2 * b[3][2] + b[3][3]);
+    int_fast32_t dq3 = abs(b[3][4] - 2 * b[3][5] + b[3][6]);
+    int_fast32_t dp = dp0 + dp3;
+    int_fast32_t dq = dq0 + dq3;
+
+    if (dp + dq < beta) {
+      // Strong filtering flag checking
+      int8_t sw = 2 * (dp0 + dq0) < beta >> 2 &&
+                  2 * (dp3 + dq3) < beta >> 2 &&
+                  abs(b[0][3] - b[0][4]) < (5 * tc[part] + 1) >> 1 &&
+                  abs(b[3][3] - b[3][4]) < (5 * tc[part] + 1) >> 1 &&
+                  abs(b[0][0] - b[0][3]) + abs(b[0][4] - b[0][7]) < beta >> 3 &&
+                  abs(b[3][0] - b[3][3]) + abs(b[3][4] - b[3][7]) < beta >> 3;
+
+      // Read lines 1 and 2. Weak filtering doesn't use the outermost pixels
+      // but let's give them anyway to simplify control flow.
+      gather_deblock_pixels(edge_src, x_stride, 1 * y_stride, 4, &b[1][0]);
+      gather_deblock_pixels(edge_src, x_stride, 2 * y_stride, 4, &b[2][0]);
+
+      for (int i = 0; i < 4; ++i) {
+        int filter_reach;
+        if (sw) {
+          filter_reach = deblock_luma_strong(&b[i][0], tc[part]);
+        } else {
+          bool p_2nd = dp < side_threshold;
+          bool q_2nd = dq < side_threshold;
+          filter_reach = deblock_luma_weak(bitdepth, &b[i][0], tc[part], p_2nd, q_2nd);
+        }
+        scatter_deblock_pixels(&b[i][0], x_stride, i * y_stride, filter_reach, edge_src);
+      }
+    }
+  }
+}
+
+static void deblock_chroma_generic(kvz_pixel *src,
+                                   int32_t stride,
+                                   edge_dir dir,
+                                   int32_t num_parts,
+                                   const int32_t *tc,
+                                   int32_t bitdepth)
+{
+  const int32_t offset = (dir == EDGE_HOR) ? stride :      1;
+  const int32_t step   = (dir == EDGE_HOR) ?      1 : stride;
+
+  for (int32_t part = 0; part < num_parts; ++part) {
+    if (tc[part] == 0) continue;
+
+    for (int i = 0; i < 4; i++) {
+      kvz_pixel *line = &src[step * (4 * part + i)];
+      const int16_t m2 = line[-offset * 2];
+      const int16_t m3 = line[-offset];
+      const int16_t m4 = line[0];
+      const int16_t m5 = line[offset];
+
+      const int32_t delta = CLIP(-tc[part], tc[part], (((m4 - m3) * 4) + m2 - m5 + 4) >> 3);
+      line[-offset] = CLIP(0, (1 << bitdepth) - 1, m3 + delta);
+      line[0]       = CLIP(0, (1 << bitdepth) - 1, m4 - delta);
+    }
+  }
+}
+
+
+int kvz_strategy_register_filter_generic(void* opaque, uint8_t bitdepth)
+{
+  bool success = true;
+
+  success &= kvz_strategyselector_register(opaque, "deblock_luma", "generic", 0, &deblock_luma_generic);
+  success &= kvz_strategyselector_register(opaque, "deblock_chroma", "generic", 0, &deblock_chroma_generic);
+
+  return success;
+}
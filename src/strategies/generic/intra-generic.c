@@ -23,6 +23,7 @@
 #include <stdlib.h>
 
 #include "kvazaar.h"
+#include "strategies/strategies-picture.h"
 #include "strategyselector.h"
 
 
@@ -188,12 +189,46 @@ static void kvz_intra_pred_planar_generic(
 #endif
 }
 
+
+/**
+ * \brief Calculate SATD costs of angular predictions for a set of modes.
+ *
+ * Boundary filtering of modes 10 and 26 is not done.
+ *
+ * \param log2_width    Log2 of width, range 2..5.
+ * \param num_modes     Number of modes in the set.
+ * \param modes         Angular modes in range 2..34.
+ * \param refs_above    Pointers to -1 index of above reference of each mode.
+ * \param refs_left     Pointers to -1 index of left reference of each mode.
+ * \param orig_block    Original block in continuous memory.
+ * \param costs_out     SATD of each mode.
+ */
+static void kvz_angular_pred_satd_generic(
+  const int_fast8_t log2_width,
+  const int_fast8_t num_modes,
+  const int8_t *const modes,
+  const kvz_pixel *const *const refs_above,
+  const kvz_pixel *const *const refs_left,
+  const kvz_pixel *const orig_block,
+  unsigned *const costs_out)
+{
+  cost_pixel_nxn_func *satd_func = kvz_pixels_get_satd_func(1 << log2_width);
+  kvz_pixel pred[32 * 32];
+
+  for (int_fast8_t i = 0; i < num_modes; ++i) {
+    kvz_angular_pred_generic(log2_width, modes[i], refs_above[i], refs_left[i], pred);
+    costs_out[i] = satd_func(pred, orig_block);
+  }
+}
+
+
 int kvz_strategy_register_intra_generic(void* opaque, uint8_t bitdepth)
 {
   bool success = true;
 
   success &= kvz_strategyselector_register(opaque, "angular_pred", "generic", 0, &kvz_angular_pred_generic);
   success &= kvz_strategyselector_register(opaque, "intra_pred_planar", "generic", 0, &kvz_intra_pred_planar_generic);
+  success &= kvz_strategyselector_register(opaque, "angular_pred_satd", "generic", 0, &kvz_angular_pred_satd_generic);
 
   return success;
 }
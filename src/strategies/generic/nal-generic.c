@@ -26,9 +26,38 @@
 #include "strategyselector.h"
 
 
+// The tables are built in kvz_strategy_register_nal_generic, which runs
+// before any worker can read them. Byte x + 256 * y of each checksum map
+// is x ^ y.
+static uint32_t ckmap4[64*256];
+static uint64_t ckmap8[32*256];
+static uint16_t crc_table[256];
+
+static void init_tables(void)
+{
+  uint8_t * const ckmap4_uint8 = (uint8_t*)&ckmap4;
+  uint8_t * const ckmap8_uint8 = (uint8_t*)&ckmap8;
+  for (int y = 0; y < 256; ++y) {
+    for (int x = 0; x < 256; ++x) {
+      ckmap4_uint8[y*256+x] = x^y;
+      ckmap8_uint8[y*256+x] = x^y;
+    }
+  }
+
+  // Entry h is the register after feeding 8 zero bits to register h << 8.
+  for (int h = 0; h < 256; ++h) {
+    uint32_t r = h << 8;
+    for (int bit = 0; bit < 8; ++bit) {
+      r = ((r << 1) & 0xffff) ^ (((r >> 15) & 1) * 0x1021);
+    }
+    crc_table[h] = r;
+  }
+}
+
+
 static void array_md5_generic(const kvz_pixel* data,
                               const int height, const int width,
-                              const int stride,
+                              const int stride, const int y_offset,
                               unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth)
 {
   assert(SEI_HASH_MAX_LENGTH >= 16);
@@ -44,7 +73,7 @@ static void array_md5_generic(const kvz_pixel* data,
 
 static void array_checksum_generic(const kvz_pixel* data,
                                    const int height, const int width,
-                                   const int stride,
+                                   const int stride, const int y_offset,
                                    unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth) {
   int x, y;
   int checksum = 0;
@@ -53,7 +82,8 @@ static void array_checksum_generic(const kvz_pixel* data,
   
   for (y = 0; y < height; ++y) {
     for (x = 0; x < width; ++x) {
-      const uint8_t mask = (uint8_t)((x & 0xff) ^ (y & 0xff) ^ (x >> 8) ^ (y >> 8));
+      const int yy = y + y_offset;
+      const uint8_t mask = (uint8_t)((x & 0xff) ^ (yy & 0xff) ^ (x >> 8) ^ (yy >> 8));
       checksum += (data[(y * stride) + x] & 0xff) ^ mask;
 #if KVZ_BIT_DEPTH > 8
       checksum += ((data[(y * stride) + x] >> 8) & 0xff) ^ mask;
@@ -70,41 +100,28 @@ static void array_checksum_generic(const kvz_pixel* data,
 
 static void array_checksum_generic4(const kvz_pixel* data,
                                    const int height, const int width,
-                                   const int stride,
+                                   const int stride, const int y_offset,
                                    unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth) {
   uint32_t checksum = 0;
   int y, x, xp;
-  
-  static uint8_t ckmap_initialized = 0;
-  static uint32_t ckmap[64*256];
 
   //TODO: add 10-bit support
   if(bitdepth != 8) {
-    array_checksum_generic(data, height, width, stride,checksum_out, bitdepth);
+    array_checksum_generic(data, height, width, stride, y_offset, checksum_out, bitdepth);
     return;
   }
-  if (!ckmap_initialized) {
-    uint8_t * const ckmap_uint8 = (uint8_t*)&ckmap;
-    int x, y;
-    for (y = 0; y < 256; ++y) {
-      for (x = 0; x < 256; ++x) {
-        ckmap_uint8[y*256+x] = x^y;
-      }
-    }
-    ckmap_initialized = 1;
-  }
-
   assert(SEI_HASH_MAX_LENGTH >= 4);
 
   for (y = 0; y < height; ++y) {
+    const int yy = y + y_offset;
     for (xp = 0; xp < width/4; ++xp) {
       const int x = xp * 4;
-      const uint32_t mask = ckmap[(xp&63)+64*(y&255)] ^ (((x >> 8) ^ (y >> 8)) * 0x1010101);
+      const uint32_t mask = ckmap4[(xp&63)+64*(yy&255)] ^ (((x >> 8) ^ (yy >> 8)) * 0x1010101);
       const uint32_t cksumbytes = (*((uint32_t*)(&data[(y * stride) + x]))) ^ mask;
       checksum += ((cksumbytes >> 24) & 0xff) + ((cksumbytes >> 16) & 0xff) + ((cksumbytes >> 8) & 0xff) + (cksumbytes & 0xff);
     }
     for (x = xp*4; x < width; ++x) {
-      uint8_t mask = (uint8_t)((x & 0xff) ^ (y & 0xff) ^ (x >> 8) ^ (y >> 8));
+      uint8_t mask = (uint8_t)((x & 0xff) ^ (yy & 0xff) ^ (x >> 8) ^ (yy >> 8));
       checksum += (data[(y * stride) + x] & 0xff) ^ mask;
     }
   }
@@ -118,41 +135,28 @@ static void array_checksum_generic4(const kvz_pixel* data,
 
 static void array_checksum_generic8(const kvz_pixel* data,
                                    const int height, const int width,
-                                   const int stride,
+                                   const int stride, const int y_offset,
                                    unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth) {
   uint32_t checksum = 0;
   int y, x, xp;
   
-  static uint8_t ckmap_initialized = 0;
-  static uint64_t ckmap[32*256];
-  
   //TODO: add 10-bit support
   if(bitdepth != 8) {
-    array_checksum_generic(data, height, width, stride,checksum_out, bitdepth);
+    array_checksum_generic(data, height, width, stride, y_offset, checksum_out, bitdepth);
     return;
   }
-  if (!ckmap_initialized) {
-    uint8_t * const ckmap_uint8 = (uint8_t*)&ckmap;
-    int x, y;
-    for (y = 0; y < 256; ++y) {
-      for (x = 0; x < 256; ++x) {
-        ckmap_uint8[y*256+x] = x^y;
-      }
-    }
-    ckmap_initialized = 1;
-  }
-
   assert(SEI_HASH_MAX_LENGTH >= 4);
 
   for (y = 0; y < height; ++y) {
+    const int yy = y + y_offset;
     for (xp = 0; xp < width/8; ++xp) {
       const int x = xp * 8;
-      const uint64_t mask = ckmap[(xp&31)+32*(y&255)] ^ ((uint64_t)((x >> 8) ^ (y >> 8)) * 0x101010101010101);
+      const uint64_t mask = ckmap8[(xp&31)+32*(yy&255)] ^ ((uint64_t)((x >> 8) ^ (yy >> 8)) * 0x101010101010101);
       const uint64_t cksumbytes = (*((uint64_t*)(&data[(y * stride) + x]))) ^ mask;
       checksum += ((cksumbytes >> 56) & 0xff) + ((cksumbytes >> 48) & 0xff) + ((cksumbytes >> 40) & 0xff) + ((cksumbytes >> 32) & 0xff) + ((cksumbytes >> 24) & 0xff) + ((cksumbytes >> 16) & 0xff) + ((cksumbytes >> 8) & 0xff) + (cksumbytes & 0xff);
     }
     for (x = xp*8; x < width; ++x) {
-      uint8_t mask = (uint8_t)((x & 0xff) ^ (y & 0xff) ^ (x >> 8) ^ (y >> 8));
+      uint8_t mask = (uint8_t)((x & 0xff) ^ (yy & 0xff) ^ (x >> 8) ^ (yy >> 8));
       checksum += (data[(y * stride) + x] & 0xff) ^ mask;
     }
   }
@@ -164,13 +168,35 @@ static void array_checksum_generic8(const kvz_pixel* data,
   checksum_out[3] = (checksum) & 0xff;
 }
 
+/**
+ * \brief Update the CRC of the decoded picture hash one byte at a time.
+ *
+ * Pixels deeper than 8 bits are fed low byte first.
+ */
+static uint32_t array_crc_generic(uint32_t crc, const kvz_pixel *data,
+                                  int height, int width, int stride)
+{
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *bytes = (const uint8_t *)&data[y * stride];
+    const int num_bytes = width * sizeof(kvz_pixel);
+    for (int i = 0; i < num_bytes; ++i) {
+      crc = (((crc << 8) | bytes[i]) & 0xffff) ^ crc_table[crc >> 8];
+    }
+  }
+
+  return crc;
+}
+
 int kvz_strategy_register_nal_generic(void* opaque, uint8_t bitdepth) {
   bool success = true;
 
+  init_tables();
+
   success &= kvz_strategyselector_register(opaque, "array_md5", "generic", 0, &array_md5_generic);
   success &= kvz_strategyselector_register(opaque, "array_checksum", "generic", 0, &array_checksum_generic);
   success &= kvz_strategyselector_register(opaque, "array_checksum", "generic4", 1, &array_checksum_generic4);
   success &= kvz_strategyselector_register(opaque, "array_checksum", "generic8", 2, &array_checksum_generic8);
+  success &= kvz_strategyselector_register(opaque, "array_crc", "generic", 0, &array_crc_generic);
   
   return success;
 }
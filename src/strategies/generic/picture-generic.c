@@ -98,6 +98,23 @@ static unsigned reg_sad_generic(const kvz_pixel * const data1, const kvz_pixel *
   return sad;
 }
 
+/**
+ * \brief Calculate SADs of a block against several blocks.
+ *
+ * \param data1       the block
+ * \param data2       blocks to compare with
+ * \param num_blocks  number of blocks in data2
+ * \param costs_out   SAD of each block in data2
+ */
+static void reg_sad_multi_generic(const kvz_pixel *data1, const kvz_pixel *const *data2,
+                                  int num_blocks, int width, int height,
+                                  unsigned stride1, unsigned stride2, unsigned *costs_out)
+{
+  for (int i = 0; i < num_blocks; ++i) {
+    costs_out[i] = reg_sad_generic(data1, data2[i], width, height, stride1, stride2);
+  }
+}
+
 /**
  * \brief  Transform differences between two 4x4 blocks.
  * From HM 13.0
@@ -675,11 +692,35 @@ static uint32_t hor_sad_generic(const kvz_pixel *pic_data, const kvz_pixel *ref_
   return result;
 }
 
+/**
+ * \brief Calculate the sum of squared differences of the pixels of a block
+ * from their mean.
+ *
+ * The result divided by the number of pixels is the variance of the block.
+ */
+static uint64_t pixel_var_generic(const kvz_pixel *data, int32_t width,
+                                  int32_t height, int32_t stride)
+{
+  uint64_t sum = 0;
+  uint64_t sum_sq = 0;
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      const uint32_t pixel = data[y * stride + x];
+      sum += pixel;
+      sum_sq += pixel * pixel;
+    }
+  }
+
+  return sum_sq - sum * sum / (width * height);
+}
+
 int kvz_strategy_register_picture_generic(void* opaque, uint8_t bitdepth)
 {
   bool success = true;
 
   success &= kvz_strategyselector_register(opaque, "reg_sad", "generic", 0, &reg_sad_generic);
+  success &= kvz_strategyselector_register(opaque, "reg_sad_multi", "generic", 0, &reg_sad_multi_generic);
 
   success &= kvz_strategyselector_register(opaque, "sad_4x4", "generic", 0, &sad_4x4_generic);
   success &= kvz_strategyselector_register(opaque, "sad_8x8", "generic", 0, &sad_8x8_generic);
@@ -713,6 +754,7 @@ int kvz_strategy_register_picture_generic(void* opaque, uint8_t bitdepth)
   success &= kvz_strategyselector_register(opaque, "get_optimized_sad", "generic", 0, &get_optimized_sad_generic);
   success &= kvz_strategyselector_register(opaque, "ver_sad", "generic", 0, &ver_sad_generic);
   success &= kvz_strategyselector_register(opaque, "hor_sad", "generic", 0, &hor_sad_generic);
+  success &= kvz_strategyselector_register(opaque, "pixel_var", "generic", 0, &pixel_var_generic);
 
   return success;
 }
@@ -0,0 +1,128 @@
+#ifndef QUANT_SHARED_GENERICS_H_
+#define QUANT_SHARED_GENERICS_H_
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+/**
+ * \ingroup Optimization
+ * \file
+ * Generic sign bit hiding shared by the quantization strategies.
+ */
+
+#include "global.h" // IWYU pragma: keep
+#include "kvazaar.h"
+
+/**
+ * \brief Hide the sign bits of the quantized coefficient groups.
+ *
+ * \param coef     transformed coefficients
+ * \param q_coef   quantized coefficients, modified in place
+ * \param delta_u  rounding errors of the quantization in raster order
+ * \param scan     coefficient scan order
+ */
+static void quant_sign_hiding_generic(const coeff_t *coef, coeff_t *q_coef,
+                                      const int32_t *delta_u,
+                                      const uint32_t *scan,
+                                      int32_t width, int32_t height)
+{
+#define SCAN_SET_SIZE 16
+#define LOG2_SCAN_SET_SIZE 4
+  int32_t n, last_cg = -1, abssum = 0, subset, subpos;
+  for (subset = (width*height - 1) >> LOG2_SCAN_SET_SIZE; subset >= 0; subset--) {
+    int32_t first_nz_pos_in_cg = SCAN_SET_SIZE, last_nz_pos_in_cg = -1;
+    subpos = subset << LOG2_SCAN_SET_SIZE;
+    abssum = 0;
+
+    // Find last coeff pos
+    for (n = SCAN_SET_SIZE - 1; n >= 0; n--)  {
+      if (q_coef[scan[n + subpos]])  {
+        last_nz_pos_in_cg = n;
+        break;
+      }
+    }
+
+    // First coeff pos
+    for (n = 0; n <SCAN_SET_SIZE; n++) {
+      if (q_coef[scan[n + subpos]]) {
+        first_nz_pos_in_cg = n;
+        break;
+      }
+    }
+
+    // Sum all kvz_quant coeffs between first and last
+    for (n = first_nz_pos_in_cg; n <= last_nz_pos_in_cg; n++) {
+      abssum += q_coef[scan[n + subpos]];
+    }
+
+    if (last_nz_pos_in_cg >= 0 && last_cg == -1) {
+      last_cg = 1;
+    }
+
+    if (last_nz_pos_in_cg - first_nz_pos_in_cg >= 4) {
+      int32_t signbit = (q_coef[scan[subpos + first_nz_pos_in_cg]] > 0 ? 0 : 1);
+      if (signbit != (abssum & 0x1)) { // compare signbit with sum_parity
+        int32_t min_cost_inc = 0x7fffffff, min_pos = -1, cur_cost = 0x7fffffff;
+        int16_t final_change = 0, cur_change = 0;
+        for (n = (last_cg == 1 ? last_nz_pos_in_cg : SCAN_SET_SIZE - 1); n >= 0; n--) {
+          uint32_t blkPos = scan[n + subpos];
+          if (q_coef[blkPos] != 0) {
+            if (delta_u[blkPos] > 0) {
+              cur_cost = -delta_u[blkPos];
+              cur_change = 1;
+            }
+            else if (n == first_nz_pos_in_cg && abs(q_coef[blkPos]) == 1) {
+              cur_cost = 0x7fffffff;
+            }
+            else {
+              cur_cost = delta_u[blkPos];
+              cur_change = -1;
+            }
+          }
+          else if (n < first_nz_pos_in_cg && ((coef[blkPos] >= 0) ? 0 : 1) != signbit) {
+            cur_cost = 0x7fffffff;
+          }
+          else {
+            cur_cost = -delta_u[blkPos];
+            cur_change = 1;
+          }
+
+          if (cur_cost < min_cost_inc) {
+            min_cost_inc = cur_cost;
+            final_change = cur_change;
+            min_pos = blkPos;
+          }
+        } // CG loop
+
+        if (q_coef[min_pos] == 32767 || q_coef[min_pos] == -32768) {
+          final_change = -1;
+        }
+
+        if (coef[min_pos] >= 0) q_coef[min_pos] += final_change;
+        else q_coef[min_pos] -= final_change;
+      } // Hide
+    }
+    if (last_cg == 1) last_cg = 0;
+  }
+
+#undef SCAN_SET_SIZE
+#undef LOG2_SCAN_SET_SIZE
+}
+
+#endif //QUANT_SHARED_GENERICS_H_
@@ -21,6 +21,7 @@
 #include "strategies/strategies-dct.h"
 
 #include "avx2/dct-avx2.h"
+#include "avx512/dct-avx512.h"
 #include "generic/dct-generic.h"
 #include "strategyselector.h"
 
@@ -49,6 +50,9 @@ int kvz_strategy_register_dct(void* opaque, uint8_t bitdepth) {
   if (kvz_g_hardware_flags.intel_flags.avx2) {
     success &= kvz_strategy_register_dct_avx2(opaque, bitdepth);
   }
+  if (kvz_g_hardware_flags.intel_flags.avx512) {
+    success &= kvz_strategy_register_dct_avx512(opaque, bitdepth);
+  }
 
   return success;
 }
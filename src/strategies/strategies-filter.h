@@ -0,0 +1,87 @@
+#ifndef STRATEGIES_FILTER_H_
+#define STRATEGIES_FILTER_H_
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+/**
+ * \ingroup Optimization
+ * \file
+ * Interface for deblocking functions.
+ */
+
+#include "filter.h"
+#include "global.h" // IWYU pragma: keep
+#include "kvazaar.h"
+
+
+// Declare function pointers.
+
+/**
+ * \brief Deblock luma pixels on an edge.
+ *
+ * The edge consists of parts of four lines. The filter decisions are made
+ * separately for each part.
+ *
+ * \param src         first pixel after the edge (q0 of the first line)
+ * \param stride      stride of the picture
+ * \param dir         direction of the edge
+ * \param num_parts   number of 4-line parts in the edge, 1 or 2
+ * \param tc          tc of each part, 0 to skip the part
+ * \param beta        beta of the edge
+ * \param bitdepth    bit depth of the pixels
+ */
+typedef void (deblock_luma_func)(kvz_pixel *src,
+                                 int32_t stride,
+                                 edge_dir dir,
+                                 int32_t num_parts,
+                                 const int32_t *tc,
+                                 int32_t beta,
+                                 int32_t bitdepth);
+
+/**
+ * \brief Deblock chroma pixels on an edge.
+ *
+ * \param src         first pixel after the edge (q0 of the first line)
+ * \param stride      stride of the chroma plane
+ * \param dir         direction of the edge
+ * \param num_parts   number of 4-line parts in the edge, 1 or 2
+ * \param tc          tc of each part, 0 to skip the part
+ * \param bitdepth    bit depth of the pixels
+ */
+typedef void (deblock_chroma_func)(kvz_pixel *src,
+                                   int32_t stride,
+                                   edge_dir dir,
+                                   int32_t num_parts,
+                                   const int32_t *tc,
+                                   int32_t bitdepth);
+
+extern deblock_luma_func * kvz_deblock_luma;
+extern deblock_chroma_func * kvz_deblock_chroma;
+
+int kvz_strategy_register_filter(void* opaque, uint8_t bitdepth);
+
+
+#define STRATEGIES_FILTER_EXPORTS \
+  {"deblock_luma", (void**) &kvz_deblock_luma}, \
+  {"deblock_chroma", (void**) &kvz_deblock_chroma}, \
+
+
+
+#endif //STRATEGIES_FILTER_H_
@@ -43,9 +43,19 @@ typedef void (intra_pred_planar_func)(
   const kvz_pixel *const ref_left,
   kvz_pixel *const dst);
 
+typedef void (angular_pred_satd_func)(
+  const int_fast8_t log2_width,
+  const int_fast8_t num_modes,
+  const int8_t *const modes,
+  const kvz_pixel *const *const refs_above,
+  const kvz_pixel *const *const refs_left,
+  const kvz_pixel *const orig_block,
+  unsigned *const costs_out);
+
 // Declare function pointers.
 extern angular_pred_func * kvz_angular_pred;
 extern intra_pred_planar_func * kvz_intra_pred_planar;
+extern angular_pred_satd_func * kvz_angular_pred_satd;
 
 int kvz_strategy_register_intra(void* opaque, uint8_t bitdepth);
 
@@ -53,6 +63,7 @@ int kvz_strategy_register_intra(void* opaque, uint8_t bitdepth);
 #define STRATEGIES_INTRA_EXPORTS \
   {"angular_pred", (void**) &kvz_angular_pred}, \
   {"intra_pred_planar", (void**) &kvz_intra_pred_planar}, \
+  {"angular_pred_satd", (void**) &kvz_angular_pred_satd}, \
 
 
 
@@ -21,6 +21,7 @@
 #include "strategies/strategies-ipol.h"
 
 #include "strategies/avx2/ipol-avx2.h"
+#include "strategies/avx512/ipol-avx512.h"
 #include "strategies/generic/ipol-generic.h"
 #include "strategyselector.h"
 
@@ -45,5 +46,8 @@ int kvz_strategy_register_ipol(void* opaque, uint8_t bitdepth) {
   if (kvz_g_hardware_flags.intel_flags.avx2) {
     success &= kvz_strategy_register_ipol_avx2(opaque, bitdepth);
   }
+  if (kvz_g_hardware_flags.intel_flags.avx512) {
+    success &= kvz_strategy_register_ipol_avx512(opaque, bitdepth);
+  }
   return success;
 }
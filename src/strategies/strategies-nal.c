@@ -20,23 +20,31 @@
 
 #include "strategies/strategies-nal.h"
 
+#include "strategies/avx2/nal-avx2.h"
 #include "strategies/generic/nal-generic.h"
+#include "strategyselector.h"
 
 
 void (*kvz_array_checksum)(const kvz_pixel* data,
                        const int height, const int width,
-                       const int stride,
+                       const int stride, const int y_offset,
                        unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth);
 void (*kvz_array_md5)(const kvz_pixel* data,
                       const int height, const int width,
-                      const int stride,
+                      const int stride, const int y_offset,
                       unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth);
+array_crc_func kvz_array_crc;
 
 
 int kvz_strategy_register_nal(void* opaque, uint8_t bitdepth) {
   bool success = true;
 
   success &= kvz_strategy_register_nal_generic(opaque, bitdepth);
-  
+
+  // The CRC needs carry-less multiplication in addition to AVX2.
+  if (kvz_g_hardware_flags.intel_flags.avx2 && kvz_g_hardware_flags.intel_flags.pclmul) {
+    success &= kvz_strategy_register_nal_avx2(opaque, bitdepth);
+  }
+
   return success;
 }
@@ -38,20 +38,39 @@
  * \param height Height of the picture.
  * \param width Width of the picture.
  * \param stride Width of one row in the pixel array.
+ * \param y_offset Row of the picture at data. Only used by the checksum.
  */
 typedef void (*array_checksum_func)(const kvz_pixel* data,
                                     const int height, const int width,
-                                    const int stride,
+                                    const int stride, const int y_offset,
                                     unsigned char checksum_out[SEI_HASH_MAX_LENGTH], const uint8_t bitdepth);
 extern array_checksum_func kvz_array_checksum;
 extern array_checksum_func kvz_array_md5;
 
+/**
+ * \brief Update the CRC of the decoded picture hash with pixels.
+ *
+ * The CRC is the one of the decoded picture hash SEI message, without
+ * the 16 zero bits fed at the end of the picture.
+ *
+ * \param crc     CRC register before the pixels
+ * \param data    first pixel
+ * \param height  number of rows
+ * \param width   number of pixels in a row
+ * \param stride  distance between rows in pixels
+ * \return        CRC register after the pixels
+ */
+typedef uint32_t (*array_crc_func)(uint32_t crc, const kvz_pixel *data,
+                                   int height, int width, int stride);
+extern array_crc_func kvz_array_crc;
+
 
 int kvz_strategy_register_nal(void* opaque, uint8_t bitdepth);
 
 
 #define STRATEGIES_NAL_EXPORTS \
   {"array_checksum", (void**) &kvz_array_checksum},\
-  {"array_md5", (void**) &kvz_array_md5},
+  {"array_md5", (void**) &kvz_array_md5},\
+  {"array_crc", (void**) &kvz_array_crc},
 
 #endif //STRATEGIES_NAL_H_
@@ -22,6 +22,7 @@
 
 #include "strategies/altivec/picture-altivec.h"
 #include "strategies/avx2/picture-avx2.h"
+#include "strategies/avx512/picture-avx512.h"
 #include "strategies/generic/picture-generic.h"
 #include "strategies/sse2/picture-sse2.h"
 #include "strategies/sse41/picture-sse41.h"
@@ -31,6 +32,7 @@
 
 // Define function pointers.
 reg_sad_func * kvz_reg_sad = 0;
+reg_sad_multi_func * kvz_reg_sad_multi = 0;
 
 cost_pixel_nxn_func * kvz_sad_4x4 = 0;
 cost_pixel_nxn_func * kvz_sad_8x8 = 0;
@@ -66,6 +68,7 @@ inter_recon_bipred_func * kvz_inter_recon_bipred_blend = 0;
 get_optimized_sad_func *kvz_get_optimized_sad = 0;
 ver_sad_func *kvz_ver_sad = 0;
 hor_sad_func *kvz_hor_sad = 0;
+pixel_var_func *kvz_pixel_var = 0;
 
 
 int kvz_strategy_register_picture(void* opaque, uint8_t bitdepth) {
@@ -85,6 +88,9 @@ int kvz_strategy_register_picture(void* opaque, uint8_t bitdepth) {
   if (kvz_g_hardware_flags.intel_flags.avx2) {
     success &= kvz_strategy_register_picture_avx2(opaque, bitdepth);
   }
+  if (kvz_g_hardware_flags.intel_flags.avx512) {
+    success &= kvz_strategy_register_picture_avx512(opaque, bitdepth);
+  }
   if (kvz_g_hardware_flags.powerpc_flags.altivec) {
     success &= kvz_strategy_register_picture_altivec(opaque, bitdepth);
   }
@@ -103,6 +103,9 @@ static unsigned satd_ ## n ## x ## n ## _ ## suffix ( \
 typedef unsigned(reg_sad_func)(const kvz_pixel *const data1, const kvz_pixel *const data2,
   const int width, const int height,
   const unsigned stride1, const unsigned stride2);
+typedef void (reg_sad_multi_func)(const kvz_pixel *data1, const kvz_pixel *const *data2,
+  int num_blocks, int width, int height,
+  unsigned stride1, unsigned stride2, unsigned *costs_out);
 typedef unsigned (cost_pixel_nxn_func)(const kvz_pixel *block1, const kvz_pixel *block2);
 typedef unsigned (cost_pixel_any_size_func)(
     int width, int height,
@@ -120,6 +123,8 @@ typedef uint32_t (ver_sad_func)(const kvz_pixel *pic_data, const kvz_pixel *ref_
 typedef uint32_t (hor_sad_func)(const kvz_pixel *pic_data, const kvz_pixel *ref_data,
                                 int32_t width, int32_t height, uint32_t pic_stride,
                                 uint32_t ref_stride, uint32_t left, uint32_t right);
+typedef uint64_t (pixel_var_func)(const kvz_pixel *data, int32_t width,
+                                  int32_t height, int32_t stride);
 
 typedef void (inter_recon_bipred_func)(const int hi_prec_luma_rec0,
 	const int hi_prec_luma_rec1,
@@ -140,6 +145,7 @@ typedef void (inter_recon_bipred_func)(const int hi_prec_luma_rec0,
 
 // Declare function pointers.
 extern reg_sad_func * kvz_reg_sad;
+extern reg_sad_multi_func * kvz_reg_sad_multi;
 
 extern cost_pixel_nxn_func * kvz_sad_4x4;
 extern cost_pixel_nxn_func * kvz_sad_8x8;
@@ -175,6 +181,7 @@ extern inter_recon_bipred_func * kvz_inter_recon_bipred_blend;
 extern get_optimized_sad_func *kvz_get_optimized_sad;
 extern ver_sad_func *kvz_ver_sad;
 extern hor_sad_func *kvz_hor_sad;
+extern pixel_var_func *kvz_pixel_var;
 
 int kvz_strategy_register_picture(void* opaque, uint8_t bitdepth);
 cost_pixel_nxn_func * kvz_pixels_get_satd_func(unsigned n);
@@ -184,6 +191,7 @@ cost_pixel_nxn_multi_func * kvz_pixels_get_sad_dual_func(unsigned n);
 
 #define STRATEGIES_PICTURE_EXPORTS \
   {"reg_sad", (void**) &kvz_reg_sad}, \
+  {"reg_sad_multi", (void**) &kvz_reg_sad_multi}, \
   {"sad_4x4", (void**) &kvz_sad_4x4}, \
   {"sad_8x8", (void**) &kvz_sad_8x8}, \
   {"sad_16x16", (void**) &kvz_sad_16x16}, \
@@ -211,6 +219,7 @@ cost_pixel_nxn_multi_func * kvz_pixels_get_sad_dual_func(unsigned n);
   {"get_optimized_sad", (void**) &kvz_get_optimized_sad}, \
   {"ver_sad", (void**) &kvz_ver_sad}, \
   {"hor_sad", (void**) &kvz_hor_sad}, \
+  {"pixel_var", (void**) &kvz_pixel_var}, \
 
 
 
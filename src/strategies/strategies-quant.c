@@ -21,6 +21,7 @@
 #include "strategies/strategies-quant.h"
 
 #include "strategies/avx2/quant-avx2.h"
+#include "strategies/avx512/quant-avx512.h"
 #include "strategies/generic/quant-generic.h"
 #include "strategyselector.h"
 
@@ -41,5 +42,8 @@ int kvz_strategy_register_quant(void* opaque, uint8_t bitdepth) {
   if (kvz_g_hardware_flags.intel_flags.avx2) {
     success &= kvz_strategy_register_quant_avx2(opaque, bitdepth);
   }
+  if (kvz_g_hardware_flags.intel_flags.avx512) {
+    success &= kvz_strategy_register_quant_avx512(opaque, bitdepth);
+  }
   return success;
 }
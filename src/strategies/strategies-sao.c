@@ -20,6 +20,7 @@
 
 #include "strategies/strategies-sao.h"
 #include "strategies/avx2/sao-avx2.h"
+#include "strategies/avx512/sao-avx512.h"
 #include "strategies/generic/sao-generic.h"
 #include "strategyselector.h"
 
@@ -39,6 +40,9 @@ int kvz_strategy_register_sao(void* opaque, uint8_t bitdepth) {
   if (kvz_g_hardware_flags.intel_flags.avx2) {
     success &= kvz_strategy_register_sao_avx2(opaque, bitdepth);
   }
+  if (kvz_g_hardware_flags.intel_flags.avx512) {
+    success &= kvz_strategy_register_sao_avx512(opaque, bitdepth);
+  }
 
   return success;
 }
\ No newline at end of file
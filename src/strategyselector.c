@@ -90,6 +90,11 @@ int kvz_strategyselector_init(int32_t cpuid, uint8_t bitdepth) {
     fprintf(stderr, "kvz_strategy_register_encode failed!\n");
     return 0;
   }
+
+  if (!kvz_strategy_register_filter(&strategies, bitdepth)) {
+    fprintf(stderr, "kvz_strategy_register_filter failed!\n");
+    return 0;
+  }
   
   while(cur_strategy_to_select->fptr) {
     *(cur_strategy_to_select->fptr) = strategyselector_choose_for(&strategies, cur_strategy_to_select->strategy_type);
@@ -115,6 +120,10 @@ int kvz_strategyselector_init(int32_t cpuid, uint8_t bitdepth) {
 		  fprintf(stderr, "avx2(%d) ", kvz_g_strategies_available.intel_flags.avx2);
 		  strategies_available = true;
 	  }
+	  if (kvz_g_strategies_available.intel_flags.avx512 != 0){
+		  fprintf(stderr, "avx512(%d) ", kvz_g_strategies_available.intel_flags.avx512);
+		  strategies_available = true;
+	  }
 	  if (kvz_g_strategies_available.intel_flags.mmx != 0) {
 		  fprintf(stderr, "mmx(%d) ", kvz_g_strategies_available.intel_flags.mmx);
 		  strategies_available = true;
@@ -168,6 +177,10 @@ int kvz_strategyselector_init(int32_t cpuid, uint8_t bitdepth) {
 		  fprintf(stderr, "avx2(%d) ", kvz_g_strategies_in_use.intel_flags.avx2);
 		  strategies_in_use = true;
 	  }
+	  if (kvz_g_strategies_in_use.intel_flags.avx512 != 0){
+		  fprintf(stderr, "avx512(%d) ", kvz_g_strategies_in_use.intel_flags.avx512);
+		  strategies_in_use = true;
+	  }
 	  if (kvz_g_strategies_in_use.intel_flags.mmx != 0) {
 		  fprintf(stderr, "mmx(%d) ", kvz_g_strategies_in_use.intel_flags.mmx);
 		  strategies_in_use = true;
@@ -243,6 +256,7 @@ int kvz_strategyselector_register(void * const opaque, const char * const type,
   if (strcmp(strategy_name, "avx") == 0) kvz_g_strategies_available.intel_flags.avx++;
   if (strcmp(strategy_name, "x86_asm_avx") == 0) kvz_g_strategies_available.intel_flags.avx++;
   if (strcmp(strategy_name, "avx2") == 0) kvz_g_strategies_available.intel_flags.avx2++;
+  if (strcmp(strategy_name, "avx512") == 0) kvz_g_strategies_available.intel_flags.avx512++;
   if (strcmp(strategy_name, "mmx") == 0) kvz_g_strategies_available.intel_flags.mmx++;
   if (strcmp(strategy_name, "sse") == 0) kvz_g_strategies_available.intel_flags.sse++;
   if (strcmp(strategy_name, "sse2") == 0) kvz_g_strategies_available.intel_flags.sse2++;
@@ -315,6 +329,7 @@ static void* strategyselector_choose_for(const strategy_list_t * const strategie
   if (strcmp(strategies->strategies[max_priority_i].strategy_name, "avx") == 0) kvz_g_strategies_in_use.intel_flags.avx++;
   if (strcmp(strategies->strategies[max_priority_i].strategy_name, "x86_asm_avx") == 0) kvz_g_strategies_in_use.intel_flags.avx++;
   if (strcmp(strategies->strategies[max_priority_i].strategy_name, "avx2") == 0) kvz_g_strategies_in_use.intel_flags.avx2++;
+  if (strcmp(strategies->strategies[max_priority_i].strategy_name, "avx512") == 0) kvz_g_strategies_in_use.intel_flags.avx512++;
   if (strcmp(strategies->strategies[max_priority_i].strategy_name, "mmx") == 0) kvz_g_strategies_in_use.intel_flags.mmx++;
   if (strcmp(strategies->strategies[max_priority_i].strategy_name, "sse") == 0) kvz_g_strategies_in_use.intel_flags.sse++;
   if (strcmp(strategies->strategies[max_priority_i].strategy_name, "sse2") == 0) kvz_g_strategies_in_use.intel_flags.sse2++;
@@ -452,6 +467,7 @@ static void set_hardware_flags(int32_t cpuid) {
     };
     enum {
       CPUID1_ECX_SSE3 = 1 << 0,
+      CPUID1_ECX_PCLMULQDQ = 1 << 1,
       CPUID1_ECX_SSSE3 = 1 << 9,
       CPUID1_ECX_SSE41 = 1 << 19,
       CPUID1_ECX_SSE42 = 1 << 20,
@@ -461,10 +477,15 @@ static void set_hardware_flags(int32_t cpuid) {
     };
     enum {
       CPUID7_EBX_AVX2 = 1 << 5,
+      CPUID7_EBX_AVX512F = 1 << 16,
+      CPUID7_EBX_AVX512BW = 1 << 30,
     };
     enum {
       XGETBV_XCR0_XMM = 1 << 1,
       XGETBV_XCR0_YMM = 1 << 2,
+      XGETBV_XCR0_OPMASK = 1 << 5,
+      XGETBV_XCR0_ZMM_HI256 = 1 << 6,
+      XGETBV_XCR0_HI16_ZMM = 1 << 7,
     };
 
     // Dig CPU features with cpuid
@@ -494,6 +515,7 @@ static void set_hardware_flags(int32_t cpuid) {
     if (cpuid1.ecx & CPUID1_ECX_SSSE3) kvz_g_hardware_flags.intel_flags.ssse3 = 1;
     if (cpuid1.ecx & CPUID1_ECX_SSE41) kvz_g_hardware_flags.intel_flags.sse41 = 1;
     if (cpuid1.ecx & CPUID1_ECX_SSE42) kvz_g_hardware_flags.intel_flags.sse42 = 1;
+    if (cpuid1.ecx & CPUID1_ECX_PCLMULQDQ) kvz_g_hardware_flags.intel_flags.pclmul = 1;
     
     // Check hardware and OS support for xsave and xgetbv.
     if (cpuid1.ecx & (CPUID1_ECX_XSAVE | CPUID1_ECX_OSXSAVE)) {
@@ -519,6 +541,16 @@ static void set_hardware_flags(int32_t cpuid) {
         cpuid_t cpuid7 = { 0, 0, 0, 0 };
         get_cpuid(7, 0, &cpuid7);
         if (cpuid7.ebx & CPUID7_EBX_AVX2)  kvz_g_hardware_flags.intel_flags.avx2 = 1;
+
+        // AVX-512 needs the OS to save the opmask and all 32 zmm registers.
+        const uint64_t zmm_state = XGETBV_XCR0_OPMASK | XGETBV_XCR0_ZMM_HI256 | XGETBV_XCR0_HI16_ZMM;
+        // Bit 31 (AVX512VL) does not fit in an enum.
+        const uint32_t avx512_bits = CPUID7_EBX_AVX512F | CPUID7_EBX_AVX512BW | 1u << 31;
+        if ((xcr0 & zmm_state) == zmm_state &&
+            (cpuid7.ebx & avx512_bits) == avx512_bits)
+        {
+          kvz_g_hardware_flags.intel_flags.avx512 = 1;
+        }
       }
     }
   }
@@ -550,6 +582,9 @@ static void set_hardware_flags(int32_t cpuid) {
 #endif
 #if COMPILE_INTEL_AVX2
   fprintf(stderr, " AVX2");
+#endif
+#if COMPILE_INTEL_AVX512
+  fprintf(stderr, " AVX512");
 #endif
   fprintf(stderr, "\nDetected: INTEL, flags:");
   if (kvz_g_hardware_flags.intel_flags.mmx) fprintf(stderr, " MMX");
@@ -559,8 +594,10 @@ static void set_hardware_flags(int32_t cpuid) {
   if (kvz_g_hardware_flags.intel_flags.ssse3) fprintf(stderr, " SSSE3");
   if (kvz_g_hardware_flags.intel_flags.sse41) fprintf(stderr, " SSE41");
   if (kvz_g_hardware_flags.intel_flags.sse42) fprintf(stderr, " SSE42");
+  if (kvz_g_hardware_flags.intel_flags.pclmul) fprintf(stderr, " PCLMUL");
   if (kvz_g_hardware_flags.intel_flags.avx) fprintf(stderr, " AVX");
   if (kvz_g_hardware_flags.intel_flags.avx2) fprintf(stderr, " AVX2");
+  if (kvz_g_hardware_flags.intel_flags.avx512) fprintf(stderr, " AVX512");
   fprintf(stderr, "\n");
 #endif //COMPILE_INTEL
 
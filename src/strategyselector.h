@@ -63,6 +63,8 @@ typedef struct {
     int sse42;
     int avx;
     int avx2;
+    int avx512;
+    int pclmul;
 
     bool hyper_threading;
   } intel_flags;
@@ -96,6 +98,7 @@ int kvz_strategyselector_register(void *opaque, const char *type, const char *st
 #include "strategies/strategies-intra.h"
 #include "strategies/strategies-sao.h"
 #include "strategies/strategies-encode.h"
+#include "strategies/strategies-filter.h"
 
 static const strategy_to_select_t strategies_to_select[] = {
   STRATEGIES_NAL_EXPORTS
@@ -106,6 +109,7 @@ static const strategy_to_select_t strategies_to_select[] = {
   STRATEGIES_INTRA_EXPORTS
   STRATEGIES_SAO_EXPORTS
   STRATEGIES_ENCODE_EXPORTS
+  STRATEGIES_FILTER_EXPORTS
   { NULL, NULL },
 };
 
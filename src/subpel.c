@@ -0,0 +1,163 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "subpel.h"
+
+#include <stdlib.h>
+
+#include "encoder.h"
+#include "strategies/strategies-ipol.h"
+
+
+/**
+ * \brief Allocate fractional pixel planes for a picture.
+ *
+ * The planes are not interpolated.
+ *
+ * \param width   width of the picture in pixels
+ * \param height  height of the picture in pixels
+ * \return        planes or NULL on failure
+ */
+subpel_planes_t * kvz_subpel_planes_alloc(int width, int height)
+{
+  subpel_planes_t *planes = MALLOC(subpel_planes_t, 1);
+  if (!planes) return NULL;
+
+  const int stride       = width  + 2 * SUBPEL_PLANES_PADDING;
+  const int plane_height = height + 2 * SUBPEL_PLANES_PADDING;
+  const size_t plane_size = (size_t)stride * plane_height;
+
+  planes->data = MALLOC(kvz_pixel, 15 * plane_size);
+  if (!planes->data) {
+    free(planes);
+    return NULL;
+  }
+
+  planes->planes[0] = NULL;
+  for (int i = 1; i < 16; i++) {
+    planes->planes[i] = planes->data + (i - 1) * plane_size +
+                        SUBPEL_PLANES_PADDING * stride + SUBPEL_PLANES_PADDING;
+  }
+
+  planes->width         = width;
+  planes->height        = height;
+  planes->stride        = stride;
+  planes->height_in_lcu = CEILDIV(height, LCU_WIDTH);
+  planes->rows_done     = 0;
+  planes->refcount      = 1;
+
+  return planes;
+}
+
+
+/**
+ * \brief Free fractional pixel planes.
+ *
+ * Decrement the reference count of the planes and deallocate them if no
+ * references exist any more.
+ */
+void kvz_subpel_planes_free(subpel_planes_t **planes_ptr)
+{
+  subpel_planes_t *planes = *planes_ptr;
+  if (planes == NULL) return;
+  *planes_ptr = NULL;
+
+  int new_refcount = KVZ_ATOMIC_DEC(&planes->refcount);
+  if (new_refcount > 0) {
+    // Still we have some references, do nothing.
+    return;
+  }
+
+  assert(new_refcount == 0);
+
+  FREE_POINTER(planes->data);
+  FREE_POINTER(planes);
+}
+
+
+/**
+ * \brief Get a new pointer to fractional pixel planes.
+ *
+ * Increment reference count and return the planes.
+ */
+subpel_planes_t * kvz_subpel_planes_copy_ref(subpel_planes_t *planes)
+{
+  int32_t new_refcount = KVZ_ATOMIC_INC(&planes->refcount);
+  // The caller should have had another reference and we added one
+  // reference so refcount should be at least 2.
+  assert(new_refcount >= 2);
+  return planes;
+}
+
+
+/**
+ * \brief Interpolate one LCU row of the fractional pixel planes.
+ *
+ * The first and the last row also include the padding above and below
+ * the picture. The reconstruction of the whole picture must be complete.
+ *
+ * \param encoder   encoder control
+ * \param planes    planes to fill
+ * \param pic       reconstructed picture
+ * \param row       index of the LCU row
+ */
+void kvz_subpel_planes_interpolate_row(const encoder_control_t *encoder,
+                                       subpel_planes_t *planes,
+                                       const kvz_picture *pic,
+                                       int row)
+{
+  assert(pic->width == planes->width && pic->height == planes->height);
+
+  const int top = row == 0 ?
+    -SUBPEL_PLANES_PADDING : row * LCU_WIDTH;
+  const int bottom = row == planes->height_in_lcu - 1 ?
+    planes->height + SUBPEL_PLANES_PADDING : (row + 1) * LCU_WIDTH;
+  const int left  = -SUBPEL_PLANES_PADDING;
+  const int right = planes->width + SUBPEL_PLANES_PADDING;
+
+  for (int y = top; y < bottom; y += LCU_WIDTH) {
+    for (int x = left; x < right; x += LCU_WIDTH) {
+      const int width  = MIN(LCU_WIDTH, right  - x);
+      const int height = MIN(LCU_WIDTH, bottom - y);
+
+      kvz_extended_block src = { 0, 0, 0, 0 };
+      kvz_get_extended_block(0, 0, x, y, 0, 0,
+                             pic->y, pic->width, pic->height,
+                             KVZ_LUMA_FILTER_TAPS,
+                             width, height,
+                             &src);
+
+      for (int i = 1; i < 16; i++) {
+        const int16_t mv[2] = { i & 3, i >> 2 };
+        kvz_sample_quarterpel_luma(encoder,
+                                   src.orig_topleft, src.stride,
+                                   width, height,
+                                   planes->planes[i] + y * planes->stride + x,
+                                   planes->stride,
+                                   mv[0] != 0, mv[1] != 0,
+                                   mv);
+      }
+
+      if (src.malloc_used) free(src.buffer);
+    }
+  }
+
+  KVZ_ATOMIC_INC(&planes->rows_done);
+}
@@ -0,0 +1,112 @@
+#ifndef SUBPEL_H_
+#define SUBPEL_H_
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+/**
+ * \ingroup DataStructures
+ * \file
+ * \brief Precomputed fractional pixel planes of a reference picture.
+ *
+ * The luma of a reconstructed picture is interpolated at all 15 fractional
+ * positions once the picture is complete, so fractional motion estimation
+ * can read the samples from memory instead of filtering them for every PU.
+ * The samples are identical to the ones computed by the interpolation
+ * filters, so using the planes does not change the encoding result.
+ */
+
+#include "global.h" // IWYU pragma: keep
+#include "kvazaar.h"
+#include "threads.h"
+
+
+// Forward declaration.
+struct encoder_control_t;
+
+/**
+ * \brief Number of pixels interpolated outside each edge of the picture.
+ */
+#define SUBPEL_PLANES_PADDING 64
+
+typedef struct subpel_planes_t {
+  /**
+   * \brief Pointers to the top-left pixel of the picture in each plane.
+   *
+   * Indexed by 4 * frac_y + frac_x. The integer position is NULL.
+   */
+  kvz_pixel *planes[16];
+
+  kvz_pixel *data;          //!< \brief buffer of all planes
+  int32_t width;            //!< \brief width of the picture in pixels
+  int32_t height;           //!< \brief height of the picture in pixels
+  int32_t stride;           //!< \brief stride of the planes in pixels
+  int32_t height_in_lcu;    //!< \brief number of LCU rows
+  int32_t rows_done;        //!< \brief number of interpolated LCU rows
+  int32_t refcount;         //!< \brief number of references to the planes
+} subpel_planes_t;
+
+subpel_planes_t * kvz_subpel_planes_alloc(int width, int height);
+void kvz_subpel_planes_free(subpel_planes_t **planes_ptr);
+subpel_planes_t * kvz_subpel_planes_copy_ref(subpel_planes_t *planes);
+
+void kvz_subpel_planes_interpolate_row(const struct encoder_control_t *encoder,
+                                       subpel_planes_t *planes,
+                                       const kvz_picture *pic,
+                                       int row);
+
+/**
+ * \brief Check whether all rows of the planes have been interpolated.
+ */
+static INLINE bool kvz_subpel_planes_ready(const subpel_planes_t *planes)
+{
+  return planes && KVZ_ATOMIC_LOAD(&planes->rows_done) == planes->height_in_lcu;
+}
+
+/**
+ * \brief Check whether a block is within the interpolated area.
+ *
+ * \param x       x-coordinate of the integer part of the block position
+ * \param y       y-coordinate of the integer part of the block position
+ */
+static INLINE bool kvz_subpel_planes_contain(const subpel_planes_t *planes,
+                                             int x, int y,
+                                             int width, int height)
+{
+  return x >= -SUBPEL_PLANES_PADDING &&
+         y >= -SUBPEL_PLANES_PADDING &&
+         x + width  <= planes->width  + SUBPEL_PLANES_PADDING &&
+         y + height <= planes->height + SUBPEL_PLANES_PADDING;
+}
+
+/**
+ * \brief Get a pointer to an interpolated block.
+ *
+ * \param mv_x    x-coordinate of the block position in quarter pixels
+ * \param mv_y    y-coordinate of the block position in quarter pixels
+ */
+static INLINE const kvz_pixel * kvz_subpel_planes_at(const subpel_planes_t *planes,
+                                                     int mv_x, int mv_y)
+{
+  const kvz_pixel *plane = planes->planes[4 * (mv_y & 3) + (mv_x & 3)];
+  assert(plane);
+  return plane + (mv_y >> 2) * planes->stride + (mv_x >> 2);
+}
+
+#endif // SUBPEL_H_
@@ -18,6 +18,11 @@
  * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
  ****************************************************************************/
 
+#ifdef __linux__
+// Needed for sched_getaffinity, sched_setaffinity and the CPU_SET macros.
+#define _GNU_SOURCE
+#endif
+
 #include "global.h"
 #include "threadqueue.h"
 
@@ -27,26 +32,54 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#endif
+
 #include "threads.h"
 
 
 /**
  * \file
  *
- * Lock acquisition order:
+ * Every worker thread owns a priority queue of jobs that are ready to run.
+ * Workers push new jobs to their own queues. When looking for a job to
+ * run, a worker takes the job with the highest priority among the queues
+ * of all workers, stealing it from another worker if needed. Jobs with
+ * equal priorities are run in the order they became ready. The global
+ * thread queue lock is only taken when a worker goes to sleep or needs to
+ * be woken up.
  *
- * 1. When locking a job and its dependency, the dependecy must be locked
- * first and then the job depending on it.
+ * Jobs have no locks. The number of unfinished dependencies, the reference
+ * count and the list of reverse dependencies of a job are only modified
+ * with atomic operations. When a job is completed, its list of reverse
+ * dependencies is closed by replacing it with THREADQUEUE_RDEPENDS_CLOSED.
+ * Dependencies added after that are ignored.
  *
- * 2. When locking a job and the thread queue, the thread queue must be
- * locked first and then the job.
+ * Jobs and the elements of the reverse dependency lists are allocated
+ * from a pool owned by the thread queue. Freed objects are put to free
+ * lists and reused, so that no memory needs to be allocated once the
+ * encoder has reached a steady state.
  *
- * 3. When accessing threadqueue_job_t.next, the thread queue must be
- * locked.
+ * The lock of a priority queue or the pool is never held while taking
+ * another lock.
+ *
+ * Worker threads can be pinned to CPUs. With KVZ_THREAD_AFFINITY_NUMA,
+ * each worker is pinned to the CPUs of one NUMA node and jobs can be
+ * assigned to a node with kvz_threadqueue_job_set_node. Such jobs are put
+ * to the queues of the workers of that node, and workers take jobs from
+ * other nodes only when there is nothing to do on their own node.
  */
 
 #define THREADQUEUE_LIST_REALLOC_SIZE 32
 
+/**
+ * \brief Number of objects allocated at once when a free list of the pool
+ * is empty.
+ */
+#define THREADQUEUE_POOL_SLAB_SIZE 256
+
 #define PTHREAD_COND_SIGNAL(c) \
   if (pthread_cond_signal((c)) != 0) { \
     fprintf(stderr, "pthread_cond_signal(%s=%p) failed!\n", #c, c); \
@@ -75,262 +108,1238 @@
     return 0; \
   }
 
-#define PTHREAD_UNLOCK(l) \
-  if (pthread_mutex_unlock((l)) != 0) { \
-    fprintf(stderr, "pthread_mutex_unlock(%s) failed!\n", #l); \
-    assert(0); \
-    return 0; \
-  }
+#define PTHREAD_UNLOCK(l) \
+  if (pthread_mutex_unlock((l)) != 0) { \
+    fprintf(stderr, "pthread_mutex_unlock(%s) failed!\n", #l); \
+    assert(0); \
+    return 0; \
+  }
+
+
+typedef enum {
+  /**
+   * \brief Job has been submitted, but is not allowed to run yet.
+   */
+  THREADQUEUE_JOB_STATE_PAUSED,
+
+  /**
+   * \brief Job is waiting for dependencies.
+   */
+  THREADQUEUE_JOB_STATE_WAITING,
+
+  /**
+   * \brief Job is ready to run.
+   */
+  THREADQUEUE_JOB_STATE_READY,
+
+  /**
+   * \brief Job is running.
+   */
+  THREADQUEUE_JOB_STATE_RUNNING,
+
+  /**
+   * \brief Job is completed.
+   */
+  THREADQUEUE_JOB_STATE_DONE,
+
+} threadqueue_job_state;
+
+
+/**
+ * \brief Element in the list of reverse dependencies of a job.
+ */
+typedef struct threadqueue_dep_t {
+  /**
+   * \brief Job depending on the job owning the list.
+   *
+   * The element holds a reference to the job.
+   */
+  struct threadqueue_job_t *job;
+
+  /**
+   * \brief Pointer to the next element.
+   */
+  struct threadqueue_dep_t *next;
+} threadqueue_dep_t;
+
+
+/**
+ * \brief Marker for a list of reverse dependencies that has been closed.
+ */
+static threadqueue_dep_t threadqueue_rdepends_closed;
+#define THREADQUEUE_RDEPENDS_CLOSED (&threadqueue_rdepends_closed)
+
+
+struct threadqueue_job_t {
+  /**
+   * \brief Thread queue whose pool the job was allocated from.
+   */
+  threadqueue_queue_t *threadqueue;
+
+  volatile threadqueue_job_state state;
+
+  /**
+   * \brief Number of dependencies that have not been completed yet.
+   *
+   * Before the job is submitted, the number is one larger so that it
+   * cannot reach zero while dependencies are being added.
+   */
+  volatile int ndepends;
+
+  /**
+   * \brief Reverse dependencies.
+   *
+   * Lock-free stack of jobs that depend on this one. They have to exist
+   * when the thread finishes, because they cannot be run before. Set to
+   * THREADQUEUE_RDEPENDS_CLOSED when the job is completed.
+   */
+  threadqueue_dep_t * volatile rdepends;
+
+  /**
+   * \brief Reference count
+   */
+  volatile int refcount;
+
+  /**
+   * \brief Pointer to the function to execute.
+   */
+  void (*fptr)(void *arg);
+
+  /**
+   * \brief Argument for fptr.
+   */
+  void *arg;
+
+  /**
+   * \brief Priority of the job. Jobs with higher priority are run first.
+   */
+  int64_t priority;
+
+  /**
+   * \brief Sequence number for ordering jobs with equal priorities.
+   */
+  uint64_t seq;
+
+  /**
+   * \brief NUMA node the job should be run on, or -1 for any node.
+   */
+  int node;
+
+  /**
+   * \brief What the job does, for tracing.
+   */
+  kvz_trace_kind trace_kind;
+
+  /**
+   * \brief POC and LCU coordinates of the job for tracing, or -1.
+   */
+  int32_t trace_poc;
+  int32_t trace_x;
+  int32_t trace_y;
+
+  /**
+   * \brief Where to store the time the job waits in a queue, or NULL.
+   */
+  int64_t *queue_time;
+
+  /**
+   * \brief Time when the job was added to a queue, in nanoseconds.
+   *
+   * Only set if queue_time is not NULL.
+   */
+  int64_t ready_time;
+
+  /**
+   * \brief Pointer to the next job in the free list of the pool.
+   */
+  struct threadqueue_job_t *next;
+};
+
+
+/**
+ * \brief Priority queue of jobs that are ready to run.
+ *
+ * Implemented as a binary heap ordered by threadqueue_job_t.priority and
+ * threadqueue_job_t.seq.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+
+  /**
+   * \brief Binary heap of jobs.
+   */
+  threadqueue_job_t **jobs;
+
+  /**
+   * \brief Allocated size of jobs.
+   */
+  int size;
+
+  /**
+   * \brief Number of jobs in the heap.
+   */
+  volatile int count;
+
+  /**
+   * \brief Sequence number for the next job added to the heap.
+   */
+  uint64_t next_seq;
+
+  /**
+   * \brief Priority of the first job in the heap.
+   *
+   * Read without locking by other workers, so it is only a hint.
+   */
+  volatile int64_t top_priority;
+} threadqueue_heap_t;
+
+
+typedef struct {
+  /**
+   * \brief The thread queue this worker belongs to.
+   */
+  threadqueue_queue_t *threadqueue;
+
+  /**
+   * \brief Index of the worker in threadqueue_queue_t.workers.
+   */
+  int id;
+
+  /**
+   * \brief Index of the CPU of the worker in threadqueue_queue_t.cpus,
+   * or -1 if the worker is not pinned.
+   */
+  int cpu;
+
+  /**
+   * \brief NUMA node of the worker.
+   */
+  int node;
+
+  /**
+   * \brief Jobs ready to run.
+   */
+  threadqueue_heap_t ready;
+} threadqueue_worker_t;
+
+
+/**
+ * \brief Pool of recycled jobs and reverse dependency list elements.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+
+  /**
+   * \brief Free jobs linked through threadqueue_job_t.next.
+   */
+  threadqueue_job_t *free_jobs;
+
+  /**
+   * \brief Free list elements linked through threadqueue_dep_t.next.
+   */
+  threadqueue_dep_t *free_deps;
+
+  /**
+   * \brief Array of allocated slabs of jobs and list elements.
+   */
+  void **slabs;
+
+  /**
+   * \brief Number of elements in slabs.
+   */
+  int slab_count;
+
+  /**
+   * \brief Allocated size of slabs.
+   */
+  int slabs_size;
+} threadqueue_pool_t;
+
+
+struct threadqueue_queue_t {
+  pthread_mutex_t lock;
+
+  /**
+   * \brief Job available condition variable
+   *
+   * Signalled when there is a new job to do and some workers are idle.
+   */
+  pthread_cond_t job_available;
+
+  /**
+   * \brief Job done condition variable
+   *
+   * Signalled when a job has been completed and someone is waiting for
+   * a job.
+   */
+  pthread_cond_t job_done;
+
+  /**
+   * Array containing spawned threads
+   */
+  pthread_t *threads;
+
+  /**
+   * \brief Number of threads spawned
+   */
+  int thread_count;
+
+  /**
+   * \brief Number of threads running
+   */
+  int thread_running_count;
+
+  /**
+   * \brief Array of workers, one for each thread.
+   */
+  threadqueue_worker_t *workers;
+
+  /**
+   * \brief Number of elements in workers.
+   */
+  int worker_count;
+
+  /**
+   * \brief Number of jobs in the priority queues of all workers.
+   *
+   * Modified only with atomic operations.
+   */
+  volatile int ready_count;
+
+  /**
+   * \brief Number of workers waiting for job_available.
+   *
+   * Modified only with atomic operations.
+   */
+  volatile int idle_count;
+
+  /**
+   * \brief Number of threads waiting for job_done.
+   *
+   * Modified only with atomic operations.
+   */
+  volatile int waiter_count;
+
+  /**
+   * \brief Counter for distributing submitted jobs to the workers.
+   */
+  volatile int next_worker;
+
+  /**
+   * \brief How worker threads are placed on CPUs.
+   */
+  enum kvz_thread_affinity affinity;
+
+  /**
+   * \brief CPUs the workers can be pinned to, ordered by NUMA node.
+   */
+  int *cpus;
+
+  /**
+   * \brief NUMA node of each CPU in cpus, or -1 if no worker is on the
+   * node.
+   */
+  int *cpu_nodes;
+
+  /**
+   * \brief Number of elements in cpus and cpu_nodes.
+   */
+  int cpu_count;
+
+  /**
+   * \brief Number of NUMA nodes used for scheduling jobs.
+   *
+   * Larger than one only with KVZ_THREAD_AFFINITY_NUMA on a system with
+   * several NUMA nodes.
+   */
+  int node_count;
+
+  /**
+   * \brief Indices of the workers in workers, ordered by NUMA node.
+   */
+  int *node_workers;
+
+  /**
+   * \brief Index of the first worker of each NUMA node in node_workers.
+   *
+   * Has node_count + 1 elements.
+   */
+  int *node_offsets;
+
+  /**
+   * \brief Pool for allocating jobs.
+   */
+  threadqueue_pool_t pool;
+
+  /**
+   * \brief Trace the jobs are recorded to, or NULL.
+   */
+  kvz_trace_t *trace;
+
+  /**
+   * \brief If true, threads should stop ASAP.
+   */
+  bool stop;
+};
+
+
+static int threadqueue_pool_init(threadqueue_pool_t *pool)
+{
+  pool->free_jobs  = NULL;
+  pool->free_deps  = NULL;
+  pool->slabs      = NULL;
+  pool->slab_count = 0;
+  pool->slabs_size = 0;
+
+  if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+    fprintf(stderr, "pthread_mutex_init(pool) failed!\n");
+    return 0;
+  }
+  return 1;
+}
+
+
+static void threadqueue_pool_free(threadqueue_pool_t *pool)
+{
+  for (int i = 0; i < pool->slab_count; i++) {
+    FREE_POINTER(pool->slabs[i]);
+  }
+  FREE_POINTER(pool->slabs);
+  pool->slab_count = 0;
+  pool->slabs_size = 0;
+  pool->free_jobs  = NULL;
+  pool->free_deps  = NULL;
+
+  pthread_mutex_destroy(&pool->lock);
+}
+
+
+/**
+ * \brief Add a newly allocated slab to the pool.
+ *
+ * The caller must have locked the pool.
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int threadqueue_pool_add_slab(threadqueue_pool_t *pool, void *slab)
+{
+  if (pool->slab_count >= pool->slabs_size) {
+    const int new_size = pool->slabs_size + THREADQUEUE_LIST_REALLOC_SIZE;
+    void **slabs = realloc(pool->slabs, new_size * sizeof(void*));
+    if (!slabs) {
+      return 0;
+    }
+    pool->slabs = slabs;
+    pool->slabs_size = new_size;
+  }
+  pool->slabs[pool->slab_count++] = slab;
+  return 1;
+}
+
+
+/**
+ * \brief Take a job from the pool.
+ *
+ * \return uninitialized job, or NULL on failure
+ */
+static threadqueue_job_t * threadqueue_pool_alloc_job(threadqueue_pool_t *pool)
+{
+  PTHREAD_LOCK(&pool->lock);
+
+  if (!pool->free_jobs) {
+    threadqueue_job_t *slab = MALLOC(threadqueue_job_t, THREADQUEUE_POOL_SLAB_SIZE);
+    if (!slab || !threadqueue_pool_add_slab(pool, slab)) {
+      FREE_POINTER(slab);
+      PTHREAD_UNLOCK(&pool->lock);
+      return NULL;
+    }
+    for (int i = 0; i < THREADQUEUE_POOL_SLAB_SIZE; i++) {
+      slab[i].next = (i + 1 < THREADQUEUE_POOL_SLAB_SIZE) ? &slab[i + 1] : NULL;
+    }
+    pool->free_jobs = slab;
+  }
+
+  threadqueue_job_t *job = pool->free_jobs;
+  pool->free_jobs = job->next;
+
+  PTHREAD_UNLOCK(&pool->lock);
+  return job;
+}
+
+
+/**
+ * \brief Return a job to the pool.
+ */
+static void threadqueue_pool_free_job(threadqueue_pool_t *pool,
+                                      threadqueue_job_t *job)
+{
+  if (pthread_mutex_lock(&pool->lock) != 0) {
+    fprintf(stderr, "pthread_mutex_lock(pool) failed!\n");
+    assert(0);
+    return;
+  }
+  job->next = pool->free_jobs;
+  pool->free_jobs = job;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+
+/**
+ * \brief Take a reverse dependency list element from the pool.
+ *
+ * \return uninitialized list element, or NULL on failure
+ */
+static threadqueue_dep_t * threadqueue_pool_alloc_dep(threadqueue_pool_t *pool)
+{
+  PTHREAD_LOCK(&pool->lock);
+
+  if (!pool->free_deps) {
+    threadqueue_dep_t *slab = MALLOC(threadqueue_dep_t, THREADQUEUE_POOL_SLAB_SIZE);
+    if (!slab || !threadqueue_pool_add_slab(pool, slab)) {
+      FREE_POINTER(slab);
+      PTHREAD_UNLOCK(&pool->lock);
+      return NULL;
+    }
+    for (int i = 0; i < THREADQUEUE_POOL_SLAB_SIZE; i++) {
+      slab[i].next = (i + 1 < THREADQUEUE_POOL_SLAB_SIZE) ? &slab[i + 1] : NULL;
+    }
+    pool->free_deps = slab;
+  }
+
+  threadqueue_dep_t *dep = pool->free_deps;
+  pool->free_deps = dep->next;
+
+  PTHREAD_UNLOCK(&pool->lock);
+  return dep;
+}
+
+
+/**
+ * \brief Return a list of reverse dependency list elements to the pool.
+ *
+ * \param first   first element of the list
+ * \param last    last element of the list
+ */
+static void threadqueue_pool_free_deps(threadqueue_pool_t *pool,
+                                       threadqueue_dep_t *first,
+                                       threadqueue_dep_t *last)
+{
+  if (pthread_mutex_lock(&pool->lock) != 0) {
+    fprintf(stderr, "pthread_mutex_lock(pool) failed!\n");
+    assert(0);
+    return;
+  }
+  last->next = pool->free_deps;
+  pool->free_deps = first;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+
+static int threadqueue_heap_init(threadqueue_heap_t *heap)
+{
+  heap->jobs         = NULL;
+  heap->size         = 0;
+  heap->count        = 0;
+  heap->next_seq     = 0;
+  heap->top_priority = INT64_MIN;
+
+  if (pthread_mutex_init(&heap->lock, NULL) != 0) {
+    fprintf(stderr, "pthread_mutex_init(heap) failed!\n");
+    return 0;
+  }
+  return 1;
+}
+
+
+static void threadqueue_heap_free(threadqueue_heap_t *heap)
+{
+  for (int i = 0; i < heap->count; i++) {
+    kvz_threadqueue_free_job(&heap->jobs[i]);
+  }
+  heap->count = 0;
+
+  FREE_POINTER(heap->jobs);
+  pthread_mutex_destroy(&heap->lock);
+}
+
+
+/**
+ * \brief Return true if job a should be run before job b.
+ */
+static INLINE bool threadqueue_job_before(const threadqueue_job_t *a,
+                                          const threadqueue_job_t *b)
+{
+  return a->priority > b->priority ||
+         (a->priority == b->priority && a->seq < b->seq);
+}
+
+
+/**
+ * \brief Add a job to a priority queue.
+ *
+ * This function takes the ownership of the job.
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int threadqueue_heap_push(threadqueue_heap_t *heap,
+                                 threadqueue_job_t *job)
+{
+  PTHREAD_LOCK(&heap->lock);
+
+  if (heap->count >= heap->size) {
+    const int new_size = heap->size + THREADQUEUE_LIST_REALLOC_SIZE;
+    threadqueue_job_t **jobs = realloc(heap->jobs, new_size * sizeof(threadqueue_job_t*));
+    if (!jobs) {
+      fprintf(stderr, "Could not alloc heap!\n");
+      PTHREAD_UNLOCK(&heap->lock);
+      return 0;
+    }
+    heap->jobs = jobs;
+    heap->size = new_size;
+  }
+
+  job->seq = heap->next_seq++;
+
+  // Move the job up until its parent is run before it.
+  int i = heap->count++;
+  while (i > 0) {
+    const int parent = (i - 1) / 2;
+    if (!threadqueue_job_before(job, heap->jobs[parent])) break;
+    heap->jobs[i] = heap->jobs[parent];
+    i = parent;
+  }
+  heap->jobs[i] = job;
+
+  heap->top_priority = heap->jobs[0]->priority;
+
+  PTHREAD_UNLOCK(&heap->lock);
+  return 1;
+}
+
+
+/**
+ * \brief Remove the job with the highest priority from a priority queue.
+ *
+ * The calling function receives the ownership of the job.
+ *
+ * \return the job, or NULL if the queue is empty
+ */
+static threadqueue_job_t * threadqueue_heap_take(threadqueue_heap_t *heap)
+{
+  // Check for an empty queue without locking it. This is racy but it
+  // keeps idle workers from hammering the locks of each other.
+  if (heap->count == 0) return NULL;
+
+  PTHREAD_LOCK(&heap->lock);
+
+  threadqueue_job_t *job = NULL;
+  if (heap->count > 0) {
+    job = heap->jobs[0];
+    threadqueue_job_t *last = heap->jobs[--heap->count];
+
+    // Move the last job down from the root until both of its children
+    // are run after it.
+    int i = 0;
+    for (;;) {
+      int child = 2 * i + 1;
+      if (child >= heap->count) break;
+      if (child + 1 < heap->count &&
+          threadqueue_job_before(heap->jobs[child + 1], heap->jobs[child])) {
+        child++;
+      }
+      if (!threadqueue_job_before(heap->jobs[child], last)) break;
+      heap->jobs[i] = heap->jobs[child];
+      i = child;
+    }
+    if (heap->count > 0) {
+      heap->jobs[i] = last;
+    }
+
+    heap->top_priority = heap->count > 0 ? heap->jobs[0]->priority : INT64_MIN;
+  }
+
+  PTHREAD_UNLOCK(&heap->lock);
+  return job;
+}
+
+
+/**
+ * \brief Add a job to the jobs ready to run.
+ *
+ * This function takes the ownership of the job. The caller must call
+ * threadqueue_wake_workers afterwards.
+ *
+ * \param worker  worker whose priority queue the job is added to
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int threadqueue_push_job(threadqueue_worker_t *worker,
+                                threadqueue_job_t *job)
+{
+  assert(job->ndepends == 0);
+  job->state = THREADQUEUE_JOB_STATE_READY;
+  if (job->queue_time) {
+    job->ready_time = kvz_time_ns();
+  }
+
+  if (!threadqueue_heap_push(&worker->ready, job)) {
+    return 0;
+  }
+
+  KVZ_ATOMIC_INC(&worker->threadqueue->ready_count);
+  return 1;
+}
+
+
+/**
+ * \brief Return true if the job can be run on the NUMA node of the worker.
+ */
+static INLINE bool threadqueue_job_is_local(const threadqueue_worker_t *worker,
+                                            const threadqueue_job_t *job)
+{
+  const int node_count = worker->threadqueue->node_count;
+  return node_count <= 1 || job->node < 0 || job->node % node_count == worker->node;
+}
+
+
+/**
+ * \brief Select the worker whose priority queue a ready job is added to.
+ *
+ * Jobs are distributed evenly to the workers of the NUMA node of the job,
+ * or to all workers if the job can be run on any node.
+ */
+static threadqueue_worker_t * threadqueue_job_worker(threadqueue_queue_t *threadqueue,
+                                                     const threadqueue_job_t *job)
+{
+  const unsigned n = (unsigned)KVZ_ATOMIC_INC(&threadqueue->next_worker);
+
+  if (threadqueue->node_count <= 1 || job->node < 0) {
+    return &threadqueue->workers[n % threadqueue->worker_count];
+  }
+
+  const int node  = job->node % threadqueue->node_count;
+  const int first = threadqueue->node_offsets[node];
+  const int count = threadqueue->node_offsets[node + 1] - first;
+  return &threadqueue->workers[threadqueue->node_workers[first + n % count]];
+}
+
+
+/**
+ * \brief Wake up idle workers after new jobs have been pushed.
+ *
+ * \param num_jobs  number of jobs pushed
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int threadqueue_wake_workers(threadqueue_queue_t *threadqueue,
+                                    int num_jobs)
+{
+  // The ready_count has been incremented before checking for idle
+  // workers. Idle workers increment idle_count before checking
+  // ready_count so at least one of the two sees the change made by the
+  // other.
+  if (num_jobs > 0 && threadqueue->idle_count > 0) {
+    PTHREAD_LOCK(&threadqueue->lock);
+    if (num_jobs == 1) {
+      PTHREAD_COND_SIGNAL(&threadqueue->job_available);
+    } else {
+      PTHREAD_COND_BROADCAST(&threadqueue->job_available);
+    }
+    PTHREAD_UNLOCK(&threadqueue->lock);
+  }
+  return 1;
+}
+
+
+/**
+ * \brief Take the job with the highest priority from the priority queues.
+ *
+ * The queue of the worker itself is preferred over others on ties.
+ *
+ * The calling function receives the ownership of the job.
+ *
+ * \param local_only  only take jobs from the workers on the same NUMA node
+ *
+ * \return the job, or NULL if no job was found
+ */
+static threadqueue_job_t * threadqueue_take_job(threadqueue_worker_t *worker,
+                                                bool local_only)
+{
+  threadqueue_queue_t * const threadqueue = worker->threadqueue;
+  const int worker_count = threadqueue->worker_count;
+
+  // Find the queue with the highest priority job. Start from the queue
+  // of this worker so that it is preferred over others on ties.
+  threadqueue_heap_t *best = NULL;
+  int64_t best_priority = INT64_MIN;
+  for (int i = 0; i < worker_count; i++) {
+    threadqueue_worker_t *other = &threadqueue->workers[(worker->id + i) % worker_count];
+    if (local_only && other->node != worker->node) continue;
+    threadqueue_heap_t *heap = &other->ready;
+    if (heap->count == 0) continue;
+    const int64_t priority = heap->top_priority;
+    if (!best || priority > best_priority) {
+      best = heap;
+      best_priority = priority;
+    }
+  }
+
+  threadqueue_job_t *job = best ? threadqueue_heap_take(best) : NULL;
+
+  // Someone else may have taken the job. Take anything available.
+  for (int i = 0; !job && i < worker_count; i++) {
+    threadqueue_worker_t *other = &threadqueue->workers[(worker->id + i) % worker_count];
+    if (local_only && other->node != worker->node) continue;
+    job = threadqueue_heap_take(&other->ready);
+  }
+
+  return job;
+}
+
+
+/**
+ * \brief Retrieve a job ready to run.
+ *
+ * Takes the job with the highest priority from the priority queues of the
+ * workers on the same NUMA node, or from all workers if there are none.
+ * If no jobs are available, sleeps until some job becomes available.
+ *
+ * The calling function receives the ownership of the job.
+ *
+ * \return the job, or NULL if the thread should stop
+ */
+static threadqueue_job_t * threadqueue_pop_job(threadqueue_worker_t *worker)
+{
+  threadqueue_queue_t * const threadqueue = worker->threadqueue;
+
+  for (;;) {
+    if (threadqueue->stop) {
+      return NULL;
+    }
+
+    threadqueue_job_t *job = NULL;
+    if (threadqueue->node_count > 1) {
+      job = threadqueue_take_job(worker, true);
+    }
+    if (!job) {
+      job = threadqueue_take_job(worker, false);
+    }
+
+    if (job) {
+      KVZ_ATOMIC_DEC(&threadqueue->ready_count);
+      return job;
+    }
+
+    // Nothing to do. Wait until something is pushed to any of the queues.
+    PTHREAD_LOCK(&threadqueue->lock);
+    KVZ_ATOMIC_INC(&threadqueue->idle_count);
+    while (!threadqueue->stop && threadqueue->ready_count == 0) {
+      PTHREAD_COND_WAIT(&threadqueue->job_available, &threadqueue->lock);
+    }
+    KVZ_ATOMIC_DEC(&threadqueue->idle_count);
+    PTHREAD_UNLOCK(&threadqueue->lock);
+  }
+}
+
+
+/**
+ * \brief Mark a job as done and close its list of reverse dependencies.
+ *
+ * \return the reverse dependencies in the order they were added
+ */
+static threadqueue_dep_t * threadqueue_finish_job(threadqueue_job_t *job)
+{
+  job->state = THREADQUEUE_JOB_STATE_DONE;
+
+  // The state must be set before closing the list. The atomic operation
+  // is a full memory barrier so anyone who sees the list closed or
+  // increments waiter_count after this sees the job as done.
+  threadqueue_dep_t *list;
+  do {
+    list = job->rdepends;
+  } while (!KVZ_ATOMIC_CAS_PTR(&job->rdepends, list, THREADQUEUE_RDEPENDS_CLOSED));
+  assert(list != THREADQUEUE_RDEPENDS_CLOSED);
+
+  // Reverse the list since new elements are added to the front.
+  threadqueue_dep_t *reversed = NULL;
+  while (list) {
+    threadqueue_dep_t *next = list->next;
+    list->next = reversed;
+    reversed = list;
+    list = next;
+  }
+  return reversed;
+}
+
 
+/**
+ * \brief Free a list of reverse dependencies.
+ */
+static void threadqueue_free_deps(threadqueue_queue_t *threadqueue,
+                                  threadqueue_dep_t *list)
+{
+  if (!list) return;
 
-typedef enum {
-  /**
-   * \brief Job has been submitted, but is not allowed to run yet.
-   */
-  THREADQUEUE_JOB_STATE_PAUSED,
+  threadqueue_dep_t *last = list;
+  for (threadqueue_dep_t *dep = list; dep; dep = dep->next) {
+    kvz_threadqueue_free_job(&dep->job);
+    last = dep;
+  }
+  threadqueue_pool_free_deps(&threadqueue->pool, list, last);
+}
 
-  /**
-   * \brief Job is waiting for dependencies.
-   */
-  THREADQUEUE_JOB_STATE_WAITING,
 
-  /**
-   * \brief Job is ready to run.
-   */
-  THREADQUEUE_JOB_STATE_READY,
+/**
+ * \brief Mark a job as done and release the jobs depending on it.
+ *
+ * Releases the reference to the job held by the worker. The newly ready
+ * job with the highest priority is returned so that the worker can run it
+ * directly, unless the worker already has a job with a higher priority in
+ * its queue. Other newly ready jobs are added to the priority queue of the
+ * worker.
+ *
+ * \return job to run next, or NULL if the worker should pick one from the
+ *         queues
+ */
+static threadqueue_job_t * threadqueue_complete_job(threadqueue_worker_t *worker,
+                                                    threadqueue_job_t *job)
+{
+  threadqueue_queue_t * const threadqueue = worker->threadqueue;
+  threadqueue_job_t *next_job = NULL;
+  int num_new_jobs = 0;
+
+  threadqueue_dep_t * const deps = threadqueue_finish_job(job);
+  threadqueue_dep_t *last_dep = deps;
+
+  // Go through all the jobs that depend on this one, decreasing their
+  // ndepends.
+  for (threadqueue_dep_t *dep = deps; dep; dep = dep->next) {
+    threadqueue_job_t *depjob = dep->job;
+    dep->job = NULL;
+    last_dep = dep;
+
+    assert(depjob->state == THREADQUEUE_JOB_STATE_WAITING ||
+           depjob->state == THREADQUEUE_JOB_STATE_PAUSED);
+
+    if (KVZ_ATOMIC_DEC(&depjob->ndepends) == 0) {
+      // The job has been submitted and this was its last dependency.
+      // The reference held by the list is passed on with the job.
+      depjob->state = THREADQUEUE_JOB_STATE_READY;
+      if (!threadqueue_job_is_local(worker, depjob)) {
+        // Hand the job over to the workers of its own node.
+        threadqueue_push_job(threadqueue_job_worker(threadqueue, depjob), depjob);
+        num_new_jobs++;
+      } else if (!next_job) {
+        next_job = depjob;
+      } else {
+        // Keep the job with the highest priority for the current thread.
+        if (depjob->priority > next_job->priority) {
+          threadqueue_job_t *tmp = next_job;
+          next_job = depjob;
+          depjob = tmp;
+        }
+        threadqueue_push_job(worker, depjob);
+        num_new_jobs++;
+      }
+    } else {
+      kvz_threadqueue_free_job(&depjob);
+    }
+  }
 
-  /**
-   * \brief Job is running.
-   */
-  THREADQUEUE_JOB_STATE_RUNNING,
+  if (deps) {
+    // Recycle the whole list at once.
+    threadqueue_pool_free_deps(&threadqueue->pool, deps, last_dep);
+  }
 
-  /**
-   * \brief Job is completed.
-   */
-  THREADQUEUE_JOB_STATE_DONE,
+  if (next_job &&
+      worker->ready.count > 0 &&
+      worker->ready.top_priority > next_job->priority)
+  {
+    // A more important job is already waiting.
+    threadqueue_push_job(worker, next_job);
+    num_new_jobs++;
+    next_job = NULL;
+  }
 
-} threadqueue_job_state;
+  threadqueue_wake_workers(threadqueue, num_new_jobs);
 
+  // Someone waiting for the job increments waiter_count before checking
+  // the state of the job, so we see the change if they did not see the
+  // job as done.
+  if (threadqueue->waiter_count > 0) {
+    PTHREAD_LOCK(&threadqueue->lock);
+    PTHREAD_COND_BROADCAST(&threadqueue->job_done);
+    PTHREAD_UNLOCK(&threadqueue->lock);
+  }
 
-struct threadqueue_job_t {
-  pthread_mutex_t lock;
+  kvz_threadqueue_free_job(&job);
 
-  threadqueue_job_state state;
+  return next_job;
+}
 
-  /**
-   * \brief Number of dependencies that have not been completed yet.
-   */
-  int ndepends;
 
-  /**
-   * \brief Reverse dependencies.
-   *
-   * Array of pointers to jobs that depend on this one. They have to exist
-   * when the thread finishes, because they cannot be run before.
-   */
-  struct threadqueue_job_t **rdepends;
+#ifdef __linux__
+/**
+ * \brief Mark the CPUs in a list such as "0-3,8-11" as belonging to a node.
+ */
+static void threadqueue_parse_cpulist(const char *list, int node, int *node_of_cpu)
+{
+  const char *str = list;
+  for (;;) {
+    char *end;
+    const long first = strtol(str, &end, 10);
+    if (end == str) break;
+    long last = first;
+    if (*end == '-') {
+      str = end + 1;
+      last = strtol(str, &end, 10);
+      if (end == str) break;
+    }
+    for (long cpu = MAX(first, 0); cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+      node_of_cpu[cpu] = node;
+    }
+    if (*end != ',') break;
+    str = end + 1;
+  }
+}
+#endif
 
-  /**
-   * \brief Number of elements in rdepends.
-   */
-  int rdepends_count;
 
-  /**
-   * \brief Allocated size of rdepends.
-   */
-  int rdepends_size;
+/**
+ * \brief Find the CPUs the process is allowed to run on.
+ *
+ * Fills threadqueue_queue_t.cpus and threadqueue_queue_t.cpu_nodes. The
+ * NUMA nodes of the CPUs are read from sysfs.
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int threadqueue_read_cpus(threadqueue_queue_t *threadqueue)
+{
+#ifdef __linux__
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    fprintf(stderr, "sched_getaffinity failed!\n");
+    return 0;
+  }
 
-  /**
-   * \brief Reference count
-   */
-  int refcount;
+  // CPUs that are not listed under any node are put to node 0.
+  int node_of_cpu[CPU_SETSIZE] = { 0 };
+  int max_node = 0;
+
+  DIR *dir = opendir("/sys/devices/system/node");
+  if (dir) {
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+      int node;
+      char extra;
+      if (sscanf(entry->d_name, "node%d%c", &node, &extra) != 1 || node < 0) {
+        continue;
+      }
+      char path[64];
+      snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+      FILE *file = fopen(path, "r");
+      if (!file) continue;
+      char list[4096];
+      if (fgets(list, sizeof(list), file)) {
+        threadqueue_parse_cpulist(list, node, node_of_cpu);
+        max_node = MAX(max_node, node);
+      }
+      fclose(file);
+    }
+    closedir(dir);
+  }
 
-  /**
-   * \brief Pointer to the function to execute.
-   */
-  void (*fptr)(void *arg);
+  const int cpu_count = CPU_COUNT(&allowed);
+  threadqueue->cpus      = MALLOC(int, cpu_count);
+  threadqueue->cpu_nodes = MALLOC(int, cpu_count);
+  if (!threadqueue->cpus || !threadqueue->cpu_nodes) {
+    fprintf(stderr, "Could not malloc threadqueue->cpus!\n");
+    return 0;
+  }
 
-  /**
-   * \brief Argument for fptr.
-   */
-  void *arg;
+  // Order the CPUs by node.
+  threadqueue->cpu_count = 0;
+  for (int node = 0; node <= max_node; node++) {
+    for (int cpu = 0; cpu < CPU_SETSIZE && threadqueue->cpu_count < cpu_count; cpu++) {
+      if (CPU_ISSET(cpu, &allowed) && node_of_cpu[cpu] == node) {
+        threadqueue->cpus[threadqueue->cpu_count]      = cpu;
+        threadqueue->cpu_nodes[threadqueue->cpu_count] = node;
+        threadqueue->cpu_count++;
+      }
+    }
+  }
 
-  /**
-   * \brief Pointer to the next job in the queue.
-   */
-  struct threadqueue_job_t *next;
+  return threadqueue->cpu_count > 0;
+#else
+  fprintf(stderr, "Thread affinity is not supported on this platform.\n");
+  return 0;
+#endif
+}
 
-};
 
+/**
+ * \brief Assign the workers to CPUs and NUMA nodes.
+ *
+ * The workers are spread evenly over the CPUs in threadqueue_queue_t.cpus.
+ * The nodes that get workers are numbered from zero in the order of the
+ * CPUs.
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int threadqueue_place_workers(threadqueue_queue_t *threadqueue)
+{
+  const int worker_count = threadqueue->worker_count;
+  const int cpu_count    = threadqueue->cpu_count;
 
-struct threadqueue_queue_t {
-  pthread_mutex_t lock;
+  for (int i = 0; i < worker_count; i++) {
+    threadqueue->workers[i].cpu = worker_count <= cpu_count ?
+                                  i * cpu_count / worker_count :
+                                  i % cpu_count;
+  }
 
-  /**
-   * \brief Job available condition variable
-   *
-   * Signalled when there is a new job to do.
-   */
-  pthread_cond_t job_available;
+  // Renumber the nodes. The CPUs of each node are consecutive.
+  int node_count = 0;
+  for (int first = 0; first < cpu_count; ) {
+    int end = first;
+    while (end < cpu_count && threadqueue->cpu_nodes[end] == threadqueue->cpu_nodes[first]) {
+      end++;
+    }
 
-  /**
-   * \brief Job done condition variable
-   *
-   * Signalled when a job has been completed.
-   */
-  pthread_cond_t job_done;
+    bool has_workers = false;
+    for (int i = 0; i < worker_count; i++) {
+      const int cpu = threadqueue->workers[i].cpu;
+      if (cpu >= first && cpu < end) has_workers = true;
+    }
 
-  /**
-   * Array containing spawned threads
-   */
-  pthread_t *threads;
+    for (int cpu = first; cpu < end; cpu++) {
+      threadqueue->cpu_nodes[cpu] = has_workers ? node_count : -1;
+    }
+    if (has_workers) node_count++;
+    first = end;
+  }
 
-  /**
-   * \brief Number of threads spawned
-   */
-  int thread_count;
+  if (threadqueue->affinity != KVZ_THREAD_AFFINITY_NUMA || node_count <= 1) {
+    // Jobs are not assigned to nodes.
+    return 1;
+  }
 
-  /**
-   * \brief Number of threads running
-   */
-  int thread_running_count;
+  threadqueue->node_workers = MALLOC(int, worker_count);
+  threadqueue->node_offsets = MALLOC(int, node_count + 1);
+  if (!threadqueue->node_workers || !threadqueue->node_offsets) {
+    fprintf(stderr, "Could not malloc threadqueue->node_workers!\n");
+    return 0;
+  }
 
-  /**
-   * \brief If true, threads should stop ASAP.
-   */
-  bool stop;
+  for (int i = 0; i < worker_count; i++) {
+    threadqueue_worker_t *worker = &threadqueue->workers[i];
+    worker->node = threadqueue->cpu_nodes[worker->cpu];
+  }
 
-  /**
-   * \brief Pointer to the first ready job
-   */
-  threadqueue_job_t *first;
+  int num_workers = 0;
+  for (int node = 0; node < node_count; node++) {
+    threadqueue->node_offsets[node] = num_workers;
+    for (int i = 0; i < worker_count; i++) {
+      if (threadqueue->workers[i].node == node) {
+        threadqueue->node_workers[num_workers++] = i;
+      }
+    }
+  }
+  threadqueue->node_offsets[node_count] = num_workers;
+  threadqueue->node_count = node_count;
 
-  /**
-   * \brief Pointer to the last ready job
-   */
-  threadqueue_job_t *last;
-};
+  return 1;
+}
 
 
 /**
- * \brief Add a job to the queue of jobs ready to run.
- *
- * The caller must have locked the thread queue and the job. This function
- * takes the ownership of the job.
+ * \brief Pin the calling worker thread to its CPU or NUMA node.
  */
-static void threadqueue_push_job(threadqueue_queue_t * threadqueue,
-                                 threadqueue_job_t *job)
+static void threadqueue_pin_worker(threadqueue_worker_t *worker)
 {
-  assert(job->ndepends == 0);
-  job->state = THREADQUEUE_JOB_STATE_READY;
-
-  if (threadqueue->first == NULL) {
-    threadqueue->first = job;
+#ifdef __linux__
+  threadqueue_queue_t * const threadqueue = worker->threadqueue;
+  if (worker->cpu < 0) return;
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  if (threadqueue->affinity == KVZ_THREAD_AFFINITY_NUMA) {
+    // Let the worker run on any CPU of its node.
+    const int node = threadqueue->cpu_nodes[worker->cpu];
+    for (int i = 0; i < threadqueue->cpu_count; i++) {
+      if (threadqueue->cpu_nodes[i] == node) {
+        CPU_SET(threadqueue->cpus[i], &cpus);
+      }
+    }
   } else {
-    threadqueue->last->next = job;
+    CPU_SET(threadqueue->cpus[worker->cpu], &cpus);
   }
 
-  threadqueue->last = job;
-  job->next = NULL;
+  if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+    fprintf(stderr, "Could not set the CPU affinity of worker %d!\n", worker->id);
+  }
+#endif
 }
 
 
 /**
- * \brief Retrieve a job from the queue of jobs ready to run.
- *
- * The caller must have locked the thread queue. The calling function
- * receives the ownership of the job.
+ * \brief Run a job, recording it to the trace.
  */
-static threadqueue_job_t * threadqueue_pop_job(threadqueue_queue_t * threadqueue)
+static void threadqueue_run_job(threadqueue_queue_t *threadqueue,
+                                threadqueue_job_t *job)
 {
-  assert(threadqueue->first != NULL);
-
-  threadqueue_job_t *job = threadqueue->first;
-  threadqueue->first = job->next;
-  job->next = NULL;
-
-  if (threadqueue->first == NULL) {
-    threadqueue->last = NULL;
+  const int64_t start = kvz_trace_begin(threadqueue->trace);
+  if (job->queue_time) {
+    // Jobs run directly after their last dependency never enter a queue.
+    *job->queue_time = job->ready_time ? kvz_time_ns() - job->ready_time : 0;
   }
-
-  return job;
+  job->fptr(job->arg);
+  kvz_trace_end(threadqueue->trace, start, job->trace_kind,
+                job->trace_poc, job->trace_x, job->trace_y);
 }
 
 
 /**
  * \brief Function executed by worker threads.
  */
-static void* threadqueue_worker(void* threadqueue_opaque)
+static void* threadqueue_worker(void* worker_opaque)
 {
-  threadqueue_queue_t * const threadqueue = (threadqueue_queue_t *) threadqueue_opaque;
+  threadqueue_worker_t * const worker = (threadqueue_worker_t *) worker_opaque;
+  threadqueue_queue_t * const threadqueue = worker->threadqueue;
 
-  PTHREAD_LOCK(&threadqueue->lock);
+  threadqueue_job_t *job = NULL;
+
+  threadqueue_pin_worker(worker);
+
+  if (threadqueue->trace) {
+    kvz_trace_register_thread(threadqueue->trace, worker->id);
+  }
 
   for (;;) {
-    while (!threadqueue->stop && threadqueue->first == NULL) {
-      // Wait until there is something to do in the queue.
-      PTHREAD_COND_WAIT(&threadqueue->job_available, &threadqueue->lock);
+    if (!job) {
+      // Get a job from the priority queues.
+      job = threadqueue_pop_job(worker);
     }
 
-    if (threadqueue->stop) {
+    if (!job) {
+      // The thread queue is stopping.
       break;
     }
 
-    // Get a job and remove it from the queue.
-    threadqueue_job_t *job = threadqueue_pop_job(threadqueue);
-
-    PTHREAD_LOCK(&job->lock);
     assert(job->state == THREADQUEUE_JOB_STATE_READY);
     job->state = THREADQUEUE_JOB_STATE_RUNNING;
-    PTHREAD_UNLOCK(&job->lock);
-    PTHREAD_UNLOCK(&threadqueue->lock);
 
-    job->fptr(job->arg);
+    threadqueue_run_job(threadqueue, job);
 
-    PTHREAD_LOCK(&threadqueue->lock);
-    PTHREAD_LOCK(&job->lock);
-    assert(job->state == THREADQUEUE_JOB_STATE_RUNNING);
-    job->state = THREADQUEUE_JOB_STATE_DONE;
-
-    PTHREAD_COND_SIGNAL(&threadqueue->job_done);
-
-    // Go through all the jobs that depend on this one, decreasing their
-    // ndepends. Count how many jobs can now start executing so we know how
-    // many threads to wake up.
-    int num_new_jobs = 0;
-    for (int i = 0; i < job->rdepends_count; ++i) {
-      threadqueue_job_t * const depjob = job->rdepends[i];
-      // The dependency (job) is locked before the job depending on it.
-      // This must be the same order as in kvz_threadqueue_job_dep_add.
-      PTHREAD_LOCK(&depjob->lock);
-
-      assert(depjob->state == THREADQUEUE_JOB_STATE_WAITING ||
-             depjob->state == THREADQUEUE_JOB_STATE_PAUSED);
-      assert(depjob->ndepends > 0);
-      depjob->ndepends--;
-
-      if (depjob->ndepends == 0 && depjob->state == THREADQUEUE_JOB_STATE_WAITING) {
-        // Move the job to ready jobs.
-        threadqueue_push_job(threadqueue, kvz_threadqueue_copy_ref(depjob));
-        num_new_jobs++;
-      }
-
-      // Clear this reference to the job.
-      PTHREAD_UNLOCK(&depjob->lock);
-      kvz_threadqueue_free_job(&job->rdepends[i]);
-    }
-    job->rdepends_count = 0;
-
-    PTHREAD_UNLOCK(&job->lock);
-    kvz_threadqueue_free_job(&job);
+    // Continue directly with a job that was waiting for this one, if any.
+    job = threadqueue_complete_job(worker, job);
 
-    // The current thread will process one of the new jobs so we wake up
-    // one threads less than the the number of new jobs.
-    for (int i = 0; i < num_new_jobs - 1; i++) {
-      pthread_cond_signal(&threadqueue->job_available);
+    if (job && threadqueue->stop) {
+      kvz_threadqueue_free_job(&job);
     }
   }
 
+  PTHREAD_LOCK(&threadqueue->lock);
   threadqueue->thread_running_count--;
   PTHREAD_UNLOCK(&threadqueue->lock);
   return NULL;
@@ -340,14 +1349,21 @@ static void* threadqueue_worker(void* threadqueue_opaque)
 /**
  * \brief Initialize the queue.
  *
+ * \param thread_count  number of worker threads
+ * \param affinity      how the worker threads are placed on CPUs
+ * \param trace         trace to record the jobs to, or NULL
+ *
  * \return 1 on success, 0 on failure
  */
-threadqueue_queue_t * kvz_threadqueue_init(int thread_count)
+threadqueue_queue_t * kvz_threadqueue_init(int thread_count,
+                                           enum kvz_thread_affinity affinity,
+                                           kvz_trace_t *trace)
 {
   threadqueue_queue_t *threadqueue = MALLOC(threadqueue_queue_t, 1);
   if (!threadqueue) {
     goto failed;
   }
+  FILL(*threadqueue, 0);
 
   if (pthread_mutex_init(&threadqueue->lock, NULL) != 0) {
     fprintf(stderr, "pthread_mutex_init failed!\n");
@@ -364,6 +1380,10 @@ threadqueue_queue_t * kvz_threadqueue_init(int thread_count)
     goto failed;
   }
 
+  if (!threadqueue_pool_init(&threadqueue->pool)) {
+    goto failed;
+  }
+
   threadqueue->threads = MALLOC(pthread_t, thread_count);
   if (!threadqueue->threads) {
     fprintf(stderr, "Could not malloc threadqueue->threads!\n");
@@ -372,16 +1392,49 @@ threadqueue_queue_t * kvz_threadqueue_init(int thread_count)
   threadqueue->thread_count = 0;
   threadqueue->thread_running_count = 0;
 
-  threadqueue->stop = false;
+  threadqueue->workers = MALLOC(threadqueue_worker_t, thread_count);
+  if (!threadqueue->workers) {
+    fprintf(stderr, "Could not malloc threadqueue->workers!\n");
+    goto failed;
+  }
+  for (int i = 0; i < thread_count; i++) {
+    threadqueue_worker_t *worker = &threadqueue->workers[i];
+    worker->threadqueue = threadqueue;
+    worker->id = i;
+    worker->cpu = -1;
+    worker->node = 0;
+    if (!threadqueue_heap_init(&worker->ready)) {
+      goto failed;
+    }
+    threadqueue->worker_count++;
+  }
+
+  threadqueue->ready_count  = 0;
+  threadqueue->idle_count   = 0;
+  threadqueue->waiter_count = 0;
+  threadqueue->next_worker  = 0;
+
+  threadqueue->trace = trace;
+
+  threadqueue->affinity   = affinity;
+  threadqueue->node_count = 1;
+  if (affinity != KVZ_THREAD_AFFINITY_NONE && thread_count > 0) {
+    if (!threadqueue_read_cpus(threadqueue)) {
+      fprintf(stderr, "Worker threads are not pinned to CPUs.\n");
+      threadqueue->affinity = KVZ_THREAD_AFFINITY_NONE;
+    } else if (!threadqueue_place_workers(threadqueue)) {
+      goto failed;
+    }
+  }
 
-  threadqueue->first              = NULL;
-  threadqueue->last               = NULL;
+  threadqueue->stop = false;
 
   // Lock the queue before creating threads, to ensure they all have correct information.
   PTHREAD_LOCK(&threadqueue->lock);
   for (int i = 0; i < thread_count; i++) {
-    if (pthread_create(&threadqueue->threads[i], NULL, threadqueue_worker, threadqueue) != 0) {
+    if (pthread_create(&threadqueue->threads[i], NULL, threadqueue_worker, &threadqueue->workers[i]) != 0) {
         fprintf(stderr, "pthread_create failed!\n");
+        PTHREAD_UNLOCK(&threadqueue->lock);
         goto failed;
     }
     threadqueue->thread_count++;
@@ -405,27 +1458,33 @@ failed:
  *
  * \return pointer to the job, or NULL on failure
  */
-threadqueue_job_t * kvz_threadqueue_job_create(void (*fptr)(void *arg), void *arg)
+threadqueue_job_t * kvz_threadqueue_job_create(threadqueue_queue_t *threadqueue,
+                                               void (*fptr)(void *arg),
+                                               void *arg)
 {
-  threadqueue_job_t *job = MALLOC(threadqueue_job_t, 1);
+  threadqueue_job_t *job = threadqueue_pool_alloc_job(&threadqueue->pool);
   if (!job) {
     fprintf(stderr, "Could not alloc job!\n");
     return NULL;
   }
 
-  if (pthread_mutex_init(&job->lock, NULL) != 0) {
-    fprintf(stderr, "pthread_mutex_init(job) failed!\n");
-    return NULL;
-  }
-
+  job->threadqueue = threadqueue;
   job->state = THREADQUEUE_JOB_STATE_PAUSED;
-  job->ndepends       = 0;
+  job->ndepends       = 1;
   job->rdepends       = NULL;
-  job->rdepends_count = 0;
-  job->rdepends_size  = 0;
   job->refcount       = 1;
   job->fptr           = fptr;
   job->arg            = arg;
+  job->priority       = 0;
+  job->seq            = 0;
+  job->node           = -1;
+  job->trace_kind     = KVZ_TRACE_JOB;
+  job->trace_poc      = -1;
+  job->trace_x        = -1;
+  job->trace_y        = -1;
+  job->queue_time     = NULL;
+  job->ready_time     = 0;
+  job->next           = NULL;
 
   return job;
 }
@@ -433,30 +1492,102 @@ threadqueue_job_t * kvz_threadqueue_job_create(void (*fptr)(void *arg), void *ar
 
 int kvz_threadqueue_submit(threadqueue_queue_t * const threadqueue, threadqueue_job_t *job)
 {
-  PTHREAD_LOCK(&threadqueue->lock);
-  PTHREAD_LOCK(&job->lock);
   assert(job->state == THREADQUEUE_JOB_STATE_PAUSED);
 
   if (threadqueue->thread_count == 0) {
     // When not using threads, run the job immediately.
-    job->fptr(job->arg);
-    job->state = THREADQUEUE_JOB_STATE_DONE;
-  } else if (job->ndepends == 0) {
-    threadqueue_push_job(threadqueue, kvz_threadqueue_copy_ref(job));
-    pthread_cond_signal(&threadqueue->job_available);
-  } else {
-    job->state = THREADQUEUE_JOB_STATE_WAITING;
+    threadqueue_run_job(threadqueue, job);
+    threadqueue_free_deps(threadqueue, threadqueue_finish_job(job));
+    return 1;
+  }
+
+  // The state must be set before decrementing ndepends, because after
+  // that the last dependency may make the job ready at any time.
+  job->state = THREADQUEUE_JOB_STATE_WAITING;
+
+  if (KVZ_ATOMIC_DEC(&job->ndepends) == 0) {
+    threadqueue_worker_t *worker = threadqueue_job_worker(threadqueue, job);
+    threadqueue_push_job(worker, kvz_threadqueue_copy_ref(job));
+    threadqueue_wake_workers(threadqueue, 1);
   }
-  PTHREAD_UNLOCK(&job->lock);
-  PTHREAD_UNLOCK(&threadqueue->lock);
 
   return 1;
 }
 
 
+/**
+ * \brief Set the priority of a job.
+ *
+ * Jobs that are ready to run are run in the order of decreasing priority.
+ * The default priority is zero. Must be called before the job is
+ * submitted.
+ */
+void kvz_threadqueue_job_set_priority(threadqueue_job_t *job, int64_t priority)
+{
+  assert(job->state == THREADQUEUE_JOB_STATE_PAUSED);
+  job->priority = priority;
+}
+
+
+/**
+ * \brief Set the NUMA node a job should be run on.
+ *
+ * The node is taken modulo the number of nodes, so that consecutive
+ * numbers are spread over all nodes. Has no effect unless the worker
+ * threads are placed with KVZ_THREAD_AFFINITY_NUMA on a system with
+ * several nodes. Must be called before the job is submitted.
+ */
+void kvz_threadqueue_job_set_node(threadqueue_job_t *job, int node)
+{
+  assert(job->state == THREADQUEUE_JOB_STATE_PAUSED);
+  assert(node >= 0);
+  job->node = node;
+}
+
+
+/**
+ * \brief Set where to store the time the job waits in a queue.
+ *
+ * When the job is started, the number of nanoseconds it was ready to run
+ * but waiting for a free thread is stored to *queue_time. Must be called
+ * before the job is submitted.
+ */
+void kvz_threadqueue_job_set_queue_time(threadqueue_job_t *job, int64_t *queue_time)
+{
+  assert(job->state == THREADQUEUE_JOB_STATE_PAUSED);
+  job->queue_time = queue_time;
+}
+
+
+/**
+ * \brief Set what a job does for tracing.
+ *
+ * Must be called before the job is submitted.
+ *
+ * \param kind  what the job does
+ * \param poc   POC of the frame, or -1
+ * \param x     LCU x coordinate, or -1
+ * \param y     LCU y coordinate, or -1
+ */
+void kvz_threadqueue_job_set_trace(threadqueue_job_t *job,
+                                   kvz_trace_kind kind,
+                                   int32_t poc,
+                                   int32_t x,
+                                   int32_t y)
+{
+  assert(job->state == THREADQUEUE_JOB_STATE_PAUSED);
+  job->trace_kind = kind;
+  job->trace_poc  = poc;
+  job->trace_x    = x;
+  job->trace_y    = y;
+}
+
+
 /**
  * \brief Add a dependency between two jobs.
  *
+ * Must be called before job is submitted.
+ *
  * \param job           job that should be executed after dependency
  * \param dependency    job that should be executed before job
  *
@@ -465,31 +1596,41 @@ int kvz_threadqueue_submit(threadqueue_queue_t * const threadqueue, threadqueue_
  */
 int kvz_threadqueue_job_dep_add(threadqueue_job_t *job, threadqueue_job_t *dependency)
 {
-  // Lock the dependency first and then the job depending on it.
-  // This must be the same order as in threadqueue_worker.
-  PTHREAD_LOCK(&dependency->lock);
+  assert(job->state == THREADQUEUE_JOB_STATE_PAUSED);
 
-  if (dependency->state == THREADQUEUE_JOB_STATE_DONE) {
+  if (dependency->rdepends == THREADQUEUE_RDEPENDS_CLOSED) {
     // The dependency has been completed already so there is nothing to do.
-    PTHREAD_UNLOCK(&dependency->lock);
     return 1;
   }
 
-  PTHREAD_LOCK(&job->lock);
-  job->ndepends++;
-  PTHREAD_UNLOCK(&job->lock);
-
-  // Add the reverse dependency
-  if (dependency->rdepends_count >= dependency->rdepends_size) {
-    dependency->rdepends_size += THREADQUEUE_LIST_REALLOC_SIZE;
-    size_t bytes = dependency->rdepends_size * sizeof(threadqueue_job_t*);
-    dependency->rdepends = realloc(dependency->rdepends, bytes);
+  threadqueue_dep_t *dep = threadqueue_pool_alloc_dep(&job->threadqueue->pool);
+  if (!dep) {
+    fprintf(stderr, "Could not alloc dependency!\n");
+    return 0;
   }
-  dependency->rdepends[dependency->rdepends_count++] = kvz_threadqueue_copy_ref(job);
+  dep->job = kvz_threadqueue_copy_ref(job);
 
-  PTHREAD_UNLOCK(&dependency->lock);
+  // Increment ndepends before adding the reverse dependency so that it
+  // cannot be decremented before it is incremented.
+  KVZ_ATOMIC_INC(&job->ndepends);
 
-  return 1;
+  for (;;) {
+    threadqueue_dep_t *head = dependency->rdepends;
+
+    if (head == THREADQUEUE_RDEPENDS_CLOSED) {
+      // The dependency was completed while we were adding it. Since the
+      // job has not been submitted, ndepends does not reach zero here.
+      KVZ_ATOMIC_DEC(&job->ndepends);
+      dep->next = NULL;
+      threadqueue_free_deps(job->threadqueue, dep);
+      return 1;
+    }
+
+    dep->next = head;
+    if (KVZ_ATOMIC_CAS_PTR(&dependency->rdepends, head, dep)) {
+      return 1;
+    }
+  }
 }
 
 
@@ -512,7 +1653,7 @@ threadqueue_job_t *kvz_threadqueue_copy_ref(threadqueue_job_t *job)
  * \brief Free a job.
  *
  * Decrement reference count of the job. If no references exist any more,
- * deallocate associated memory and destroy mutexes.
+ * return the job to the pool of the thread queue.
  *
  * Sets the job pointer to NULL.
  */
@@ -530,14 +1671,10 @@ void kvz_threadqueue_free_job(threadqueue_job_t **job_ptr)
 
   assert(new_refcount == 0);
 
-  for (int i = 0; i < job->rdepends_count; i++) {
-    kvz_threadqueue_free_job(&job->rdepends[i]);
+  if (job->rdepends != THREADQUEUE_RDEPENDS_CLOSED) {
+    threadqueue_free_deps(job->threadqueue, job->rdepends);
   }
-  job->rdepends_count = 0;
-
-  FREE_POINTER(job->rdepends);
-  pthread_mutex_destroy(&job->lock);
-  FREE_POINTER(job);
+  threadqueue_pool_free_job(&job->threadqueue->pool, job);
 }
 
 
@@ -548,11 +1685,20 @@ void kvz_threadqueue_free_job(threadqueue_job_t **job_ptr)
  */
 int kvz_threadqueue_waitfor(threadqueue_queue_t * threadqueue, threadqueue_job_t * job)
 {
-  PTHREAD_LOCK(&job->lock);
+  const int64_t start = kvz_trace_begin(threadqueue->trace);
+
+  PTHREAD_LOCK(&threadqueue->lock);
+  // The counter must be incremented before checking the state of the job.
+  // This must be the opposite order to threadqueue_complete_job.
+  KVZ_ATOMIC_INC(&threadqueue->waiter_count);
   while (job->state != THREADQUEUE_JOB_STATE_DONE) {
-    PTHREAD_COND_WAIT(&threadqueue->job_done, &job->lock);
+    PTHREAD_COND_WAIT(&threadqueue->job_done, &threadqueue->lock);
   }
-  PTHREAD_UNLOCK(&job->lock);
+  KVZ_ATOMIC_DEC(&threadqueue->waiter_count);
+  PTHREAD_UNLOCK(&threadqueue->lock);
+
+  kvz_trace_end(threadqueue->trace, start, KVZ_TRACE_WAIT,
+                job->trace_poc, job->trace_x, job->trace_y);
 
   return 1;
 }
@@ -605,16 +1751,26 @@ void kvz_threadqueue_free(threadqueue_queue_t *threadqueue)
   kvz_threadqueue_stop(threadqueue);
 
   // Free all jobs.
-  while (threadqueue->first) {
-    threadqueue_job_t *next = threadqueue->first->next;
-    kvz_threadqueue_free_job(&threadqueue->first);
-    threadqueue->first = next;
+  for (int i = 0; i < threadqueue->worker_count; i++) {
+    threadqueue_heap_free(&threadqueue->workers[i].ready);
   }
-  threadqueue->last = NULL;
+  threadqueue->worker_count = 0;
+  threadqueue->ready_count = 0;
 
+  FREE_POINTER(threadqueue->workers);
   FREE_POINTER(threadqueue->threads);
   threadqueue->thread_count = 0;
 
+  FREE_POINTER(threadqueue->cpus);
+  FREE_POINTER(threadqueue->cpu_nodes);
+  FREE_POINTER(threadqueue->node_workers);
+  FREE_POINTER(threadqueue->node_offsets);
+  threadqueue->cpu_count = 0;
+  threadqueue->node_count = 0;
+
+  // All jobs must have been freed before the pool.
+  threadqueue_pool_free(&threadqueue->pool);
+
   if (pthread_mutex_destroy(&threadqueue->lock) != 0) {
     fprintf(stderr, "pthread_mutex_destroy failed!\n");
   }
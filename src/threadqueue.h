@@ -27,17 +27,35 @@
  */
 
 #include "global.h" // IWYU pragma: keep
+#include "kvazaar.h"
+#include "trace.h"
 
 #include <pthread.h>
 
 typedef struct threadqueue_job_t threadqueue_job_t;
 typedef struct threadqueue_queue_t threadqueue_queue_t;
 
-threadqueue_queue_t * kvz_threadqueue_init(int thread_count);
+threadqueue_queue_t * kvz_threadqueue_init(int thread_count,
+                                           enum kvz_thread_affinity affinity,
+                                           kvz_trace_t *trace);
 
-threadqueue_job_t * kvz_threadqueue_job_create(void (*fptr)(void *arg), void *arg);
+threadqueue_job_t * kvz_threadqueue_job_create(threadqueue_queue_t *threadqueue,
+                                               void (*fptr)(void *arg),
+                                               void *arg);
 int kvz_threadqueue_submit(threadqueue_queue_t * threadqueue, threadqueue_job_t *job);
 
+void kvz_threadqueue_job_set_priority(threadqueue_job_t *job, int64_t priority);
+
+void kvz_threadqueue_job_set_node(threadqueue_job_t *job, int node);
+
+void kvz_threadqueue_job_set_queue_time(threadqueue_job_t *job, int64_t *queue_time);
+
+void kvz_threadqueue_job_set_trace(threadqueue_job_t *job,
+                                   kvz_trace_kind kind,
+                                   int32_t poc,
+                                   int32_t x,
+                                   int32_t y);
+
 int kvz_threadqueue_job_dep_add(threadqueue_job_t *job, threadqueue_job_t *dependency);
 
 threadqueue_job_t *kvz_threadqueue_copy_ref(threadqueue_job_t *job);
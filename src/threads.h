@@ -55,6 +55,10 @@
 
 #define KVZ_ATOMIC_INC(ptr)                     __sync_add_and_fetch((volatile int32_t*)ptr, 1)
 #define KVZ_ATOMIC_DEC(ptr)                     __sync_add_and_fetch((volatile int32_t*)ptr, -1)
+#define KVZ_ATOMIC_LOAD(ptr)                    __sync_add_and_fetch((volatile int32_t*)ptr, 0)
+#define KVZ_ATOMIC_CAS_PTR(ptr, oldval, newval) __sync_bool_compare_and_swap((void* volatile*)(ptr), (void*)(oldval), (void*)(newval))
+
+#define KVZ_THREAD_LOCAL __thread
 
 #else //__GNUC__
 //TODO: we assume !GCC => Windows... this may be bad
@@ -69,9 +73,27 @@
 
 #define KVZ_ATOMIC_INC(ptr)                     InterlockedIncrement((volatile LONG*)ptr)
 #define KVZ_ATOMIC_DEC(ptr)                     InterlockedDecrement((volatile LONG*)ptr)
+#define KVZ_ATOMIC_LOAD(ptr)                    InterlockedCompareExchange((volatile LONG*)ptr, 0, 0)
+#define KVZ_ATOMIC_CAS_PTR(ptr, oldval, newval) (InterlockedCompareExchangePointer((PVOID volatile*)(ptr), (PVOID)(newval), (PVOID)(oldval)) == (PVOID)(oldval))
+
+#ifdef _MSC_VER
+#define KVZ_THREAD_LOCAL __declspec(thread)
+#else
+#define KVZ_THREAD_LOCAL __thread
+#endif
 
 #endif //__GNUC__
 
+/**
+ * \brief Get the current time in nanoseconds.
+ */
+static INLINE int64_t kvz_time_ns(void)
+{
+  KVZ_CLOCK_T clock;
+  KVZ_GET_TIME(&clock);
+  return (int64_t)(KVZ_CLOCK_T_AS_DOUBLE(clock) * 1e9);
+}
+
 #ifdef __APPLE__
 // POSIX semaphores are deprecated on Mac so we use Grand Central Dispatch
 // semaphores instead.
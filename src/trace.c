@@ -0,0 +1,306 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "trace.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/**
+ * \brief Number of events kept for each thread.
+ *
+ * When a buffer is full, the oldest events are overwritten.
+ */
+#define KVZ_TRACE_BUFFER_SIZE (1 << 16)
+
+
+typedef struct {
+  int64_t start;
+  int64_t stop;
+  int32_t poc;
+  int32_t x;
+  int32_t y;
+  int32_t kind;
+} kvz_trace_event_t;
+
+
+/**
+ * \brief Ring buffer of the events of one thread.
+ *
+ * Only written by the thread owning it, so no locking is needed.
+ */
+typedef struct {
+  /**
+   * \brief Trace the buffer belongs to.
+   */
+  const kvz_trace_t *trace;
+
+  /**
+   * \brief Total number of events recorded, including overwritten ones.
+   */
+  uint64_t count;
+
+  kvz_trace_event_t events[KVZ_TRACE_BUFFER_SIZE];
+} kvz_trace_buffer_t;
+
+
+struct kvz_trace_t {
+  FILE *file;
+
+  /**
+   * \brief Time when the trace was created.
+   */
+  int64_t start;
+
+  /**
+   * \brief Buffers for worker threads, followed by the buffer shared by
+   * all other threads.
+   */
+  kvz_trace_buffer_t **buffers;
+
+  /**
+   * \brief Number of elements in buffers.
+   */
+  int buffer_count;
+};
+
+
+static const char * const trace_kind_names[KVZ_TRACE_NUM_KINDS] = {
+  "job", "lcu", "encode_children", "bitstream", "wait",
+  "search", "recon", "deblock", "sao", "cabac",
+  "lookahead", "subpel",
+};
+
+static const char * const trace_kind_categories[KVZ_TRACE_NUM_KINDS] = {
+  "job", "job", "job", "job", "wait",
+  "stage", "stage", "stage", "stage", "stage",
+  "job", "job",
+};
+
+
+/**
+ * \brief Buffer of the calling thread, or NULL if the thread has not been
+ * registered.
+ */
+static KVZ_THREAD_LOCAL kvz_trace_buffer_t *trace_thread_buffer = NULL;
+
+
+/**
+ * \brief Allocate a trace.
+ *
+ * \param filename      file to write the trace to
+ * \param thread_count  number of worker threads
+ *
+ * \return the trace, or NULL on failure
+ */
+kvz_trace_t * kvz_trace_alloc(const char *filename, int thread_count)
+{
+  kvz_trace_t *trace = calloc(1, sizeof(kvz_trace_t));
+  if (!trace) {
+    fprintf(stderr, "Failed to allocate trace.\n");
+    return NULL;
+  }
+
+  trace->file = fopen(filename, "w");
+  if (!trace->file) {
+    fprintf(stderr, "Could not open trace file \"%s\".\n", filename);
+    goto failed;
+  }
+
+  trace->buffer_count = thread_count + 1;
+  trace->buffers = calloc(trace->buffer_count, sizeof(kvz_trace_buffer_t*));
+  if (!trace->buffers) {
+    fprintf(stderr, "Failed to allocate trace buffers.\n");
+    goto failed;
+  }
+  for (int i = 0; i < trace->buffer_count; i++) {
+    trace->buffers[i] = MALLOC(kvz_trace_buffer_t, 1);
+    if (!trace->buffers[i]) {
+      fprintf(stderr, "Failed to allocate trace buffers.\n");
+      goto failed;
+    }
+    trace->buffers[i]->trace = trace;
+    trace->buffers[i]->count = 0;
+  }
+
+  trace->start = kvz_time_ns();
+
+  return trace;
+
+failed:
+  if (trace->file) fclose(trace->file);
+  trace->file = NULL;
+  kvz_trace_free(trace);
+  return NULL;
+}
+
+
+static void trace_write_thread(FILE *file, int tid, const char *name)
+{
+  fprintf(file,
+          "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+          "\"args\":{\"name\":\"%s\"}},\n"
+          "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+          "\"args\":{\"sort_index\":%d}}",
+          tid, name, tid, tid);
+}
+
+
+static void trace_write_event(FILE *file,
+                              int tid,
+                              int64_t start,
+                              const kvz_trace_event_t *event)
+{
+  const int kind = event->kind;
+
+  // Timestamps are in microseconds.
+  fprintf(file,
+          ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+          "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{",
+          trace_kind_names[kind],
+          trace_kind_categories[kind],
+          (event->start - start) / 1000.0,
+          (event->stop - event->start) / 1000.0,
+          tid);
+
+  const char *separator = "";
+  if (event->poc >= 0) {
+    fprintf(file, "\"poc\":%d", event->poc);
+    separator = ",";
+  }
+  if (event->x >= 0 && event->y >= 0) {
+    fprintf(file, "%s\"x\":%d,\"y\":%d", separator, event->x, event->y);
+  }
+  fprintf(file, "}}");
+}
+
+
+/**
+ * \brief Write the trace to the file.
+ *
+ * Must not be called while other threads may record events.
+ *
+ * \return 1 on success, 0 on failure
+ */
+static int trace_write(kvz_trace_t *trace)
+{
+  FILE *file = trace->file;
+  const int main_tid = trace->buffer_count - 1;
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+  trace_write_thread(file, main_tid, "main");
+  for (int i = 0; i < main_tid; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "worker %d", i);
+    fprintf(file, ",\n");
+    trace_write_thread(file, i, name);
+  }
+
+  for (int i = 0; i < trace->buffer_count; i++) {
+    const kvz_trace_buffer_t *buffer = trace->buffers[i];
+
+    uint64_t first = 0;
+    if (buffer->count > KVZ_TRACE_BUFFER_SIZE) {
+      first = buffer->count - KVZ_TRACE_BUFFER_SIZE;
+      fprintf(stderr, "Trace buffer of thread %d overflowed. "
+                      "%" PRIu64 " oldest events were dropped.\n", i, first);
+    }
+
+    for (uint64_t n = first; n < buffer->count; n++) {
+      trace_write_event(file, i, trace->start,
+                        &buffer->events[n % KVZ_TRACE_BUFFER_SIZE]);
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+
+  if (ferror(file)) {
+    fprintf(stderr, "Failed to write trace file.\n");
+    return 0;
+  }
+  return 1;
+}
+
+
+/**
+ * \brief Write the trace to the file and free it.
+ */
+void kvz_trace_free(kvz_trace_t *trace)
+{
+  if (!trace) return;
+
+  if (trace->file) {
+    trace_write(trace);
+    fclose(trace->file);
+  }
+
+  if (trace->buffers) {
+    for (int i = 0; i < trace->buffer_count; i++) {
+      FREE_POINTER(trace->buffers[i]);
+    }
+  }
+  FREE_POINTER(trace->buffers);
+  free(trace);
+}
+
+
+/**
+ * \brief Make the calling thread record its events to its own buffer.
+ *
+ * Threads that have not been registered share a single buffer. Only one
+ * of them may record events at a time.
+ *
+ * \param thread_id   index of the worker thread
+ */
+void kvz_trace_register_thread(kvz_trace_t *trace, int thread_id)
+{
+  assert(thread_id >= 0 && thread_id < trace->buffer_count - 1);
+  trace_thread_buffer = trace->buffers[thread_id];
+}
+
+
+/**
+ * \brief Record a span of time to the buffer of the calling thread.
+ */
+void kvz_trace_record(kvz_trace_t *trace,
+                      int64_t start,
+                      int64_t stop,
+                      kvz_trace_kind kind,
+                      int32_t poc,
+                      int32_t x,
+                      int32_t y)
+{
+  kvz_trace_buffer_t *buffer = trace_thread_buffer;
+  if (!buffer || buffer->trace != trace) {
+    buffer = trace->buffers[trace->buffer_count - 1];
+  }
+
+  kvz_trace_event_t *event = &buffer->events[buffer->count % KVZ_TRACE_BUFFER_SIZE];
+  event->start = start;
+  event->stop  = stop;
+  event->poc   = poc;
+  event->x     = x;
+  event->y     = y;
+  event->kind  = kind;
+  buffer->count++;
+}
@@ -0,0 +1,121 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+/**
+ * \ingroup Threading
+ * \file
+ * \brief Recording of the jobs run by each thread.
+ *
+ * Spans of time are recorded to a buffer of the calling thread and
+ * written to a file in Chrome trace event format when the trace is freed.
+ * The files can be viewed with chrome://tracing or Perfetto.
+ */
+
+#include "global.h" // IWYU pragma: keep
+
+#include "threads.h"
+
+
+typedef struct kvz_trace_t kvz_trace_t;
+
+/**
+ * \brief What a recorded span of time was spent on.
+ */
+typedef enum {
+  KVZ_TRACE_JOB = 0,      //!< job without a more specific kind
+  KVZ_TRACE_LCU,          //!< job encoding an LCU
+  KVZ_TRACE_CHILDREN,     //!< job encoding a tile or a slice
+  KVZ_TRACE_BITSTREAM,    //!< job writing the bitstream of a frame
+  KVZ_TRACE_WAIT,         //!< waiting for a job to be completed
+  KVZ_TRACE_SEARCH,       //!< mode search of an LCU
+  KVZ_TRACE_RECON,        //!< storing the reconstruction of an LCU
+  KVZ_TRACE_DEBLOCK,      //!< deblocking of an LCU
+  KVZ_TRACE_SAO,          //!< SAO search and reconstruction of an LCU
+  KVZ_TRACE_CABAC,        //!< CABAC coding of an LCU
+  KVZ_TRACE_LOOKAHEAD,    //!< job analysing a frame ahead of encoding
+  KVZ_TRACE_SUBPEL,       //!< job interpolating fractional pixel planes
+  KVZ_TRACE_NUM_KINDS,
+} kvz_trace_kind;
+
+kvz_trace_t * kvz_trace_alloc(const char *filename, int thread_count);
+void kvz_trace_free(kvz_trace_t *trace);
+
+void kvz_trace_register_thread(kvz_trace_t *trace, int thread_id);
+
+void kvz_trace_record(kvz_trace_t *trace,
+                      int64_t start,
+                      int64_t stop,
+                      kvz_trace_kind kind,
+                      int32_t poc,
+                      int32_t x,
+                      int32_t y);
+
+/**
+ * \brief Start a span of time.
+ *
+ * \return start time to pass to kvz_trace_end
+ */
+static INLINE int64_t kvz_trace_begin(const kvz_trace_t *trace)
+{
+  return trace ? kvz_time_ns() : 0;
+}
+
+/**
+ * \brief End a span of time started with kvz_trace_begin.
+ *
+ * Does nothing if trace is NULL.
+ *
+ * \param poc   POC of the frame, or -1
+ * \param x     LCU x coordinate, or -1
+ * \param y     LCU y coordinate, or -1
+ */
+static INLINE void kvz_trace_end(kvz_trace_t *trace,
+                                 int64_t start,
+                                 kvz_trace_kind kind,
+                                 int32_t poc,
+                                 int32_t x,
+                                 int32_t y)
+{
+  if (trace) {
+    kvz_trace_record(trace, start, kvz_time_ns(), kind, poc, x, y);
+  }
+}
+
+/**
+ * \brief Record a span of time with given start and stop times.
+ *
+ * Does nothing if trace is NULL.
+ */
+static INLINE void kvz_trace_span(kvz_trace_t *trace,
+                                  int64_t start,
+                                  int64_t stop,
+                                  kvz_trace_kind kind,
+                                  int32_t poc,
+                                  int32_t x,
+                                  int32_t y)
+{
+  if (trace) {
+    kvz_trace_record(trace, start, stop, kind, poc, x, y);
+  }
+}
+
+#endif // TRACE_H_
@@ -22,6 +22,7 @@
 
 #include <stdlib.h>
 
+#include "filter.h"
 #include "image.h"
 #include "sao.h"
 
@@ -47,6 +48,7 @@ videoframe_t * kvz_videoframe_alloc(int32_t width,
   if (chroma_format != KVZ_CSP_400) {
     frame->sao_chroma = MALLOC(sao_info_t, frame->width_in_lcu * frame->height_in_lcu);
   }
+  frame->deblock_info = MALLOC(deblock_info_t, frame->width_in_lcu * frame->height_in_lcu);
 
   return frame;
 }
@@ -67,6 +69,7 @@ int kvz_videoframe_free(videoframe_t * const frame)
 
   FREE_POINTER(frame->sao_luma);
   FREE_POINTER(frame->sao_chroma);
+  FREE_POINTER(frame->deblock_info);
 
   free(frame);
 
@@ -47,6 +47,7 @@ typedef struct videoframe
   cu_array_t* cu_array;     //!< \brief Info for each CU at each depth.
   struct sao_info_t *sao_luma;   //!< \brief Array of sao parameters for every LCU.
   struct sao_info_t *sao_chroma;   //!< \brief Array of sao parameters for every LCU.
+  struct deblock_info_t *deblock_info; //!< \brief Array of deblocking parameters for every LCU.
   int32_t poc;           //!< \brief Picture order count
 } videoframe_t;
 
@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2017 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * Kvazaar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "greatest/greatest.h"
+
+#include "test_strategies.h"
+
+#include <string.h>
+
+#define TEST_STRIDE 80
+
+static kvz_pixel var_test_data[64 * TEST_STRIDE];
+
+static void setup()
+{
+  // Fill test data with pseudo-random values.
+  uint32_t state = 1;
+  for (int i = 0; i < 64 * TEST_STRIDE; i++) {
+    state = state * 1103515245 + 12345;
+    var_test_data[i] = (state >> 16) & 0xff;
+  }
+}
+
+static uint64_t expected_var(int width, int height)
+{
+  uint64_t sum = 0;
+  uint64_t sum_sq = 0;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      const uint64_t pixel = var_test_data[y * TEST_STRIDE + x];
+      sum += pixel;
+      sum_sq += pixel * pixel;
+    }
+  }
+  return sum_sq - sum * sum / (width * height);
+}
+
+TEST test_pixel_var_lcu()
+{
+  ASSERT_EQ(kvz_pixel_var(var_test_data, 64, 64, TEST_STRIDE), expected_var(64, 64));
+  PASS();
+}
+
+TEST test_pixel_var_partial()
+{
+  // Blocks at the right and bottom edges of the frame.
+  ASSERT_EQ(kvz_pixel_var(var_test_data, 8, 64, TEST_STRIDE), expected_var(8, 64));
+  ASSERT_EQ(kvz_pixel_var(var_test_data, 40, 2, TEST_STRIDE), expected_var(40, 2));
+  ASSERT_EQ(kvz_pixel_var(var_test_data, 63, 17, TEST_STRIDE), expected_var(63, 17));
+  PASS();
+}
+
+TEST test_pixel_var_flat()
+{
+  kvz_pixel flat[64 * 64];
+  memset(flat, 200, sizeof(flat));
+  ASSERT_EQ(kvz_pixel_var(flat, 64, 64, 64), 0);
+  PASS();
+}
+
+SUITE(pixel_var_tests)
+{
+  setup();
+
+  for (volatile int i = 0; i < strategies.count; ++i) {
+    if (strcmp(strategies.strategies[i].type, "pixel_var") != 0) {
+      continue;
+    }
+
+    kvz_pixel_var = strategies.strategies[i].fptr;
+    RUN_TEST(test_pixel_var_lcu);
+    RUN_TEST(test_pixel_var_partial);
+    RUN_TEST(test_pixel_var_flat);
+  }
+}
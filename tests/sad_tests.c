@@ -320,6 +320,37 @@ TEST test_reg_sad_overflow(void)
 }
 
 
+TEST test_reg_sad_multi(void)
+{
+  unsigned width = sad_test_env.width;
+  unsigned height = sad_test_env.height;
+  unsigned stride = 64;
+
+  // Five blocks, so that the batches are not all full.
+  const kvz_pixel *blocks[5] = {
+    g_big_ref->y, g_64x64_max->y, g_big_pic->y, g_64x64_zero->y, g_big_ref->y,
+  };
+  unsigned results[5];
+
+  reg_sad_multi_func *tested_func = sad_test_env.tested_func;
+  tested_func(g_big_pic->y, blocks, 5, width, height, stride, stride, results);
+
+  sprintf(sad_test_env.msg, "%s(%ux%u):%s",
+          sad_test_env.strategy->type,
+          width,
+          height,
+          sad_test_env.strategy->strategy_name);
+
+  for (int i = 0; i < 5; ++i) {
+    if (results[i] != simple_sad(g_big_pic->y, blocks[i], stride, width, height)) {
+      FAILm(sad_test_env.msg);
+    }
+  }
+
+  PASSm(sad_test_env.msg);
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 // TEST FIXTURES
 SUITE(sad_tests)
@@ -385,6 +416,32 @@ SUITE(sad_tests)
       RUN_TEST(test_reg_sad_overflow);
     }
   }
+
+  for (volatile unsigned i = 0; i < strategies.count; ++i) {
+    if (strcmp(strategies.strategies[i].type, "reg_sad_multi") != 0) {
+      continue;
+    }
+
+    static const struct dimension {
+      int width;
+      int height;
+    } tested_dims[] = {
+      {64, 64}, {32, 32}, {16, 16}, {8, 8},
+      {64, 32}, {16, 8}, {8, 16}, {8, 4}, {4, 8},
+      {48, 16}, {24, 16}, {12, 4}, {4, 12},
+      // Not used in inter search but valid
+      {7, 3}, {63, 5}
+    };
+
+    sad_test_env.tested_func = strategies.strategies[i].fptr;
+    sad_test_env.strategy = &strategies.strategies[i];
+    int num_dim_tests = sizeof(tested_dims) / sizeof(tested_dims[0]);
+    for (volatile int dim_test = 0; dim_test < num_dim_tests; ++dim_test) {
+      sad_test_env.width = tested_dims[dim_test].width;
+      sad_test_env.height = tested_dims[dim_test].height;
+      RUN_TEST(test_reg_sad_multi);
+    }
+  }
   
   tear_down_tests();
 }
@@ -12,6 +12,10 @@ valgrind_test 264x130 10 $common_args -r1 --owf=1 --threads=0 --no-wpp
 valgrind_test 264x130 10 $common_args -r1 --owf=0 --threads=0 --no-wpp
 valgrind_test 264x130 10 $common_args -r2 --owf=1 --threads=2 --wpp
 valgrind_test 264x130 10 $common_args -r2 --owf=0 --threads=2 --no-wpp
+valgrind_test 264x130 10 $common_args -r2 --owf=1 --threads=2 --no-wpp --frame-filter
+valgrind_test 264x130 10 $common_args -r2 --owf=1 --threads=2 --wpp --thread-affinity=numa
+valgrind_test 264x130 10 $common_args -r2 --owf=1 --threads=2 --wpp --trace-file=/dev/null
+valgrind_test 264x130 10 $common_args -r2 --owf=1 --threads=2 --tiles-height-split=u2 --no-wpp --stats
 valgrind_test 264x130 10 $common_args -r2 --owf=1 --threads=2 --tiles-height-split=u2 --no-wpp
 valgrind_test 264x130 10 $common_args -r2 --owf=0 --threads=2 --tiles-height-split=u2 --no-wpp
 valgrind_test 512x512  3 $common_args -r2 --owf=1 --threads=2 --tiles=2x2 --no-wpp
@@ -10,3 +10,10 @@ common_args='264x130 10 -p0 -r1 --threads=2 --wpp --owf=1 --rd=0'
 valgrind_test $common_args --no-rdoq --no-deblock --no-sao --no-signhide --subme=1 --pu-depth-intra=2-3
 valgrind_test $common_args --no-rdoq --no-signhide --subme=0
 valgrind_test $common_args --rdoq --no-deblock --no-sao --subme=0
+valgrind_test $common_args --no-rdoq --no-signhide --subme=0 --aq-mode=variance
+valgrind_test $common_args --no-rdoq --no-signhide --subme=0 --me=pyramid
+valgrind_test $common_args --no-rdoq --no-signhide --subme=4 --subpel-planes
+valgrind_test $common_args --no-rdoq --no-signhide --subme=4 --me-cache
+valgrind_test $common_args --rdoq --no-deblock --no-sao --subme=0 --coeff-bit-table
+valgrind_test $common_args --no-rdoq --no-signhide --subme=0 --hash=md5
+valgrind_test $common_args --no-rdoq --no-signhide --subme=0 --hash=crc
@@ -31,6 +31,7 @@ extern SUITE(dct_tests);
 #endif //KVZ_BIT_DEPTH == 8
 
 extern SUITE(coeff_sum_tests);
+extern SUITE(pixel_var_tests);
 extern SUITE(mv_cand_tests);
 extern SUITE(inter_recon_bipred_tests);
 
@@ -56,6 +57,8 @@ int main(int argc, char **argv)
 
   RUN_SUITE(coeff_sum_tests);
 
+  RUN_SUITE(pixel_var_tests);
+
   RUN_SUITE(mv_cand_tests);
 
   // Doesn't work in git